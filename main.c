@@ -1,1041 +1,1298 @@
 #include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
-#include <assert.h>
-
-#include <PL/platform_filesystem.h>
-#include <PL/platform_math.h>
-
-#define VERSION "0.01"
+#include <time.h>
+
+#if defined(_WIN32)
+#   include <windows.h>
+#   include <psapi.h>
+#else
+#   include <sys/resource.h>
+#   include <sys/time.h>
+#   include <sys/stat.h>
+#   include <dirent.h>
+#   include <sys/socket.h>
+#   include <sys/un.h>
+#   include <pthread.h>
+#   include <signal.h>
+#   include <unistd.h>
+#endif
 
-/* debug flags */
-#define DEBUG_PARSER
+#if defined(__linux__)
+#   include <sys/inotify.h>
+#   include <poll.h>
+#endif
 
-enum { /* do NOT change the ordering of these!!! */
-    MAP_FORMAT_IDT2,    /* Quake, Quake 2 */
-    MAP_FORMAT_IDT3,    /* Quake 3 */
-    MAP_FORMAT_IDT4,    /* Doom 3 */
+#include <PL/platform_filesystem.h>
 
-    MAP_FORMAT_GSRC,    /* Half-Life */
-    MAP_FORMAT_SRC,     /* Half-Life 2 */
+#include "t3d/t3d.h"
 
-    MAX_MAP_FORMATS
+T3DOptions startup_options = {
+        .format = MAP_FORMAT_IDT2,
 };
 
-unsigned int startup_format = MAP_FORMAT_IDT2;
-
 bool startup_test = false;
-bool startup_actors = false;
-bool startup_add = false;
-bool startup_sub = false;
-
-void GameCommand(const char *parm) {
-    if(strncmp("idt2", parm, 4) == 0) { /* this is the default */
-        return;
-    }
+bool startup_watch = false;
+bool startup_leakcheck = false;
+bool startup_index = false;
+bool startup_import = false;
+bool startup_split_groups = false;
+unsigned int startup_threads = 0;
+char startup_server[PL_SYSTEM_MAX_PATH] = "";
+
+T3DTileOptions startup_tiles = {
+        .columns = 0,   /* not tiling */
+};
 
-    if(strncmp("idt3", parm, 4) == 0) {
-        startup_format = MAP_FORMAT_IDT3;
+/* leaves format untouched if the game isn't recognised */
+void ParseGame(const char *parm, unsigned int *format) {
+    if(strncmp("idt2", parm, 4) == 0) {
+        *format = MAP_FORMAT_IDT2;
+    } else if(strncmp("idt3", parm, 4) == 0) {
+        *format = MAP_FORMAT_IDT3;
     } else if(strncmp("idt4", parm, 4) == 0) {
-        startup_format = MAP_FORMAT_IDT4;
+        *format = MAP_FORMAT_IDT4;
     } else if(strncmp("gsrc", parm, 4) == 0) {
-        startup_format = MAP_FORMAT_GSRC;
+        *format = MAP_FORMAT_GSRC;
     } else if(strncmp("src", parm, 3) == 0) {
-        startup_format = MAP_FORMAT_SRC;
+        *format = MAP_FORMAT_SRC;
     }
 }
 
-/**************************************************/
-
-/* https://stackoverflow.com/questions/3018313/algorithm-to-convert-rgb-to-hsv-and-hsv-to-rgb-in-range-0-255-for-both */
-void ConvertHSV(unsigned char h, unsigned char s, unsigned char v,
-                unsigned char *r, unsigned char *g, unsigned char *b) {
-    if(s == 0) {
-        if(v == 0) {
-            *r = 255;
-            *g = 255;
-            *b = 255;
-        } else {
-            *r = v;
-            *g = v;
-            *b = v;
-        }
+void GameCommand(const char *parm) {
+    if(parm == NULL) {
+        fprintf(stderr, "no game specified, ignoring!\n");
         return;
     }
 
-    unsigned char region = (unsigned char) (h / 43);
-    unsigned char remainder = (unsigned char) ((h - (region * 43)) * 6);
-
-    unsigned char p = (unsigned char) ((v * (255 - s)) >> 8);
-    unsigned char q = (unsigned char) ((v * (255 - ((s * remainder) >> 8))) >> 8);
-    unsigned char t = (unsigned char) ((v * (255 - ((s * (255 - remainder)) >> 8))) >> 8);
-
-    switch(region) {
-        case 0:     *r = v; *g = t; *b = p; break;
-        case 1:     *r = q; *g = v; *b = p; break;
-        case 2:     *r = p; *g = v; *b = t; break;
-        case 3:     *r = p; *g = q; *b = v; break;
-        case 4:     *r = t; *g = p; *b = v; break;
-        default:    *r = v; *g = p; *b = q; break;
-    }
+    ParseGame(parm, &startup_options.format);
 }
 
-/**************************************************/
-
-#define MAX_MAP_BRUSHES     56875
-#define MAX_MAP_ENTITIES    4096
+void ServerCommand(const char *parm) {
+    if(parm == NULL) {
+        fprintf(stderr, "no socket specified for server, ignoring!\n");
+        return;
+    }
 
-#define MAX_BRUSH_FACES 4096
+    snprintf(startup_server, sizeof(startup_server), "%s", parm);
+}
 
-enum {
-    CTX_MAP,
+void ThreadsCommand(const char *parm) {
+    unsigned int threads;
+    if(parm == NULL || sscanf(parm, "%u", &threads) != 1 || threads == 0) {
+        fprintf(stderr, "invalid number of threads, ignoring!\n");
+        return;
+    }
 
-    CTX_ACTORLIST,
-    CTX_ACTOR,
+    startup_threads = threads;
+}
 
-    CTX_BRUSH,
+void TilesCommand(const char *parm) {
+    unsigned int columns, rows;
+    int num = (parm != NULL) ? sscanf(parm, "%ux%u", &columns, &rows) : 0;
+    if(num < 1 || columns == 0 || (num == 2 && rows == 0)) {
+        fprintf(stderr, "invalid tile grid, expected e.g. 4x4, ignoring!\n");
+        return;
+    }
 
-    CTX_POLYLIST,
-    CTX_POLYGON,
-};
+    startup_tiles.columns = columns;
+    startup_tiles.rows    = (num == 2) ? rows : columns;
+}
 
-/****************************
- * Actors
- ***************************/
+void TileMarginCommand(const char *parm) {
+    double margin;
+    if(parm == NULL || sscanf(parm, "%lf", &margin) != 1 || margin < 0.0) {
+        fprintf(stderr, "invalid tile margin, ignoring!\n");
+        return;
+    }
 
-enum {
-    ACT_Brush,          /* */
-    ACT_Mover,          /* func_wall */
+    startup_tiles.margin = margin;
+}
 
-    ACT_AmbientSound,   /* */
+/**************************************************/
+/* Extraction */
 
-    ACT_PlayerStart,    /* info_player_start */
+/* Only the actors matching one of these are converted, which are found
+ * via the index, so the rest of the document doesn't need to be parsed. */
 
-    ACT_Light,          /* light */
-    ACT_Spotlight,      /* light_spot */
+#define MAX_EXTRACT_FILTERS 32
 
-    ACT_Sparks,         /* env_spark */
+typedef enum ExtractType {
+    EXTRACT_NAME,
+    EXTRACT_CLASS,
+    EXTRACT_REGION,
+} ExtractType;
 
-    ACT_LevelSummary,   /* worldspawn */
-    ACT_LevelInfo,      /* worldspawn */
+typedef struct ExtractFilter {
+    ExtractType type;
+    char pattern[64];       /* may end in '*' to match anything starting with it */
+    float mins[3], maxs[3];
+} ExtractFilter;
 
-    ACT_PathNode,
+ExtractFilter extract_filters[MAX_EXTRACT_FILTERS];
+unsigned int num_extract_filters = 0;
 
-    /* UT99 */
-    ACT_HealthVial,     /* item_battery */
+void ExtractCommand(const char *parm) {
+    if(parm == NULL) {
+        fprintf(stderr, "no filter specified for extract, ignoring!\n");
+        return;
+    }
 
-    ACT_Unknown
-};
+    if(num_extract_filters >= MAX_EXTRACT_FILTERS) {
+        fprintf(stderr, "too many extract filters, ignoring \"%s\"!\n", parm);
+        return;
+    }
 
-#define StandardEntityName(a)                   { (a), (a), (a), (a), (a) }
-#define EntityName(ID2, ID3, ID4, GSRC, SRC)    { (ID2), (ID3), (ID4), (GSRC), (SRC) }
+    ExtractFilter *filter = &extract_filters[num_extract_filters];
+    if(strncmp("name=", parm, 5) == 0) {
+        filter->type = EXTRACT_NAME;
+        snprintf(filter->pattern, sizeof(filter->pattern), "%s", parm + 5);
+    } else if(strncmp("class=", parm, 6) == 0) {
+        filter->type = EXTRACT_CLASS;
+        snprintf(filter->pattern, sizeof(filter->pattern), "%s", parm + 6);
+    } else if(strncmp("region=", parm, 7) == 0 &&
+              sscanf(parm + 7, "%f,%f,%f,%f,%f,%f", &filter->mins[0], &filter->mins[1], &filter->mins[2],
+                     &filter->maxs[0], &filter->maxs[1], &filter->maxs[2]) == 6) {
+        filter->type = EXTRACT_REGION;
+    } else {
+        fprintf(stderr, "invalid extract filter, expected name=, class= or region=x,y,z,x,y,z, ignoring!\n");
+        return;
+    }
 
-typedef struct ActorDef {
-    const char *name;
-    unsigned int id;
+    num_extract_filters++;
+}
 
-    const char *targets[MAX_MAP_FORMATS];
-} ActorDef;
-ActorDef actor_definitions[]={
-        {"Brush",           ACT_Brush},
-        {"Mover",           ACT_Mover},
-        {"AmbientSound",    ACT_AmbientSound},
+bool MatchPattern(const char *pattern, const char *string) {
+    size_t length = strlen(pattern);
+    if(length > 0 && pattern[length - 1] == '*') {
+        return pl_strncasecmp(pattern, string, length - 1) == 0;
+    }
 
-        { "PlayerStart",    ACT_PlayerStart,    StandardEntityName("info_player_start") },
-        { "Light",          ACT_Light,          StandardEntityName("light") },
+    return pl_strcasecmp(pattern, string) == 0;
+}
 
-        { "PathNode",       ACT_PathNode,       EntityName(NULL, NULL, NULL, "info_node", "info_node") },
+bool MatchFilter(const ExtractFilter *filter, const T3DIndexEntry *entry) {
+    switch(filter->type) {
+        case EXTRACT_NAME:
+            return MatchPattern(filter->pattern, entry->name);
+        case EXTRACT_CLASS:
+            return MatchPattern(filter->pattern, entry->class_name);
+        case EXTRACT_REGION:
+            for(unsigned int i = 0; i < 3; ++i) {
+                if(entry->maxs[i] < filter->mins[i] || entry->mins[i] > filter->maxs[i]) {
+                    return false;
+                }
+            }
+            return true;
+    }
 
-        {"Spotlight",       ACT_Spotlight},
-        {"Sparks",          ACT_Sparks},
-        {"LevelSummary",    ACT_LevelSummary},
-        {"LevelInfo",       ACT_LevelInfo},
+    return false;
+}
 
-        /* UT99 */
-        { "HealthVial",     ACT_HealthVial,     EntityName(NULL, NULL, NULL, "item_battery", NULL) },
+/* parses just the actors that were asked for */
+T3DError ExtractT3D(T3DContext *ctx, const char *in_path) {
+    T3DIndex *index = t3dLoadIndex(ctx, in_path, false);
+    if(index == NULL) {
+        return t3dGetError(ctx);
+    }
 
-        {NULL}
-};
+    bool *selected = calloc(index->num_entries + 1, sizeof(bool));
+    if(selected == NULL) {
+        fprintf(stderr, "error: failed to allocate extract selection!\n");
+        t3dDestroyIndex(ctx, index);
+        return T3D_ERROR_MEMORY;
+    }
 
-typedef struct Actor {
-    char name[64];
-    char class[64];
+    unsigned int num_selected = 0;
+    for(unsigned int i = 0; i < index->num_entries; ++i) {
+        for(unsigned int j = 0; j < num_extract_filters && !selected[i]; ++j) {
+            selected[i] = MatchFilter(&extract_filters[j], &index->entries[i]);
+        }
+        num_selected += selected[i];
+    }
 
-    ActorDef *class_index;
+    fprintf(stderr, "extracting %u/%u actors\n", num_selected, index->num_entries);
+    T3DError error = t3dParseIndexed(ctx, in_path, index, selected);
 
-    PLVector3 location;
+    free(selected);
+    t3dDestroyIndex(ctx, index);
 
-    union {
-        struct {
-            char effect[32];
+    return error;
+}
 
-            /* HSV                                 */
-            unsigned int hue;           /* 0 - 255 */
-            unsigned int saturation;    /* 0 - 255 */
-            unsigned int brightness;    /* 0 - 255 */
+/* rebuilds the index for the input, without converting anything */
+bool IndexT3D(const char *in_path) {
+    T3DContext *ctx = t3dCreateContext(&startup_options);
+    if(ctx == NULL) {
+        fprintf(stderr, "error: failed to create conversion context!\n");
+        return false;
+    }
 
-            unsigned int radius;
-        } Light;
+    T3DIndex *index = t3dLoadIndex(ctx, in_path, true);
+    if(index != NULL) {
+        unsigned int num_brushes = 0, num_polygons = 0;
+        for(unsigned int i = 0; i < index->num_entries; ++i) {
+            num_brushes  += index->entries[i].num_brushes;
+            num_polygons += index->entries[i].num_polygons;
+        }
+        fprintf(stderr, "indexed %u actors, %u brushes, %u polygons\n", index->num_entries, num_brushes, num_polygons);
+        t3dDestroyIndex(ctx, index);
+    }
 
-        struct {
-            float time;
-            float day_fraction;
+    t3dDestroyContext(ctx);
 
-            unsigned int ticks;
-            unsigned int year;
-            unsigned int month;
-            unsigned int day;
-            unsigned int hour;
-            unsigned int second;
-            unsigned int millisecond;
-        } LevelDescriptor;
+    return (index != NULL);
+}
 
-        struct {
-            char title[32];
-            char author[32];
-            char player_count[32];
-            char level_enter_text[32];
+/**************************************************/
+/* Watch Mode */
 
-            int recommended_enemies;
-            int recommended_teammates;
-        } LevelSummary; /* + LevelInfo */
+double GetWatchTime(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
 
-        struct {
-            char csg[32];
-        } Brush;
-    };
-} Actor;
+bool UpdateWatch(T3DContext *ctx, T3DIncremental *inc, const char *in_path, const char *out_path) {
+    double start = GetWatchTime();
 
-ActorDef *GetActorIdentification(const char *name) {
-    for(unsigned int i = 0; i < plArrayElements(actor_definitions); ++i) {
-        if(actor_definitions[i].name == NULL) {
-            break;
-        }
+    size_t length;
+    char *buf = t3dLoadFile(ctx, in_path, &length);
+    if(buf == NULL) {
+        return false;
+    }
 
-        if(pl_strncasecmp(name, actor_definitions[i].name, sizeof(name)) == 0) {
-            return &actor_definitions[i];
-        }
+    T3DOutput *output = t3dOpenOutput(ctx, out_path);
+    if(output == NULL) {
+        t3dFree(ctx, buf);
+        return false;
     }
 
-    return &actor_definitions[ACT_Unknown];
-}
+    unsigned int num_changed = 0, num_blocks = 0;
+    T3DError error = t3dUpdateIncremental(inc, buf, length, t3dGetOutputSink(output), &num_changed, &num_blocks);
 
-const char *GetEntityForActor(Actor *actor) {
-    if(startup_actors || actor->class_index->id == ACT_Unknown) {
-        if(actor->class[0] == '\0' || actor->class[0] == ' ') {
-            printf("warning: invalid actor name, possibly failed to parse?\n");
-            return "unknown";
-        }
-        return &actor->class[0];
+    T3DError close_error = t3dCloseOutput(output);
+    if(error == T3D_ERROR_NONE) {
+        error = close_error;
     }
+    t3dFree(ctx, buf);
 
-    const char *target = actor->class_index->targets[startup_format];
-    if(target == NULL || target[0] == '\0') {
-        printf("warning: no entity target provided for actor \"%s\" in this mode, returning actor name instead!\n",
-               actor->class_index->name);
-        return &actor->class[0];
+    if(error != T3D_ERROR_NONE) {
+        fprintf(stderr, "failed to convert \"%s\" (%s)!\n", in_path, t3dGetErrorString(error));
+        return false;
     }
 
-    return target;
-}
+    fprintf(stderr, "converted %d/%d changed blocks in %.2fms\n", num_changed, num_blocks, GetWatchTime() - start);
 
-/****************************/
+    return true;
+}
 
-typedef struct Polygon { /* i 'ssa face >:I */
-    char item[64];
-    char texture[128];
-    char group[64];
+void WatchT3D(const char *in_path, const char *out_path) {
+#if defined(__linux__)
+    T3DContext *ctx = t3dCreateContext(&startup_options);
+    T3DIncremental *inc = (ctx != NULL) ? t3dCreateIncremental(ctx) : NULL;
+    if(inc == NULL) {
+        fprintf(stderr, "error: failed to create conversion context!\n");
+        exit(EXIT_FAILURE);
+    }
 
-    /* T3D spec specifies that we're not guaranteed four vertices
-     * so, while I haven't seen a case of this, we will respect it */
-    PLVector3 vertices[32];
-    unsigned int num_vertices;
+    /* watch the directory rather than the file, as editors tend to replace rather than write in place */
+    char dir[PL_SYSTEM_MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s", in_path);
+    char *separator = strrchr(dir, '/');
+    if(separator != NULL) {
+        *separator = '\0';
+    } else {
+        snprintf(dir, sizeof(dir), ".");
+    }
+    const char *name = plGetFileName(in_path);
 
-    PLVector3 u;
-    PLVector3 v;
+    int fd = inotify_init1(IN_CLOEXEC);
+    if(fd == -1 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        fprintf(stderr, "error: failed to watch \"%s\"!\n", in_path);
+        exit(EXIT_FAILURE);
+    }
 
-    PLVector3 origin;
-} Polygon;
+    UpdateWatch(ctx, inc, in_path, out_path);
 
-enum {
-    CSG_Active,
-    CSG_Add,
-    CSG_Subtract,
-    CSG_Intersect,
-    CSG_Deintersect,
-};
+    fprintf(stderr, "watching \"%s\" for changes...\n", in_path);
 
-typedef struct Brush { /* i 'ssa primitive >:I */
-    char name[32];
-
-    Polygon *poly_list;
-    Polygon *cur_poly;
-    unsigned int num_poly;
-    unsigned int max_poly;
-
-    PLVector3 location;
-    PLVector3 rotation;
-    PLVector3 pre_pivot;
-    PLVector3 post_pivot;
-
-    unsigned int csg;
-    unsigned int flags;
-    unsigned int poly_flags;
-    unsigned int colour;
-} Brush;
-
-struct {
-    struct {
-        char name[32];
-
-        unsigned int num_brushes;
-    } map;
-
-    Brush brushes[MAX_MAP_BRUSHES];
-    Brush *cur_brush;
-    unsigned int num_brushes;
-
-    Actor actors[MAX_MAP_ENTITIES];
-    Actor *cur_actor;
-    unsigned int num_actors;
-
-    /* parsing data */
-
-    struct {
-        unsigned int context;
-    } chunks[16];
-    int cur_chunk;
-    char *cur_pos;
-
-    unsigned int cur_line;
-} t3d;
-
-/* yeah, yeah... I know... shut-up. */
-#define SkipLine()      while(*t3d.cur_pos != '\n' && *t3d.cur_pos != '\r') { t3d.cur_pos++; } t3d.cur_line++;
-#define SkipSpaces()    while(*t3d.cur_pos == ' ') { t3d.cur_pos++; }
-#define ParseBlock()    while(*t3d.cur_pos != '\0')
-#define ParseLine()     while(*t3d.cur_pos != '\0' && *t3d.cur_pos != '\n' && *t3d.cur_pos != '\r')
-
-void ParseString(char *out) {
-    SkipSpaces();
-    if(*t3d.cur_pos == '=') t3d.cur_pos++;
-    SkipSpaces();
-
-    unsigned int i = 0;
-    ParseBlock() {
-        if(*t3d.cur_pos == ' ' || *t3d.cur_pos == '\n' || *t3d.cur_pos == '\r') {
+    char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    for(;;) {
+        ssize_t length = read(fd, events, sizeof(events));
+        if(length <= 0) {
             break;
         }
 
-        out[i++] = *t3d.cur_pos++;
-    }
-    out[i] = '\0';
-}
-
-void ParseNext(void) {
-    ParseBlock() {
-        if (*t3d.cur_pos == '\n' || *t3d.cur_pos == '\r') {
-            if(t3d.cur_pos[0] == '\r' && t3d.cur_pos[1] == '\n') { /* LF */
-                t3d.cur_line++;
-                t3d.cur_pos += 2;
-                continue;
-            } else {
-                printf("funny line ending... blurgh!\n");
+        bool changed = false;
+        for(char *ptr = events; ptr < events + length;) {
+            struct inotify_event *event = (struct inotify_event *) ptr;
+            if(event->len > 0 && strcmp(event->name, name) == 0) {
+                changed = true;
             }
-
-            t3d.cur_pos++;
-            continue;
+            ptr += sizeof(struct inotify_event) + event->len;
         }
 
-        if(*t3d.cur_pos == '\t') {
-            t3d.cur_pos++;
+        if(!changed) {
             continue;
         }
 
-        if(*t3d.cur_pos == ' ') {
-            SkipSpaces();
-            continue;
-        }
-
-        if (*t3d.cur_pos == ';') { /* skip comment */
-            SkipLine();
-            continue;
+        /* saves often arrive as a burst of events, so let them settle first */
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        while(poll(&pfd, 1, 50) > 0) {
+            if(read(fd, events, sizeof(events)) <= 0) {
+                break;
+            }
         }
 
-        break;
+        UpdateWatch(ctx, inc, in_path, out_path);
     }
-}
-
-int ParseInteger(void) {
-    char n[4];
-    ParseString(n);
-    return atoi(n);
-}
 
-float ParseVectorCoordinate(void) {
-    while(*t3d.cur_pos != '+' && *t3d.cur_pos != '-' && isdigit(*t3d.cur_pos) == 0) t3d.cur_pos++;
-    float f = strtof(t3d.cur_pos, &t3d.cur_pos);
-    if (*t3d.cur_pos == ',') t3d.cur_pos++;
-    return f;
-}
-
-PLVector3 ParseVector(void) {
-    if(*t3d.cur_pos == '(') t3d.cur_pos++;
-
-    PLVector3 vector = {
-        ParseVectorCoordinate(),
-        ParseVectorCoordinate(),
-        ParseVectorCoordinate()
-    };
+    close(fd);
 
-    SkipLine();
+    t3dDestroyIncremental(inc);
+    t3dDestroyContext(ctx);
+#else
+    (void)(in_path);
+    (void)(out_path);
 
-    return vector;
-}
-
-bool ChunkStart(void) {
-    if(pl_strncasecmp(t3d.cur_pos, "Begin", 5) == 0) {
-        t3d.cur_pos += 5;
-        ParseNext();
-        return true;
-    }
-
-    return false;
+    fprintf(stderr, "error: watch mode isn't supported on this platform!\n");
+    exit(EXIT_FAILURE);
+#endif
 }
 
-bool ChunkEnd(const char *chunk) {
-    if(pl_strncasecmp(t3d.cur_pos, "End", 3) == 0) {
-        t3d.cur_pos += 3;
-        ParseNext();
+/**************************************************/
+/* Server Mode */
+
+/* Listens on a unix socket and converts whatever it's sent, so each
+ * request only costs the conversion itself, rather than a new process.
+ * Every worker keeps hold of its own context between requests, so the
+ * allocations it's built up are reused. A connection carries a single
+ * request, as "key value" lines up to an empty line:
+ *
+ *   input foo.t3d      read the document from here, or...
+ *   length 1234        ...it follows the request, this many bytes of it
+ *   output foo.map     write the map here, otherwise it's sent back
+ *   game src           along with any of the usual flags, i.e. "sort"
+ *
+ * Map data that's sent back comes in "data <length>" frames, and the
+ * reply always finishes with "ok <brushes> <actors>" or "error <why>".
+ *
+ * Requests can read and write any file the server can, so the socket's
+ * only accessible to the user running it, who's trusted with all of that. */
+
+#if !defined(_WIN32)
+
+#define SERVER_MAX_WORKERS  64
+#define SERVER_MAX_QUEUE    64
+#define SERVER_MAX_PAYLOAD  ((size_t) 1 << 30)
+#define SERVER_TIMEOUT      30  /* seconds a client may sit idle before it's dropped */
+
+typedef struct ServerConnection {
+    int fd;
+
+    char buffer[4096];  /* read ahead of wherever the request ends */
+    size_t start, end;
+
+    char error[256];    /* first error logged */
+} ServerConnection;
+
+typedef struct ServerRequest {
+    char input[PL_SYSTEM_MAX_PATH];
+    char output[PL_SYSTEM_MAX_PATH];
+    size_t length;
+
+    T3DOptions options;
+} ServerRequest;
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    int queue[SERVER_MAX_QUEUE];
+    unsigned int head, num_queued;
+} server = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .cond  = PTHREAD_COND_INITIALIZER,
+};
 
-        size_t len = strlen(chunk);
-        if(pl_strncasecmp(t3d.cur_pos, chunk, len) != 0) {
-            printf("error: missing end segment for %s!\n", chunk);
-            exit(EXIT_FAILURE);
+bool SendServer(ServerConnection *conn, const void *data, size_t length) {
+    const char *pos = (const char *) data;
+    while(length > 0) {
+        ssize_t sent = write(conn->fd, pos, length);
+        if(sent <= 0) {
+            return false;
         }
-
-        SkipLine();
-        ParseNext();
-
-        return true;
+        pos += sent;
+        length -= (size_t) sent;
     }
-
-    return false;
+    return true;
 }
 
-/*******************************/
-
-void ReadMap();
-void ReadBrush();
-void ReadPolyList();
-void ReadPolygon();
-void ReadActor();
+bool ReplyServer(ServerConnection *conn, const char *format, ...) {
+    char line[512];
 
-bool ReadField(const char *prop) {
-    SkipSpaces();
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
 
-    size_t len = strlen(prop);
-    if(pl_strncasecmp(t3d.cur_pos, prop, len) == 0) {
-        t3d.cur_pos += len;
-        SkipSpaces();
-        if(*t3d.cur_pos == '=') t3d.cur_pos++;
-        SkipSpaces();
-        return true;
+    if(length < 0) {
+        return false;
     }
 
-    return false;
+    return SendServer(conn, line, ((size_t) length < sizeof(line)) ? (size_t) length : sizeof(line) - 1);
 }
 
-bool ReadVectorField(const char *prop, PLVector3 *vector) {
-    if(!ReadField(prop)) {
-        return false;
+size_t WriteServerFrame(const void *data, size_t length, void *user) {
+    ServerConnection *conn = (ServerConnection *) user;
+    if(!ReplyServer(conn, "data %zu\n", length) || !SendServer(conn, data, length)) {
+        return 0;
     }
-
-    SkipSpaces();
-    *vector = ParseVector();
-    SkipLine();
-
-    return true;
+    return length;
 }
 
-bool ReadProperty(const char *parm) {
-    SkipSpaces();
+/* warnings get passed along, anything less is dropped */
+void LogServer(T3DLogLevel level, const char *message, void *user) {
+    ServerConnection *conn = (ServerConnection *) user;
+    if(level < T3D_LOG_WARNING) {
+        return;
+    }
 
-    char prop[16];
-    snprintf(prop, sizeof(prop), "%s=", parm);
+    char line[256];
+    snprintf(line, sizeof(line), "%s", message);
+    line[strcspn(line, "\r\n")] = '\0';
 
-    size_t len = strlen(prop);
-    if(pl_strncasecmp(t3d.cur_pos, prop, len) == 0) {
-        t3d.cur_pos += len;
-        return true;
+    if(level == T3D_LOG_ERROR) {
+        if(conn->error[0] == '\0') {
+            snprintf(conn->error, sizeof(conn->error), "%s", line);
+        }
+        return;
     }
 
-    return false;
+    ReplyServer(conn, "warning %s\n", line);
 }
 
-bool ReadPropertyString(const char *parm, char *out) {
-    if(ReadProperty(parm)) {
-#ifdef DEBUG_PARSER
-        printf("prop=%s\n", parm);
-#endif
+bool ReadServer(ServerConnection *conn, void *data, size_t length) {
+    char *pos = (char *) data;
+    while(length > 0) {
+        if(conn->start == conn->end) {
+            ssize_t num = read(conn->fd, conn->buffer, sizeof(conn->buffer));
+            if(num <= 0) {
+                return false;
+            }
+            conn->start = 0;
+            conn->end = (size_t) num;
+        }
 
-        ParseString(out);
-        return true;
+        size_t num = conn->end - conn->start;
+        if(num > length) {
+            num = length;
+        }
+        memcpy(pos, &conn->buffer[conn->start], num);
+        conn->start += num;
+        pos += num;
+        length -= num;
     }
-
-    return false;
+    return true;
 }
 
-bool ReadPropertyInteger(const char *parm, int *out) {
-    if(ReadProperty(parm)) {
-        *out = ParseInteger();
-        return true;
-    }
+bool ReadServerLine(ServerConnection *conn, char *line, size_t size) {
+    size_t length = 0;
+    for(char c; ReadServer(conn, &c, 1);) {
+        if(c == '\n') {
+            if(length > 0 && line[length - 1] == '\r') {
+                length--;
+            }
+            line[length] = '\0';
+            return true;
+        }
 
+        if(length + 1 >= size) {
+            return false;
+        }
+        line[length++] = c;
+    }
     return false;
 }
 
-void SkipProperty(void) {
-    char name[16];
-    unsigned int pos = 0;
-    while(*t3d.cur_pos != '=') {
-        name[pos++] = *t3d.cur_pos++;
-    }
-    name[pos] = '\0';
-    printf("unknown property \"%s\", ignoring!\n", name);
-    while(*t3d.cur_pos != ' ' && *t3d.cur_pos != '\n' && *t3d.cur_pos != '\r') t3d.cur_pos++;
-}
+bool ReadServerRequest(ServerConnection *conn, ServerRequest *request) {
+    static const struct {
+        const char *name;
+        size_t offset;
+    } flags[] = {
+            { "actors", offsetof(T3DOptions, actors) },
+            { "add", offsetof(T3DOptions, add) },
+            { "sub", offsetof(T3DOptions, sub) },
+            { "props", offsetof(T3DOptions, properties) },
+            { "dupes", offsetof(T3DOptions, duplicates) },
+            { "dedupe", offsetof(T3DOptions, dedupe) },
+            { "sort", offsetof(T3DOptions, sort) },
+    };
 
-void ReadChunk(void) {
-    t3d.cur_chunk++;
+    memset(request, 0, sizeof(ServerRequest));
+    request->options = startup_options;
 
-    ParseBlock() {
-        if (pl_strncasecmp(t3d.cur_pos, "Map", 3) == 0) {
-            t3d.chunks[t3d.cur_chunk].context = CTX_MAP;
-            t3d.cur_pos += 3;
-            ReadMap();
-            break;
+    char line[PL_SYSTEM_MAX_PATH + 32];
+    while(ReadServerLine(conn, line, sizeof(line))) {
+        if(line[0] == '\0') {
+            if(request->input[0] == '\0' && request->length == 0) {
+                snprintf(conn->error, sizeof(conn->error), "no input or length given");
+                return false;
+            }
+            return true;
         }
 
-        if (pl_strncasecmp(t3d.cur_pos, "Brush", 5) == 0) {
-            t3d.cur_pos += 5;
-            ReadBrush();
-            break;
+        char *value = strchr(line, ' ');
+        if(value != NULL) {
+            *value++ = '\0';
+        } else {
+            value = line + strlen(line);
         }
 
-        if (pl_strncasecmp(t3d.cur_pos, "Actor", 5) == 0) {
-            t3d.cur_pos += 5;
-            ReadActor();
-            break;
-        }
+        if(strcmp(line, "input") == 0) {
+            snprintf(request->input, sizeof(request->input), "%s", value);
+        } else if(strcmp(line, "output") == 0) {
+            snprintf(request->output, sizeof(request->output), "%s", value);
+        } else if(strcmp(line, "length") == 0) {
+            request->length = strtoull(value, NULL, 10);
+            if(request->length == 0 || request->length > SERVER_MAX_PAYLOAD) {
+                snprintf(conn->error, sizeof(conn->error), "invalid length \"%s\"", value);
+                return false;
+            }
+        } else if(strcmp(line, "game") == 0) {
+            ParseGame(value, &request->options.format);
+        } else {
+            bool found = false;
+            for(size_t i = 0; i < plArrayElements(flags); ++i) {
+                if(strcmp(line, flags[i].name) == 0) {
+                    *(bool *) ((char *) &request->options + flags[i].offset) = true;
+                    found = true;
+                    break;
+                }
+            }
 
-        if (pl_strncasecmp(t3d.cur_pos, "PolyList", 8) == 0) {
-            t3d.cur_pos += 8;
-            ReadPolyList();
-            break;
+            if(!found) {
+                snprintf(conn->error, sizeof(conn->error), "unknown key \"%s\"", line);
+                return false;
+            }
         }
+    }
 
-        if (pl_strncasecmp(t3d.cur_pos, "Polygon", 7) == 0) {
-            t3d.cur_pos += 7;
-            ReadPolygon();
-            break;
-        }
+    snprintf(conn->error, sizeof(conn->error), "incomplete request");
+    return false;
+}
 
-        if (pl_strncasecmp(t3d.cur_pos, "ActorList", 9) == 0) {
-            t3d.chunks[t3d.cur_chunk].context = CTX_ACTORLIST;
-            SkipLine();
-            break;
+void ServeRequest(T3DContext *ctx, ServerConnection *conn) {
+    ServerRequest request;
+    if(!ReadServerRequest(conn, &request)) {
+        ReplyServer(conn, "error %s\n", conn->error);
+        return;
+    }
+
+    request.options.log = LogServer;
+    request.options.log_user = conn;
+    t3dSetOptions(ctx, &request.options);
+    t3dResetContext(ctx);
+
+    /* needs to stick around until the map's been written */
+    char *buf = NULL;
+    if(request.length > 0) {
+        if((buf = t3dMalloc(ctx, request.length + 1)) == NULL || !ReadServer(conn, buf, request.length)) {
+            t3dFree(ctx, buf);
+            ReplyServer(conn, "error failed to read %zu bytes of input\n", request.length);
+            return;
         }
+        buf[request.length] = '\0';
+        t3dParseBuffer(ctx, buf, request.length);
+    } else {
+        t3dParseFile(ctx, request.input);
+    }
 
-        char chunk_name[32];
-        ParseString(chunk_name);
-        printf("unhandled chunk \"%s\"!\n", chunk_name);
-        exit(EXIT_FAILURE);
+    if(t3dGetError(ctx) == T3D_ERROR_NONE) {
+        if(request.output[0] != '\0') {
+            T3DOutput *output = t3dOpenOutput(ctx, request.output);
+            if(output != NULL) {
+                t3dWriteMap(ctx, t3dGetOutputSink(output));
+                t3dCloseOutput(output);
+            }
+        } else {
+            T3DSink sink = { WriteServerFrame, conn };
+            t3dWriteMap(ctx, &sink);
+        }
     }
-    t3d.cur_chunk--;
-}
 
-#define print_heading(a)    for(unsigned int i = 0; i < t3d.cur_chunk; ++i) printf(" "); printf("parsing " a "\n");
+    t3dFree(ctx, buf);
 
-void ReadPolygon(void) {
-    print_heading("Polygon");
+    T3DError error = t3dGetError(ctx);
+    if(error != T3D_ERROR_NONE) {
+        ReplyServer(conn, "error %s\n", (conn->error[0] != '\0') ? conn->error : t3dGetErrorString(error));
+        return;
+    }
 
-    ParseLine() {
-        if(ReadPropertyString("Item", t3d.cur_brush->cur_poly->item)) {
-            continue;
-        }
+    ReplyServer(conn, "ok %u %u\n", t3dGetNumBrushes(ctx), t3dGetNumActors(ctx));
+}
 
-        if(ReadPropertyString("Texture", t3d.cur_brush->cur_poly->texture)) {
-            continue;
+void *ServerWorker(void *user) {
+    T3DContext *ctx = (T3DContext *) user;
+    for(;;) {
+        pthread_mutex_lock(&server.mutex);
+        while(server.num_queued == 0) {
+            pthread_cond_wait(&server.cond, &server.mutex);
         }
+        int fd = server.queue[server.head];
+        server.head = (server.head + 1) % SERVER_MAX_QUEUE;
+        server.num_queued--;
+        pthread_mutex_unlock(&server.mutex);
+
+        ServerConnection conn = { .fd = fd };
+        ServeRequest(ctx, &conn);
+        close(fd);
+    }
+    return NULL;
+}
 
-        if(ReadPropertyString("Group", t3d.cur_brush->cur_poly->group)) {
-            continue;
-        }
+void RunServer(const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if(strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "error: socket path \"%s\" is too long!\n", path);
+        exit(EXIT_FAILURE);
+    }
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
 
-        /* T3D spec suggests to ignore 'link' property, so we shall */
+    /* clients going away shouldn't take us down with them */
+    signal(SIGPIPE, SIG_IGN);
 
-        SkipProperty();
+    /* a socket left here is from a previous run, but anything else isn't ours to remove */
+    struct stat st;
+    if(lstat(path, &st) == 0) {
+        if(!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "error: \"%s\" already exists and isn't a socket!\n", path);
+            exit(EXIT_FAILURE);
+        }
+        unlink(path);
     }
 
-    if(plIsEmptyString(t3d.cur_brush->cur_poly->texture)) {
-        strncpy(t3d.cur_brush->cur_poly->texture, "none", sizeof(t3d.cur_brush->cur_poly->texture));
+    /* created as 0600, so there's no window where anyone else could connect */
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t mask = umask(0177);
+    bool bound = (fd != -1 && bind(fd, (struct sockaddr *) &address, sizeof(address)) == 0);
+    umask(mask);
+    if(!bound || listen(fd, SERVER_MAX_QUEUE) == -1) {
+        fprintf(stderr, "error: failed to listen on \"%s\"!\n", path);
+        exit(EXIT_FAILURE);
     }
 
-    ParseBlock() {
-        ParseNext();
-
-        if(ChunkEnd("Polygon")) {
-            break;
-        }
+    long num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if(num_workers < 1) num_workers = 1;
+    if(num_workers > SERVER_MAX_WORKERS) num_workers = SERVER_MAX_WORKERS;
 
-        if(ChunkStart()) {
-            ReadChunk();
-            continue;
+    for(long i = 0; i < num_workers; ++i) {
+        T3DContext *ctx = t3dCreateContext(&startup_options);
+        pthread_t thread;
+        if(ctx == NULL || pthread_create(&thread, NULL, ServerWorker, ctx) != 0) {
+            fprintf(stderr, "error: failed to start server worker!\n");
+            exit(EXIT_FAILURE);
         }
+        pthread_detach(thread);
+    }
 
-        if(ReadVectorField("Origin", &t3d.cur_brush->cur_poly->origin)) {
-            continue;
-        }
+    fprintf(stderr, "listening on \"%s\" with %ld workers...\n", path, num_workers);
 
-        if(ReadVectorField("TextureU", &t3d.cur_brush->cur_poly->u)) {
+    for(;;) {
+        int client = accept(fd, NULL, NULL);
+        if(client == -1) {
             continue;
         }
 
-        if(ReadVectorField("TextureV", &t3d.cur_brush->cur_poly->v)) {
-            continue;
+        /* otherwise a few idle clients would be enough to tie up every worker */
+        struct timeval timeout = { .tv_sec = SERVER_TIMEOUT };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        pthread_mutex_lock(&server.mutex);
+        bool queued = (server.num_queued < SERVER_MAX_QUEUE);
+        if(queued) {
+            server.queue[(server.head + server.num_queued) % SERVER_MAX_QUEUE] = client;
+            server.num_queued++;
+            pthread_cond_signal(&server.cond);
         }
+        pthread_mutex_unlock(&server.mutex);
 
-        if(ReadVectorField("Vertex", &t3d.cur_brush->cur_poly->vertices[t3d.cur_brush->cur_poly->num_vertices])) {
-            t3d.cur_brush->cur_poly->num_vertices++;
-            continue;
+        if(!queued) {
+            ServerConnection conn = { .fd = client };
+            ReplyServer(&conn, "error server is busy\n");
+            close(client);
         }
-
-        SkipLine();
-    }
-
-    t3d.cur_brush->cur_poly++;
-    t3d.cur_brush->num_poly++;
-    if(t3d.cur_brush->num_poly > t3d.cur_brush->max_poly) {
-        printf("error: invalid number of polygons for brush (%d / %d), aborting!\n",
-               t3d.cur_brush->num_poly, t3d.cur_brush->max_poly);
-        exit(EXIT_FAILURE);
     }
 }
 
-void ReadPolyList(void) {
-    print_heading("PolyList");
+#else
 
-    ParseLine() {
-        if(ReadPropertyInteger("Num", (int *) &t3d.cur_brush->max_poly)) {
-            continue;
-        }
+void RunServer(const char *path) {
+    (void)(path);
 
-        SkipProperty();
-    }
+    fprintf(stderr, "error: server mode isn't supported on this platform!\n");
+    exit(EXIT_FAILURE);
+}
 
-    if(t3d.cur_brush->max_poly == 0) {
-        t3d.cur_brush->max_poly = MAX_BRUSH_FACES;
-    }
+#endif
 
-    if((t3d.cur_brush->poly_list = calloc(t3d.cur_brush->max_poly, sizeof(Polygon))) == NULL) {
-        printf("error: failed to allocate %d polygons, aborting!\n", t3d.cur_brush->num_poly);
-        exit(EXIT_FAILURE);
+/**************************************************/
+/* Leak Checking */
+
+/* only created if there's actually a leak */
+typedef struct PointFile {
+    char path[PL_SYSTEM_MAX_PATH];
+    FILE *fp;
+} PointFile;
+
+size_t WritePointFile(const void *data, size_t length, void *user) {
+    PointFile *pts = (PointFile *) user;
+    if(pts->fp == NULL && (pts->fp = fopen(pts->path, "w")) == NULL) {
+        fprintf(stderr, "error: failed to open \"%s\" for writing!\n", pts->path);
+        return 0;
     }
 
-    t3d.cur_brush->cur_poly = &t3d.cur_brush->poly_list[0];
-
-    ParseBlock() {
-        ParseNext();
+    return fwrite(data, 1, length, pts->fp);
+}
 
-        if(ChunkEnd("PolyList")) {
+/* strips the extension off along with any compression, i.e. foo.map.gz -> foo, keeping hold of the latter */
+void StripOutputPath(char *path, char *compression, size_t size) {
+    compression[0] = '\0';
+    for(unsigned int i = 0; i < 2; ++i) {
+        char *ext = strrchr(path, '.');
+        if(ext == NULL || strpbrk(ext, "/\\") != NULL) {
             break;
         }
 
-        if(ChunkStart()) {
-            ReadChunk();
-            continue;
+        bool compressed = (t3dGetCompression(path) != T3D_COMPRESSION_NONE);
+        if(compressed) {
+            snprintf(compression, size, "%s", ext);
         }
-
-        SkipLine();
-    }
-
-    if(t3d.cur_brush->num_poly < t3d.cur_brush->max_poly) {
-        printf("shrinking polylist (%d < %d)... ", t3d.cur_brush->num_poly, t3d.cur_brush->max_poly);
-        if((t3d.cur_brush->poly_list = realloc(t3d.cur_brush->poly_list, t3d.cur_brush->num_poly * sizeof(Polygon)))
-           == NULL) {
-            printf("error: failed to shrink polylist down!\n");
-            exit(EXIT_FAILURE);
+        *ext = '\0';
+        if(!compressed) {
+            break;
         }
-        t3d.cur_brush->max_poly = t3d.cur_brush->num_poly;
-        printf("done!\n");
     }
 }
 
-void ReadMap(void) {
-    print_heading("Map");
+/* sits alongside the map, i.e. foo.map.gz -> foo.pts, or in the working directory if it went to stdout */
+void GetPointFilePath(const char *out_path, char *pts_path, size_t size) {
+    char compression[16];
+    snprintf(pts_path, size, "%s", (strcmp(out_path, "-") == 0) ? "./t3d2map" : out_path);
+    StripOutputPath(pts_path, compression, sizeof(compression));
+    strncat(pts_path, ".pts", size - strlen(pts_path) - 1);
+}
 
-    /* header */
-    ParseLine() {
-        if(ReadPropertyString("Name", t3d.map.name)) {
-            continue;
-        }
+bool CheckLeaks(T3DContext *ctx, const char *out_path) {
+    PointFile pts = { .fp = NULL };
+    GetPointFilePath(out_path, pts.path, sizeof(pts.path));
 
-        if(ReadPropertyInteger("Brushes", (int*) &t3d.map.num_brushes)) {
-            continue;
-        }
+    /* don't leave an old one lying around to confuse anyone */
+    remove(pts.path);
 
-        SkipProperty();
-    }
+    T3DSink sink = { WritePointFile, &pts };
+    bool leaked;
+    t3dCheckLeaks(ctx, &sink, &leaked);
 
-    ParseBlock() {
-        ParseNext();
+    if(pts.fp != NULL) {
+        fclose(pts.fp);
+        fprintf(stderr, "wrote leak to \"%s\"\n", pts.path);
+    }
 
-        if(ChunkEnd("Map")) {
-            break;
-        }
+    return !leaked && t3dGetError(ctx) == T3D_ERROR_NONE;
+}
 
-        if(ChunkStart()) {
-            ReadChunk();
-            continue;
-        }
+/**************************************************/
+/* Split Export */
+
+/* tiles and groups are each written out to a map of their own, alongside a manifest of them all */
+typedef struct SplitOutputs {
+    T3DContext *ctx;
+    const char *out_path;
+    T3DOutput **outputs;    /* for each one, while it's being written */
+} SplitOutputs;
+
+bool InitSplitOutputs(SplitOutputs *split, T3DContext *ctx, const char *out_path, unsigned int num_outputs) {
+    split->ctx = ctx;
+    split->out_path = out_path;
+    split->outputs = calloc(num_outputs, sizeof(T3DOutput *));
+    return (split->outputs != NULL);
+}
 
-        SkipLine();
+const T3DSink *OpenSplitOutput(SplitOutputs *split, unsigned int index, const char *path) {
+    T3DOutput **output = &split->outputs[index];
+    if((*output = t3dOpenOutput(split->ctx, path)) == NULL) {
+        return NULL;
     }
+
+    return t3dGetOutputSink(*output);
 }
 
-void ReadActor(void) {
-    t3d.chunks[t3d.cur_chunk].context = CTX_ACTOR;
+bool CloseSplitOutput(SplitOutputs *split, unsigned int index) {
+    T3DOutput **output = &split->outputs[index];
+    T3DError error = t3dCloseOutput(*output);
+    *output = NULL;
 
-    print_heading("Actor");
+    return (error == T3D_ERROR_NONE);
+}
 
-    ParseLine() {
-        if(ReadPropertyString("Class", t3d.cur_actor->class)) {
-            t3d.cur_actor->class_index = GetActorIdentification(t3d.cur_actor->class);
-            continue;
-        }
+/* i.e. foo.map.gz -> foo.tiles, with the header already written */
+FILE *OpenManifest(const char *out_path, const char *extension, char *path, size_t size) {
+    char compression[16];
+    snprintf(path, size, "%s", out_path);
+    StripOutputPath(path, compression, sizeof(compression));
+    strncat(path, extension, size - strlen(path) - 1);
 
-        if(ReadPropertyString("Name", t3d.cur_actor->name)) {
-            continue;
-        }
+    FILE *fp = fopen(path, "w");
+    if(fp == NULL) {
+        fprintf(stderr, "error: failed to open \"%s\" for writing!\n", path);
+        return NULL;
+    }
 
-        SkipProperty();
+    fprintf(fp, "// generated by t3d2map v" T3D_VERSION "\n");
+    return fp;
+}
+
+bool CloseManifest(FILE *fp, const char *path, const char *what) {
+    if(fclose(fp) != 0) {
+        fprintf(stderr, "error: failed to write \"%s\"!\n", path);
+        return false;
     }
 
-    ParseBlock() {
-        ParseNext();
+    fprintf(stderr, "wrote %s manifest to \"%s\"\n", what, path);
+    return true;
+}
 
-        if(ChunkEnd("Actor")) {
-            break;
-        }
+/**************************************************/
+/* Tiled Export */
+
+/* i.e. foo.map.gz -> foo_1_2.map.gz */
+void GetTilePath(const char *out_path, const T3DTile *tile, char *tile_path, size_t size) {
+    char base[PL_SYSTEM_MAX_PATH], compression[16];
+    snprintf(base, sizeof(base), "%s", out_path);
+    StripOutputPath(base, compression, sizeof(compression));
+    snprintf(tile_path, size, "%s_%u_%u.map%s", base, tile->column, tile->row, compression);
+}
 
-        if(ChunkStart()) {
-            ReadChunk();
-            continue;
-        }
+const T3DSink *OpenTile(const T3DTile *tile, void *user) {
+    SplitOutputs *split = (SplitOutputs *) user;
+
+    char path[PL_SYSTEM_MAX_PATH];
+    GetTilePath(split->out_path, tile, path, sizeof(path));
+    return OpenSplitOutput(split, tile->row * startup_tiles.columns + tile->column, path);
+}
 
-        if(ReadVectorField("Location", &t3d.cur_actor->location)) {
+bool CloseTile(const T3DTile *tile, const T3DSink *sink, void *user) {
+    (void)(sink);
+    return CloseSplitOutput((SplitOutputs *) user, tile->row * startup_tiles.columns + tile->column);
+}
+
+/* describes each of the tiles, so they can be farmed out to be compiled */
+bool WriteTileManifest(const char *out_path, const T3DTile *tiles, unsigned int num_tiles) {
+    char path[PL_SYSTEM_MAX_PATH];
+    FILE *fp = OpenManifest(out_path, ".tiles", path, sizeof(path));
+    if(fp == NULL) {
+        return false;
+    }
+
+    fprintf(fp, "// columns rows margin\n");
+    fprintf(fp, "grid %u %u %g\n", startup_tiles.columns, startup_tiles.rows, startup_tiles.margin);
+    fprintf(fp, "// column row ( mins ) ( maxs ) brushes entities path\n");
+    for(unsigned int i = 0; i < num_tiles; ++i) {
+        const T3DTile *tile = &tiles[i];
+        if(tile->num_brushes == 0) {
             continue;
         }
 
-        switch(t3d.cur_actor->class_index->id) {
-            default:break;
+        char tile_path[PL_SYSTEM_MAX_PATH];
+        GetTilePath(plGetFileName(out_path), tile, tile_path, sizeof(tile_path));
+        fprintf(fp, "tile %u %u ( %g %g %g ) ( %g %g %g ) %u %u \"%s\"\n", tile->column, tile->row,
+                tile->mins[0], tile->mins[1], tile->mins[2], tile->maxs[0], tile->maxs[1], tile->maxs[2],
+                tile->num_brushes, tile->num_actors, tile_path);
+    }
 
-            case ACT_LevelSummary:break;
-            case ACT_Spotlight:break;
+    return CloseManifest(fp, path, "tile");
+}
 
-            case ACT_Light: {
-                if(ReadPropertyString("LightEffect", t3d.cur_actor->Light.effect)) {
-                    continue;
-                }
+bool WriteTiles(T3DContext *ctx, const char *out_path) {
+    unsigned int num_tiles = startup_tiles.columns * startup_tiles.rows;
+    T3DTile *tiles = calloc(num_tiles, sizeof(T3DTile));
+    SplitOutputs split;
+    if(!InitSplitOutputs(&split, ctx, out_path, num_tiles) || tiles == NULL) {
+        fprintf(stderr, "error: failed to allocate %u tiles!\n", num_tiles);
+        free(tiles);
+        free(split.outputs);
+        return false;
+    }
 
-                if(ReadPropertyInteger("LightBrightness", (int *) &t3d.cur_actor->Light.brightness)) {
-                    continue;
-                }
+    T3DTileOptions options = startup_tiles;
+    options.num_threads = startup_threads;
+    options.open        = OpenTile;
+    options.close       = CloseTile;
+    options.user        = &split;
 
-                if(ReadPropertyInteger("LightHue", (int *) &t3d.cur_actor->Light.hue)) {
-                    continue;
-                }
+    bool status = (t3dWriteTiles(ctx, &options, tiles) == T3D_ERROR_NONE) &&
+                  WriteTileManifest(out_path, tiles, num_tiles);
 
-                if(ReadPropertyInteger("LightRadius", (int *) &t3d.cur_actor->Light.radius)) {
-                    continue;
-                }
+    free(tiles);
+    free(split.outputs);
 
-                if(ReadPropertyInteger("LightSaturation", (int *) &t3d.cur_actor->Light.saturation)) {
-                    continue;
-                }
-            } break;
+    return status;
+}
 
-            case ACT_Brush: {
-                if(ReadPropertyString("CsgOper", t3d.cur_actor->Brush.csg)) {
-                    continue;
-                }
-            } break;
+/**************************************************/
+/* Group Export */
+
+/* i.e. foo.map.gz -> foo_3_Castle.map.gz, or foo_0.map.gz for those not in a group */
+void GetGroupPath(const char *out_path, const T3DGroup *group, char *group_path, size_t size) {
+    char base[PL_SYSTEM_MAX_PATH], compression[16];
+    snprintf(base, sizeof(base), "%s", out_path);
+    StripOutputPath(base, compression, sizeof(compression));
+
+    /* editor names can have anything in them */
+    char name[64] = "";
+    if(group->name[0] != '\0') {
+        snprintf(name, sizeof(name), "_%s", group->name);
+        for(char *c = &name[1]; *c != '\0'; ++c) {
+            if(!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '-')) {
+                *c = '_';
+            }
         }
-
-        SkipLine();
     }
 
-    t3d.num_actors++;
-    t3d.cur_actor++;
+    snprintf(group_path, size, "%s_%u%s.map%s", base, group->index, name, compression);
 }
 
-void ReadBrush(void) {
-    t3d.chunks[t3d.cur_chunk].context = CTX_BRUSH;
+const T3DSink *OpenGroup(const T3DGroup *group, void *user) {
+    SplitOutputs *split = (SplitOutputs *) user;
 
-    print_heading("Brush");
+    char path[PL_SYSTEM_MAX_PATH];
+    GetGroupPath(split->out_path, group, path, sizeof(path));
+    return OpenSplitOutput(split, group->index, path);
+}
 
-    ParseLine() {
-        if(ReadPropertyString("Name", t3d.map.name)) {
-            continue;
-        }
+bool CloseGroup(const T3DGroup *group, const T3DSink *sink, void *user) {
+    (void)(sink);
+    return CloseSplitOutput((SplitOutputs *) user, group->index);
+}
 
-        SkipProperty();
-    }
-
-    if((t3d.cur_chunk > 0) && (t3d.chunks[t3d.cur_chunk - 1].context == CTX_ACTOR)) {
-        if (t3d.cur_actor->class_index->id == ACT_Brush || t3d.cur_actor->class_index->id == ACT_Mover) {
-            t3d.cur_brush->location = t3d.cur_actor->location;
-            if (pl_strncasecmp(t3d.cur_actor->Brush.csg, "CSG_Subtract", 12) == 0) {
-                t3d.cur_brush->csg = CSG_Subtract;
-            } else if (pl_strncasecmp(t3d.cur_actor->Brush.csg, "CSG_Active", 10) == 0) {
-                t3d.cur_brush->csg = CSG_Active;
-            } else if (pl_strncasecmp(t3d.cur_actor->Brush.csg, "CSG_Add", 7) == 0) {
-                t3d.cur_brush->csg = CSG_Add;
-            } else if (pl_strncasecmp(t3d.cur_actor->Brush.csg, "CSG_Deintersect", 15) == 0) {
-                t3d.cur_brush->csg = CSG_Deintersect;
-            } else if (pl_strncasecmp(t3d.cur_actor->Brush.csg, "CSG_Intersect", 13) == 0) {
-                t3d.cur_brush->csg = CSG_Intersect;
-            }
-        } else {
-            printf("warning: previous chunk was an actor but not of a brush class!\n");
-        }
+/* same idea as the tile manifest, so each can be handed off to be compiled */
+bool WriteGroupManifest(const char *out_path, const T3DGroup *groups, unsigned int num_groups) {
+    char path[PL_SYSTEM_MAX_PATH];
+    FILE *fp = OpenManifest(out_path, ".groups", path, sizeof(path));
+    if(fp == NULL) {
+        return false;
     }
 
-    ParseBlock() {
-        ParseNext();
-
-        if(ChunkEnd("Brush")) {
-            break;
-        }
-
-        if(ChunkStart()) {
-            ReadChunk();
+    fprintf(fp, "// index \"name\" brushes entities path\n");
+    for(unsigned int i = 0; i < num_groups; ++i) {
+        const T3DGroup *group = &groups[i];
+        if(group->num_brushes == 0) {
             continue;
         }
 
-        if(ReadVectorField("Location", &t3d.cur_brush->location)) {
-            continue;
-        }
+        char group_path[PL_SYSTEM_MAX_PATH];
+        GetGroupPath(plGetFileName(out_path), group, group_path, sizeof(group_path));
+        fprintf(fp, "group %u \"%s\" %u %u \"%s\"\n", group->index, group->name,
+                group->num_brushes, group->num_actors, group_path);
+    }
 
-        if(ReadVectorField("PrePivot", &t3d.cur_brush->pre_pivot)) {
-            continue;
-        }
+    return CloseManifest(fp, path, "group");
+}
 
-        if(ReadVectorField("PostPivot", &t3d.cur_brush->post_pivot)) {
-            continue;
-        }
+bool WriteGroups(T3DContext *ctx, const char *out_path) {
+    unsigned int num_groups = t3dGetNumGroups(ctx);
+    T3DGroup *groups = calloc(num_groups, sizeof(T3DGroup));
+    SplitOutputs split;
+    if(!InitSplitOutputs(&split, ctx, out_path, num_groups) || groups == NULL) {
+        fprintf(stderr, "error: failed to allocate %u groups!\n", num_groups);
+        free(groups);
+        free(split.outputs);
+        return false;
+    }
 
-        if(ReadField("Settings")) {
-            ParseLine() {
-                SkipSpaces();
+    T3DGroupOptions options = {
+            .num_threads = startup_threads,
+            .open        = OpenGroup,
+            .close       = CloseGroup,
+            .user        = &split,
+    };
 
-                if(ReadPropertyInteger("CSG", (int *) &t3d.cur_brush->csg)) {
-                    continue;
-                }
+    bool status = (t3dWriteGroups(ctx, &options, groups) == T3D_ERROR_NONE) &&
+                  WriteGroupManifest(out_path, groups, num_groups);
 
-                if(ReadPropertyInteger("Flags", (int *) &t3d.cur_brush->flags)) {
-                    continue;
-                }
+    free(groups);
+    free(split.outputs);
 
-                if(ReadPropertyInteger("PolyFlags", (int *) &t3d.cur_brush->poly_flags)) {
-                    continue;
-                }
+    return status;
+}
 
-                if(ReadPropertyInteger("Color", (int *) &t3d.cur_brush->colour)) {
-                    continue;
-                }
-            }
+/**************************************************/
+/* Statistics */
+
+/* most the process has ever had resident, in bytes */
+size_t GetPeakRSS(void) {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#   if defined(__APPLE__)
+    return (size_t) usage.ru_maxrss;
+#   else
+    return (size_t) usage.ru_maxrss * 1024;
+#   endif
+#endif
+}
+
+void PrintMemoryStats(T3DContext *ctx) {
+    fprintf(stderr, "   memory (live / peak / allocations)\n");
+    for(unsigned int i = 0; i < T3D_MAX_MEMORY_TAGS; ++i) {
+        T3DMemoryStats stats;
+        t3dGetMemoryStats(ctx, (T3DMemoryTag) i, &stats);
+        if(stats.num_allocations == 0) {
             continue;
         }
 
-        SkipLine();
+        fprintf(stderr, "    %-12s = %10zu / %10zu / %lu\n",
+                t3dGetMemoryTagName((T3DMemoryTag) i), stats.live, stats.peak, stats.num_allocations);
     }
 
-    t3d.num_brushes++;
-    t3d.cur_brush++;
+    T3DMemoryStats total;
+    t3dGetMemoryStats(ctx, T3D_MAX_MEMORY_TAGS, &total);
+    fprintf(stderr, "   peak memory = %.2fMB\n", (double) total.peak / (1024.0 * 1024.0));
+    fprintf(stderr, "   peak rss    = %.2fMB\n", (double) GetPeakRSS() / (1024.0 * 1024.0));
 }
 
-void ParseT3D(const char *path) {
-    memset(&t3d, 0, sizeof t3d);
+/**************************************************/
+/* Batch Conversion */
+
+typedef struct BatchFiles {
+    T3DBatchJob *jobs;
+    char (*paths)[2][PL_SYSTEM_MAX_PATH];
+    unsigned int num_jobs, max_jobs;
+} BatchFiles;
+
+bool IsDirectory(const char *path) {
+#if defined(_WIN32)
+    DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
 
-    printf("attempting to read T3D at \"%s\" ... ", path);
+/* i.e. foo.t3d, foo.t3d.gz or foo.t3d.zst, giving back foo */
+bool GetBatchName(const char *file_name, char *name, size_t size) {
+    snprintf(name, size, "%s", file_name);
 
-    if(!plFileExists(path)) {
-        printf("failed to find \"%s\", aborting!\n", path);
-        exit(EXIT_FAILURE);
+    char *ext = strrchr(name, '.');
+    if(ext != NULL && t3dGetCompression(name) != T3D_COMPRESSION_NONE) {
+        *ext = '\0';
+        ext = strrchr(name, '.');
     }
 
-    PLFile *fp = plOpenFile(path, false);
-    if(fp == NULL) {
-        printf("failed to read \"%s\", aborting!\n", path);
-        exit(EXIT_FAILURE);
+    if(ext == NULL || ext == name || pl_strcasecmp(ext, ".t3d") != 0) {
+        return false;
     }
 
-    char *buf;
-    size_t length = plGetFileSize(fp);
-    buf = malloc(length);
-    if(plReadFile(fp, buf, 1, length) != length) {
-      printf("Failed to read entirety of T3D, expect faults!\n");
+    *ext = '\0';
+    return true;
+}
+
+bool AddBatchFile(BatchFiles *files, const char *in_dir, const char *out_dir, const char *file_name) {
+    char name[PL_SYSTEM_MAX_PATH];
+    if(!GetBatchName(file_name, name, sizeof(name))) {
+        return true;
     }
-    buf[length] = '\0';
-    plCloseFile(fp);
 
-    printf("success!\n");
-    printf("parsing...\n");
+    if(files->num_jobs == files->max_jobs) {
+        unsigned int max_jobs = (files->max_jobs > 0) ? files->max_jobs * 2 : 64;
+        char (*paths)[2][PL_SYSTEM_MAX_PATH] = realloc(files->paths, sizeof(*paths) * max_jobs);
+        if(paths == NULL) {
+            return false;
+        }
+        files->paths = paths;
+        files->max_jobs = max_jobs;
+    }
+
+    char *paths[2] = { files->paths[files->num_jobs][0], files->paths[files->num_jobs][1] };
+    snprintf(paths[0], PL_SYSTEM_MAX_PATH, "%s/%s", in_dir, file_name);
+    snprintf(paths[1], PL_SYSTEM_MAX_PATH, "%s/%s.map", out_dir, name);
+    files->num_jobs++;
 
-    t3d.cur_actor = &t3d.actors[0];
-    t3d.cur_brush = &t3d.brushes[0];
-    t3d.cur_chunk = -1;
-    t3d.cur_pos   = &buf[0];
+    return true;
+}
 
-    ParseBlock() {
-        ParseNext();
+bool FindBatchFiles(BatchFiles *files, const char *in_dir, const char *out_dir) {
+#if defined(_WIN32)
+    char pattern[PL_SYSTEM_MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", in_dir);
 
-        /* begin */
-        if(pl_strncasecmp(t3d.cur_pos, "Begin", 5) == 0) {
-            t3d.cur_pos += 5;
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if(find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
 
-            ParseNext();
-            ReadChunk();
-            continue;
+    bool status = true;
+    do {
+        if(!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            status = AddBatchFile(files, in_dir, out_dir, data.cFileName);
         }
+    } while(status && FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR *dir = opendir(in_dir);
+    if(dir == NULL) {
+        return false;
     }
 
-    if(t3d.cur_chunk != -1) {
-        printf("warning: failed to escape all blocks - parsing may have failed!\n");
+    bool status = true;
+    struct dirent *entry;
+    while(status && (entry = readdir(dir)) != NULL) {
+        status = AddBatchFile(files, in_dir, out_dir, entry->d_name);
     }
+    closedir(dir);
+#endif
+    return status;
 }
 
-void WriteMap(const char *path) {
-    FILE *fp = fopen(path, "w");
-    if(fp == NULL) {
-        printf("failed to open \"%s\", aborting!\n", path);
-        exit(EXIT_FAILURE);
+int CompareBatchPaths(const void *a, const void *b) {
+    return strcmp(((const char (*)[PL_SYSTEM_MAX_PATH]) a)[0], ((const char (*)[PL_SYSTEM_MAX_PATH]) b)[0]);
+}
+
+/* there's just too much going on at once to be worth hearing about how each is getting on */
+void LogBatch(T3DLogLevel level, const char *message, void *user) {
+    (void)(user);
+    if(level >= T3D_LOG_WARNING) {
+        fputs(message, stderr);
     }
+}
 
-#define WriteField(a, b)    fprintf(fp, "\"%s\" \"%s\"\n", (a), (b))
-#define WriteVector(a, b)   fprintf(fp, "\"%s\" \"%d %d %d\"\n", (a), (int)(b).y, (int)(b).x, (int)(b).z)
+/* converts every T3D in the directory, writing the maps out alongside or into out_dir */
+bool ConvertDirectory(const char *in_dir, const char *out_dir) {
+    BatchFiles files = { NULL };
+    if(!FindBatchFiles(&files, in_dir, out_dir)) {
+        fprintf(stderr, "error: failed to read directory \"%s\"!\n", in_dir);
+        free(files.paths);
+        return false;
+    }
 
-    /* write out the world spawn */
+    if(files.num_jobs == 0) {
+        fprintf(stderr, "error: no T3D files found in \"%s\"!\n", in_dir);
+        free(files.paths);
+        return false;
+    }
 
-    fprintf(fp, "//\n");
-    fprintf(fp, "// generated with t3d2map v" VERSION "\n");
-    fprintf(fp, "//\n");
+    /* in a consistent order, whatever the directory gives back */
+    qsort(files.paths, files.num_jobs, sizeof(*files.paths), CompareBatchPaths);
 
-    fprintf(fp, "{\n");
-    switch(startup_format) {
-        default:
-        case MAP_FORMAT_IDT2: {
-            WriteField("classname", "worldspawn");
-            WriteField("wad", "/gfx/base.wad");
-            WriteField("worldtype", "0");
-        } break;
+    if((files.jobs = calloc(files.num_jobs, sizeof(T3DBatchJob))) == NULL) {
+        fprintf(stderr, "error: failed to allocate %u jobs!\n", files.num_jobs);
+        free(files.paths);
+        return false;
     }
 
-    unsigned int num_brushes = t3d.map.num_brushes;
-    if(num_brushes == 0) {
-        if(t3d.num_brushes == 0) {
-            printf("error: no brushes from t3d!\n");
-            exit(EXIT_FAILURE);
-        }
-        num_brushes = t3d.num_brushes - 1;
+    for(unsigned int i = 0; i < files.num_jobs; ++i) {
+        files.jobs[i].in_path = files.paths[i][0];
+        files.jobs[i].out_path = files.paths[i][1];
     }
 
-    printf("writing %d brushes...\n", num_brushes);
-    for(unsigned int i = 0; i < num_brushes; ++i) {
-        if(startup_add && t3d.brushes[i].csg != CSG_Add) {
-            continue;
-        }
+    T3DOptions options = startup_options;
+    options.log = LogBatch;
 
-        if(startup_sub && t3d.brushes[i].csg != CSG_Subtract) {
-            continue;
-        }
+    T3DBatchOptions batch = { .num_workers = startup_threads };
 
-#ifdef DEBUG_PARSER
-        printf("brush %d\n", i);
-        printf(" name:     %s\n", t3d.brushes[i].name);
-        printf(" csg:      %d\n", t3d.brushes[i].csg);
-        printf(" location: %s\n", plPrintVector3(&t3d.brushes[i].location, pl_int_var));
-#endif
+    fprintf(stderr, "converting %u T3D files from \"%s\"...\n", files.num_jobs, in_dir);
 
-        if(t3d.brushes[i].num_poly < 4) {
-            printf("warning: invalid number of polygons to produce brush (%d), skipping!\n", t3d.brushes[i].num_poly);
+    double start = GetWatchTime();
+    t3dConvertBatch(&options, &batch, files.jobs, files.num_jobs);
+    double time = GetWatchTime() - start;
+
+    unsigned int num_failed = 0, num_brushes = 0, num_actors = 0;
+    for(unsigned int i = 0; i < files.num_jobs; ++i) {
+        const T3DBatchJob *job = &files.jobs[i];
+        if(job->error != T3D_ERROR_NONE) {
+            fprintf(stderr, "failed to convert \"%s\" (%s)!\n", job->in_path, t3dGetErrorString(job->error));
+            num_failed++;
             continue;
         }
 
-        fprintf(fp, "// brush %d\n", i);
-        fprintf(fp, "{\n");
+        num_brushes += job->num_brushes;
+        num_actors += job->num_actors;
+    }
 
-        for(unsigned int j = 0; j < t3d.brushes[i].num_poly; ++j) {
-            Polygon *cur_face = &t3d.brushes[i].poly_list[j];
+    fprintf(stderr, "done!\n\n");
 
-            /* todo: may need to switch these coords around depending on output... */
+    fprintf(stderr, "========================================\n");
+    fprintf(stderr, " STATISTICS FOR %s\n", in_dir);
+    fprintf(stderr, "   converted = %u/%u\n", files.num_jobs - num_failed, files.num_jobs);
+    fprintf(stderr, "   brushes   = %u\n", num_brushes);
+    fprintf(stderr, "   actors    = %u\n", num_actors);
+    fprintf(stderr, "   time      = %.2fms\n", time);
+    fprintf(stderr, "   peak rss  = %.2fMB\n", (double) GetPeakRSS() / (1024.0 * 1024.0));
+    fprintf(stderr, "========================================\n");
 
-            float x[3], y[3], z[3];
-            for(unsigned int k = 0; k < 3; ++k) {
-                x[k] = cur_face->vertices[k].y + t3d.brushes[i].location.y;
-                y[k] = cur_face->vertices[k].x + t3d.brushes[i].location.x;
-                z[k] = cur_face->vertices[k].z + t3d.brushes[i].location.z;
-            }
+    free(files.jobs);
+    free(files.paths);
 
-            fprintf(fp, "( %d %d %d ) ( %d %d %d ) ( %d %d %d ) %s 0 0 0 1 1\n",
-                    (int) x[0], (int) y[0], (int) z[0],
-                    (int) x[1], (int) y[1], (int) z[1],
-                    (int) x[2], (int) y[2], (int) z[2],
-                    cur_face->texture
-            );
-
-#if 1
-            printf(" poly %d\n", j);
-            printf("  texture: %s\n", cur_face->texture);
-            printf("  group:   %s\n", cur_face->group);
-            printf("  item:    %s\n", cur_face->item);
-            for(unsigned int k = 0; k < 4; ++k) {
-                printf("  vector %d (%s)\n", k, plPrintVector3(&cur_face->vertices[k], pl_int_var));
-            }
-#endif
-        }
+    return num_failed == 0;
+}
 
-        fprintf(fp, "}\n");
-    }
+/**************************************************/
+/* Import */
 
-    fprintf(fp, "}\n");
+/* goes by the extension once any compression is off it, i.e. foo.map.gz */
+bool IsMapPath(const char *path) {
+    char name[PL_SYSTEM_MAX_PATH];
+    snprintf(name, sizeof(name), "%s", path);
 
-    if(t3d.num_actors > 0) {
-        for (unsigned int i = 0; i < (t3d.num_actors - 1); ++i) {
-            if(t3d.actors[i].class_index->id == ACT_Brush) {
-                continue;
-            }
+    char *ext = strrchr(name, '.');
+    if(ext != NULL && t3dGetCompression(name) != T3D_COMPRESSION_NONE) {
+        *ext = '\0';
+        ext = strrchr(name, '.');
+    }
 
-            fprintf(fp, "{\n");
+    return ext != NULL && strpbrk(ext, "/\\") == NULL && pl_strcasecmp(ext, ".map") == 0;
+}
 
-            WriteField("classname", GetEntityForActor(&t3d.actors[i]));
-            WriteVector("origin", t3d.actors[i].location);
+bool ImportMAP(const char *in_path, const char *out_path) {
+    T3DContext *ctx = t3dCreateContext(&startup_options);
+    if(ctx == NULL) {
+        fprintf(stderr, "error: failed to create conversion context!\n");
+        return false;
+    }
 
-            if (pl_strncasecmp(t3d.actors[i].class, "light", 5) == 0) {
-                unsigned char r, g, b;
-                ConvertHSV((unsigned char) t3d.actors[i].Light.hue,
-                           (unsigned char) t3d.actors[i].Light.saturation,
-                           (unsigned char) t3d.actors[i].Light.brightness,
-                           &r, &g, &b);
-                fprintf(fp, "\"light\" \"%d %d %d\"\n", r, g, b);
+    T3DOutput *output = t3dOpenOutput(ctx, out_path);
+    if(output == NULL) {
+        t3dDestroyContext(ctx);
+        return false;
+    }
 
-            }
+    T3DError error = t3dImportMap(ctx, in_path, t3dGetOutputSink(output));
+    if(t3dCloseOutput(output) != T3D_ERROR_NONE) {
+        error = T3D_ERROR_IO;
+    }
 
-            fprintf(fp, "}\n");
-        }
+    if(error == T3D_ERROR_NONE) {
+        fprintf(stderr, "done!\n\n");
+        PrintMemoryStats(ctx);
     }
+
+    t3dDestroyContext(ctx);
+    return error == T3D_ERROR_NONE;
 }
 
 /**************************************************/
@@ -1061,17 +1318,46 @@ int main(int argc, char **argv) {
                 " src  (Half-Life 2)"
             },
 
-            { "-actors", &startup_actors, NULL, "retain original actor names for entities" },
-            { "-add", &startup_add, NULL, "only additive geometry" },
-            { "-sub", &startup_sub, NULL, "only subtractive geometry" },
+            { "-actors", &startup_options.actors, NULL, "retain original actor names for entities" },
+            { "-add", &startup_options.add, NULL, "only additive geometry" },
+            { "-sub", &startup_options.sub, NULL, "only subtractive geometry" },
+            { "-props", &startup_options.properties, NULL, "pass all actor properties through as entity keys" },
+            { "-dupes", &startup_options.duplicates, NULL, "report brushes that duplicate another" },
+            { "-dedupe", &startup_options.dedupe, NULL, "drop brushes that duplicate another" },
+            { "-sort", &startup_options.sort, NULL, "write brushes and entities out in spatial order, rather than editor order" },
+            { "-tiles", NULL, TilesCommand, "split the map up into a grid of tiles, e.g. 4x4, written out alongside a manifest" },
+            { "-tilemargin", NULL, TileMarginCommand, "also write brushes within this distance of a tile into it" },
+            { "-groups", &startup_options.groups, NULL, "keep brushes together by editor group, as func_group entities or visgroups" },
+            { "-splitgroups", &startup_split_groups, NULL, "write each editor group out as a map of its own, alongside a manifest" },
+            { "-leakcheck", &startup_leakcheck, NULL, "flood fill from the player starts and write a point file if the map leaks" },
+            { "-watch", &startup_watch, NULL, "keep running and re-convert the input whenever it changes" },
+            { "-server", NULL, ServerCommand, "listen on the given unix socket and convert whatever's sent to it; only the user running it may connect, and can read or write any file it can" },
+            { "-index", &startup_index, NULL, "rebuild the index of the input's actors, written alongside it as .idx" },
+            { "-threads", NULL, ThreadsCommand, "number of documents to parse at once when converting a directory, or tiles/groups to write at once, defaults to one per core" },
+            { "-verbose", &startup_options.verbose, NULL, "print out everything the parser comes across, there's a lot" },
+            { "-import", &startup_import, NULL, "convert a MAP back into a T3D, also the default when the input ends in .map" },
+            {
+                "-extract",
+                NULL, ExtractCommand,
+                "only convert the actors matching the filter, found via the index; may be given more than once, e.g.\n"
+                " name=Light12\n"
+                " class=Light* (case insensitive, trailing * matches anything)\n"
+                " region=x0,y0,z0,x1,y1,z1 (overlapping the bounds, in map space)"
+            },
 
             {NULL, NULL}
     };
 
-    printf("t3d2map v" VERSION "\nDeveloped by Mark \"hogsy\" Sowden <markelswo@gmail.com>\n\n");
+    fprintf(stderr, "t3d2map v" T3D_VERSION "\nDeveloped by Mark \"hogsy\" Sowden <markelswo@gmail.com>\n\n");
     if(argc < 2) {
-        printf("\nusage:\n t3d2map <in> [out]\n");
+        printf("\nusage:\n t3d2map <in> [out]\n t3d2map <in.map> [out.t3d]\n t3d2map -server <socket>\n");
+        printf(" input may be gzip or zstd compressed, and output is compressed if it ends in .gz or .zst\n");
+        printf(" either may be - for stdin or stdout, with everything else going to stderr\n");
+        printf(" if the input's a directory, every T3D in it is converted, into the output directory if given\n");
         for(size_t i = 0; i < plArrayElements(launch_arguments); ++i) {
+            if(launch_arguments[i].check == NULL) {
+                break;
+            }
             printf("  %s : %20s\n", launch_arguments[i].check, launch_arguments[i].description);
         }
         return EXIT_SUCCESS;
@@ -1080,55 +1366,168 @@ int main(int argc, char **argv) {
     char in_path[PL_SYSTEM_MAX_PATH];
     snprintf(in_path, PL_SYSTEM_MAX_PATH, "%s", argv[1]);
 
+    /* lil slower, but simpler to implement new commands... */
+
+    /* starting from the input, as it may be a command instead, i.e. -server */
+    for(int i = 1; i < argc; i++) {
+        if(argv[i][0] != '-' || argv[i][1] == '\0') {
+            continue;
+        }
+
+        bool found = false;
+        for(size_t j = 0; j < plArrayElements(launch_arguments); ++j) {
+            if(launch_arguments[j].check == NULL) {
+                break;
+            }
+
+            if(pl_strcasecmp(launch_arguments[j].check, argv[i]) == 0) {
+                if (launch_arguments[j].function != NULL) {
+                    const char *parm = NULL;
+                    if ((i + 1) < argc && argv[i + 1][0] != '-') { /* pass the next argument along */
+                        parm = argv[++i];
+                    }
+                    launch_arguments[j].function(parm);
+                } else if(launch_arguments[j].boolean != NULL) {
+                    *launch_arguments[j].boolean = true;
+                }
+                found = true;
+                break;
+            }
+        }
+
+        if(!found) {
+            fprintf(stderr, "unknown or invalid command, \"%s\", ignoring!\n", argv[i]);
+        }
+    }
+
+    if(startup_server[0] != '\0') {
+        RunServer(startup_server);
+        return EXIT_SUCCESS;
+    }
+
+    if(IsMapPath(in_path)) {
+        startup_import = true;
+    }
+
+    /* a directory has everything in it converted, with reads and writes overlapping the parsing */
+    if(IsDirectory(in_path)) {
+        if(startup_test || startup_watch || startup_index || startup_import || startup_leakcheck ||
+           startup_tiles.columns > 0 || startup_split_groups || num_extract_filters > 0) {
+            fprintf(stderr, "error: only plain conversion is supported when converting a directory!\n");
+            return EXIT_FAILURE;
+        }
+
+        const char *out_dir = (argc > 2 && argv[2][0] != '-') ? argv[2] : in_path;
+        if(!IsDirectory(out_dir)) {
+            fprintf(stderr, "error: output \"%s\" must be an existing directory!\n", out_dir);
+            return EXIT_FAILURE;
+        }
+
+        return ConvertDirectory(in_path, out_dir) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /* "-" for either goes via stdin or stdout, so it can sit in a pipeline */
+    bool in_piped = (strcmp(in_path, "-") == 0);
+    bool out_piped = (argc > 2 && strcmp(argv[2], "-") == 0) || (in_piped && (argc < 3 || argv[2][0] == '-'));
+
     char out_path[PL_SYSTEM_MAX_PATH];
-    if(argc > 2 && argv[2][0] != '-') {
+    if(out_piped) {
+        snprintf(out_path, PL_SYSTEM_MAX_PATH, "-");
+    } else if(argc > 2 && argv[2][0] != '-') {
         snprintf(out_path, PL_SYSTEM_MAX_PATH, "%s", argv[2]);
     } else {
         char ext[32];
         plStripExtension(ext, 32, plGetFileName(in_path));
-        snprintf(out_path, PL_SYSTEM_MAX_PATH, "./%s.map", ext);
+        if(t3dGetCompression(in_path) != T3D_COMPRESSION_NONE) {
+            char name[32]; /* i.e. foo.t3d.gz */
+            snprintf(name, sizeof(name), "%s", ext);
+            plStripExtension(ext, 32, name);
+        }
+        snprintf(out_path, PL_SYSTEM_MAX_PATH, "./%s.%s", ext, startup_import ? "t3d" : "map");
     }
 
-    /* lil slower, but simpler to implement new commands... */
+    if(in_piped && (startup_watch || startup_index || num_extract_filters > 0)) {
+        fprintf(stderr, "error: -watch, -index and -extract need an input file, not stdin!\n");
+        return EXIT_FAILURE;
+    } else if(out_piped && (startup_tiles.columns > 0 || startup_split_groups)) {
+        fprintf(stderr, "error: -tiles and -splitgroups need an output file, not stdout!\n");
+        return EXIT_FAILURE;
+    } else if(startup_tiles.columns > 0 && startup_split_groups) {
+        fprintf(stderr, "error: -tiles and -splitgroups can't be used together!\n");
+        return EXIT_FAILURE;
+    }
 
-    for(unsigned int i = 2; i < argc; i++) {
-        if(argv[i][0] == '-') {
-            for(size_t j = 0; j < plArrayElements(launch_arguments); ++j) {
-                if(launch_arguments[j].check == NULL) {
-                    break;
-                }
+    if(startup_import) {
+        return ImportMAP(in_path, out_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-                if(pl_strncasecmp(launch_arguments[j].check, argv[i], sizeof(launch_arguments[j].check)) == 0) {
-                    if (launch_arguments[j].function != NULL) {
-                        const char *parm = NULL;
-                        if ((i + 1) < argc && argv[i + 1][0] != '-') { /* pass the next argument along */
-                            parm = argv[++i];
-                        }
-                        launch_arguments[j].function(parm);
-                    } else if(launch_arguments[j].boolean != NULL) {
-                        *launch_arguments[j].boolean = true;
-                    }
-                    continue;
-                }
-            }
-        }
+    if(startup_index) {
+        return IndexT3D(in_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(startup_watch) {
+        WatchT3D(in_path, out_path);
+        return EXIT_SUCCESS;
+    }
 
-        printf("unknown or invalid command, \"%s\", ignoring!\n", argv[i]);
+    T3DContext *ctx = t3dCreateContext(&startup_options);
+    if(ctx == NULL) {
+        fprintf(stderr, "error: failed to create conversion context!\n");
+        return EXIT_FAILURE;
     }
 
-    ParseT3D(in_path);
+    T3DError error = (num_extract_filters > 0) ? ExtractT3D(ctx, in_path) : t3dParseFile(ctx, in_path);
+    if(error != T3D_ERROR_NONE) {
+        t3dDestroyContext(ctx);
+        return EXIT_FAILURE;
+    }
 
-    if(!startup_test) {
-        WriteMap(out_path);
+    if(!startup_test && startup_tiles.columns > 0) {
+        if(!WriteTiles(ctx, out_path)) {
+            t3dDestroyContext(ctx);
+            return EXIT_FAILURE;
+        }
+    } else if(!startup_test && startup_split_groups) {
+        if(!WriteGroups(ctx, out_path)) {
+            t3dDestroyContext(ctx);
+            return EXIT_FAILURE;
+        }
+    } else if(!startup_test) {
+        T3DOutput *output = t3dOpenOutput(ctx, out_path);
+        if(output == NULL) {
+            t3dDestroyContext(ctx);
+            return EXIT_FAILURE;
+        }
+
+        t3dWriteMap(ctx, t3dGetOutputSink(output));
+        if(t3dCloseOutput(output) != T3D_ERROR_NONE) {
+            t3dDestroyContext(ctx);
+            return EXIT_FAILURE;
+        }
     }
 
-    printf("done!\n\n");
+    bool sealed = true;
+    if(startup_leakcheck) {
+        sealed = CheckLeaks(ctx, out_path);
+    }
+
+    fprintf(stderr, "done!\n\n");
+
+    fprintf(stderr, "========================================\n");
+    fprintf(stderr, " STATISTICS FOR %s\n", pl_strtoupper(in_path));
+    fprintf(stderr, "   brushes = %d\n", t3dGetNumBrushes(ctx));
+    fprintf(stderr, "   actors  = %d\n", t3dGetNumActors(ctx));
+    if(startup_options.duplicates || startup_options.dedupe) {
+        fprintf(stderr, "   duplicates = %d\n", t3dGetNumDuplicates(ctx));
+    }
+    if(startup_leakcheck) {
+        fprintf(stderr, "   leaks   = %s\n", sealed ? "none" : "LEAKED");
+    }
+    PrintMemoryStats(ctx);
+    fprintf(stderr, "========================================\n");
 
-    printf("========================================\n");
-    printf(" STATISTICS FOR %s\n", pl_strtoupper(in_path));
-    printf("   brushes = %d\n", t3d.num_brushes);
-    printf("   actors  = %d\n", t3d.num_actors);
-    printf("========================================\n");
+    t3dDestroyContext(ctx);
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    /* so it can be used to gate anything that comes after */
+    return sealed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "t3d_private.h"
+
+/* A conversion runs from start to finish on a thread of its own, with its
+ * own context, so the only thing shared with the caller is its status. The
+ * context hands over its progress at every chunk it parses and brush it
+ * writes, which is where the status is brought up to date and where it
+ * finds out whether it's been cancelled. Once it's done, whether it got to
+ * the end or not, the context is destroyed, so nothing's left held besides
+ * the status itself until it's finished with. */
+
+struct T3DConversion {
+    T3DOptions options;     /* with the progress function swapped for UpdateProgress */
+    T3DProgressFunction progress;
+    void *progress_user;
+
+    const char *in_path;    /* kept after the conversion itself, in the same allocation */
+    const char *out_path;
+
+    T3DMutex mutex;     /* guards the status */
+    T3DProgress status;
+    T3DError error;
+    bool cancelled;
+    bool done;
+
+    T3DThread thread;
+};
+
+static bool UpdateProgress(const T3DProgress *progress, void *user) {
+    T3DConversion *conversion = (T3DConversion *) user;
+    t3dLockMutex(&conversion->mutex);
+    conversion->status = *progress;
+    bool cancelled = conversion->cancelled;
+    t3dUnlockMutex(&conversion->mutex);
+
+    if(!cancelled && conversion->progress != NULL) {
+        cancelled = !conversion->progress(progress, conversion->progress_user);
+    }
+
+    return !cancelled;
+}
+
+static T3DError Convert(T3DConversion *conversion) {
+    T3DContext *ctx = t3dCreateContext(&conversion->options);
+    if(ctx == NULL) {
+        return T3D_ERROR_MEMORY;
+    }
+
+    if(t3dParseFile(ctx, conversion->in_path) == T3D_ERROR_NONE) {
+        T3DOutput *output = t3dOpenOutput(ctx, conversion->out_path);
+        if(output != NULL) {
+            t3dWriteMap(ctx, t3dGetOutputSink(output));
+            t3dCloseOutput(output);
+
+            /* don't leave half a map lying around */
+            if(t3dGetError(ctx) != T3D_ERROR_NONE && !t3dIsStandardStream(conversion->out_path)) {
+                remove(conversion->out_path);
+            }
+        }
+    }
+
+    T3DError error = t3dGetError(ctx);
+    if(error == T3D_ERROR_CANCELLED) {
+        t3dLog(ctx, T3D_LOG_INFO, "cancelled conversion of \"%s\"\n", conversion->in_path);
+    }
+
+    t3dDestroyContext(ctx);
+    return error;
+}
+
+static void ConversionThread(void *user) {
+    T3DConversion *conversion = (T3DConversion *) user;
+    T3DError error = Convert(conversion);
+
+    t3dLockMutex(&conversion->mutex);
+    conversion->status.phase = T3D_PHASE_DONE;
+    conversion->error = error;
+    conversion->done = true;
+    T3DProgress status = conversion->status;
+    t3dUnlockMutex(&conversion->mutex);
+
+    /* one last time, so it's not necessary to poll to find out when it's done */
+    if(conversion->progress != NULL) {
+        conversion->progress(&status, conversion->progress_user);
+    }
+}
+
+T3DConversion *t3dStartConversion(const T3DOptions *options, const char *in_path, const char *out_path) {
+    if(options == NULL || in_path == NULL || out_path == NULL) {
+        return NULL;
+    }
+
+    T3DAllocator allocator = options->allocator;
+    if(allocator.malloc == NULL || allocator.realloc == NULL || allocator.free == NULL) {
+        memset(&allocator, 0, sizeof(T3DAllocator));
+    }
+
+    size_t in_length = strlen(in_path) + 1;
+    size_t out_length = strlen(out_path) + 1;
+    size_t size = sizeof(T3DConversion) + in_length + out_length;
+    T3DConversion *conversion = (allocator.malloc != NULL) ? allocator.malloc(size, allocator.user) : malloc(size);
+    if(conversion == NULL) {
+        return NULL;
+    }
+
+    memset(conversion, 0, sizeof(T3DConversion));
+    char *paths = (char *) (conversion + 1);
+    memcpy(paths, in_path, in_length);
+    memcpy(paths + in_length, out_path, out_length);
+    conversion->in_path = paths;
+    conversion->out_path = paths + in_length;
+
+    conversion->options = *options;
+    conversion->options.progress = UpdateProgress;
+    conversion->options.progress_user = conversion;
+    conversion->progress = options->progress;
+    conversion->progress_user = options->progress_user;
+    conversion->status.phase = T3D_PHASE_QUEUED;
+
+    t3dInitMutex(&conversion->mutex);
+    if(!t3dCreateThread(&conversion->thread, ConversionThread, conversion)) {
+        t3dDestroyMutex(&conversion->mutex);
+        if(allocator.free != NULL) {
+            allocator.free(conversion, allocator.user);
+        } else {
+            free(conversion);
+        }
+        return NULL;
+    }
+
+    return conversion;
+}
+
+bool t3dGetConversionProgress(T3DConversion *conversion, T3DProgress *progress) {
+    t3dLockMutex(&conversion->mutex);
+    *progress = conversion->status;
+    bool done = conversion->done;
+    t3dUnlockMutex(&conversion->mutex);
+
+    return done;
+}
+
+void t3dCancelConversion(T3DConversion *conversion) {
+    t3dLockMutex(&conversion->mutex);
+    conversion->cancelled = true;
+    t3dUnlockMutex(&conversion->mutex);
+}
+
+T3DError t3dFinishConversion(T3DConversion *conversion) {
+    t3dJoinThread(&conversion->thread);
+    t3dDestroyMutex(&conversion->mutex);
+
+    T3DError error = conversion->error;
+
+    T3DAllocator allocator = conversion->options.allocator;
+    if(allocator.malloc != NULL && allocator.realloc != NULL && allocator.free != NULL) {
+        allocator.free(conversion, allocator.user);
+    } else {
+        free(conversion);
+    }
+
+    return error;
+}
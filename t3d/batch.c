@@ -0,0 +1,817 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#if defined(T3D_USE_URING)
+#   include <liburing.h>
+#   include <errno.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/stat.h>
+#endif
+
+#include "t3d_private.h"
+
+/* Converting a whole set of documents one after another leaves the disk
+ * idle while each is parsed, and the cores idle while each is read and
+ * written. Instead this runs it as three stages: the next few documents
+ * are read in ahead, a pool of workers parses and writes each into memory,
+ * and finished maps are written out behind. There's a bounded queue
+ * between each stage, so a slow disk or a slow parse only ever holds up so
+ * much. Reads and writes go through io_uring where it's available, which
+ * keeps plenty in flight from a single thread, and a couple of threads
+ * doing blocking I/O otherwise. */
+
+#define MAX_BATCH_QUEUE         64
+#define DEFAULT_READ_AHEAD      8
+#define DEFAULT_WRITE_BEHIND    8
+#define NUM_IO_THREADS          2
+
+/* reads and writes are broken up, as a single one can only be so big */
+#define MAX_IO_SIZE             (64 * 1024 * 1024)
+
+typedef struct BatchItem {
+    T3DBatchJob *job;
+
+    char *data;     /* the document, then the map */
+    size_t length;
+    size_t max_length;
+
+#if defined(T3D_USE_URING)
+    int fd;
+    size_t done;
+#endif
+} BatchItem;
+
+typedef struct Queue {
+    T3DMutex mutex;
+    T3DCondition filled;
+    T3DCondition emptied;
+
+    BatchItem *items[MAX_BATCH_QUEUE];
+    unsigned int head, num_items;
+    unsigned int max_items;
+
+    unsigned int num_producers; /* closed once all of these are done */
+} Queue;
+
+enum {
+    BATCH_STARTING,
+    BATCH_RUNNING,
+    BATCH_ABORTED,
+};
+
+typedef struct Batch {
+    T3DOptions options;
+    T3DAllocator allocator;
+
+    BatchItem *items;
+    unsigned int num_items;
+
+    T3DMutex mutex;
+    T3DCondition ready;
+    unsigned int next_read;
+    int state;  /* nothing's read until every stage is up and running */
+
+    Queue parse_queue;
+    Queue write_queue;
+} Batch;
+
+/**************************************************/
+
+static void *BatchMalloc(Batch *batch, size_t size) {
+    return (batch->allocator.malloc != NULL) ? batch->allocator.malloc(size, batch->allocator.user) : malloc(size);
+}
+
+static void *BatchRealloc(Batch *batch, void *ptr, size_t size) {
+    return (batch->allocator.realloc != NULL) ? batch->allocator.realloc(ptr, size, batch->allocator.user) :
+           realloc(ptr, size);
+}
+
+static void BatchFree(Batch *batch, void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+
+    if(batch->allocator.free != NULL) {
+        batch->allocator.free(ptr, batch->allocator.user);
+    } else {
+        free(ptr);
+    }
+}
+
+/* for anything that happens outside of a context, i.e. writing */
+static void BatchLog(Batch *batch, T3DLogLevel level, const char *format, ...) {
+    char message[1024];
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if(batch->options.log != NULL) {
+        batch->options.log(level, message, batch->options.log_user);
+    } else {
+        fputs(message, stderr);
+    }
+}
+
+/**************************************************/
+/* Queues */
+
+static void InitQueue(Queue *queue, unsigned int max_items, unsigned int num_producers) {
+    memset(queue, 0, sizeof(Queue));
+    queue->max_items = (max_items > MAX_BATCH_QUEUE) ? MAX_BATCH_QUEUE : (max_items > 0) ? max_items : 1;
+    queue->num_producers = num_producers;
+
+    t3dInitMutex(&queue->mutex);
+    t3dInitCondition(&queue->filled);
+    t3dInitCondition(&queue->emptied);
+}
+
+static void DestroyQueue(Queue *queue) {
+    t3dDestroyCondition(&queue->emptied);
+    t3dDestroyCondition(&queue->filled);
+    t3dDestroyMutex(&queue->mutex);
+}
+
+/* blocks for as long as the queue is full */
+static void PushQueue(Queue *queue, BatchItem *item) {
+    t3dLockMutex(&queue->mutex);
+    while(queue->num_items == queue->max_items) {
+        t3dWaitCondition(&queue->emptied, &queue->mutex);
+    }
+
+    queue->items[(queue->head + queue->num_items) % MAX_BATCH_QUEUE] = item;
+    queue->num_items++;
+
+    t3dSignalCondition(&queue->filled);
+    t3dUnlockMutex(&queue->mutex);
+}
+
+/* returns NULL once the queue is empty and everything feeding it is done,
+ * or straight away if it's empty and we're not to wait */
+static BatchItem *PopQueue(Queue *queue, bool wait) {
+    t3dLockMutex(&queue->mutex);
+    while(wait && queue->num_items == 0 && queue->num_producers > 0) {
+        t3dWaitCondition(&queue->filled, &queue->mutex);
+    }
+
+    BatchItem *item = NULL;
+    if(queue->num_items > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % MAX_BATCH_QUEUE;
+        queue->num_items--;
+        t3dSignalCondition(&queue->emptied);
+    }
+
+    t3dUnlockMutex(&queue->mutex);
+    return item;
+}
+
+/* called by each producer once it's done */
+static void FinishQueue(Queue *queue) {
+    t3dLockMutex(&queue->mutex);
+    if(--queue->num_producers == 0) {
+        t3dBroadcastCondition(&queue->filled);
+    }
+    t3dUnlockMutex(&queue->mutex);
+}
+
+/**************************************************/
+/* Reading */
+
+static BatchItem *GetNextRead(Batch *batch) {
+    t3dLockMutex(&batch->mutex);
+    while(batch->state == BATCH_STARTING) {
+        t3dWaitCondition(&batch->ready, &batch->mutex);
+    }
+
+    BatchItem *item = NULL;
+    if(batch->state == BATCH_RUNNING && batch->next_read < batch->num_items) {
+        item = &batch->items[batch->next_read++];
+    }
+    t3dUnlockMutex(&batch->mutex);
+    return item;
+}
+
+/* keeps room for the terminator */
+static bool AllocateInput(Batch *batch, BatchItem *item, size_t length) {
+    if((item->data = BatchMalloc(batch, length + 1)) == NULL) {
+        return false;
+    }
+
+    item->length = length;
+    item->max_length = length + 1;
+    return true;
+}
+
+static void DiscardData(Batch *batch, BatchItem *item) {
+    BatchFree(batch, item->data);
+    item->data = NULL;
+    item->length = 0;
+}
+
+/* anything that can't be read is handed on without any data, and the
+ * parser then gets to read it and report whatever's wrong with it */
+static void ReadThread(void *user) {
+    Batch *batch = (Batch *) user;
+
+    BatchItem *item;
+    while((item = GetNextRead(batch)) != NULL) {
+        FILE *fp = fopen(item->job->in_path, "rb");
+        if(fp != NULL) {
+            long length = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+            rewind(fp);
+
+            if(length >= 0 && AllocateInput(batch, item, (size_t) length)) {
+                if(fread(item->data, 1, item->length, fp) != item->length) {
+                    DiscardData(batch, item);
+                }
+            }
+            fclose(fp);
+        }
+
+        PushQueue(&batch->parse_queue, item);
+    }
+
+    FinishQueue(&batch->parse_queue);
+}
+
+#if defined(T3D_USE_URING)
+/* a signal shouldn't bring the whole stage down */
+static int WaitRing(struct io_uring *ring, struct io_uring_cqe **cqe) {
+    int result;
+    while((result = io_uring_wait_cqe(ring, cqe)) == -EINTR) {}
+    return result;
+}
+
+/* whatever each ring has been handed, so it can be failed if the ring stops working */
+typedef struct InFlight {
+    BatchItem *items[MAX_BATCH_QUEUE];
+    unsigned int num_items;
+} InFlight;
+
+static void RemoveInFlight(InFlight *in_flight, BatchItem *item) {
+    for(unsigned int i = 0; i < in_flight->num_items; ++i) {
+        if(in_flight->items[i] == item) {
+            in_flight->items[i] = in_flight->items[--in_flight->num_items];
+            return;
+        }
+    }
+}
+
+/* by now the ring's been torn down, so it's safe to let go of the data too */
+static void FailInFlight(Batch *batch, InFlight *in_flight, void (*fail)(Batch *batch, BatchItem *item)) {
+    for(unsigned int i = 0; i < in_flight->num_items; ++i) {
+        close(in_flight->items[i]->fd);
+        fail(batch, in_flight->items[i]);
+    }
+    in_flight->num_items = 0;
+}
+
+static bool SubmitRead(struct io_uring *ring, BatchItem *item) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    if(sqe == NULL) {
+        return false;
+    }
+
+    size_t length = item->length - item->done;
+    if(length > MAX_IO_SIZE) {
+        length = MAX_IO_SIZE;
+    }
+
+    io_uring_prep_read(sqe, item->fd, &item->data[item->done], (unsigned int) length, (__u64) item->done);
+    io_uring_sqe_set_data(sqe, item);
+    return true;
+}
+
+/* starts reading the next document, returns false if there's no more to read */
+static bool StartRead(Batch *batch, struct io_uring *ring, InFlight *in_flight) {
+    BatchItem *item = GetNextRead(batch);
+    if(item == NULL) {
+        return false;
+    }
+
+    item->done = 0;
+    if((item->fd = open(item->job->in_path, O_RDONLY)) >= 0) {
+        struct stat st;
+        if(fstat(item->fd, &st) == 0 && AllocateInput(batch, item, (size_t) st.st_size)) {
+            /* nothing to wait for */
+            if(item->length == 0) {
+                close(item->fd);
+                PushQueue(&batch->parse_queue, item);
+                return true;
+            }
+
+            if(SubmitRead(ring, item)) {
+                in_flight->items[in_flight->num_items++] = item;
+                return true;
+            }
+        }
+
+        close(item->fd);
+    }
+
+    DiscardData(batch, item);
+    PushQueue(&batch->parse_queue, item);
+    return true;
+}
+
+/* keeps up to the read ahead in flight at once, handing each over as it
+ * completes, returns false if the ring stopped working part way */
+static bool ReadRing(Batch *batch, struct io_uring *ring, InFlight *in_flight) {
+    bool more = true;
+    for(;;) {
+        while(more && in_flight->num_items < batch->parse_queue.max_items) {
+            more = StartRead(batch, ring, in_flight);
+        }
+
+        if(in_flight->num_items == 0) {
+            return true;
+        }
+
+        io_uring_submit(ring);
+
+        struct io_uring_cqe *cqe = NULL;
+        if(WaitRing(ring, &cqe) < 0) {
+            return false;
+        }
+
+        BatchItem *item = (BatchItem *) io_uring_cqe_get_data(cqe);
+        int result = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+
+        if(result > 0) {
+            item->done += (size_t) result;
+            if(item->done < item->length && SubmitRead(ring, item)) {
+                continue;
+            }
+        }
+
+        /* short of what fstat said, so something's gone wrong */
+        RemoveInFlight(in_flight, item);
+        close(item->fd);
+        if(item->done != item->length) {
+            DiscardData(batch, item);
+        }
+        PushQueue(&batch->parse_queue, item);
+    }
+}
+
+/* it's not known how much of it was read, so it's not handed on */
+static void FailRead(Batch *batch, BatchItem *item) {
+    item->job->error = T3D_ERROR_IO;
+    BatchLog(batch, T3D_LOG_ERROR, "error: failed to read \"%s\"!\n", item->job->in_path);
+    DiscardData(batch, item);
+}
+
+static void ReadRingThread(void *user) {
+    Batch *batch = (Batch *) user;
+
+    struct io_uring ring;
+    if(io_uring_queue_init(MAX_BATCH_QUEUE, &ring, 0) < 0) {
+        /* shouldn't happen as it's been checked already, but don't leave everything hanging */
+        ReadThread(user);
+        return;
+    }
+
+    InFlight in_flight = { .num_items = 0 };
+    bool failed = !ReadRing(batch, &ring, &in_flight);
+    io_uring_queue_exit(&ring);
+
+    if(failed) {
+        /* the rest is read without it, so everything still gets through */
+        FailInFlight(batch, &in_flight, FailRead);
+        ReadThread(user);
+        return;
+    }
+
+    FinishQueue(&batch->parse_queue);
+}
+#endif
+
+/**************************************************/
+/* Parsing */
+
+typedef struct MemorySink {
+    Batch *batch;
+    BatchItem *item;
+} MemorySink;
+
+static size_t WriteMemory(const void *data, size_t length, void *user) {
+    Batch *batch = ((MemorySink *) user)->batch;
+    BatchItem *item = ((MemorySink *) user)->item;
+
+    if(item->length + length > item->max_length) {
+        size_t max_length = item->max_length * 2;
+        if(max_length < item->length + length) {
+            max_length = item->length + length;
+        }
+
+        char *new_data = BatchRealloc(batch, item->data, max_length);
+        if(new_data == NULL) {
+            return 0;
+        }
+        item->data = new_data;
+        item->max_length = max_length;
+    }
+
+    memcpy(&item->data[item->length], data, length);
+    item->length += length;
+    return length;
+}
+
+/* returns true if the map's to be written out behind us */
+static bool ConvertItem(Batch *batch, T3DContext *ctx, BatchItem *item) {
+    T3DBatchJob *job = item->job;
+
+    /* whatever needs decoding along the way goes by the path, which reads it again */
+    size_t bom_length = 0;
+    bool direct = (item->data != NULL) &&
+                  t3dDetectEncoding(item->data, item->length, &bom_length) == T3D_ENCODING_UTF8 &&
+                  !(item->length >= 2 && (unsigned char) item->data[0] == 0x1F && (unsigned char) item->data[1] == 0x8B) &&
+                  !(item->length >= 4 && memcmp(item->data, "\x28\xB5\x2F\xFD", 4) == 0);
+
+    if(direct) {
+        t3dResetContext(ctx);
+        item->data[item->length] = '\0';
+        t3dParseBuffer(ctx, &item->data[bom_length], item->length - bom_length);
+    } else {
+        t3dParseFile(ctx, job->in_path);
+    }
+
+    T3DError error = t3dGetError(ctx);
+    if(error != T3D_ERROR_NONE) {
+        job->error = error;
+        DiscardData(batch, item);
+        return false;
+    }
+
+    job->num_brushes = t3dGetNumBrushes(ctx);
+    job->num_actors = t3dGetNumActors(ctx);
+
+    /* compressing is as much work as anything else here, so it may as well happen on this thread */
+    if(t3dGetCompression(job->out_path) != T3D_COMPRESSION_NONE) {
+        T3DOutput *output = t3dOpenOutput(ctx, job->out_path);
+        if(output != NULL) {
+            t3dWriteMap(ctx, t3dGetOutputSink(output));
+            t3dCloseOutput(output);
+        }
+        job->error = t3dGetError(ctx);
+        DiscardData(batch, item);
+        return false;
+    }
+
+    /* the document's needed up until the map is written, so goes afterwards */
+    BatchItem map;
+    memset(&map, 0, sizeof(BatchItem));
+    map.job = job;
+    map.max_length = (item->length / 2) + 1;
+    if((map.data = BatchMalloc(batch, map.max_length)) != NULL) {
+        MemorySink memory = { batch, &map };
+        T3DSink sink = { WriteMemory, &memory };
+        t3dWriteMap(ctx, &sink);
+    } else {
+        t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to allocate output for \"%s\"!\n", job->out_path);
+    }
+
+    DiscardData(batch, item);
+    *item = map;
+
+    if((job->error = t3dGetError(ctx)) != T3D_ERROR_NONE) {
+        DiscardData(batch, item);
+        return false;
+    }
+
+    return true;
+}
+
+static void ParseThread(void *user) {
+    Batch *batch = (Batch *) user;
+
+    /* hangs on to its allocations from one document to the next */
+    T3DContext *ctx = t3dCreateContext(&batch->options);
+
+    BatchItem *item;
+    while((item = PopQueue(&batch->parse_queue, true)) != NULL) {
+        if(ctx == NULL) {
+            item->job->error = T3D_ERROR_MEMORY;
+            DiscardData(batch, item);
+            continue;
+        }
+
+        if(ConvertItem(batch, ctx, item)) {
+            PushQueue(&batch->write_queue, item);
+        }
+    }
+
+    t3dDestroyContext(ctx);
+    FinishQueue(&batch->write_queue);
+}
+
+/**************************************************/
+/* Writing */
+
+static void FinishWrite(Batch *batch, BatchItem *item, bool written) {
+    if(!written) {
+        item->job->error = T3D_ERROR_IO;
+        BatchLog(batch, T3D_LOG_ERROR, "error: failed to write \"%s\"!\n", item->job->out_path);
+    }
+
+    DiscardData(batch, item);
+}
+
+static void WriteThread(void *user) {
+    Batch *batch = (Batch *) user;
+
+    BatchItem *item;
+    while((item = PopQueue(&batch->write_queue, true)) != NULL) {
+        FILE *fp = fopen(item->job->out_path, "wb");
+        bool written = (fp != NULL) && fwrite(item->data, 1, item->length, fp) == item->length;
+        if(fp != NULL && fclose(fp) != 0) {
+            written = false;
+        }
+
+        FinishWrite(batch, item, written);
+    }
+}
+
+#if defined(T3D_USE_URING)
+static bool SubmitWrite(struct io_uring *ring, BatchItem *item) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    if(sqe == NULL) {
+        return false;
+    }
+
+    size_t length = item->length - item->done;
+    if(length > MAX_IO_SIZE) {
+        length = MAX_IO_SIZE;
+    }
+
+    io_uring_prep_write(sqe, item->fd, &item->data[item->done], (unsigned int) length, (__u64) item->done);
+    io_uring_sqe_set_data(sqe, item);
+    return true;
+}
+
+static bool StartWrite(Batch *batch, struct io_uring *ring, BatchItem *item) {
+    item->done = 0;
+    if((item->fd = open(item->job->out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        FinishWrite(batch, item, false);
+        return false;
+    }
+
+    if(item->length == 0 || !SubmitWrite(ring, item)) {
+        FinishWrite(batch, item, (item->length == 0) && close(item->fd) == 0);
+        return false;
+    }
+
+    return true;
+}
+
+static bool IsQueueFinished(Queue *queue) {
+    t3dLockMutex(&queue->mutex);
+    bool finished = (queue->num_items == 0 && queue->num_producers == 0);
+    t3dUnlockMutex(&queue->mutex);
+    return finished;
+}
+
+/* waits on the queue only when there's nothing else in flight to wait on,
+ * returns false if the ring stopped working part way */
+static bool WriteRing(Batch *batch, struct io_uring *ring, InFlight *in_flight) {
+    for(;;) {
+        BatchItem *item;
+        while(in_flight->num_items < batch->write_queue.max_items &&
+              (item = PopQueue(&batch->write_queue, in_flight->num_items == 0)) != NULL) {
+            if(StartWrite(batch, ring, item)) {
+                in_flight->items[in_flight->num_items++] = item;
+            }
+        }
+
+        if(in_flight->num_items == 0) {
+            if(IsQueueFinished(&batch->write_queue)) {
+                return true;
+            }
+            continue;
+        }
+
+        io_uring_submit(ring);
+
+        struct io_uring_cqe *cqe = NULL;
+        if(WaitRing(ring, &cqe) < 0) {
+            return false;
+        }
+
+        item = (BatchItem *) io_uring_cqe_get_data(cqe);
+        int result = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+
+        if(result > 0) {
+            item->done += (size_t) result;
+            if(item->done < item->length && SubmitWrite(ring, item)) {
+                continue;
+            }
+        }
+
+        RemoveInFlight(in_flight, item);
+        bool written = (item->done == item->length);
+        if(close(item->fd) != 0) {
+            written = false;
+        }
+        FinishWrite(batch, item, written);
+    }
+}
+
+/* there's no telling how much of it made it out, so don't leave it looking finished */
+static void FailWrite(Batch *batch, BatchItem *item) {
+    remove(item->job->out_path);
+    FinishWrite(batch, item, false);
+}
+
+static void WriteRingThread(void *user) {
+    Batch *batch = (Batch *) user;
+
+    struct io_uring ring;
+    if(io_uring_queue_init(MAX_BATCH_QUEUE, &ring, 0) < 0) {
+        WriteThread(user);
+        return;
+    }
+
+    InFlight in_flight = { .num_items = 0 };
+    bool failed = !WriteRing(batch, &ring, &in_flight);
+    io_uring_queue_exit(&ring);
+
+    /* the queue still needs draining, otherwise the parsers back up behind it */
+    if(failed) {
+        FailInFlight(batch, &in_flight, FailWrite);
+        WriteThread(user);
+    }
+}
+
+/* it may well be built in but not allowed, i.e. within a container */
+static bool IsUringAvailable(void) {
+    struct io_uring ring;
+    if(io_uring_queue_init(1, &ring, 0) < 0) {
+        return false;
+    }
+
+    io_uring_queue_exit(&ring);
+    return true;
+}
+#endif
+
+/**************************************************/
+
+/* where it's not possible to get the stages going */
+static void ConvertSerially(Batch *batch) {
+    T3DContext *ctx = t3dCreateContext(&batch->options);
+    for(unsigned int i = 0; i < batch->num_items; ++i) {
+        T3DBatchJob *job = batch->items[i].job;
+        if(ctx == NULL) {
+            job->error = T3D_ERROR_MEMORY;
+            continue;
+        }
+
+        if(t3dParseFile(ctx, job->in_path) == T3D_ERROR_NONE) {
+            job->num_brushes = t3dGetNumBrushes(ctx);
+            job->num_actors = t3dGetNumActors(ctx);
+
+            T3DOutput *output = t3dOpenOutput(ctx, job->out_path);
+            if(output != NULL) {
+                t3dWriteMap(ctx, t3dGetOutputSink(output));
+                t3dCloseOutput(output);
+            }
+        }
+
+        job->error = t3dGetError(ctx);
+    }
+
+    t3dDestroyContext(ctx);
+}
+
+/* returns how many actually started */
+static unsigned int StartThreads(Batch *batch, T3DThread *threads, unsigned int num_threads, Queue *queue,
+                                 void (*function)(void *user)) {
+    unsigned int num_started = 0;
+    for(unsigned int i = 0; i < num_threads; ++i) {
+        if(t3dCreateThread(&threads[num_started], function, batch)) {
+            num_started++;
+        } else if(queue != NULL) {
+            FinishQueue(queue);
+        }
+    }
+
+    return num_started;
+}
+
+static void JoinThreads(T3DThread *threads, unsigned int num_threads) {
+    for(unsigned int i = 0; i < num_threads; ++i) {
+        t3dJoinThread(&threads[i]);
+    }
+}
+
+T3DError t3dConvertBatch(const T3DOptions *options, const T3DBatchOptions *batch_options, T3DBatchJob *jobs,
+                         unsigned int num_jobs) {
+    if(options == NULL || jobs == NULL) {
+        return T3D_ERROR_PARAMETER;
+    }
+
+    if(num_jobs == 0) {
+        return T3D_ERROR_NONE;
+    }
+
+    T3DBatchOptions defaults = { 0 };
+    if(batch_options == NULL) {
+        batch_options = &defaults;
+    }
+
+    Batch batch;
+    memset(&batch, 0, sizeof(Batch));
+    batch.options = *options;
+    /* there's no one document to report on, with several on the go at once */
+    batch.options.progress = NULL;
+    batch.allocator = options->allocator;
+    if(batch.allocator.malloc == NULL || batch.allocator.realloc == NULL || batch.allocator.free == NULL) {
+        memset(&batch.allocator, 0, sizeof(T3DAllocator));
+    }
+
+    unsigned int num_workers = batch_options->num_workers;
+    if(num_workers == 0) {
+        num_workers = t3dGetNumProcessors();
+    }
+    if(num_workers > num_jobs) {
+        num_workers = num_jobs;
+    }
+
+    batch.items = BatchMalloc(&batch, sizeof(BatchItem) * num_jobs);
+    T3DThread *workers = BatchMalloc(&batch, sizeof(T3DThread) * num_workers);
+    if(batch.items == NULL || workers == NULL) {
+        BatchFree(&batch, batch.items);
+        BatchFree(&batch, workers);
+        return T3D_ERROR_MEMORY;
+    }
+
+    memset(batch.items, 0, sizeof(BatchItem) * num_jobs);
+    batch.num_items = num_jobs;
+    for(unsigned int i = 0; i < num_jobs; ++i) {
+        jobs[i].error = T3D_ERROR_NONE;
+        jobs[i].num_brushes = 0;
+        jobs[i].num_actors = 0;
+        batch.items[i].job = &jobs[i];
+    }
+
+    unsigned int num_io_threads = NUM_IO_THREADS;
+    void (*read_function)(void *user) = ReadThread;
+    void (*write_function)(void *user) = WriteThread;
+#if defined(T3D_USE_URING)
+    if(IsUringAvailable()) {
+        num_io_threads = 1;
+        read_function = ReadRingThread;
+        write_function = WriteRingThread;
+    }
+#endif
+
+    t3dInitMutex(&batch.mutex);
+    t3dInitCondition(&batch.ready);
+    InitQueue(&batch.parse_queue, batch_options->read_ahead ? batch_options->read_ahead : DEFAULT_READ_AHEAD,
+              num_io_threads);
+    InitQueue(&batch.write_queue, batch_options->write_behind ? batch_options->write_behind : DEFAULT_WRITE_BEHIND,
+              num_workers);
+
+    T3DThread readers[NUM_IO_THREADS], writers[NUM_IO_THREADS];
+    unsigned int num_readers = StartThreads(&batch, readers, num_io_threads, &batch.parse_queue, read_function);
+    unsigned int num_parsers = StartThreads(&batch, workers, num_workers, &batch.write_queue, ParseThread);
+    unsigned int num_writers = StartThreads(&batch, writers, num_io_threads, NULL, write_function);
+
+    /* every stage needs something pulling on it, otherwise it's just going to back up */
+    t3dLockMutex(&batch.mutex);
+    batch.state = (num_readers > 0 && num_parsers > 0 && num_writers > 0) ? BATCH_RUNNING : BATCH_ABORTED;
+    t3dBroadcastCondition(&batch.ready);
+    t3dUnlockMutex(&batch.mutex);
+
+    JoinThreads(readers, num_readers);
+    JoinThreads(workers, num_parsers);
+    JoinThreads(writers, num_writers);
+
+    if(batch.state == BATCH_ABORTED) {
+        BatchLog(&batch, T3D_LOG_WARNING, "warning: failed to start batch threads, converting one at a time!\n");
+        ConvertSerially(&batch);
+    }
+
+    BatchFree(&batch, workers);
+
+    DestroyQueue(&batch.write_queue);
+    DestroyQueue(&batch.parse_queue);
+    t3dDestroyCondition(&batch.ready);
+    t3dDestroyMutex(&batch.mutex);
+
+    T3DError error = T3D_ERROR_NONE;
+    for(unsigned int i = 0; i < num_jobs && error == T3D_ERROR_NONE; ++i) {
+        error = jobs[i].error;
+    }
+
+    BatchFree(&batch, batch.items);
+
+    return error;
+}
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#elif defined(__aarch64__)
+#   include <arm_neon.h>
+#endif
+
+#include "t3d_private.h"
+
+/* Some versions of UnrealEd, and anything that went via the clipboard,
+ * write the T3D out as UTF-16 with a BOM. Everything past the loader
+ * expects single bytes, so it's turned into UTF-8 as it's read in, a
+ * chunk at a time, rather than loading it all and converting after. In
+ * practice it's nearly all ASCII, so runs of that are done 16 characters
+ * at a time where there's SIMD available. */
+
+#define DECODE_CHUNK_SIZE   (64 * 1024)
+
+T3DEncoding t3dDetectEncoding(const void *data, size_t length, size_t *bom_length) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    if(length >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        *bom_length = 3;
+        return T3D_ENCODING_UTF8;
+    } else if(length >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+        *bom_length = 2;
+        return T3D_ENCODING_UTF16LE;
+    } else if(length >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+        *bom_length = 2;
+        return T3D_ENCODING_UTF16BE;
+    }
+
+    *bom_length = 0;
+    return T3D_ENCODING_UTF8;
+}
+
+T3DEncoding t3dDetectFileEncoding(const char *path, size_t *bom_length) {
+    unsigned char bom[3];
+    size_t length = 0;
+
+    FILE *fp = fopen(path, "rb");
+    if(fp != NULL) {
+        length = fread(bom, 1, sizeof(bom), fp);
+        fclose(fp);
+    }
+
+    return t3dDetectEncoding(bom, length, bom_length);
+}
+
+const char *t3dGetEncodingName(T3DEncoding encoding) {
+    switch(encoding) {
+        default: return "UTF-8";
+        case T3D_ENCODING_UTF16LE: return "UTF-16LE";
+        case T3D_ENCODING_UTF16BE: return "UTF-16BE";
+    }
+}
+
+void t3dInitDecoder(T3DDecoder *decoder, T3DEncoding encoding) {
+    memset(decoder, 0, sizeof(T3DDecoder));
+    decoder->encoding = encoding;
+}
+
+/**************************************************/
+
+/* returns how much of the input made up the character, or 0 if there isn't enough of it yet */
+static size_t ReadUTF16(const unsigned char *in, size_t length, bool big_endian, uint32_t *c) {
+    if(length < 2) {
+        return 0;
+    }
+
+    uint32_t unit = big_endian ? (uint32_t) (in[0] << 8 | in[1]) : (uint32_t) (in[1] << 8 | in[0]);
+    if(unit >= 0xD800 && unit < 0xDC00) {
+        if(length < 4) {
+            return 0;
+        }
+
+        uint32_t low = big_endian ? (uint32_t) (in[2] << 8 | in[3]) : (uint32_t) (in[3] << 8 | in[2]);
+        if(low >= 0xDC00 && low < 0xE000) {
+            *c = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+            return 4;
+        }
+
+        /* unpaired, so just the one gets replaced */
+        *c = 0xFFFD;
+        return 2;
+    }
+
+    /* the parser treats a NUL as the end of the document */
+    if(unit == 0) {
+        unit = ' ';
+    } else if(unit >= 0xDC00 && unit < 0xE000) {
+        unit = 0xFFFD;
+    }
+
+    *c = unit;
+    return 2;
+}
+
+static unsigned int GetUTF8Length(uint32_t c) {
+    if(c < 0x80) return 1;
+    if(c < 0x800) return 2;
+    if(c < 0x10000) return 3;
+    return 4;
+}
+
+static void WriteUTF8(uint32_t c, unsigned int length, char *out) {
+    unsigned char *bytes = (unsigned char *) out;
+    switch(length) {
+        case 1:
+            bytes[0] = (unsigned char) c;
+            break;
+        case 2:
+            bytes[0] = (unsigned char) (0xC0 | (c >> 6));
+            bytes[1] = (unsigned char) (0x80 | (c & 0x3F));
+            break;
+        case 3:
+            bytes[0] = (unsigned char) (0xE0 | (c >> 12));
+            bytes[1] = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+            bytes[2] = (unsigned char) (0x80 | (c & 0x3F));
+            break;
+        default:
+            bytes[0] = (unsigned char) (0xF0 | (c >> 18));
+            bytes[1] = (unsigned char) (0x80 | ((c >> 12) & 0x3F));
+            bytes[2] = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+            bytes[3] = (unsigned char) (0x80 | (c & 0x3F));
+            break;
+    }
+}
+
+/* narrows down runs of ASCII 16 characters at a time, stopping at the first block that isn't,
+ * or that has a NUL in it, as those are left for ReadUTF16 to deal with */
+static size_t DecodeASCII(const unsigned char *in, size_t length, bool big_endian, char *out, size_t size,
+                          size_t *written) {
+    size_t pos = 0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16((short) 0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    for(; length - pos >= 32 && size - *written >= 16; pos += 32, *written += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &in[pos]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &in[pos + 16]);
+        if(big_endian) {
+            a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+            b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+        }
+
+        __m128i high = _mm_and_si128(_mm_or_si128(a, b), mask);
+        __m128i nul = _mm_or_si128(_mm_cmpeq_epi16(a, zero), _mm_cmpeq_epi16(b, zero));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF || _mm_movemask_epi8(nul) != 0) {
+            break;
+        }
+
+        _mm_storeu_si128((__m128i *) &out[*written], _mm_packus_epi16(a, b));
+    }
+#elif defined(__aarch64__)
+    for(; length - pos >= 32 && size - *written >= 16; pos += 32, *written += 16) {
+        uint8x16_t a = vld1q_u8(&in[pos]);
+        uint8x16_t b = vld1q_u8(&in[pos + 16]);
+        if(big_endian) {
+            a = vrev16q_u8(a);
+            b = vrev16q_u8(b);
+        }
+
+        uint16x8_t wa = vreinterpretq_u16_u8(a), wb = vreinterpretq_u16_u8(b);
+        if(vmaxvq_u16(vorrq_u16(wa, wb)) >= 0x80 || vminvq_u16(vminq_u16(wa, wb)) == 0) {
+            break;
+        }
+
+        vst1q_u8((uint8_t *) &out[*written], vcombine_u8(vmovn_u16(wa), vmovn_u16(wb)));
+    }
+#endif
+    return pos;
+}
+
+static size_t DecodeUTF16(T3DDecoder *decoder, const unsigned char *in, size_t length, char *out, size_t size,
+                          size_t *written) {
+    bool big_endian = (decoder->encoding == T3D_ENCODING_UTF16BE);
+
+    /* finish off whatever was left hanging at the end of the last lot first */
+    size_t pos = 0;
+    while(decoder->num_pending > 0) {
+        uint32_t c;
+        size_t used = ReadUTF16(decoder->pending, decoder->num_pending, big_endian, &c);
+        if(used == 0) {
+            if(pos == length) {
+                return pos;
+            }
+            decoder->pending[decoder->num_pending++] = in[pos++];
+            continue;
+        }
+
+        unsigned int num_bytes = GetUTF8Length(c);
+        if(size - *written < num_bytes) {
+            return pos;
+        }
+        WriteUTF8(c, num_bytes, &out[*written]);
+        *written += num_bytes;
+
+        decoder->num_pending -= (unsigned int) used;
+        memmove(decoder->pending, &decoder->pending[used], decoder->num_pending);
+    }
+
+    while(pos < length) {
+        pos += DecodeASCII(&in[pos], length - pos, big_endian, out, size, written);
+
+        /* a few at a time before trying again, so the odd non-ASCII character doesn't cost much */
+        for(unsigned int i = 0; i < 16 && pos < length; ++i) {
+            uint32_t c;
+            size_t used = ReadUTF16(&in[pos], length - pos, big_endian, &c);
+            if(used == 0) {
+                decoder->num_pending = (unsigned int) (length - pos);
+                memcpy(decoder->pending, &in[pos], decoder->num_pending);
+                return length;
+            }
+
+            unsigned int num_bytes = GetUTF8Length(c);
+            if(size - *written < num_bytes) {
+                return pos;
+            }
+            WriteUTF8(c, num_bytes, &out[*written]);
+            *written += num_bytes;
+            pos += used;
+        }
+
+        if(size - *written < 4) {
+            break;
+        }
+    }
+
+    return pos;
+}
+
+/* Decodes as much of the input as there's room for, returning how much of
+ * it was used up; written is advanced by however much went into out. A
+ * character split across the end of the input is kept for the next call. */
+size_t t3dDecodeText(T3DDecoder *decoder, const void *data, size_t length, char *out, size_t size, size_t *written) {
+    const unsigned char *in = (const unsigned char *) data;
+    if(decoder->encoding == T3D_ENCODING_UTF16LE || decoder->encoding == T3D_ENCODING_UTF16BE) {
+        return DecodeUTF16(decoder, in, length, out, size, written);
+    }
+
+    size_t num_bytes = size - *written;
+    if(num_bytes > length) {
+        num_bytes = length;
+    }
+    memcpy(&out[*written], in, num_bytes);
+    *written += num_bytes;
+    return num_bytes;
+}
+
+/* Decodes data onto the end of buf, growing it as needed, and always
+ * leaving room for the terminator. */
+bool t3dAppendText(T3DContext *ctx, T3DDecoder *decoder, const void *data, size_t length, char **buf,
+                   size_t *buf_length, size_t *max_length) {
+    const char *in = (const char *) data;
+    for(;;) {
+        size_t used = t3dDecodeText(decoder, in, length, *buf, *max_length - 1, buf_length);
+        in += used;
+        length -= used;
+        if(length == 0) {
+            return true;
+        }
+
+        size_t new_length = *max_length * 2;
+        char *new_buf = t3dReallocTag(ctx, *buf, new_length, T3D_MEMORY_INPUT);
+        if(new_buf == NULL) {
+            return false;
+        }
+        *buf = new_buf;
+        *max_length = new_length;
+    }
+}
+
+/* for anything that isn't UTF-8, so it never has to be held in memory as it was */
+char *t3dLoadEncodedFile(T3DContext *ctx, const char *path, T3DEncoding encoding, size_t *length) {
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        t3dSetError(ctx, T3D_ERROR_IO, "failed to read \"%s\", aborting!\n", path);
+        return NULL;
+    }
+
+    long file_length = 0;
+    if(fseek(fp, 0, SEEK_END) == 0) {
+        file_length = ftell(fp);
+    }
+    rewind(fp);
+
+    /* going by it being mostly ASCII, so half the size */
+    size_t max_length = (file_length > 0 ? (size_t) file_length / 2 : 0) + 64;
+    unsigned char *chunk = t3dMallocTag(ctx, DECODE_CHUNK_SIZE, T3D_MEMORY_STREAM);
+    char *buf = t3dMallocTag(ctx, max_length, T3D_MEMORY_INPUT);
+
+    T3DDecoder decoder;
+    t3dInitDecoder(&decoder, encoding);
+
+    *length = 0;
+    bool bom = true;
+    size_t read;
+    while(chunk != NULL && buf != NULL && (read = fread(chunk, 1, DECODE_CHUNK_SIZE, fp)) > 0) {
+        size_t bom_length = 0;
+        if(bom) {
+            t3dDetectEncoding(chunk, read, &bom_length);
+            bom = false;
+        }
+
+        if(!t3dAppendText(ctx, &decoder, &chunk[bom_length], read - bom_length, &buf, length, &max_length)) {
+            break;
+        }
+    }
+
+    if(ferror(fp)) {
+        t3dSetError(ctx, T3D_ERROR_IO, "failed to read \"%s\", aborting!\n", path);
+    } else if(decoder.num_pending > 0) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: T3D ends part way through a character!\n");
+    }
+
+    fclose(fp);
+    t3dFree(ctx, chunk);
+
+    if(ctx->error != T3D_ERROR_NONE) {
+        t3dFree(ctx, buf);
+        return NULL;
+    }
+
+    buf[*length] = '\0';
+    return buf;
+}
@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "t3d_private.h"
+
+/* Each of the output formats, written out piece by piece as the writer
+ * walks over the document, so nothing is ever built up in memory first.
+ * The layout is always the same, the world and its brushes followed by
+ * every other entity, it's just the syntax that changes. */
+
+/**************************************************/
+
+static void GetMapAxis(const PLVector3 *axis, double *out) {
+    out[0] = axis->y;
+    out[1] = axis->x;
+    out[2] = axis->z;
+}
+
+static double GetLength(const double *v) {
+    return sqrt(t3dDotProduct(v, v));
+}
+
+typedef struct TextureAxes {
+    double u[3], v[3];
+    double u_shift, v_shift;
+    double u_scale, v_scale;
+} TextureAxes;
+
+/* unreal projects with (point - origin) | axis, where the axis length is texels per unit */
+static void GetTextureAxes(const T3DBrush *brush, const T3DPolygon *face, double points[3][3], TextureAxes *axes) {
+    double origin[3];
+    t3dGetMapPoint(&face->origin, &brush->location, origin);
+    GetMapAxis(&face->u, axes->u);
+    GetMapAxis(&face->v, axes->v);
+
+    double u_length = GetLength(axes->u);
+    double v_length = GetLength(axes->v);
+    if(u_length > 0.0 && v_length > 0.0) {
+        axes->u_shift = -t3dDotProduct(origin, axes->u);
+        axes->v_shift = -t3dDotProduct(origin, axes->v);
+        axes->u_scale = 1.0 / u_length;
+        axes->v_scale = 1.0 / v_length;
+        for(unsigned int i = 0; i < 3; ++i) {
+            /* adding zero gets rid of any -0 */
+            axes->u[i] = axes->u[i] / u_length + 0.0;
+            axes->v[i] = axes->v[i] / v_length + 0.0;
+        }
+        axes->u_shift += 0.0;
+        axes->v_shift += 0.0;
+        return;
+    }
+
+    /* nothing to go on, so fall back to projecting along the closest axis like quake does */
+    double normal[3];
+    t3dGetNormal(points[0], points[1], points[2], normal);
+    t3dGetBaseTextureAxes(normal, axes->u, axes->v);
+    axes->u_shift = axes->v_shift = 0.0;
+    axes->u_scale = axes->v_scale = 1.0;
+}
+
+#define WriteHeader()       t3dWriterPrintf(writer, "// generated with t3d2map v" T3D_VERSION "\n")
+#define WriteField(a, b)    t3dWriterPrintf(writer, "%s\"%s\" \"%s\"\n", writer->format->indent, (a), (b))
+
+/**************************************************/
+/* Quake, Quake 2 */
+
+static void IDT2_BeginMap(T3DWriter *writer) {
+    t3dWriterPrintf(writer, "//\n");
+    WriteHeader();
+    t3dWriterPrintf(writer, "//\n");
+
+    t3dWriterPrintf(writer, "{\n");
+    WriteField("classname", "worldspawn");
+    WriteField("wad", "/gfx/base.wad");
+    WriteField("worldtype", "0");
+}
+
+static void IDT2_BeginBrush(T3DWriter *writer, unsigned int index) {
+    t3dWriterPrintf(writer, "// brush %u\n", index);
+}
+
+static void IDT2_WriteBrush(T3DWriter *writer, const T3DBrush *brush) {
+    t3dWriterPrintf(writer, "{\n");
+
+    for(unsigned int i = 0; i < brush->num_poly; ++i) {
+        const T3DPolygon *face = &brush->poly_list[i];
+
+        double p[3][3];
+        t3dGetFacePoints(brush, face, p);
+        t3dWriterPrintf(writer, "( %d %d %d ) ( %d %d %d ) ( %d %d %d ) %s 0 0 0 1 1\n",
+                        (int) p[0][0], (int) p[0][1], (int) p[0][2],
+                        (int) p[1][0], (int) p[1][1], (int) p[1][2],
+                        (int) p[2][0], (int) p[2][1], (int) p[2][2],
+                        face->texture);
+    }
+
+    t3dWriterPrintf(writer, "}\n");
+}
+
+static void IDT2_EndWorld(T3DWriter *writer) {
+    t3dWriterPrintf(writer, "}\n");
+}
+
+/* same as trenchbroom, which the compilers merge back into the world */
+static void IDT2_BeginGroup(T3DWriter *writer, unsigned int group) {
+    t3dWriterPrintf(writer, "{\n");
+    WriteField("classname", "func_group");
+    WriteField("_tb_type", "_tb_group");
+    WriteField("_tb_name", t3dGetGroupName(writer->ctx, group));
+    t3dWriterPrintf(writer, "%s\"_tb_id\" \"%u\"\n", writer->format->indent, group);
+}
+
+static void IDT2_BeginEntity(T3DWriter *writer) {
+    t3dWriterPrintf(writer, "{\n");
+}
+
+static void IDT2_EndEntity(T3DWriter *writer) {
+    t3dWriterPrintf(writer, "}\n");
+}
+
+static void IDT2_WriteLight(T3DWriter *writer, unsigned char r, unsigned char g, unsigned char b) {
+    t3dWriterPrintf(writer, "\"light\" \"%d %d %d\"\n", r, g, b);
+}
+
+static void IDT2_EndMap(T3DWriter *writer) {
+    (void)(writer);
+}
+
+/**************************************************/
+/* Quake 3 */
+
+static void IDT3_BeginMap(T3DWriter *writer) {
+    WriteHeader();
+    t3dWriterPrintf(writer, "// entity 0\n");
+    t3dWriterPrintf(writer, "{\n");
+    WriteField("classname", "worldspawn");
+}
+
+static void IDT3_WriteBrush(T3DWriter *writer, const T3DBrush *brush) {
+    t3dWriterPrintf(writer, "{\n");
+
+    for(unsigned int i = 0; i < brush->num_poly; ++i) {
+        const T3DPolygon *face = &brush->poly_list[i];
+
+        double p[3][3];
+        t3dGetFacePoints(brush, face, p);
+        t3dWriterPrintf(writer, "( %d %d %d ) ( %d %d %d ) ( %d %d %d ) %s 0 0 0 0.5 0.5 0 0 0\n",
+                        (int) p[0][0], (int) p[0][1], (int) p[0][2],
+                        (int) p[1][0], (int) p[1][1], (int) p[1][2],
+                        (int) p[2][0], (int) p[2][1], (int) p[2][2],
+                        face->texture);
+    }
+
+    t3dWriterPrintf(writer, "}\n");
+}
+
+/* shared with doom 3, which also wants the colour normalised */
+static void IDT3_WriteLight(T3DWriter *writer, unsigned char r, unsigned char g, unsigned char b) {
+    t3dWriterPrintf(writer, "%s\"_color\" \"%g %g %g\"\n", writer->format->indent,
+                    r / 255.0, g / 255.0, b / 255.0);
+}
+
+/**************************************************/
+/* Doom 3 */
+
+static void IDT4_BeginMap(T3DWriter *writer) {
+    t3dWriterPrintf(writer, "Version 2\n");
+    WriteHeader();
+    t3dWriterPrintf(writer, "// entity 0\n");
+    t3dWriterPrintf(writer, "{\n");
+    WriteField("classname", "worldspawn");
+}
+
+static void IDT4_BeginBrush(T3DWriter *writer, unsigned int index) {
+    t3dWriterPrintf(writer, "// primitive %u\n", index);
+}
+
+/* there's no func_group to be had here, so they just stay together in the world */
+static void IDT4_BeginGroup(T3DWriter *writer, unsigned int group) {
+    t3dWriterPrintf(writer, "// group %u \"%s\"\n", group, t3dGetGroupName(writer->ctx, group));
+}
+
+static void IDT4_EndGroup(T3DWriter *writer) {
+    (void)(writer);
+}
+
+/* brushDef3 has the planes spelled out, rather than the points they go through */
+static void IDT4_WriteBrush(T3DWriter *writer, const T3DBrush *brush) {
+    t3dWriterPrintf(writer, "{\n brushDef3\n {\n");
+
+    for(unsigned int i = 0; i < brush->num_poly; ++i) {
+        const T3DPolygon *face = &brush->poly_list[i];
+
+        double p[3][3], normal[3];
+        t3dGetFacePoints(brush, face, p);
+        t3dGetNormal(p[0], p[1], p[2], normal);
+
+        /* adding zero gets rid of any -0 */
+        double plane[4] = { normal[0] + 0.0, normal[1] + 0.0, normal[2] + 0.0, -t3dDotProduct(normal, p[1]) + 0.0 };
+
+        t3dWriterPrintf(writer, "  ( %g %g %g %g ) ( ( 0.0078125 0 0 ) ( 0 0.0078125 0 ) ) \"textures/%s\" 0 0 0\n",
+                        plane[0], plane[1], plane[2], plane[3], face->texture);
+    }
+
+    t3dWriterPrintf(writer, " }\n}\n");
+}
+
+/**************************************************/
+/* Half-Life */
+
+static void GSRC_BeginMap(T3DWriter *writer) {
+    t3dWriterPrintf(writer, "//\n");
+    WriteHeader();
+    t3dWriterPrintf(writer, "//\n");
+
+    t3dWriterPrintf(writer, "{\n");
+    WriteField("classname", "worldspawn");
+    WriteField("mapversion", "220");
+    WriteField("wad", "");
+}
+
+/* valve 220 carries the texture axes on each face, so alignment survives */
+static void GSRC_WriteBrush(T3DWriter *writer, const T3DBrush *brush) {
+    t3dWriterPrintf(writer, "{\n");
+
+    for(unsigned int i = 0; i < brush->num_poly; ++i) {
+        const T3DPolygon *face = &brush->poly_list[i];
+
+        double p[3][3];
+        t3dGetFacePoints(brush, face, p);
+
+        TextureAxes axes;
+        GetTextureAxes(brush, face, p, &axes);
+
+        t3dWriterPrintf(writer, "( %d %d %d ) ( %d %d %d ) ( %d %d %d ) %s "
+                                "[ %g %g %g %g ] [ %g %g %g %g ] 0 %g %g\n",
+                        (int) p[0][0], (int) p[0][1], (int) p[0][2],
+                        (int) p[1][0], (int) p[1][1], (int) p[1][2],
+                        (int) p[2][0], (int) p[2][1], (int) p[2][2],
+                        face->texture,
+                        axes.u[0], axes.u[1], axes.u[2], axes.u_shift,
+                        axes.v[0], axes.v[1], axes.v[2], axes.v_shift,
+                        axes.u_scale, axes.v_scale);
+    }
+
+    t3dWriterPrintf(writer, "}\n");
+}
+
+/* shared with source */
+static void GSRC_WriteLight(T3DWriter *writer, unsigned char r, unsigned char g, unsigned char b) {
+    t3dWriterPrintf(writer, "%s\"_light\" \"%d %d %d 200\"\n", writer->format->indent, r, g, b);
+}
+
+/**************************************************/
+/* Half-Life 2 */
+
+/* anything, so long as it's bright and the same each time */
+static void GetGroupColour(const T3DContext *ctx, unsigned int group, unsigned char *colour) {
+    uint32_t hash = ctx->groups[group].hash;
+    for(unsigned int i = 0; i < 3; ++i) {
+        colour[i] = (unsigned char) (96 + ((hash >> (i * 8)) & 0x9F));
+    }
+}
+
+static void SRC_BeginMap(T3DWriter *writer) {
+    t3dWriterPrintf(writer, "versioninfo\n{\n");
+    t3dWriterPrintf(writer, "\t\"editorversion\" \"400\"\n");
+    t3dWriterPrintf(writer, "\t\"editorbuild\" \"0\"\n");
+    t3dWriterPrintf(writer, "\t\"mapversion\" \"1\"\n");
+    t3dWriterPrintf(writer, "\t\"formatversion\" \"100\"\n");
+    t3dWriterPrintf(writer, "\t\"prefab\" \"0\"\n");
+    t3dWriterPrintf(writer, "}\n");
+
+    /* each group gets a visgroup, which the brushes are then tagged with */
+    T3DContext *ctx = writer->ctx;
+    if(ctx->options.groups && t3dGetNumGroups(ctx) > 1) {
+        t3dWriterPrintf(writer, "visgroups\n{\n");
+        for(unsigned int i = 1; i < t3dGetNumGroups(ctx); ++i) {
+            unsigned char colour[3];
+            GetGroupColour(ctx, i, colour);
+            t3dWriterPrintf(writer, "\tvisgroup\n\t{\n");
+            t3dWriterPrintf(writer, "\t\t\"name\" \"%s\"\n", t3dGetGroupName(ctx, i));
+            t3dWriterPrintf(writer, "\t\t\"visgroupid\" \"%u\"\n", i);
+            t3dWriterPrintf(writer, "\t\t\"color\" \"%d %d %d\"\n", colour[0], colour[1], colour[2]);
+            t3dWriterPrintf(writer, "\t}\n");
+        }
+        t3dWriterPrintf(writer, "}\n");
+    }
+
+    t3dWriterPrintf(writer, "world\n{\n");
+    t3dWriteId(writer, "\t");
+    WriteField("mapversion", "1");
+    WriteField("classname", "worldspawn");
+    WriteField("comment", "generated with t3d2map v" T3D_VERSION);
+}
+
+static void SRC_BeginBrush(T3DWriter *writer, unsigned int index) {
+    (void)(writer);
+    (void)(index);
+}
+
+static void SRC_WriteBrush(T3DWriter *writer, const T3DBrush *brush) {
+    t3dWriterPrintf(writer, "\tsolid\n\t{\n");
+    t3dWriteId(writer, "\t\t");
+
+    for(unsigned int i = 0; i < brush->num_poly; ++i) {
+        const T3DPolygon *face = &brush->poly_list[i];
+
+        double p[3][3];
+        t3dGetFacePoints(brush, face, p);
+
+        TextureAxes axes;
+        GetTextureAxes(brush, face, p, &axes);
+
+        t3dWriterPrintf(writer, "\t\tside\n\t\t{\n");
+        t3dWriteId(writer, "\t\t\t");
+        t3dWriterPrintf(writer, "\t\t\t\"plane\" \"(%d %d %d) (%d %d %d) (%d %d %d)\"\n",
+                        (int) p[0][0], (int) p[0][1], (int) p[0][2],
+                        (int) p[1][0], (int) p[1][1], (int) p[1][2],
+                        (int) p[2][0], (int) p[2][1], (int) p[2][2]);
+        t3dWriterPrintf(writer, "\t\t\t\"material\" \"%s\"\n", face->texture);
+        t3dWriterPrintf(writer, "\t\t\t\"uaxis\" \"[%g %g %g %g] %g\"\n",
+                        axes.u[0], axes.u[1], axes.u[2], axes.u_shift, axes.u_scale);
+        t3dWriterPrintf(writer, "\t\t\t\"vaxis\" \"[%g %g %g %g] %g\"\n",
+                        axes.v[0], axes.v[1], axes.v[2], axes.v_shift, axes.v_scale);
+        t3dWriterPrintf(writer, "\t\t\t\"rotation\" \"0\"\n");
+        t3dWriterPrintf(writer, "\t\t\t\"lightmapscale\" \"16\"\n");
+        t3dWriterPrintf(writer, "\t\t\t\"smoothing_groups\" \"0\"\n");
+        t3dWriterPrintf(writer, "\t\t}\n");
+    }
+
+    if(writer->ctx->options.groups && brush->group != 0) {
+        unsigned char colour[3];
+        GetGroupColour(writer->ctx, brush->group, colour);
+        t3dWriterPrintf(writer, "\t\teditor\n\t\t{\n");
+        t3dWriterPrintf(writer, "\t\t\t\"color\" \"%d %d %d\"\n", colour[0], colour[1], colour[2]);
+        if(writer->defer_ids) {
+            t3dWriterPrintf(writer, "\t\t\t\"visgroupid\" \"%c\"\n", T3D_DEFERRED_GROUP);
+        } else {
+            t3dWriterPrintf(writer, "\t\t\t\"visgroupid\" \"%u\"\n", brush->group);
+        }
+        t3dWriterPrintf(writer, "\t\t\t\"visgroupshown\" \"1\"\n");
+        t3dWriterPrintf(writer, "\t\t\t\"visgroupautoshown\" \"1\"\n");
+        t3dWriterPrintf(writer, "\t\t}\n");
+    }
+
+    t3dWriterPrintf(writer, "\t}\n");
+}
+
+static void SRC_BeginGroup(T3DWriter *writer, unsigned int group) {
+    (void)(writer);
+    (void)(group);
+}
+
+static void SRC_BeginEntity(T3DWriter *writer) {
+    t3dWriterPrintf(writer, "entity\n{\n");
+    t3dWriteId(writer, "\t");
+}
+
+/**************************************************/
+
+static const T3DFormat formats[MAX_MAP_FORMATS] = {
+        [MAP_FORMAT_IDT2] = {
+                .begin_map    = IDT2_BeginMap,
+                .begin_brush  = IDT2_BeginBrush,
+                .write_brush  = IDT2_WriteBrush,
+                .end_world    = IDT2_EndWorld,
+                .begin_group  = IDT2_BeginGroup,
+                .end_group    = IDT2_EndEntity,
+                .begin_entity = IDT2_BeginEntity,
+                .write_light  = IDT2_WriteLight,
+                .end_entity   = IDT2_EndEntity,
+                .end_map      = IDT2_EndMap,
+                .indent       = "",
+                .group_entities = true,
+        },
+        [MAP_FORMAT_IDT3] = {
+                .begin_map    = IDT3_BeginMap,
+                .begin_brush  = IDT2_BeginBrush,
+                .write_brush  = IDT3_WriteBrush,
+                .end_world    = IDT2_EndWorld,
+                .begin_group  = IDT2_BeginGroup,
+                .end_group    = IDT2_EndEntity,
+                .begin_entity = IDT2_BeginEntity,
+                .write_light  = IDT3_WriteLight,
+                .end_entity   = IDT2_EndEntity,
+                .end_map      = IDT2_EndMap,
+                .indent       = "",
+                .group_entities = true,
+        },
+        [MAP_FORMAT_IDT4] = {
+                .begin_map    = IDT4_BeginMap,
+                .begin_brush  = IDT4_BeginBrush,
+                .write_brush  = IDT4_WriteBrush,
+                .end_world    = IDT2_EndWorld,
+                .begin_group  = IDT4_BeginGroup,
+                .end_group    = IDT4_EndGroup,
+                .begin_entity = IDT2_BeginEntity,
+                .write_light  = IDT3_WriteLight,
+                .end_entity   = IDT2_EndEntity,
+                .end_map      = IDT2_EndMap,
+                .indent       = "",
+        },
+        [MAP_FORMAT_GSRC] = {
+                .begin_map    = GSRC_BeginMap,
+                .begin_brush  = IDT2_BeginBrush,
+                .write_brush  = GSRC_WriteBrush,
+                .end_world    = IDT2_EndWorld,
+                .begin_group  = IDT2_BeginGroup,
+                .end_group    = IDT2_EndEntity,
+                .begin_entity = IDT2_BeginEntity,
+                .write_light  = GSRC_WriteLight,
+                .end_entity   = IDT2_EndEntity,
+                .end_map      = IDT2_EndMap,
+                .indent       = "",
+                .group_entities = true,
+        },
+        [MAP_FORMAT_SRC] = {
+                .begin_map    = SRC_BeginMap,
+                .begin_brush  = SRC_BeginBrush,
+                .write_brush  = SRC_WriteBrush,
+                .end_world    = IDT2_EndWorld,
+                .begin_group  = SRC_BeginGroup,
+                .end_group    = IDT4_EndGroup,
+                .begin_entity = SRC_BeginEntity,
+                .write_light  = GSRC_WriteLight,
+                .end_entity   = IDT2_EndEntity,
+                .end_map      = IDT2_EndMap,
+                .indent       = "\t",
+                .uses_ids     = true,
+        },
+};
+
+const T3DFormat *t3dGetFormat(unsigned int format) {
+    if(format >= MAX_MAP_FORMATS) {
+        format = MAP_FORMAT_IDT2;
+    }
+
+    return &formats[format];
+}
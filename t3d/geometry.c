@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "t3d_private.h"
+
+/**************************************************/
+
+/* unreal's x and y are swapped over to get to the map's space */
+void t3dGetMapPoint(const PLVector3 *point, const PLVector3 *offset, double *out) {
+    out[0] = point->y + offset->y;
+    out[1] = point->x + offset->x;
+    out[2] = point->z + offset->z;
+}
+
+double t3dDotProduct(const double *a, const double *b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/* normal is in the same winding as qbsp expects, i.e. facing out of the brush; returns the length before normalising */
+double t3dGetNormal(const double *p0, const double *p1, const double *p2, double *normal) {
+    double a[3] = { p0[0] - p1[0], p0[1] - p1[1], p0[2] - p1[2] };
+    double b[3] = { p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2] };
+    normal[0] = a[1] * b[2] - a[2] * b[1];
+    normal[1] = a[2] * b[0] - a[0] * b[2];
+    normal[2] = a[0] * b[1] - a[1] * b[0];
+
+    double length = sqrt(t3dDotProduct(normal, normal));
+    if(length > 0.0) {
+        normal[0] /= length;
+        normal[1] /= length;
+        normal[2] /= length;
+    }
+    return length;
+}
+
+/* picks the first three points on the face that actually describe a plane */
+void t3dGetFacePoints(const T3DBrush *brush, const T3DPolygon *face, double points[3][3]) {
+    t3dGetMapPoint(&face->vertices[0], &brush->location, points[0]);
+    t3dGetMapPoint(&face->vertices[1], &brush->location, points[1]);
+    t3dGetMapPoint(&face->vertices[2], &brush->location, points[2]);
+
+    double normal[3];
+    if(t3dGetNormal(points[0], points[1], points[2], normal) > 0.0) {
+        return;
+    }
+
+    for(unsigned int i = 2; i + 1 < face->num_vertices; ++i) {
+        t3dGetMapPoint(&face->vertices[i], &brush->location, points[1]);
+        t3dGetMapPoint(&face->vertices[i + 1], &brush->location, points[2]);
+        if(t3dGetNormal(points[0], points[1], points[2], normal) > 0.0) {
+            return;
+        }
+    }
+
+    /* nothing better, so leave it for the compiler to complain about */
+    t3dGetMapPoint(&face->vertices[1], &brush->location, points[1]);
+    t3dGetMapPoint(&face->vertices[2], &brush->location, points[2]);
+}
+
+/* returns false if there's nothing to it */
+bool t3dGetBrushBounds(const T3DBrush *brush, double *mins, double *maxs) {
+    bool valid = false;
+    for(unsigned int i = 0; i < brush->num_poly; ++i) {
+        const T3DPolygon *face = &brush->poly_list[i];
+        for(unsigned int j = 0; j < face->num_vertices; ++j) {
+            double point[3];
+            t3dGetMapPoint(&face->vertices[j], &brush->location, point);
+            for(unsigned int k = 0; k < 3; ++k) {
+                if(!valid || point[k] < mins[k]) mins[k] = point[k];
+                if(!valid || point[k] > maxs[k]) maxs[k] = point[k];
+            }
+            valid = true;
+        }
+    }
+    return valid;
+}
+
+/* middle of the brush's bounds, used for putting brushes in order */
+void t3dGetBrushCentre(const T3DBrush *brush, double *centre) {
+    double mins[3], maxs[3];
+    if(!t3dGetBrushBounds(brush, mins, maxs)) {
+        centre[0] = centre[1] = centre[2] = 0.0;
+        return;
+    }
+
+    for(unsigned int i = 0; i < 3; ++i) {
+        centre[i] = (mins[i] + maxs[i]) * 0.5;
+    }
+}
+
+void t3dGetActorCentre(const T3DContext *ctx, const T3DActor *actor, double *centre) {
+    static const PLVector3 origin = { 0, 0, 0 };
+    PLVector3 location = { 0, 0, 0 };
+    t3dGetActorVector(ctx, actor, "Location", &location);
+    t3dGetMapPoint(&location, &origin, centre);
+}
+
+/* the axes quake projects textures along, going by whichever is closest to the face */
+void t3dGetBaseTextureAxes(const double *normal, double *u, double *v) {
+    static const double base_axes[6][3][3] = {
+            { {  0, 0,  1 }, { 1, 0, 0 }, { 0, -1,  0 } },
+            { {  0, 0, -1 }, { 1, 0, 0 }, { 0, -1,  0 } },
+            { {  1, 0,  0 }, { 0, 1, 0 }, { 0,  0, -1 } },
+            { { -1, 0,  0 }, { 0, 1, 0 }, { 0,  0, -1 } },
+            { {  0, 1,  0 }, { 1, 0, 0 }, { 0,  0, -1 } },
+            { {  0, -1, 0 }, { 1, 0, 0 }, { 0,  0, -1 } },
+    };
+
+    unsigned int best = 0;
+    double best_dot = 0.0;
+    for(unsigned int i = 0; i < 6; ++i) {
+        double dot = t3dDotProduct(normal, base_axes[i][0]);
+        if(dot > best_dot) {
+            best_dot = dot;
+            best = i;
+        }
+    }
+
+    memcpy(u, base_axes[best][1], sizeof(double) * 3);
+    memcpy(v, base_axes[best][2], sizeof(double) * 3);
+}
+
+/**************************************************/
+/* Duplicate Brushes */
+
+/* Brushes are hashed on the set of planes and textures they end up with
+ * in the map, so the same brush is picked up regardless of the order its
+ * faces are in or how unreal happened to split them up. */
+
+#define FNV_OFFSET  14695981039346656037ULL
+#define FNV_PRIME   1099511628211ULL
+
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    for(size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static int CompareHashes(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* zero is never returned, so it can be used to mark a brush that isn't exported */
+uint64_t t3dHashBrush(const T3DBrush *brush) {
+    uint64_t faces[MAX_BRUSH_FACES];
+    unsigned int num_faces = 0;
+
+    for(unsigned int i = 0; i < brush->num_poly && i < MAX_BRUSH_FACES; ++i) {
+        const T3DPolygon *face = &brush->poly_list[i];
+
+        /* exactly what ends up in the map */
+        double points[3][3];
+        t3dGetFacePoints(brush, face, points);
+        for(unsigned int j = 0; j < 3; ++j) {
+            for(unsigned int k = 0; k < 3; ++k) {
+                points[j][k] = (int) points[j][k];
+            }
+        }
+
+        /* snapped to a grid, so the same plane through different points still matches */
+        double normal[3];
+        t3dGetNormal(points[0], points[1], points[2], normal);
+        int64_t plane[4] = {
+                llround(normal[0] * 65536.0),
+                llround(normal[1] * 65536.0),
+                llround(normal[2] * 65536.0),
+                llround(t3dDotProduct(normal, points[1]) * 64.0),
+        };
+
+        uint64_t hash = HashBytes(FNV_OFFSET, plane, sizeof(plane));
+        faces[num_faces++] = HashBytes(hash, face->texture, strlen(face->texture));
+    }
+
+    qsort(faces, num_faces, sizeof(uint64_t), CompareHashes);
+
+    uint64_t hash = HashBytes(FNV_OFFSET, &brush->csg, sizeof(brush->csg));
+    for(unsigned int i = 0; i < num_faces; ++i) {
+        if(i > 0 && faces[i] == faces[i - 1]) {
+            continue;
+        }
+        hash = HashBytes(hash, &faces[i], sizeof(uint64_t));
+    }
+
+    return (hash != 0) ? hash : 1;
+}
+
+/* Returns an array with an entry for each brush, giving the index of the
+ * brush that supersedes it, or UINT32_MAX if it's unique. Later brushes
+ * take precedence, as they would in unreal. */
+uint32_t *t3dFindDuplicateBrushes(T3DContext *ctx, const uint64_t *hashes, unsigned int num_brushes) {
+    ctx->num_duplicates = 0;
+
+    uint32_t *duplicates = t3dMallocTag(ctx, sizeof(uint32_t) * (num_brushes + 1), T3D_MEMORY_BRUSHES);
+    if(duplicates == NULL) {
+        return NULL;
+    }
+
+    unsigned int table_size = 1;
+    while(table_size < (num_brushes * 2) + 1) table_size <<= 1;
+    uint32_t *table = t3dMallocTag(ctx, sizeof(uint32_t) * table_size, T3D_MEMORY_BRUSHES);
+    if(table == NULL) {
+        t3dFree(ctx, duplicates);
+        return NULL;
+    }
+    memset(table, 0xff, sizeof(uint32_t) * table_size);
+
+    for(unsigned int i = num_brushes; i-- > 0;) {
+        duplicates[i] = UINT32_MAX;
+        if(hashes[i] == 0) {
+            continue;
+        }
+
+        unsigned int slot = (unsigned int) (hashes[i] & (table_size - 1));
+        while(table[slot] != UINT32_MAX && hashes[table[slot]] != hashes[i]) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if(table[slot] != UINT32_MAX) {
+            duplicates[i] = table[slot];
+            ctx->num_duplicates++;
+            continue;
+        }
+
+        table[slot] = i;
+    }
+
+    t3dFree(ctx, table);
+
+    return duplicates;
+}
+
+/* logs each of the duplicates, returns false if brush shouldn't be exported */
+bool t3dCheckDuplicate(T3DContext *ctx, const uint32_t *duplicates, unsigned int index) {
+    if(duplicates == NULL || duplicates[index] == UINT32_MAX) {
+        return true;
+    }
+
+    if(ctx->options.duplicates) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: brush %u is a duplicate of brush %u%s\n",
+               index, duplicates[index], ctx->options.dedupe ? ", dropping" : "");
+    }
+
+    return !ctx->options.dedupe;
+}
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "t3d_private.h"
+
+/* UnrealEd keeps a Group on each polygon, which is how the level was
+ * organised in the editor. The names are interned as they're parsed, so
+ * each brush just carries an index, with 0 left for those that weren't in
+ * one. When writing, brushes are kept together by group; in split mode
+ * each group is written out as a map of its own, concurrently, along with
+ * the entities that name it as their first group. */
+
+/* names are compared case insensitively, same as the editor */
+static uint32_t HashGroupName(const char *name) {
+    uint32_t hash = 2166136261u;
+    for(const char *c = name; *c != '\0'; ++c) {
+        char l = (*c >= 'A' && *c <= 'Z') ? (char) (*c + ('a' - 'A')) : *c;
+        hash = (hash ^ (unsigned char) l) * 16777619u;
+    }
+    return hash;
+}
+
+/* returns the slot holding the name, or the empty one it would go in */
+static uint32_t *FindGroupSlot(const T3DContext *ctx, const char *name, uint32_t hash) {
+    unsigned int mask = ctx->group_table_size - 1;
+    for(unsigned int i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t *slot = &ctx->group_table[i];
+        if(*slot == 0) {
+            return slot;
+        }
+
+        const T3DGroupName *group = &ctx->groups[*slot];
+        if(group->hash == hash && pl_strncasecmp(group->name, name, sizeof(group->name)) == 0) {
+            return slot;
+        }
+    }
+}
+
+static bool GrowGroupTable(T3DContext *ctx) {
+    unsigned int size = (ctx->group_table_size == 0) ? 64 : ctx->group_table_size * 2;
+    uint32_t *table = t3dCallocTag(ctx, size, sizeof(uint32_t), T3D_MEMORY_GROUPS);
+    if(table == NULL) {
+        return false;
+    }
+
+    t3dFree(ctx, ctx->group_table);
+    ctx->group_table = table;
+    ctx->group_table_size = size;
+
+    for(unsigned int i = 1; i < ctx->num_groups; ++i) {
+        *FindGroupSlot(ctx, ctx->groups[i].name, ctx->groups[i].hash) = i;
+    }
+    return true;
+}
+
+/* there's no way to escape these in a map, so they're stored as they'll be written */
+static void CleanGroupName(const char *name, char *out) {
+    snprintf(out, sizeof(((T3DGroupName *) NULL)->name), "%s", name);
+    for(char *c = out; *c != '\0'; ++c) {
+        if(*c == '"') *c = '\'';
+        else if(*c == T3D_DEFERRED_ID || *c == T3D_DEFERRED_GROUP) *c = ' ';
+    }
+}
+
+/* returns 0 if the name's empty, or we ran out of memory */
+unsigned int t3dInternGroup(T3DContext *ctx, const char *group_name) {
+    if(group_name[0] == '\0') {
+        return 0;
+    }
+
+    char name[sizeof(ctx->groups->name)];
+    CleanGroupName(group_name, name);
+
+    /* kept at most half full */
+    if((ctx->num_groups + 1) * 2 > ctx->group_table_size && !GrowGroupTable(ctx)) {
+        return 0;
+    }
+
+    uint32_t hash = HashGroupName(name);
+    uint32_t *slot = FindGroupSlot(ctx, name, hash);
+    if(*slot != 0) {
+        return *slot;
+    }
+
+    /* the first is always the empty one */
+    if(ctx->num_groups + 1 >= ctx->max_groups) {
+        unsigned int max_groups = (ctx->max_groups == 0) ? 16 : ctx->max_groups * 2;
+        T3DGroupName *groups = t3dReallocTag(ctx, ctx->groups, sizeof(T3DGroupName) * max_groups, T3D_MEMORY_GROUPS);
+        if(groups == NULL) {
+            return 0;
+        }
+
+        memset(&groups[ctx->max_groups], 0, sizeof(T3DGroupName) * (max_groups - ctx->max_groups));
+        ctx->groups = groups;
+        ctx->max_groups = max_groups;
+        if(ctx->num_groups == 0) {
+            ctx->num_groups = 1;
+        }
+    }
+
+    T3DGroupName *group = &ctx->groups[ctx->num_groups];
+    memcpy(group->name, name, sizeof(group->name));
+    group->hash = hash;
+
+    *slot = ctx->num_groups;
+    return ctx->num_groups++;
+}
+
+/* returns 0 if there's no such group */
+unsigned int t3dFindGroup(const T3DContext *ctx, const char *group_name) {
+    if(group_name[0] == '\0' || ctx->group_table_size == 0) {
+        return 0;
+    }
+
+    char name[sizeof(ctx->groups->name)];
+    CleanGroupName(group_name, name);
+    return *FindGroupSlot(ctx, name, HashGroupName(name));
+}
+
+void t3dResetGroups(T3DContext *ctx) {
+    if(ctx->group_table != NULL) {
+        memset(ctx->group_table, 0, sizeof(uint32_t) * ctx->group_table_size);
+    }
+    ctx->num_groups = (ctx->groups != NULL) ? 1 : 0;
+}
+
+unsigned int t3dGetNumGroups(const T3DContext *ctx) {
+    return (ctx->num_groups > 0) ? ctx->num_groups : 1;
+}
+
+const char *t3dGetGroupName(const T3DContext *ctx, unsigned int group) {
+    if(group >= t3dGetNumGroups(ctx)) {
+        return NULL;
+    }
+
+    return (group > 0) ? ctx->groups[group].name : "";
+}
+
+/* Reorders the export so each group's brushes are together, in the order
+ * they'd otherwise have gone out in, starting with those not in a group.
+ * Anything that won't be exported goes in with those too, so a group's
+ * range is only empty if there's nothing in it to write. The group of each
+ * brush is taken from groups if given, i.e. when it's not been parsed. */
+bool t3dLayoutGroups(T3DContext *ctx, T3DExport *info, const uint32_t *groups) {
+    unsigned int num_groups = t3dGetNumGroups(ctx);
+    uint32_t *starts = t3dCallocTag(ctx, num_groups + 1, sizeof(uint32_t), T3D_MEMORY_GEOMETRY);
+    uint32_t *order = t3dMallocTag(ctx, sizeof(uint32_t) * (info->num_brushes + 1), T3D_MEMORY_GEOMETRY);
+    if(starts == NULL || order == NULL) {
+        t3dFree(ctx, starts);
+        t3dFree(ctx, order);
+        return false;
+    }
+
+#define GetGroup(a) ((groups != NULL) ? groups[(a)] : \
+                     t3dIsBrushExported(ctx, &ctx->brushes[(a)]) ? ctx->brushes[(a)].group : 0)
+
+    for(unsigned int n = 0; n < info->num_brushes; ++n) {
+        starts[GetGroup(t3dGetExportBrush(info, n)) + 1]++;
+    }
+
+    for(unsigned int i = 1; i <= num_groups; ++i) {
+        starts[i] += starts[i - 1];
+    }
+
+    /* fills each in from its start, which leaves them where the next one begins, so shift them back after */
+    for(unsigned int n = 0; n < info->num_brushes; ++n) {
+        unsigned int i = t3dGetExportBrush(info, n);
+        order[starts[GetGroup(i)]++] = i;
+    }
+
+    memmove(&starts[1], starts, sizeof(uint32_t) * num_groups);
+    starts[0] = 0;
+
+#undef GetGroup
+
+    t3dFree(ctx, info->brush_order);
+    info->brush_order = order;
+    info->group_starts = starts;
+    info->num_groups = num_groups;
+    return true;
+}
+
+/**************************************************/
+
+static const T3DSink *OpenGroup(T3DPoolJob *job, void *user) {
+    const T3DGroupOptions *options = (const T3DGroupOptions *) user;
+    return options->open((const T3DGroup *) job->user, options->user);
+}
+
+static bool CloseGroup(T3DPoolJob *job, const T3DSink *sink, void *user) {
+    const T3DGroupOptions *options = (const T3DGroupOptions *) user;
+    return options->close((const T3DGroup *) job->user, sink, options->user);
+}
+
+/* an actor goes with the first of its groups, if there's a group by that name with
+ * brushes in it, otherwise with those not in a group */
+static unsigned int GetActorGroup(T3DContext *ctx, const T3DActor *actor, const T3DGroup *groups) {
+    char name[256] = "";
+    if(!t3dGetActorString(ctx, actor, "Group", name, sizeof(name))) {
+        return 0;
+    }
+
+    name[strcspn(name, ",")] = '\0';
+    unsigned int group = t3dFindGroup(ctx, name);
+    return (groups[group].num_brushes > 0) ? group : 0;
+}
+
+/* everything's checked here, before any threads get going, so any warnings only turn up the once */
+static void SplitGroups(T3DContext *ctx, const T3DGroupOptions *options, const T3DExport *info, T3DGroup *groups) {
+    unsigned int num_groups = info->num_groups;
+    uint32_t *brushes = t3dMallocTag(ctx, sizeof(uint32_t) * (info->num_brushes + 1), T3D_MEMORY_GEOMETRY);
+    uint32_t *actors = t3dMallocTag(ctx, sizeof(uint32_t) * (info->num_actors + 1), T3D_MEMORY_GEOMETRY);
+    uint32_t *owners = t3dMallocTag(ctx, sizeof(uint32_t) * (info->num_actors + 1), T3D_MEMORY_GEOMETRY);
+    uint32_t *starts = t3dCallocTag(ctx, num_groups, sizeof(uint32_t), T3D_MEMORY_GEOMETRY);
+    T3DPoolJob *jobs = t3dCallocTag(ctx, num_groups, sizeof(T3DPoolJob), T3D_MEMORY_GEOMETRY);
+    if(brushes != NULL && actors != NULL && owners != NULL && starts != NULL && jobs != NULL) {
+        /* the brushes are already together by group, so just need to drop those that aren't going out */
+        unsigned int num_brushes = 0;
+        for(unsigned int i = 0; i < num_groups; ++i) {
+            groups[i].index = i;
+            groups[i].name  = t3dGetGroupName(ctx, i);
+            for(unsigned int n = info->group_starts[i]; n < info->group_starts[i + 1]; ++n) {
+                unsigned int j = t3dGetExportBrush(info, n);
+                if(t3dCheckBrush(ctx, &ctx->brushes[j], j) && t3dCheckDuplicate(ctx, info->duplicates, j)) {
+                    brushes[num_brushes++] = j;
+                    groups[i].num_brushes++;
+                }
+            }
+        }
+
+        for(unsigned int n = 0; n < info->num_actors; ++n) {
+            unsigned int i = t3dGetExportActor(info, n);
+            owners[i] = UINT32_MAX;
+            if(t3dCheckEntity(ctx, &ctx->actors[i])) {
+                owners[i] = GetActorGroup(ctx, &ctx->actors[i], groups);
+                groups[owners[i]].num_actors++;
+            }
+        }
+
+        for(unsigned int i = 1; i < num_groups; ++i) {
+            starts[i] = starts[i - 1] + groups[i - 1].num_actors;
+        }
+
+        /* groups without any brushes won't compile, so they're left out */
+        unsigned int num_jobs = 0;
+        for(unsigned int i = 0, first = 0; i < num_groups; first += groups[i++].num_brushes) {
+            if(groups[i].num_brushes == 0) {
+                continue;
+            }
+
+            T3DPoolJob *job = &jobs[num_jobs++];
+            snprintf(job->name, sizeof(job->name), "group \"%.64s\"", groups[i].name);
+            job->user        = &groups[i];
+            job->brushes     = &brushes[first];
+            job->num_brushes = groups[i].num_brushes;
+            job->actors      = &actors[starts[i]];
+            job->num_actors  = groups[i].num_actors;
+        }
+
+        for(unsigned int n = 0; n < info->num_actors; ++n) {
+            unsigned int i = t3dGetExportActor(info, n);
+            if(owners[i] != UINT32_MAX) {
+                actors[starts[owners[i]]++] = i;
+            }
+        }
+
+        T3DPoolOptions pool_options = {
+                .what        = "groups",
+                .num_threads = options->num_threads,
+                /* each is a map of its own, so there's nothing to tag */
+                .ungrouped   = true,
+                .open        = OpenGroup,
+                .close       = CloseGroup,
+                .user        = (void *) options,
+        };
+        t3dRunPool(ctx, &pool_options, jobs, num_jobs);
+    }
+
+    t3dFree(ctx, brushes);
+    t3dFree(ctx, actors);
+    t3dFree(ctx, owners);
+    t3dFree(ctx, starts);
+    t3dFree(ctx, jobs);
+}
+
+T3DError t3dWriteGroups(T3DContext *ctx, const T3DGroupOptions *options, T3DGroup *groups) {
+    if(options == NULL || groups == NULL || options->open == NULL || options->close == NULL) {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: invalid options passed to t3dWriteGroups!\n");
+        return ctx->error;
+    }
+
+    memset(groups, 0, sizeof(T3DGroup) * t3dGetNumGroups(ctx));
+
+    T3DExport info;
+    if(t3dBeginExport(ctx, &info) && (info.group_starts != NULL || t3dLayoutGroups(ctx, &info, NULL))) {
+        SplitGroups(ctx, options, &info, groups);
+    }
+    t3dEndExport(ctx, &info);
+
+    return ctx->error;
+}
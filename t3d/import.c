@@ -0,0 +1,910 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "t3d_private.h"
+
+/* Goes the other way, reading a MAP and writing it back out as a T3D.
+ *
+ * Unreal's world starts out solid, so everything is carved out of a
+ * subtractive brush surrounding the whole map and each brush is then added
+ * back in. MAP brushes are only planes, so each face is clipped against
+ * the rest of its brush to get the polygon unreal wants.
+ *
+ * The document is gone over three times: first to size up the world, then
+ * to write out the entities, and finally to write out the brushes, so that
+ * none of it ever has to be kept around. */
+
+#define MAX_IMPORT_FACES        256
+#define MAX_WINDING_VERTICES    64
+#define MAX_POLYGON_VERTICES    16  /* unreal won't take any more than this */
+#define MAX_ENTITY_KEYS         256
+
+#define WORLD_SIZE          131072.0
+#define PLANE_EPSILON       0.01
+#define SUBTRACT_MARGIN     256.0
+
+#define DEGREES_TO_RADIANS  (3.14159265358979323846 / 180.0)
+
+typedef enum ImportPass {
+    PASS_MEASURE,
+    PASS_ACTORS,
+    PASS_BRUSHES,
+} ImportPass;
+
+typedef struct ImportFace {
+    double normal[3];
+    double dist;
+
+    char texture[128];
+
+    /* valve 220 style, which is what standard projection gets turned into */
+    double u[3], v[3];
+    double u_shift, v_shift;
+    double u_scale, v_scale;
+} ImportFace;
+
+typedef struct Winding {
+    double points[MAX_WINDING_VERTICES][3];
+    unsigned int num_points;
+} Winding;
+
+typedef struct ImportKey {
+    const char *key, *value;
+    unsigned int key_length, value_length;
+} ImportKey;
+
+typedef struct Importer {
+    T3DContext *ctx;
+    T3DWriter *writer;
+    ImportPass pass;
+
+    const char *pos;
+    unsigned int line;
+
+    /* current token */
+    const char *token;
+    unsigned int length;
+    bool quoted;
+
+    ImportFace faces[MAX_IMPORT_FACES];
+    Winding windings[MAX_IMPORT_FACES];
+    unsigned int num_faces;
+
+    ImportKey keys[MAX_ENTITY_KEYS];
+    unsigned int num_keys;
+
+    unsigned int num_brushes;
+    unsigned int num_actors;
+    double mins[3], maxs[3];
+} Importer;
+
+/**************************************************/
+/* Tokens */
+
+static bool NextToken(Importer *importer) {
+    const char *pos = importer->pos;
+
+    for(;;) {
+        if(*pos == '\n') {
+            importer->line++;
+            pos++;
+        } else if(*pos == ' ' || *pos == '\t' || *pos == '\r') {
+            pos++;
+        } else if(pos[0] == '/' && pos[1] == '/') {
+            while(*pos != '\n' && *pos != '\0') pos++;
+        } else {
+            break;
+        }
+    }
+
+    if(*pos == '\0') {
+        importer->pos = pos;
+        importer->token = pos;
+        importer->length = 0;
+        return false;
+    }
+
+    importer->quoted = (*pos == '"');
+    if(importer->quoted) {
+        const char *start = ++pos;
+        while(*pos != '"' && *pos != '\n' && *pos != '\0') pos++;
+        importer->token = start;
+        importer->length = (unsigned int) (pos - start);
+        if(*pos == '"') pos++;
+    } else if(*pos == '(' || *pos == ')' || *pos == '[' || *pos == ']') {
+        importer->token = pos++;
+        importer->length = 1;
+    } else {
+        /* otherwise it runs to the next space, as texture names can have brackets in them */
+        const char *start = pos;
+        while(*pos != '\0' && *pos != ' ' && *pos != '\t' && *pos != '\r' && *pos != '\n') pos++;
+        importer->token = start;
+        importer->length = (unsigned int) (pos - start);
+    }
+
+    importer->pos = pos;
+    return true;
+}
+
+static bool IsToken(const Importer *importer, const char *string) {
+    return !importer->quoted && importer->length == strlen(string) &&
+           strncmp(importer->token, string, importer->length) == 0;
+}
+
+static bool ExpectToken(Importer *importer, const char *string) {
+    if(NextToken(importer) && IsToken(importer, string)) {
+        return true;
+    }
+
+    t3dSetError(importer->ctx, T3D_ERROR_SYNTAX, "error: expected \"%s\" on line %u, found \"%.*s\"!\n",
+                string, importer->line + 1, (int) importer->length, importer->token);
+    return false;
+}
+
+static double ReadNumber(Importer *importer) {
+    char *end;
+    double value = 0.0;
+    if(NextToken(importer)) {
+        value = strtod(importer->token, &end);
+        if(end == importer->token + importer->length) {
+            return value;
+        }
+    }
+
+    t3dSetError(importer->ctx, T3D_ERROR_SYNTAX, "error: expected a number on line %u, found \"%.*s\"!\n",
+                importer->line + 1, (int) importer->length, importer->token);
+    return 0.0;
+}
+
+static char PeekChar(const Importer *importer) {
+    const char *pos = importer->pos;
+    while(*pos == ' ' || *pos == '\t') pos++;
+    return *pos;
+}
+
+static void SkipLine(Importer *importer) {
+    while(*importer->pos != '\n' && *importer->pos != '\0') importer->pos++;
+}
+
+/* for anything we don't handle, i.e. patches, starting from either its name or its
+ * opening brace; a closing brace that isn't its own is left for whatever it belongs to */
+static void SkipBlock(Importer *importer) {
+    unsigned int depth = IsToken(importer, "{") ? 1 : 0;
+    while(NextToken(importer)) {
+        if(IsToken(importer, "{")) {
+            depth++;
+        } else if(IsToken(importer, "}")) {
+            if(depth == 0) {
+                importer->pos = importer->token;
+                return;
+            }
+            if(--depth == 0) {
+                return;
+            }
+        }
+    }
+}
+
+/**************************************************/
+/* Brushes */
+
+static void ReadPoint(Importer *importer, double *point) {
+    ExpectToken(importer, "(");
+    for(unsigned int i = 0; i < 3; ++i) {
+        point[i] = ReadNumber(importer);
+    }
+    ExpectToken(importer, ")");
+}
+
+static void ReadValveAxis(Importer *importer, double *axis, double *shift) {
+    ExpectToken(importer, "[");
+    for(unsigned int i = 0; i < 3; ++i) {
+        axis[i] = ReadNumber(importer);
+    }
+    *shift = ReadNumber(importer);
+    ExpectToken(importer, "]");
+}
+
+/* standard quake alignment, turned into explicit axes like valve 220 */
+static void GetStandardAxes(ImportFace *face, double rotation) {
+    t3dGetBaseTextureAxes(face->normal, face->u, face->v);
+
+    double angle = rotation * DEGREES_TO_RADIANS;
+    double s = sin(angle), c = cos(angle);
+    if(rotation == 0.0) { s = 0.0; c = 1.0; }
+    else if(rotation == 90.0) { s = 1.0; c = 0.0; }
+    else if(rotation == 180.0) { s = 0.0; c = -1.0; }
+    else if(rotation == 270.0) { s = -1.0; c = 0.0; }
+
+    unsigned int sv = (face->u[0] != 0.0) ? 0 : (face->u[1] != 0.0) ? 1 : 2;
+    unsigned int tv = (face->v[0] != 0.0) ? 0 : (face->v[1] != 0.0) ? 1 : 2;
+
+    double *axes[2] = { face->u, face->v };
+    for(unsigned int i = 0; i < 2; ++i) {
+        double ns = c * axes[i][sv] - s * axes[i][tv];
+        double nt = s * axes[i][sv] + c * axes[i][tv];
+        axes[i][sv] = ns;
+        axes[i][tv] = nt;
+    }
+}
+
+static void ReadFace(Importer *importer, ImportFace *face) {
+    double points[3][3];
+    for(unsigned int i = 0; i < 3; ++i) {
+        ReadPoint(importer, points[i]);
+    }
+
+    /* same winding the writer uses, so the normal faces out of the brush */
+    t3dGetNormal(points[0], points[1], points[2], face->normal);
+    face->dist = t3dDotProduct(face->normal, points[1]);
+
+    NextToken(importer);
+    snprintf(face->texture, sizeof(face->texture), "%.*s", (int) importer->length, importer->token);
+
+    /* valve 220 carries its axes, otherwise it's offset, rotation and scale */
+    double rotation = 0.0;
+    if(PeekChar(importer) == '[') {
+        ReadValveAxis(importer, face->u, &face->u_shift);
+        ReadValveAxis(importer, face->v, &face->v_shift);
+        rotation = ReadNumber(importer);
+    } else {
+        face->u_shift = ReadNumber(importer);
+        face->v_shift = ReadNumber(importer);
+        rotation = ReadNumber(importer);
+        GetStandardAxes(face, rotation);
+    }
+
+    face->u_scale = ReadNumber(importer);
+    face->v_scale = ReadNumber(importer);
+    if(face->u_scale == 0.0) face->u_scale = 1.0;
+    if(face->v_scale == 0.0) face->v_scale = 1.0;
+
+    /* quake 2 and 3 have surface flags following, which there's no use for */
+    SkipLine(importer);
+}
+
+static void GetBaseWinding(const ImportFace *face, Winding *winding) {
+    const double *normal = face->normal;
+
+    unsigned int axis = 0;
+    for(unsigned int i = 1; i < 3; ++i) {
+        if(fabs(normal[i]) > fabs(normal[axis])) axis = i;
+    }
+
+    double up[3] = { 0.0, 0.0, 0.0 };
+    up[(axis == 2) ? 0 : 2] = 1.0;
+
+    double d = t3dDotProduct(up, normal);
+    for(unsigned int i = 0; i < 3; ++i) {
+        up[i] -= d * normal[i];
+    }
+    double length = sqrt(t3dDotProduct(up, up));
+    for(unsigned int i = 0; i < 3; ++i) {
+        up[i] *= WORLD_SIZE / length;
+    }
+
+    double right[3] = {
+            up[1] * normal[2] - up[2] * normal[1],
+            up[2] * normal[0] - up[0] * normal[2],
+            up[0] * normal[1] - up[1] * normal[0],
+    };
+
+    for(unsigned int i = 0; i < 3; ++i) {
+        double origin = normal[i] * face->dist;
+        winding->points[0][i] = origin - right[i] + up[i];
+        winding->points[1][i] = origin + right[i] + up[i];
+        winding->points[2][i] = origin + right[i] - up[i];
+        winding->points[3][i] = origin - right[i] - up[i];
+    }
+    winding->num_points = 4;
+}
+
+/* keeps whatever's behind the plane */
+static void ClipWinding(Winding *winding, const ImportFace *plane) {
+    double dists[MAX_WINDING_VERTICES];
+    bool front = false;
+    for(unsigned int i = 0; i < winding->num_points; ++i) {
+        dists[i] = t3dDotProduct(winding->points[i], plane->normal) - plane->dist;
+        if(dists[i] > PLANE_EPSILON) front = true;
+    }
+
+    if(!front) {
+        return;
+    }
+
+    Winding out;
+    out.num_points = 0;
+    for(unsigned int i = 0; i < winding->num_points && out.num_points + 2 <= MAX_WINDING_VERTICES; ++i) {
+        const double *p0 = winding->points[i];
+        const double *p1 = winding->points[(i + 1) % winding->num_points];
+        double d0 = dists[i], d1 = dists[(i + 1) % winding->num_points];
+
+        if(d0 <= PLANE_EPSILON) {
+            memcpy(out.points[out.num_points++], p0, sizeof(double) * 3);
+        }
+
+        if((d0 > PLANE_EPSILON && d1 < -PLANE_EPSILON) || (d0 < -PLANE_EPSILON && d1 > PLANE_EPSILON)) {
+            double t = d0 / (d0 - d1);
+            for(unsigned int j = 0; j < 3; ++j) {
+                out.points[out.num_points][j] = p0[j] + t * (p1[j] - p0[j]);
+            }
+            out.num_points++;
+        }
+    }
+
+    *winding = out;
+}
+
+/* tidies up after clipping, and puts it in the order the writer expects */
+static void FinishWinding(Winding *winding, const double *normal) {
+    for(unsigned int i = 0; i < winding->num_points; ++i) {
+        for(unsigned int j = 0; j < 3; ++j) {
+            double rounded = floor(winding->points[i][j] + 0.5);
+            if(fabs(winding->points[i][j] - rounded) < PLANE_EPSILON) {
+                winding->points[i][j] = rounded;
+            }
+        }
+    }
+
+    unsigned int num_points = 0;
+    for(unsigned int i = 0; i < winding->num_points; ++i) {
+        const double *prev = winding->points[(num_points > 0) ? num_points - 1 : winding->num_points - 1];
+        const double *p = winding->points[i];
+        if(fabs(p[0] - prev[0]) < PLANE_EPSILON && fabs(p[1] - prev[1]) < PLANE_EPSILON &&
+           fabs(p[2] - prev[2]) < PLANE_EPSILON) {
+            continue;
+        }
+        memmove(winding->points[num_points++], p, sizeof(double) * 3);
+    }
+    winding->num_points = num_points;
+
+    /* the writer gets its normal from (p0 - p1) x (p2 - p1), which wants these going clockwise */
+    double area[3] = { 0.0, 0.0, 0.0 };
+    for(unsigned int i = 0; i < winding->num_points; ++i) {
+        const double *a = winding->points[i];
+        const double *b = winding->points[(i + 1) % winding->num_points];
+        area[0] += (a[1] - b[1]) * (a[2] + b[2]);
+        area[1] += (a[2] - b[2]) * (a[0] + b[0]);
+        area[2] += (a[0] - b[0]) * (a[1] + b[1]);
+    }
+
+    if(t3dDotProduct(area, normal) > 0.0) {
+        for(unsigned int i = 0; i < winding->num_points / 2; ++i) {
+            double swap[3];
+            memcpy(swap, winding->points[i], sizeof(swap));
+            memcpy(winding->points[i], winding->points[winding->num_points - 1 - i], sizeof(swap));
+            memcpy(winding->points[winding->num_points - 1 - i], swap, sizeof(swap));
+        }
+    }
+}
+
+/* returns false if there's not enough left of the brush to bother with */
+static bool BuildWindings(Importer *importer, double *mins, double *maxs) {
+    unsigned int num_valid = 0;
+    for(unsigned int i = 0; i < importer->num_faces; ++i) {
+        Winding *winding = &importer->windings[i];
+        const ImportFace *face = &importer->faces[i];
+
+        GetBaseWinding(face, winding);
+        for(unsigned int j = 0; j < importer->num_faces && winding->num_points >= 3; ++j) {
+            if(j == i) {
+                continue;
+            }
+
+            /* a plane that's repeated only counts the first time */
+            const ImportFace *plane = &importer->faces[j];
+            if(t3dDotProduct(face->normal, plane->normal) > 1.0 - 1e-6 && fabs(face->dist - plane->dist) < PLANE_EPSILON) {
+                if(j < i) {
+                    winding->num_points = 0;
+                }
+                continue;
+            }
+
+            ClipWinding(winding, plane);
+        }
+
+        if(winding->num_points < 3) {
+            winding->num_points = 0;
+            continue;
+        }
+
+        FinishWinding(winding, face->normal);
+        if(winding->num_points < 3) {
+            winding->num_points = 0;
+            continue;
+        }
+
+        for(unsigned int j = 0; j < winding->num_points; ++j) {
+            for(unsigned int k = 0; k < 3; ++k) {
+                double v = winding->points[j][k];
+                if(num_valid == 0 && j == 0) {
+                    mins[k] = maxs[k] = v;
+                    continue;
+                }
+                if(v < mins[k]) mins[k] = v;
+                if(v > maxs[k]) maxs[k] = v;
+            }
+        }
+        num_valid++;
+    }
+
+    return (num_valid >= 4);
+}
+
+/* map space to unreal's, x and y are swapped back over */
+#define WriteVector(name, p)    t3dWriterPrintf(writer, "             %-8s %+013.6f,%+013.6f,%+013.6f\n", \
+                                                (name), (p)[1] + 0.0, (p)[0] + 0.0, (p)[2] + 0.0)
+
+static void WritePolygon(T3DWriter *writer, const ImportFace *face, const Winding *winding, unsigned int first,
+                         unsigned int num_points, const double *location, unsigned int link) {
+    /* unreal goes by (point - origin) | axis, so find an origin that gives the same shifts */
+    double u[3], v[3];
+    for(unsigned int i = 0; i < 3; ++i) {
+        u[i] = face->u[i] / face->u_scale;
+        v[i] = face->v[i] / face->v_scale;
+    }
+
+    double uu = t3dDotProduct(u, u), uv = t3dDotProduct(u, v), vv = t3dDotProduct(v, v);
+    double det = uu * vv - uv * uv;
+    double a = 0.0, b = 0.0;
+    if(fabs(det) > 1e-12) {
+        a = (-face->u_shift * vv + face->v_shift * uv) / det;
+        b = (-face->v_shift * uu + face->u_shift * uv) / det;
+    }
+
+    double origin[3];
+    for(unsigned int i = 0; i < 3; ++i) {
+        origin[i] = a * u[i] + b * v[i] - location[i];
+    }
+
+    if(face->texture[0] != '\0') {
+        t3dWriterPrintf(writer, "          Begin Polygon Texture=%s Link=%u\n", face->texture, link);
+    } else {
+        t3dWriterPrintf(writer, "          Begin Polygon Link=%u\n", link);
+    }
+    WriteVector("Origin", origin);
+    WriteVector("Normal", face->normal);
+    WriteVector("TextureU", u);
+    WriteVector("TextureV", v);
+
+    /* always starting from the first, so the points the writer picks out stay the same */
+    unsigned int indices[MAX_POLYGON_VERTICES] = { 0 };
+    for(unsigned int i = 0; i < num_points; ++i) {
+        indices[i] = (i == 0) ? 0 : first + i - 1;
+    }
+
+    for(unsigned int i = 0; i < num_points; ++i) {
+        double point[3];
+        for(unsigned int j = 0; j < 3; ++j) {
+            point[j] = winding->points[indices[i]][j] - location[j];
+        }
+        WriteVector("Vertex", point);
+    }
+
+    t3dWriterPrintf(writer, "          End Polygon\n");
+}
+
+static void WriteBrush(Importer *importer, const char *csg, const double *mins, const double *maxs) {
+    T3DWriter *writer = importer->writer;
+    unsigned int index = importer->num_brushes;
+
+    /* pivot goes in the middle, which is where unreal would put it */
+    double location[3];
+    for(unsigned int i = 0; i < 3; ++i) {
+        location[i] = floor((mins[i] + maxs[i]) * 0.5 + 0.5);
+    }
+
+    t3dWriterPrintf(writer, "Begin Actor Class=Brush Name=Brush%u\n", index);
+    t3dWriterPrintf(writer, "    CsgOper=%s\n", csg);
+    t3dWriterPrintf(writer, "    Location=(X=%f,Y=%f,Z=%f)\n", location[1], location[0], location[2]);
+    t3dWriterPrintf(writer, "    Begin Brush Name=Model%u\n", index);
+    t3dWriterPrintf(writer, "       Begin PolyList\n");
+
+    unsigned int link = 0;
+    for(unsigned int i = 0; i < importer->num_faces; ++i) {
+        const Winding *winding = &importer->windings[i];
+        if(winding->num_points == 0) {
+            continue;
+        }
+
+        /* anything with too many sides gets split into a fan, it's convex so that's fine */
+        unsigned int first = 1;
+        do {
+            unsigned int num_points = winding->num_points - first + 1;
+            if(num_points > MAX_POLYGON_VERTICES) num_points = MAX_POLYGON_VERTICES;
+            WritePolygon(writer, &importer->faces[i], winding, first, num_points, location, link++);
+            first += num_points - 2;
+        } while(first + 1 < winding->num_points);
+    }
+
+    t3dWriterPrintf(writer, "       End PolyList\n");
+    t3dWriterPrintf(writer, "    End Brush\n");
+    t3dWriterPrintf(writer, "    Brush=Model'MyLevel.Model%u'\n", index);
+    t3dWriterPrintf(writer, "    Name=Brush%u\n", index);
+    t3dWriterPrintf(writer, "End Actor\n");
+}
+
+static void AddBrush(Importer *importer) {
+    double mins[3], maxs[3];
+    if(!BuildWindings(importer, mins, maxs)) {
+        if(importer->pass == PASS_MEASURE) {
+            t3dLog(importer->ctx, T3D_LOG_WARNING, "warning: brush ending on line %u has too few sides, skipping!\n",
+                   importer->line + 1);
+        }
+        return;
+    }
+
+    if(importer->pass == PASS_MEASURE) {
+        for(unsigned int i = 0; i < 3; ++i) {
+            if(importer->num_brushes == 0 || mins[i] < importer->mins[i]) importer->mins[i] = mins[i];
+            if(importer->num_brushes == 0 || maxs[i] > importer->maxs[i]) importer->maxs[i] = maxs[i];
+        }
+    } else if(importer->pass == PASS_BRUSHES) {
+        WriteBrush(importer, "CSG_Add", mins, maxs);
+    }
+
+    importer->num_brushes++;
+}
+
+static void ReadBrush(Importer *importer) {
+    importer->num_faces = 0;
+
+    while(NextToken(importer) && importer->ctx->error == T3D_ERROR_NONE) {
+        if(IsToken(importer, "}")) {
+            if(importer->pass != PASS_ACTORS) {
+                AddBrush(importer);
+            }
+            return;
+        }
+
+        /* patches and doom 3 brushes */
+        if(!IsToken(importer, "(")) {
+            if(importer->pass == PASS_MEASURE) {
+                t3dLog(importer->ctx, T3D_LOG_WARNING, "warning: unsupported %.*s on line %u, skipping!\n",
+                       (int) importer->length, importer->token, importer->line + 1);
+            }
+            SkipBlock(importer);
+            ExpectToken(importer, "}");
+            return;
+        }
+
+        /* faces aren't of any use when writing the actors */
+        if(importer->pass == PASS_ACTORS) {
+            SkipLine(importer);
+            continue;
+        }
+
+        if(importer->num_faces >= MAX_IMPORT_FACES) {
+            t3dSetError(importer->ctx, T3D_ERROR_LIMIT, "error: brush on line %u has more than %u faces!\n",
+                        importer->line + 1, MAX_IMPORT_FACES);
+            return;
+        }
+
+        importer->pos = importer->token;
+        ReadFace(importer, &importer->faces[importer->num_faces++]);
+    }
+}
+
+/* a box around the whole map for everything else to be added into */
+static void WriteWorld(Importer *importer) {
+    static const double normals[6][3] = {
+            { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+    };
+
+    double mins[3], maxs[3];
+    for(unsigned int i = 0; i < 3; ++i) {
+        mins[i] = floor(importer->mins[i] - SUBTRACT_MARGIN);
+        maxs[i] = ceil(importer->maxs[i] + SUBTRACT_MARGIN);
+    }
+
+    importer->num_faces = 6;
+    for(unsigned int i = 0; i < 6; ++i) {
+        ImportFace *face = &importer->faces[i];
+        memset(face, 0, sizeof(ImportFace));
+        memcpy(face->normal, normals[i], sizeof(face->normal));
+        face->dist = (i % 2 == 0) ? maxs[i / 2] : -mins[i / 2];
+        GetStandardAxes(face, 0.0);
+        face->u_scale = face->v_scale = 1.0;
+    }
+
+    if(BuildWindings(importer, mins, maxs)) {
+        WriteBrush(importer, "CSG_Subtract", mins, maxs);
+        importer->num_brushes++;
+    }
+}
+
+/**************************************************/
+/* Entities */
+
+static const char *GetKey(const Importer *importer, const char *key, unsigned int *length) {
+    size_t key_length = strlen(key);
+    for(unsigned int i = 0; i < importer->num_keys; ++i) {
+        const ImportKey *k = &importer->keys[i];
+        if(k->key_length == key_length && pl_strncasecmp(k->key, key, key_length) == 0) {
+            *length = k->value_length;
+            return k->value;
+        }
+    }
+
+    return NULL;
+}
+
+static unsigned int GetKeyNumbers(const Importer *importer, const char *key, double *numbers, unsigned int max) {
+    unsigned int length;
+    const char *value = GetKey(importer, key, &length);
+    if(value == NULL) {
+        return 0;
+    }
+
+    unsigned int num = 0;
+    const char *end = value + length;
+    while(num < max && value < end) {
+        char *next;
+        numbers[num] = strtod(value, &next);
+        if(next == value || next > end) {
+            break;
+        }
+        value = next;
+        num++;
+    }
+
+    return num;
+}
+
+/* anything from the various formats the writer produces, or quake's own light and _color */
+static bool GetLightColour(const Importer *importer, unsigned char *rgb) {
+    double light[4], colour[3];
+    unsigned int num_light = GetKeyNumbers(importer, "_light", light, 4);
+    if(num_light == 0) {
+        num_light = GetKeyNumbers(importer, "light", light, 4);
+    }
+    unsigned int num_colour = GetKeyNumbers(importer, "_color", colour, 3);
+
+    if(num_light == 0 && num_colour == 0) {
+        return false;
+    }
+
+    double c[3] = { 255.0, 255.0, 255.0 };
+    if(num_light >= 3) {
+        memcpy(c, light, sizeof(c));
+    } else if(num_colour == 3) {
+        double scale = (colour[0] <= 1.0 && colour[1] <= 1.0 && colour[2] <= 1.0) ? 255.0 : 1.0;
+        for(unsigned int i = 0; i < 3; ++i) {
+            c[i] = colour[i] * scale;
+        }
+    }
+
+    /* just an intensity, which tints whatever colour there is */
+    if(num_light == 1) {
+        double brightness = (light[0] > 255.0) ? 255.0 : light[0];
+        for(unsigned int i = 0; i < 3; ++i) {
+            c[i] *= brightness / 255.0;
+        }
+    }
+
+    for(unsigned int i = 0; i < 3; ++i) {
+        rgb[i] = (unsigned char) ((c[i] < 0.0) ? 0 : (c[i] > 255.0) ? 255 : (int) c[i]);
+    }
+    return true;
+}
+
+/* these are already covered by the actor itself */
+static bool IsHandledKey(const ImportKey *key) {
+    static const char *handled[] = { "classname", "origin", "angle", "light", "_light", "_color" };
+    for(unsigned int i = 0; i < plArrayElements(handled); ++i) {
+        size_t length = strlen(handled[i]);
+        if(key->key_length == length && pl_strncasecmp(key->key, handled[i], length) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void WriteActor(Importer *importer) {
+    T3DContext *ctx = importer->ctx;
+    T3DWriter *writer = importer->writer;
+
+    unsigned int length;
+    const char *value = GetKey(importer, "classname", &length);
+    if(value == NULL) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: entity ending on line %u has no classname, skipping!\n",
+               importer->line + 1);
+        return;
+    }
+
+    char classname[64];
+    snprintf(classname, sizeof(classname), "%.*s", (int) length, value);
+
+    /* fall back to the classname as it is, which is what the writer does when there's no target */
+    const char *class_name = classname;
+    const T3DActorDef *def = t3dGetActorDefForEntity(classname, ctx->options.format);
+    if(def != NULL) {
+        class_name = def->name;
+    } else {
+        t3dLog(ctx, T3D_LOG_WARNING,
+               "warning: no actor class provided for entity \"%s\" in this mode, using its classname instead!\n",
+               classname);
+    }
+
+    unsigned int index = importer->num_actors++;
+    t3dWriterPrintf(writer, "Begin Actor Class=%s Name=%s%u\n", class_name, class_name, index);
+
+    double origin[3];
+    if(GetKeyNumbers(importer, "origin", origin, 3) == 3) {
+        t3dWriterPrintf(writer, "    Location=(X=%f,Y=%f,Z=%f)\n", origin[1], origin[0], origin[2]);
+    }
+
+    /* quake goes from x towards y, and those are swapped over */
+    double angle;
+    if(GetKeyNumbers(importer, "angle", &angle, 1) == 1 && angle >= 0.0) {
+        int yaw = (int) lround((90.0 - angle) * 65536.0 / 360.0) & 0xFFFF;
+        t3dWriterPrintf(writer, "    Rotation=(Yaw=%d)\n", yaw);
+    }
+
+    unsigned char rgb[3];
+    if(GetLightColour(importer, rgb)) {
+        unsigned char h, s, v;
+        t3dConvertRGB(rgb[0], rgb[1], rgb[2], &h, &s, &v);
+        t3dWriterPrintf(writer, "    LightBrightness=%u\n", v);
+        t3dWriterPrintf(writer, "    LightHue=%u\n", h);
+        t3dWriterPrintf(writer, "    LightSaturation=%u\n", s);
+    }
+
+    if(ctx->options.properties) {
+        for(unsigned int i = 0; i < importer->num_keys; ++i) {
+            const ImportKey *key = &importer->keys[i];
+            if(!IsHandledKey(key)) {
+                t3dWriterPrintf(writer, "    %.*s=\"%.*s\"\n", (int) key->key_length, key->key,
+                                (int) key->value_length, key->value);
+            }
+        }
+    }
+
+    t3dWriterPrintf(writer, "    Name=%s%u\n", class_name, index);
+    t3dWriterPrintf(writer, "End Actor\n");
+}
+
+static void ReadEntity(Importer *importer) {
+    importer->num_keys = 0;
+
+    bool has_brushes = false;
+    while(NextToken(importer) && importer->ctx->error == T3D_ERROR_NONE) {
+        if(IsToken(importer, "}")) {
+            break;
+        }
+
+        if(IsToken(importer, "{")) {
+            ReadBrush(importer);
+            has_brushes = true;
+            continue;
+        }
+
+        if(!importer->quoted) {
+            t3dSetError(importer->ctx, T3D_ERROR_SYNTAX, "error: unexpected \"%.*s\" on line %u!\n",
+                        (int) importer->length, importer->token, importer->line + 1);
+            return;
+        }
+
+        ImportKey *key = &importer->keys[importer->num_keys];
+        key->key = importer->token;
+        key->key_length = importer->length;
+        if(!NextToken(importer) || !importer->quoted) {
+            t3dSetError(importer->ctx, T3D_ERROR_SYNTAX, "error: expected a value on line %u!\n",
+                        importer->line + 1);
+            return;
+        }
+        key->value = importer->token;
+        key->value_length = importer->length;
+
+        if(importer->num_keys + 1 < MAX_ENTITY_KEYS) {
+            importer->num_keys++;
+        }
+    }
+
+    if(importer->pass != PASS_ACTORS || importer->ctx->error != T3D_ERROR_NONE) {
+        return;
+    }
+
+    /* brush entities are merged into the world, there's nothing in unreal to carry them */
+    unsigned int length;
+    const char *classname = GetKey(importer, "classname", &length);
+    if(has_brushes) {
+        if(classname != NULL && (length != 10 || pl_strncasecmp(classname, "worldspawn", length) != 0)) {
+            t3dLog(importer->ctx, T3D_LOG_INFO, "merging brushes of \"%.*s\" into the world\n",
+                   (int) length, classname);
+        }
+        return;
+    }
+
+    if(classname != NULL && length == 10 && pl_strncasecmp(classname, "worldspawn", length) == 0) {
+        return;
+    }
+
+    WriteActor(importer);
+}
+
+static void ReadMap(Importer *importer, const char *buf, ImportPass pass) {
+    importer->pass = pass;
+    importer->pos = buf;
+    importer->line = 0;
+
+    while(NextToken(importer) && importer->ctx->error == T3D_ERROR_NONE) {
+        if(IsToken(importer, "{")) {
+            ReadEntity(importer);
+            continue;
+        }
+
+        /* i.e. the "Version 2" at the top of doom 3 maps */
+        SkipLine(importer);
+    }
+}
+
+/**************************************************/
+
+T3DError t3dImportMapBuffer(T3DContext *ctx, const char *buf, size_t length, const T3DSink *sink) {
+    if(buf == NULL || buf[length] != '\0') {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: buffer passed to t3dImportMapBuffer must be NUL-terminated!\n");
+        return ctx->error;
+    }
+
+    if(sink == NULL || sink->write == NULL) {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: invalid sink passed to t3dImportMapBuffer!\n");
+        return ctx->error;
+    }
+
+    Importer *importer = t3dCallocTag(ctx, 1, sizeof(Importer), T3D_MEMORY_GEOMETRY);
+    T3DWriter *writer = t3dMallocTag(ctx, sizeof(T3DWriter), T3D_MEMORY_WRITER);
+    if(importer == NULL || writer == NULL) {
+        t3dFree(ctx, importer);
+        t3dFree(ctx, writer);
+        return ctx->error;
+    }
+
+    importer->ctx = ctx;
+    importer->writer = writer;
+    t3dInitWriter(writer, ctx, sink);
+
+    ReadMap(importer, buf, PASS_MEASURE);
+    if(ctx->error == T3D_ERROR_NONE && importer->num_brushes == 0) {
+        t3dSetError(ctx, T3D_ERROR_NO_BRUSHES, "error: no brushes in map!\n");
+    }
+
+    if(ctx->error == T3D_ERROR_NONE) {
+        /* counting the subtractive one around everything */
+        t3dWriterPrintf(writer, "Begin Map Brushes=%u\n", importer->num_brushes + 1);
+
+        ReadMap(importer, buf, PASS_ACTORS);
+        unsigned int num_actors = importer->num_actors;
+
+        /* the subtractive brush has to come before anything is added into it */
+        importer->num_brushes = 0;
+        WriteWorld(importer);
+        ReadMap(importer, buf, PASS_BRUSHES);
+
+        t3dWriterPrintf(writer, "End Map\n");
+        t3dFlushWriter(writer);
+
+        t3dLog(ctx, T3D_LOG_INFO, "wrote %u brushes and %u actors\n", importer->num_brushes, num_actors);
+    }
+
+    t3dFree(ctx, importer);
+    t3dFree(ctx, writer);
+
+    return ctx->error;
+}
+
+T3DError t3dImportMap(T3DContext *ctx, const char *path, const T3DSink *sink) {
+    t3dResetContext(ctx);
+
+    size_t length;
+    if((ctx->buffer = t3dLoadFile(ctx, path, &length)) == NULL) {
+        return ctx->error;
+    }
+
+    t3dLog(ctx, T3D_LOG_INFO, "importing...\n");
+
+    return t3dImportMapBuffer(ctx, ctx->buffer, length, sink);
+}
@@ -0,0 +1,570 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "t3d_private.h"
+
+/* Each top-level block (usually an actor) is hashed and the output it
+ * produced is cached against that hash, so when the input changes only
+ * the blocks that were actually modified need to be parsed again. The
+ * map is then put back together from the cached fragments. */
+
+typedef struct Fragment {
+    char *data;     /* NULL if nothing was exported */
+    size_t length;
+
+    uint64_t hash;      /* of the brush's geometry, if we're looking for duplicates or sorting */
+    double centre[3];   /* if we're sorting */
+    uint32_t group;     /* into the block's groups, if we're grouping */
+} Fragment;
+
+typedef struct Block {
+    uint64_t hash;
+
+    /* only valid during an update */
+    char *start;
+    size_t length;
+
+    Fragment *brushes;
+    unsigned int num_brushes;
+
+    Fragment *actors;
+    unsigned int num_actors;
+
+    /* as they were numbered when the block was parsed, which won't be the same as in the map */
+    T3DGroupName *groups;
+    unsigned int num_groups;
+} Block;
+
+struct T3DIncremental {
+    T3DContext *ctx;
+
+    Block *blocks;
+    unsigned int num_blocks;
+};
+
+/* FNV-1a */
+static uint64_t HashBlock(const char *data, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void FreeBlock(T3DContext *ctx, Block *block) {
+    if(block->brushes != NULL) {
+        for(unsigned int i = 0; i < block->num_brushes; ++i) {
+            t3dFree(ctx, block->brushes[i].data);
+        }
+        t3dFree(ctx, block->brushes);
+    }
+
+    if(block->actors != NULL) {
+        for(unsigned int i = 0; i < block->num_actors; ++i) {
+            t3dFree(ctx, block->actors[i].data);
+        }
+        t3dFree(ctx, block->actors);
+    }
+
+    t3dFree(ctx, block->groups);
+
+    memset(block, 0, sizeof(Block));
+}
+
+/* ActorList is deliberately treated as a single block, as that's how the parser handles it */
+static bool IsContainerChunk(const char *pos) {
+    return (pl_strncasecmp(pos, "Map", 3) == 0);
+}
+
+/* splits the document up into its top-level blocks, returns the number found */
+unsigned int t3dFindBlocks(T3DContext *ctx, const char *buf, T3DSpan **blocks, const char **header, T3DMemoryTag tag) {
+    unsigned int num_blocks = 0, max_blocks = 256;
+    if((*blocks = t3dCallocTag(ctx, max_blocks, sizeof(T3DSpan), tag)) == NULL) {
+        return 0;
+    }
+
+    *header = NULL;
+
+    /* every entry marks whether or not that depth is a container */
+    bool containers[MAX_CHUNK_DEPTH] = { true };
+    unsigned int depth = 0;
+
+    const char *pos = buf;
+    while(*pos != '\0') {
+        const char *line = pos;
+        while(*pos == ' ' || *pos == '\t') pos++;
+
+        if(pl_strncasecmp(pos, "Begin", 5) == 0) {
+            pos += 5;
+            while(*pos == ' ' || *pos == '\t') pos++;
+
+            if(depth < MAX_CHUNK_DEPTH - 1) {
+                if(containers[depth]) {
+                    if(IsContainerChunk(pos)) {
+                        if(*header == NULL) {
+                            *header = pos + 3;
+                        }
+                    } else {
+                        if(num_blocks == max_blocks) {
+                            T3DSpan *new_blocks = t3dReallocTag(ctx, *blocks, max_blocks * 2 * sizeof(T3DSpan), tag);
+                            if(new_blocks == NULL) {
+                                return num_blocks;
+                            }
+                            *blocks = new_blocks;
+                            max_blocks *= 2;
+                        }
+                        (*blocks)[num_blocks].offset = (uint32_t) (line - buf);
+                        (*blocks)[num_blocks].length = 0;
+                    }
+                }
+                containers[depth + 1] = containers[depth] && IsContainerChunk(pos);
+            }
+            depth++;
+        } else if(pl_strncasecmp(pos, "End", 3) == 0 && depth > 0) {
+            depth--;
+            if(depth < MAX_CHUNK_DEPTH - 1 && containers[depth] && !containers[depth + 1]) {
+                while(*pos != '\0' && *pos != '\n') pos++;
+                if(*pos == '\n') pos++;
+                (*blocks)[num_blocks].length = (uint32_t) (pos - buf) - (*blocks)[num_blocks].offset;
+                num_blocks++;
+                continue;
+            }
+        }
+
+        while(*pos != '\0' && *pos != '\n') pos++;
+        if(*pos == '\n') pos++;
+    }
+
+    return num_blocks;
+}
+
+/* sink that accumulates everything into a fragment */
+typedef struct FragmentSink {
+    T3DContext *ctx;
+    Fragment *fragment;
+} FragmentSink;
+
+static size_t WriteFragment(const void *data, size_t length, void *user) {
+    FragmentSink *sink = (FragmentSink *) user;
+
+    char *buf = t3dReallocTag(sink->ctx, sink->fragment->data, sink->fragment->length + length, T3D_MEMORY_INCREMENTAL);
+    if(buf == NULL) {
+        return 0;
+    }
+
+    memcpy(&buf[sink->fragment->length], data, length);
+    sink->fragment->data = buf;
+    sink->fragment->length += length;
+    return length;
+}
+
+/* parses the given block in isolation and caches whatever it produces */
+static bool ConvertBlock(T3DContext *ctx, Block *block) {
+    char end = block->start[block->length];
+    block->start[block->length] = '\0';
+
+    t3dResetContext(ctx);
+    t3dParseBuffer(ctx, block->start, block->length);
+
+    block->start[block->length] = end;
+
+    if(ctx->error != T3D_ERROR_NONE) {
+        return false;
+    }
+
+    block->num_brushes = ctx->num_brushes;
+    block->num_actors  = ctx->num_actors;
+    if(((block->brushes = t3dCallocTag(ctx, block->num_brushes + 1, sizeof(Fragment), T3D_MEMORY_INCREMENTAL)) == NULL) ||
+       ((block->actors = t3dCallocTag(ctx, block->num_actors + 1, sizeof(Fragment), T3D_MEMORY_INCREMENTAL)) == NULL)) {
+        return false;
+    }
+
+    /* these go for everything, so the order comes out the same as a full conversion */
+    for(unsigned int i = 0; i < ctx->num_brushes; ++i) {
+        if(ctx->options.duplicates || ctx->options.dedupe || ctx->options.sort) {
+            block->brushes[i].hash = t3dHashBrush(&ctx->brushes[i]);
+        }
+        if(ctx->options.sort) {
+            t3dGetBrushCentre(&ctx->brushes[i], block->brushes[i].centre);
+        }
+    }
+    for(unsigned int i = 0; i < ctx->num_actors && ctx->options.sort; ++i) {
+        t3dGetActorCentre(ctx, &ctx->actors[i], block->actors[i].centre);
+    }
+
+    /* kept by name, as the numbers only hold within this block */
+    if(ctx->options.groups && ctx->num_groups > 1) {
+        block->num_groups = ctx->num_groups;
+        if((block->groups = t3dMallocTag(ctx, sizeof(T3DGroupName) * block->num_groups, T3D_MEMORY_INCREMENTAL)) == NULL) {
+            return false;
+        }
+        memcpy(block->groups, ctx->groups, sizeof(T3DGroupName) * block->num_groups);
+
+        for(unsigned int i = 0; i < ctx->num_brushes; ++i) {
+            if(t3dIsBrushExported(ctx, &ctx->brushes[i])) {
+                block->brushes[i].group = ctx->brushes[i].group;
+            }
+        }
+    }
+
+    T3DWriter writer;
+    for(unsigned int i = 0; i < ctx->num_brushes; ++i) {
+        if(!t3dCheckBrush(ctx, &ctx->brushes[i], i)) {
+            continue;
+        }
+
+        FragmentSink user = { ctx, &block->brushes[i] };
+        T3DSink sink = { WriteFragment, &user };
+        t3dInitWriter(&writer, ctx, &sink);
+        writer.defer_ids = true;
+        t3dWriteBrush(&writer, &ctx->brushes[i]);
+        t3dFlushWriter(&writer);
+    }
+
+    for(unsigned int i = 0; i < ctx->num_actors; ++i) {
+        if(!t3dCheckEntity(ctx, &ctx->actors[i])) {
+            continue;
+        }
+
+        FragmentSink user = { ctx, &block->actors[i] };
+        T3DSink sink = { WriteFragment, &user };
+        t3dInitWriter(&writer, ctx, &sink);
+        writer.defer_ids = true;
+        t3dWriteEntity(&writer, &ctx->actors[i]);
+        t3dFlushWriter(&writer);
+    }
+
+    return (ctx->error == T3D_ERROR_NONE);
+}
+
+T3DIncremental *t3dCreateIncremental(T3DContext *ctx) {
+    T3DIncremental *inc = t3dCallocTag(ctx, 1, sizeof(T3DIncremental), T3D_MEMORY_INCREMENTAL);
+    if(inc == NULL) {
+        return NULL;
+    }
+
+    inc->ctx = ctx;
+    return inc;
+}
+
+void t3dDestroyIncremental(T3DIncremental *inc) {
+    if(inc == NULL) {
+        return;
+    }
+
+    for(unsigned int i = 0; i < inc->num_blocks; ++i) {
+        FreeBlock(inc->ctx, &inc->blocks[i]);
+    }
+    t3dFree(inc->ctx, inc->blocks);
+    t3dFree(inc->ctx, inc);
+}
+
+/* same as the writer's, but going by the hashes cached alongside each brush */
+static uint32_t *FindDuplicates(T3DContext *ctx, const Fragment **brushes, unsigned int num_brushes) {
+    if(!ctx->options.duplicates && !ctx->options.dedupe) {
+        return NULL;
+    }
+
+    uint64_t *hashes = t3dCallocTag(ctx, num_brushes + 1, sizeof(uint64_t), T3D_MEMORY_BRUSHES);
+    if(hashes == NULL) {
+        return NULL;
+    }
+
+    for(unsigned int i = 0; i < num_brushes; ++i) {
+        if(brushes[i]->data != NULL) {
+            hashes[i] = brushes[i]->hash;
+        }
+    }
+
+    uint32_t *duplicates = t3dFindDuplicateBrushes(ctx, hashes, num_brushes);
+    t3dFree(ctx, hashes);
+
+    return duplicates;
+}
+
+/* same as the writer's, returns NULL if we're sticking to the original order */
+static uint32_t *SortFragments(T3DContext *ctx, const Fragment **fragments, unsigned int num, bool ties) {
+    if(!ctx->options.sort) {
+        return NULL;
+    }
+
+    uint32_t *order = t3dMallocTag(ctx, sizeof(uint32_t) * (num + 1), T3D_MEMORY_INCREMENTAL);
+    double *centres = t3dMallocTag(ctx, sizeof(double) * 3 * (num + 1), T3D_MEMORY_INCREMENTAL);
+    uint64_t *hashes = t3dMallocTag(ctx, sizeof(uint64_t) * (num + 1), T3D_MEMORY_INCREMENTAL);
+    if(order != NULL && centres != NULL && hashes != NULL) {
+        for(unsigned int i = 0; i < num; ++i) {
+            memcpy(&centres[i * 3], fragments[i]->centre, sizeof(double) * 3);
+            hashes[i] = fragments[i]->hash;
+        }
+
+        if(!t3dSortSpatially(ctx, centres, ties ? hashes : NULL, num, order)) {
+            t3dFree(ctx, order);
+            order = NULL;
+        }
+    }
+
+    t3dFree(ctx, centres);
+    t3dFree(ctx, hashes);
+
+    return order;
+}
+
+/* flattens the fragments out so they can be indexed the same as the context's brushes and actors */
+static const Fragment **GatherFragments(T3DContext *ctx, const Block *blocks, unsigned int num_blocks,
+                                        bool actors, unsigned int num) {
+    const Fragment **fragments = t3dMallocTag(ctx, sizeof(Fragment *) * (num + 1), T3D_MEMORY_INCREMENTAL);
+    if(fragments == NULL) {
+        return NULL;
+    }
+
+    unsigned int index = 0;
+    for(unsigned int i = 0; i < num_blocks; ++i) {
+        unsigned int count = actors ? blocks[i].num_actors : blocks[i].num_brushes;
+        for(unsigned int j = 0; j < count && index < num; ++j, ++index) {
+            fragments[index] = actors ? &blocks[i].actors[j] : &blocks[i].brushes[j];
+        }
+    }
+
+    return fragments;
+}
+
+/* Numbers the groups across the whole map, going through each block's in
+ * the order they were first seen, same as a full conversion would, and
+ * returns the group of each brush in that numbering. */
+static uint32_t *GatherGroups(T3DContext *ctx, const Block *blocks, unsigned int num_blocks, unsigned int num) {
+    for(unsigned int i = 0; i < num_blocks; ++i) {
+        for(unsigned int j = 1; j < blocks[i].num_groups; ++j) {
+            t3dInternGroup(ctx, blocks[i].groups[j].name);
+        }
+    }
+
+    uint32_t *groups = t3dCallocTag(ctx, num + 1, sizeof(uint32_t), T3D_MEMORY_INCREMENTAL);
+    if(groups == NULL) {
+        return NULL;
+    }
+
+    unsigned int index = 0;
+    for(unsigned int i = 0; i < num_blocks; ++i) {
+        for(unsigned int j = 0; j < blocks[i].num_brushes && index < num; ++j, ++index) {
+            uint32_t group = blocks[i].brushes[j].group;
+            if(group != 0 && group < blocks[i].num_groups) {
+                groups[index] = t3dFindGroup(ctx, blocks[i].groups[group].name);
+            }
+        }
+    }
+
+    return groups;
+}
+
+static void WriteFragments(T3DWriter *writer, const T3DExport *info, const Fragment **brushes,
+                           const uint32_t *groups, unsigned int first, unsigned int last) {
+    T3DContext *ctx = writer->ctx;
+    for(unsigned int n = first; n < last; ++n) {
+        unsigned int i = t3dGetExportBrush(info, n);
+        if(brushes[i]->data == NULL || !t3dCheckDuplicate(ctx, info->duplicates, i)) {
+            continue;
+        }
+
+        t3dBeginBrush(writer, i);
+        t3dWriterWriteDeferred(writer, brushes[i]->data, brushes[i]->length, (groups != NULL) ? groups[i] : 0);
+    }
+}
+
+/* same as the writer's, everything but group 0 */
+static void WriteFragmentGroups(T3DWriter *writer, const T3DExport *info, const Fragment **brushes,
+                                const uint32_t *groups) {
+    for(unsigned int i = 1; i < info->num_groups; ++i) {
+        if(info->group_starts[i] == info->group_starts[i + 1]) {
+            continue;
+        }
+
+        writer->format->begin_group(writer, i);
+        WriteFragments(writer, info, brushes, groups, info->group_starts[i], info->group_starts[i + 1]);
+        writer->format->end_group(writer);
+    }
+}
+
+/* converts any blocks that changed and writes the whole map out again */
+T3DError t3dUpdateIncremental(T3DIncremental *inc, char *buf, size_t length, const T3DSink *sink,
+                              unsigned int *num_changed, unsigned int *num_blocks) {
+    T3DContext *ctx = inc->ctx;
+
+    t3dResetContext(ctx);
+
+    if(buf == NULL || buf[length] != '\0' || sink == NULL || sink->write == NULL) {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: invalid parameters passed to t3dUpdateIncremental!\n");
+        return ctx->error;
+    }
+
+    T3DSpan *spans;
+    const char *header = NULL;
+    unsigned int new_num_blocks = t3dFindBlocks(ctx, buf, &spans, &header, T3D_MEMORY_INCREMENTAL);
+    Block *blocks = NULL;
+    if(ctx->error == T3D_ERROR_NONE) {
+        blocks = t3dCallocTag(ctx, new_num_blocks + 1, sizeof(Block), T3D_MEMORY_INCREMENTAL);
+    }
+    if(blocks == NULL) {
+        t3dFree(ctx, spans);
+        return ctx->error;
+    }
+
+    for(unsigned int i = 0; i < new_num_blocks; ++i) {
+        blocks[i].start  = buf + spans[i].offset;
+        blocks[i].length = spans[i].length;
+    }
+    t3dFree(ctx, spans);
+
+    /* anything we've seen before can be pulled straight out of the cache */
+    unsigned int table_size = 1;
+    while(table_size < (inc->num_blocks * 2) + 1) table_size <<= 1;
+    Block **table = t3dCallocTag(ctx, table_size, sizeof(Block *), T3D_MEMORY_INCREMENTAL);
+    if(table == NULL) {
+        t3dFree(ctx, blocks);
+        return ctx->error;
+    }
+
+    for(unsigned int i = 0; i < inc->num_blocks; ++i) {
+        unsigned int slot = (unsigned int) (inc->blocks[i].hash & (table_size - 1));
+        while(table[slot] != NULL) slot = (slot + 1) & (table_size - 1);
+        table[slot] = &inc->blocks[i];
+    }
+
+    *num_changed = 0;
+    for(unsigned int i = 0; i < new_num_blocks; ++i) {
+        blocks[i].hash = HashBlock(blocks[i].start, blocks[i].length);
+
+        unsigned int slot = (unsigned int) (blocks[i].hash & (table_size - 1));
+        while(table[slot] != NULL) {
+            if(table[slot]->hash == blocks[i].hash && table[slot]->brushes != NULL) {
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if(table[slot] != NULL) {
+            /* take ownership of the cached fragments */
+            blocks[i].brushes     = table[slot]->brushes;
+            blocks[i].num_brushes = table[slot]->num_brushes;
+            blocks[i].actors      = table[slot]->actors;
+            blocks[i].num_actors  = table[slot]->num_actors;
+            blocks[i].groups      = table[slot]->groups;
+            blocks[i].num_groups  = table[slot]->num_groups;
+            table[slot]->brushes  = NULL;
+            table[slot]->actors   = NULL;
+            table[slot]->groups   = NULL;
+            continue;
+        }
+
+        (*num_changed)++;
+        if(!ConvertBlock(ctx, &blocks[i])) {
+            break;
+        }
+    }
+
+    t3dFree(ctx, table);
+
+    for(unsigned int i = 0; i < inc->num_blocks; ++i) {
+        FreeBlock(ctx, &inc->blocks[i]);
+    }
+    t3dFree(ctx, inc->blocks);
+
+    inc->blocks     = blocks;
+    inc->num_blocks = new_num_blocks;
+    *num_blocks     = new_num_blocks;
+
+    if(ctx->error != T3D_ERROR_NONE) {
+        /* don't keep around anything that might be half-done */
+        for(unsigned int i = 0; i < inc->num_blocks; ++i) {
+            FreeBlock(ctx, &inc->blocks[i]);
+        }
+        inc->num_blocks = 0;
+        return ctx->error;
+    }
+
+    /* now stitch everything back together */
+
+    t3dResetContext(ctx);
+    if(header != NULL) {
+        t3dReadMapHeader(ctx, header);
+    }
+
+    for(unsigned int i = 0; i < new_num_blocks; ++i) {
+        ctx->num_brushes += blocks[i].num_brushes;
+        ctx->num_actors  += blocks[i].num_actors;
+    }
+
+    unsigned int num_brushes, num_actors;
+    bool status = t3dGetExportCounts(ctx, &num_brushes, &num_actors);
+
+    /* these were only borrowed for the sake of counting */
+    ctx->num_brushes = 0;
+    ctx->num_actors  = 0;
+
+    if(!status) {
+        return ctx->error;
+    }
+
+    const Fragment **brushes = GatherFragments(ctx, blocks, new_num_blocks, false, num_brushes);
+    const Fragment **actors = GatherFragments(ctx, blocks, new_num_blocks, true, num_actors);
+    uint32_t *groups = NULL;
+    if(ctx->options.groups && brushes != NULL) {
+        groups = GatherGroups(ctx, blocks, new_num_blocks, num_brushes);
+    }
+    if(brushes == NULL || actors == NULL || (ctx->options.groups && groups == NULL)) {
+        t3dFree(ctx, brushes);
+        t3dFree(ctx, actors);
+        t3dFree(ctx, groups);
+        return ctx->error;
+    }
+
+    T3DExport info = {
+            .num_brushes  = num_brushes,
+            .num_actors   = num_actors,
+            .duplicates   = FindDuplicates(ctx, brushes, num_brushes),
+            .brush_order  = SortFragments(ctx, brushes, num_brushes, true),
+            .actor_order  = SortFragments(ctx, actors, num_actors, false),
+    };
+    if(groups != NULL) {
+        t3dLayoutGroups(ctx, &info, groups);
+    }
+
+    T3DWriter writer;
+    t3dInitWriter(&writer, ctx, sink);
+    t3dWriteWorldspawn(&writer);
+
+    if(info.group_starts != NULL) {
+        WriteFragments(&writer, &info, brushes, groups, 0, info.group_starts[1]);
+        if(!writer.format->group_entities) {
+            WriteFragmentGroups(&writer, &info, brushes, groups);
+        }
+    } else {
+        WriteFragments(&writer, &info, brushes, groups, 0, num_brushes);
+    }
+
+    t3dEndWorldspawn(&writer);
+
+    if(info.group_starts != NULL && writer.format->group_entities) {
+        WriteFragmentGroups(&writer, &info, brushes, groups);
+    }
+
+    for(unsigned int n = 0; n < num_actors; ++n) {
+        unsigned int i = t3dGetExportActor(&info, n);
+        if(actors[i]->data == NULL) {
+            continue;
+        }
+
+        t3dWriterWriteDeferred(&writer, actors[i]->data, actors[i]->length, 0);
+    }
+
+    t3dEndMap(&writer);
+    t3dFlushWriter(&writer);
+
+    t3dEndExport(ctx, &info);
+    t3dFree(ctx, brushes);
+    t3dFree(ctx, actors);
+    t3dFree(ctx, groups);
+
+    return ctx->error;
+}
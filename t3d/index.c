@@ -0,0 +1,372 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "t3d_private.h"
+
+/* The index is a table of contents for a document, giving the byte range
+ * of each top-level block along with enough about what's in it to pick
+ * out the ones that are wanted. Those can then be read and parsed on their
+ * own, rather than going over the whole document each time. It's written
+ * out alongside the document, stamped with the document's size and time,
+ * so it's easy to tell when it needs to be built again. */
+
+#define INDEX_MAGIC     "T3DI"
+#define INDEX_VERSION   1
+
+typedef struct IndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_size;    /* catches anything built with a different layout */
+    uint32_t num_entries;
+    uint64_t file_size;
+    int64_t file_time;
+} IndexHeader;
+
+static bool GetFileStamp(const char *path, uint64_t *size, int64_t *time) {
+    struct stat info;
+    if(stat(path, &info) != 0) {
+        return false;
+    }
+
+    *size = (uint64_t) info.st_size;
+    *time = (int64_t) info.st_mtime;
+    return true;
+}
+
+/* i.e. foo.t3d -> foo.t3d.idx */
+static void GetIndexPath(const char *path, char *index_path, size_t size) {
+    snprintf(index_path, size, "%s.idx", path);
+}
+
+static T3DIndex *CreateIndex(T3DContext *ctx, unsigned int num_entries) {
+    T3DIndex *index = t3dCallocTag(ctx, 1, sizeof(T3DIndex), T3D_MEMORY_INDEX);
+    if(index == NULL) {
+        return NULL;
+    }
+
+    if((index->entries = t3dCallocTag(ctx, num_entries + 1, sizeof(T3DIndexEntry), T3D_MEMORY_INDEX)) == NULL) {
+        t3dFree(ctx, index);
+        return NULL;
+    }
+
+    index->num_entries = num_entries;
+    return index;
+}
+
+void t3dDestroyIndex(T3DContext *ctx, T3DIndex *index) {
+    if(index == NULL) {
+        return;
+    }
+
+    t3dFree(ctx, index->entries);
+    t3dFree(ctx, index);
+}
+
+/* parses each block in isolation to find out what's in it */
+static bool IndexBlock(T3DContext *ctx, char *buf, const T3DSpan *block, T3DIndexEntry *entry) {
+    entry->offset = block->offset;
+    entry->length = block->length;
+
+    char *start = buf + block->offset;
+    char end = start[block->length];
+    start[block->length] = '\0';
+
+    t3dResetContext(ctx);
+    t3dParseBuffer(ctx, start, block->length);
+
+    start[block->length] = end;
+
+    if(ctx->error != T3D_ERROR_NONE) {
+        return false;
+    }
+
+    if(ctx->num_actors > 0) {
+        snprintf(entry->class_name, sizeof(entry->class_name), "%s", ctx->actors[0].class_name);
+        snprintf(entry->name, sizeof(entry->name), "%s", ctx->actors[0].name);
+    }
+
+    bool valid = false;
+    double mins[3], maxs[3];
+    for(unsigned int i = 0; i < ctx->num_brushes; ++i) {
+        entry->num_polygons += ctx->brushes[i].num_poly;
+
+        double brush_mins[3], brush_maxs[3];
+        if(!t3dGetBrushBounds(&ctx->brushes[i], brush_mins, brush_maxs)) {
+            continue;
+        }
+
+        for(unsigned int j = 0; j < 3; ++j) {
+            if(!valid || brush_mins[j] < mins[j]) mins[j] = brush_mins[j];
+            if(!valid || brush_maxs[j] > maxs[j]) maxs[j] = brush_maxs[j];
+        }
+        valid = true;
+    }
+    entry->num_brushes = ctx->num_brushes;
+
+    /* otherwise it's just a point */
+    if(!valid && ctx->num_actors > 0) {
+        t3dGetActorCentre(ctx, &ctx->actors[0], mins);
+        memcpy(maxs, mins, sizeof(maxs));
+        valid = true;
+    }
+
+    for(unsigned int i = 0; i < 3 && valid; ++i) {
+        entry->mins[i] = (float) mins[i];
+        entry->maxs[i] = (float) maxs[i];
+    }
+
+    return true;
+}
+
+T3DIndex *t3dBuildIndex(T3DContext *ctx, char *buf, size_t length) {
+    t3dResetContext(ctx);
+
+    if(buf == NULL || buf[length] != '\0') {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: buffer passed to t3dBuildIndex must be NUL-terminated!\n");
+        return NULL;
+    }
+
+    if(length > UINT32_MAX) {
+        t3dSetError(ctx, T3D_ERROR_LIMIT, "error: documents larger than 4GB aren't supported!\n");
+        return NULL;
+    }
+
+    T3DSpan *blocks;
+    const char *header;
+    unsigned int num_blocks = t3dFindBlocks(ctx, buf, &blocks, &header, T3D_MEMORY_INDEX);
+    T3DIndex *index = (ctx->error == T3D_ERROR_NONE) ? CreateIndex(ctx, num_blocks) : NULL;
+    if(index == NULL) {
+        t3dFree(ctx, blocks);
+        return NULL;
+    }
+
+    for(unsigned int i = 0; i < num_blocks; ++i) {
+        if(!IndexBlock(ctx, buf, &blocks[i], &index->entries[i])) {
+            t3dDestroyIndex(ctx, index);
+            index = NULL;
+            break;
+        }
+    }
+
+    t3dFree(ctx, blocks);
+    t3dResetContext(ctx);
+
+    return index;
+}
+
+T3DError t3dWriteIndex(T3DContext *ctx, const T3DIndex *index, const T3DSink *sink) {
+    if(index == NULL || sink == NULL || sink->write == NULL) {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: invalid parameters passed to t3dWriteIndex!\n");
+        return ctx->error;
+    }
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(IndexHeader));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version     = INDEX_VERSION;
+    header.entry_size  = sizeof(T3DIndexEntry);
+    header.num_entries = index->num_entries;
+    header.file_size   = index->file_size;
+    header.file_time   = index->file_time;
+
+    size_t length = sizeof(T3DIndexEntry) * index->num_entries;
+    if(sink->write(&header, sizeof(IndexHeader), sink->user) != sizeof(IndexHeader) ||
+       sink->write(index->entries, length, sink->user) != length) {
+        t3dSetError(ctx, T3D_ERROR_IO, "error: failed to write index!\n");
+    }
+
+    return ctx->error;
+}
+
+T3DIndex *t3dReadIndex(T3DContext *ctx, const char *index_path, const char *path) {
+    uint64_t file_size;
+    int64_t file_time;
+    if(!GetFileStamp(path, &file_size, &file_time)) {
+        return NULL;
+    }
+
+    FILE *fp = fopen(index_path, "rb");
+    if(fp == NULL) {
+        return NULL;
+    }
+
+    long index_size = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+    if(index_size < (long) sizeof(IndexHeader) || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    IndexHeader header;
+    T3DIndex *index = NULL;
+    if(fread(&header, sizeof(IndexHeader), 1, fp) != 1 ||
+       memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != INDEX_VERSION ||
+       header.entry_size != sizeof(T3DIndexEntry) ||
+       header.file_size != file_size || header.file_time != file_time) {
+        fclose(fp);
+        return NULL;
+    }
+
+    /* the count can't be trusted until it's been checked against what's actually there */
+    if(header.num_entries > (uint64_t) (index_size - sizeof(IndexHeader)) / sizeof(T3DIndexEntry)) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: index \"%s\" is corrupt, ignoring it!\n", index_path);
+        fclose(fp);
+        return NULL;
+    }
+
+    if((index = CreateIndex(ctx, header.num_entries)) != NULL) {
+        index->file_size = header.file_size;
+        index->file_time = header.file_time;
+        if(fread(index->entries, sizeof(T3DIndexEntry), header.num_entries, fp) != header.num_entries) {
+            t3dDestroyIndex(ctx, index);
+            index = NULL;
+        }
+    }
+
+    fclose(fp);
+
+    return index;
+}
+
+T3DIndex *t3dLoadIndex(T3DContext *ctx, const char *path, bool rebuild) {
+    char index_path[PL_SYSTEM_MAX_PATH];
+    GetIndexPath(path, index_path, sizeof(index_path));
+
+    T3DIndex *index = rebuild ? NULL : t3dReadIndex(ctx, index_path, path);
+    if(index != NULL) {
+        t3dLog(ctx, T3D_LOG_INFO, "read index from \"%s\"\n", index_path);
+        return index;
+    }
+
+    uint64_t file_size;
+    int64_t file_time;
+    if(!GetFileStamp(path, &file_size, &file_time)) {
+        t3dSetError(ctx, T3D_ERROR_IO, "failed to find \"%s\", aborting!\n", path);
+        return NULL;
+    }
+
+    size_t length;
+    char *buf = t3dLoadFile(ctx, path, &length);
+    if(buf == NULL) {
+        return NULL;
+    }
+
+    t3dLog(ctx, T3D_LOG_INFO, "indexing \"%s\"...\n", path);
+    index = t3dBuildIndex(ctx, buf, length);
+    t3dFree(ctx, buf);
+    if(index == NULL) {
+        return NULL;
+    }
+
+    index->file_size = file_size;
+    index->file_time = file_time;
+
+    /* not being able to save it for next time isn't the end of the world */
+    FILE *fp = fopen(index_path, "wb");
+    if(fp == NULL) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: failed to open \"%s\" for writing!\n", index_path);
+        return index;
+    }
+
+    T3DSink sink = { t3dWriteFile, fp };
+    t3dWriteIndex(ctx, index, &sink);
+    if(fclose(fp) != 0 || ctx->error != T3D_ERROR_NONE) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: failed to write \"%s\"!\n", index_path);
+        ctx->error = T3D_ERROR_NONE;
+        remove(index_path);
+    }
+
+    return index;
+}
+
+/**************************************************/
+
+/* pulls the selected blocks out of the document, seeking straight to them where it can */
+static char *ReadSelected(T3DContext *ctx, const char *path, const T3DIndex *index, const bool *selected,
+                          size_t *length) {
+    *length = 0;
+    for(unsigned int i = 0; i < index->num_entries; ++i) {
+        if(selected[i]) {
+            *length += index->entries[i].length;
+        }
+    }
+
+    char *buf = t3dMallocTag(ctx, *length + 1, T3D_MEMORY_INPUT);
+    if(buf == NULL) {
+        return NULL;
+    }
+
+    /* compressed or converted documents have to be gone through from the start regardless */
+    size_t bom_length = 0;
+    char *document = NULL;
+    size_t document_length = 0;
+    FILE *fp = NULL;
+    if(t3dDetectFileCompression(path) != T3D_COMPRESSION_NONE ||
+       t3dDetectFileEncoding(path, &bom_length) != T3D_ENCODING_UTF8) {
+        document = t3dLoadFile(ctx, path, &document_length);
+    } else if((fp = fopen(path, "rb")) == NULL) {
+        t3dSetError(ctx, T3D_ERROR_IO, "failed to read \"%s\", aborting!\n", path);
+    }
+
+    size_t pos = 0;
+    for(unsigned int i = 0; i < index->num_entries && ctx->error == T3D_ERROR_NONE; ++i) {
+        const T3DIndexEntry *entry = &index->entries[i];
+        if(!selected[i]) {
+            continue;
+        }
+
+        if(document != NULL) {
+            if(entry->offset + entry->length > document_length) {
+                t3dSetError(ctx, T3D_ERROR_IO, "error: index doesn't match \"%s\"!\n", path);
+                break;
+            }
+            memcpy(&buf[pos], &document[entry->offset], entry->length);
+        } else if(fseek(fp, (long) (entry->offset + bom_length), SEEK_SET) != 0 ||
+                  fread(&buf[pos], 1, entry->length, fp) != entry->length) {
+            t3dSetError(ctx, T3D_ERROR_IO, "error: failed to read block %u from \"%s\"!\n", i, path);
+            break;
+        }
+        pos += entry->length;
+    }
+    buf[pos] = '\0';
+
+    if(fp != NULL) {
+        fclose(fp);
+    }
+    t3dFree(ctx, document);
+
+    if(ctx->error != T3D_ERROR_NONE) {
+        t3dFree(ctx, buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
+T3DError t3dParseIndexed(T3DContext *ctx, const char *path, const T3DIndex *index, const bool *selected) {
+    t3dResetContext(ctx);
+
+    if(path == NULL || index == NULL || selected == NULL) {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: invalid parameters passed to t3dParseIndexed!\n");
+        return ctx->error;
+    }
+
+    size_t length;
+    if((ctx->buffer = ReadSelected(ctx, path, index, selected, &length)) == NULL) {
+        return ctx->error;
+    }
+
+    if(t3dParseBuffer(ctx, ctx->buffer, length) != T3D_ERROR_NONE) {
+        return ctx->error;
+    }
+
+    /* the last brush and actor of a document are never exported, so these stand in for them */
+    ctx->num_brushes++;
+    ctx->num_actors++;
+    t3dGrowBrushes(ctx);
+    t3dGrowActors(ctx);
+
+    return ctx->error;
+}
@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "t3d_private.h"
+
+/* A quick check for leaks before the map ever gets near a compiler. The
+ * brushes are voxelised into a grid, which is then flood filled from each
+ * player start; if the fill makes it out to the edge of the grid, the map
+ * leaks. Cells that a brush overlaps at all are counted as solid, so any
+ * gap narrower than a cell will be missed, but it won't cry wolf. */
+
+#define MAX_CELLS       (1 << 24)
+#define MIN_CELL_SIZE   8.0
+
+/* 1-6 give the direction a cell was reached from */
+#define CELL_EMPTY      0
+#define CELL_START      7
+#define CELL_SOLID      0xff
+
+/* spacing between points written to the point file */
+#define POINT_SPACING   8.0
+
+typedef struct Grid {
+    double origin[3];
+    double cell_size;
+    unsigned int size[3];
+    unsigned char *cells;
+} Grid;
+
+typedef struct Plane {
+    double normal[3];
+    double dist;
+} Plane;
+
+static const int directions[6][3] = {
+        {  1, 0, 0 }, { -1, 0, 0 },
+        { 0,  1, 0 }, { 0, -1, 0 },
+        { 0, 0,  1 }, { 0, 0, -1 },
+};
+
+static double GetTime(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
+
+/* planes as the compiler will see them, facing out of the brush */
+static unsigned int GetBrushPlanes(const T3DBrush *brush, Plane *planes) {
+    unsigned int num_planes = 0;
+    for(unsigned int i = 0; i < brush->num_poly && num_planes < MAX_BRUSH_FACES; ++i) {
+        double points[3][3];
+        t3dGetFacePoints(brush, &brush->poly_list[i], points);
+        for(unsigned int j = 0; j < 3; ++j) {
+            for(unsigned int k = 0; k < 3; ++k) {
+                points[j][k] = (int) points[j][k];
+            }
+        }
+
+        Plane *plane = &planes[num_planes];
+        if(t3dGetNormal(points[0], points[1], points[2], plane->normal) == 0.0) {
+            continue;
+        }
+        plane->dist = t3dDotProduct(plane->normal, points[1]);
+        num_planes++;
+    }
+    return num_planes;
+}
+
+static void AddBounds(double *mins, double *maxs, const double *point) {
+    for(unsigned int i = 0; i < 3; ++i) {
+        if(point[i] < mins[i]) mins[i] = point[i];
+        if(point[i] > maxs[i]) maxs[i] = point[i];
+    }
+}
+
+/* the grid always has at least a cell of space around everything, so it's always possible to get around the outside */
+static bool CreateGrid(T3DContext *ctx, Grid *grid, const double *mins, const double *maxs) {
+    grid->cell_size = MIN_CELL_SIZE;
+    for(;;) {
+        uint64_t num_cells = 1;
+        for(unsigned int i = 0; i < 3; ++i) {
+            grid->size[i] = (unsigned int) ceil((maxs[i] - mins[i]) / grid->cell_size) + 3;
+            num_cells *= grid->size[i];
+        }
+
+        if(num_cells <= MAX_CELLS) {
+            break;
+        }
+
+        grid->cell_size *= 2.0;
+    }
+
+    for(unsigned int i = 0; i < 3; ++i) {
+        grid->origin[i] = mins[i] - grid->cell_size;
+    }
+
+    grid->cells = t3dCallocTag(ctx, (size_t) grid->size[0] * grid->size[1] * grid->size[2], 1, T3D_MEMORY_GEOMETRY);
+    return (grid->cells != NULL);
+}
+
+static inline uint32_t GetCellIndex(const Grid *grid, unsigned int x, unsigned int y, unsigned int z) {
+    return x + (y + z * grid->size[1]) * grid->size[0];
+}
+
+static void GetCellPosition(const Grid *grid, uint32_t index, unsigned int *position) {
+    position[0] = index % grid->size[0];
+    position[1] = (index / grid->size[0]) % grid->size[1];
+    position[2] = index / (grid->size[0] * grid->size[1]);
+}
+
+static void GetCellCentre(const Grid *grid, uint32_t index, double *point) {
+    unsigned int position[3];
+    GetCellPosition(grid, index, position);
+    for(unsigned int i = 0; i < 3; ++i) {
+        point[i] = grid->origin[i] + (position[i] + 0.5) * grid->cell_size;
+    }
+}
+
+static bool IsBorderCell(const Grid *grid, uint32_t index) {
+    unsigned int position[3];
+    GetCellPosition(grid, index, position);
+    for(unsigned int i = 0; i < 3; ++i) {
+        if(position[i] == 0 || position[i] == grid->size[i] - 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* works out the run of cells along each row that the brush overlaps, straight from its planes */
+static void FillBrush(Grid *grid, const Plane *planes, unsigned int num_planes, const double *mins, const double *maxs) {
+    const double cs = grid->cell_size;
+    const double epsilon = 0.01;
+
+    unsigned int lo[3], hi[3];
+    for(unsigned int i = 0; i < 3; ++i) {
+        lo[i] = (unsigned int) floor((mins[i] - grid->origin[i]) / cs);
+        hi[i] = (unsigned int) floor((maxs[i] - grid->origin[i]) / cs);
+        if(hi[i] >= grid->size[i]) hi[i] = grid->size[i] - 1;
+    }
+
+    for(unsigned int z = lo[2]; z <= hi[2]; ++z) {
+        double z0 = grid->origin[2] + z * cs;
+        for(unsigned int y = lo[1]; y <= hi[1]; ++y) {
+            double y0 = grid->origin[1] + y * cs;
+
+            int start = (int) lo[0], end = (int) hi[0];
+            for(unsigned int i = 0; i < num_planes && start <= end; ++i) {
+                const double *n = planes[i].normal;
+
+                /* the cell overlaps the brush if some part of it is behind every plane */
+                double r = planes[i].dist - epsilon;
+                r -= n[1] * ((n[1] > 0.0) ? y0 : y0 + cs);
+                r -= n[2] * ((n[2] > 0.0) ? z0 : z0 + cs);
+
+                if(fabs(n[0]) < 1e-9) {
+                    if(r <= 0.0) {
+                        start = end + 1;
+                    }
+                } else if(n[0] > 0.0) {
+                    double limit = ceil((r / n[0] - grid->origin[0]) / cs) - 1.0;
+                    if(limit < end) end = (limit < start) ? start - 1 : (int) limit;
+                } else {
+                    double limit = floor((r / n[0] - grid->origin[0] - cs) / cs) + 1.0;
+                    if(limit > start) start = (limit > end) ? end + 1 : (int) limit;
+                }
+            }
+
+            if(start <= end) {
+                memset(&grid->cells[GetCellIndex(grid, (unsigned int) start, y, z)], CELL_SOLID,
+                       (size_t) (end - start + 1));
+            }
+        }
+    }
+}
+
+/* player starts sit right on top of the floor, so may well end up in a solid cell */
+static bool GetStartCell(const Grid *grid, const double *location, uint32_t *index) {
+    int position[3];
+    for(unsigned int i = 0; i < 3; ++i) {
+        position[i] = (int) floor((location[i] - grid->origin[i]) / grid->cell_size);
+        if(position[i] < 0 || position[i] >= (int) grid->size[i]) {
+            return false;
+        }
+    }
+
+    static const int offsets[] = { 0, 1, -1 };
+    for(unsigned int i = 0; i < 27; ++i) {
+        int x = position[0] + offsets[i % 3];
+        int y = position[1] + offsets[(i / 3) % 3];
+        int z = position[2] + offsets[i / 9];
+        if(x < 0 || y < 0 || z < 0 || x >= (int) grid->size[0] || y >= (int) grid->size[1] || z >= (int) grid->size[2]) {
+            continue;
+        }
+
+        *index = GetCellIndex(grid, (unsigned int) x, (unsigned int) y, (unsigned int) z);
+        if(grid->cells[*index] != CELL_SOLID) {
+            return true;
+        }
+    }
+
+    *index = UINT32_MAX;
+    return true;
+}
+
+static void WritePoint(T3DWriter *writer, const double *point) {
+    t3dWriterPrintf(writer, "%g %g %g\n", point[0], point[1], point[2]);
+}
+
+static void WriteLine(T3DWriter *writer, const double *from, const double *to) {
+    double delta[3] = { to[0] - from[0], to[1] - from[1], to[2] - from[2] };
+    double length = sqrt(t3dDotProduct(delta, delta));
+    unsigned int steps = (unsigned int) ceil(length / POINT_SPACING);
+    for(unsigned int i = 1; i <= steps; ++i) {
+        double f = (double) i / steps;
+        double point[3] = { from[0] + delta[0] * f, from[1] + delta[1] * f, from[2] + delta[2] * f };
+        WritePoint(writer, point);
+    }
+}
+
+/* walks back from where we got out to the start, then writes it out the other way around */
+static void WritePointFile(T3DContext *ctx, const T3DSink *sink, const Grid *grid, uint32_t leak,
+                           const double *start) {
+    unsigned int num_cells = 0;
+    for(uint32_t index = leak;; ++num_cells) {
+        unsigned char cell = grid->cells[index];
+        if(cell == CELL_START) {
+            num_cells++;
+            break;
+        }
+
+        /* step back the way we came */
+        unsigned int position[3];
+        GetCellPosition(grid, index, position);
+        const int *direction = directions[cell - 1];
+        index = GetCellIndex(grid, position[0] - direction[0], position[1] - direction[1], position[2] - direction[2]);
+    }
+
+    uint32_t *path = t3dMallocTag(ctx, sizeof(uint32_t) * num_cells, T3D_MEMORY_GEOMETRY);
+    if(path == NULL) {
+        return;
+    }
+
+    uint32_t index = leak;
+    for(unsigned int i = num_cells; i-- > 0;) {
+        path[i] = index;
+        unsigned char cell = grid->cells[index];
+        if(cell == CELL_START) {
+            break;
+        }
+
+        unsigned int position[3];
+        GetCellPosition(grid, index, position);
+        const int *direction = directions[cell - 1];
+        index = GetCellIndex(grid, position[0] - direction[0], position[1] - direction[1], position[2] - direction[2]);
+    }
+
+    T3DWriter writer;
+    t3dInitWriter(&writer, ctx, sink);
+
+    double last[3] = { start[0], start[1], start[2] };
+    WritePoint(&writer, last);
+    for(unsigned int i = 0; i < num_cells; ++i) {
+        double point[3];
+        GetCellCentre(grid, path[i], point);
+        WriteLine(&writer, last, point);
+        memcpy(last, point, sizeof(last));
+    }
+
+    t3dFlushWriter(&writer);
+    t3dFree(ctx, path);
+}
+
+/* flood fills from each of the given cells, returns the border cell it escaped to if there's a leak */
+static uint32_t FloodFill(T3DContext *ctx, Grid *grid, const uint32_t *starts, unsigned int num_starts) {
+    size_t num_cells = (size_t) grid->size[0] * grid->size[1] * grid->size[2];
+    uint32_t *queue = t3dMallocTag(ctx, sizeof(uint32_t) * num_cells, T3D_MEMORY_GEOMETRY);
+    if(queue == NULL) {
+        return UINT32_MAX;
+    }
+
+    size_t head = 0, tail = 0;
+    for(unsigned int i = 0; i < num_starts; ++i) {
+        if(grid->cells[starts[i]] == CELL_EMPTY) {
+            grid->cells[starts[i]] = CELL_START;
+            queue[tail++] = starts[i];
+        }
+    }
+
+    /* breadth first, so the first way out that turns up is also the shortest */
+    uint32_t leak = UINT32_MAX;
+    while(head < tail && leak == UINT32_MAX) {
+        uint32_t index = queue[head++];
+        if(IsBorderCell(grid, index)) {
+            leak = index;
+            break;
+        }
+
+        unsigned int position[3];
+        GetCellPosition(grid, index, position);
+        for(unsigned int i = 0; i < 6; ++i) {
+            /* border cells are never expanded, so this can't step outside the grid */
+            uint32_t next = GetCellIndex(grid,
+                                         position[0] + directions[i][0],
+                                         position[1] + directions[i][1],
+                                         position[2] + directions[i][2]);
+            if(grid->cells[next] == CELL_EMPTY) {
+                grid->cells[next] = (unsigned char) (i + 1);
+                queue[tail++] = next;
+            }
+        }
+    }
+
+    t3dFree(ctx, queue);
+
+    return leak;
+}
+
+/* traces the leak back to whichever start it came from */
+static uint32_t GetLeakStart(const Grid *grid, uint32_t index) {
+    for(;;) {
+        unsigned char cell = grid->cells[index];
+        if(cell == CELL_START) {
+            return index;
+        }
+
+        unsigned int position[3];
+        GetCellPosition(grid, index, position);
+        const int *direction = directions[cell - 1];
+        index = GetCellIndex(grid, position[0] - direction[0], position[1] - direction[1], position[2] - direction[2]);
+    }
+}
+
+T3DError t3dCheckLeaks(T3DContext *ctx, const T3DSink *sink, bool *leaked) {
+    *leaked = false;
+
+    if(sink == NULL || sink->write == NULL) {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: invalid sink passed to t3dCheckLeaks!\n");
+        return ctx->error;
+    }
+
+    unsigned int num_brushes, num_actors;
+    if(!t3dGetExportCounts(ctx, &num_brushes, &num_actors)) {
+        return ctx->error;
+    }
+
+    double start_time = GetTime();
+
+    /* work out how big everything is first, so we know how big the grid needs to be */
+    double mins[3] = { INFINITY, INFINITY, INFINITY }, maxs[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for(unsigned int i = 0; i < num_brushes; ++i) {
+        double brush_mins[3], brush_maxs[3];
+        if(t3dIsBrushExported(ctx, &ctx->brushes[i]) && t3dGetBrushBounds(&ctx->brushes[i], brush_mins, brush_maxs)) {
+            AddBounds(mins, maxs, brush_mins);
+            AddBounds(mins, maxs, brush_maxs);
+        }
+    }
+
+    uint32_t *starts = t3dMallocTag(ctx, sizeof(uint32_t) * (num_actors + 1), T3D_MEMORY_GEOMETRY);
+    double *locations = t3dMallocTag(ctx, sizeof(double) * 3 * (num_actors + 1), T3D_MEMORY_GEOMETRY);
+    if(starts == NULL || locations == NULL) {
+        t3dFree(ctx, starts);
+        t3dFree(ctx, locations);
+        return ctx->error;
+    }
+
+    unsigned int num_starts = 0;
+    for(unsigned int i = 0; i < num_actors; ++i) {
+        const T3DActor *actor = &ctx->actors[i];
+        if(actor->class_index == NULL || actor->class_index->id != ACT_PlayerStart) {
+            continue;
+        }
+
+        t3dGetActorCentre(ctx, actor, &locations[num_starts * 3]);
+        starts[num_starts++] = i;
+    }
+
+    if(num_starts == 0) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: no player starts to check for leaks from!\n");
+        t3dFree(ctx, starts);
+        t3dFree(ctx, locations);
+        return ctx->error;
+    }
+
+    if(mins[0] > maxs[0]) {
+        /* nothing at all, so there's nothing to stop anyone getting out */
+        mins[0] = mins[1] = mins[2] = 0.0;
+        maxs[0] = maxs[1] = maxs[2] = 0.0;
+    }
+
+    Grid grid;
+    if(!CreateGrid(ctx, &grid, mins, maxs)) {
+        t3dFree(ctx, starts);
+        t3dFree(ctx, locations);
+        return ctx->error;
+    }
+
+    t3dLog(ctx, T3D_LOG_INFO, "checking for leaks with %ux%ux%u cells of %g units...\n",
+           grid.size[0], grid.size[1], grid.size[2], grid.cell_size);
+
+    Plane *planes = t3dMallocTag(ctx, sizeof(Plane) * MAX_BRUSH_FACES, T3D_MEMORY_GEOMETRY);
+    if(planes == NULL) {
+        t3dFree(ctx, grid.cells);
+        t3dFree(ctx, starts);
+        t3dFree(ctx, locations);
+        return ctx->error;
+    }
+
+    for(unsigned int i = 0; i < num_brushes; ++i) {
+        const T3DBrush *brush = &ctx->brushes[i];
+
+        double brush_mins[3], brush_maxs[3];
+        if(!t3dIsBrushExported(ctx, brush) || !t3dGetBrushBounds(brush, brush_mins, brush_maxs)) {
+            continue;
+        }
+
+        unsigned int num_planes = GetBrushPlanes(brush, planes);
+        FillBrush(&grid, planes, num_planes, brush_mins, brush_maxs);
+    }
+
+    t3dFree(ctx, planes);
+
+    /* sort out where everyone starts from, anyone starting off outside the grid is a leak by default */
+    unsigned int num_cells = 0, outside = UINT32_MAX;
+    for(unsigned int i = 0; i < num_starts; ++i) {
+        uint32_t index;
+        if(!GetStartCell(&grid, &locations[i * 3], &index)) {
+            outside = i;
+            break;
+        }
+
+        if(index == UINT32_MAX) {
+            t3dLog(ctx, T3D_LOG_WARNING, "warning: player start %u is inside solid geometry, ignoring!\n", starts[i]);
+            continue;
+        }
+
+        /* keep the locations in step with the cells, so we know where a leak came from */
+        memmove(&locations[num_cells * 3], &locations[i * 3], sizeof(double) * 3);
+        starts[num_cells++] = index;
+    }
+
+    if(outside != UINT32_MAX) {
+        *leaked = true;
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: player start %u is outside of the map!\n", starts[outside]);
+
+        T3DWriter writer;
+        t3dInitWriter(&writer, ctx, sink);
+        WritePoint(&writer, &locations[outside * 3]);
+        t3dFlushWriter(&writer);
+    } else {
+        uint32_t leak = FloodFill(ctx, &grid, starts, num_cells);
+        if(leak != UINT32_MAX) {
+            *leaked = true;
+
+            uint32_t start = GetLeakStart(&grid, leak);
+            unsigned int i = 0;
+            while(i < num_cells && starts[i] != start) ++i;
+
+            double point[3];
+            GetCellCentre(&grid, leak, point);
+            t3dLog(ctx, T3D_LOG_WARNING, "warning: map leaks out to (%g %g %g)!\n", point[0], point[1], point[2]);
+
+            WritePointFile(ctx, sink, &grid, leak, &locations[i * 3]);
+        }
+    }
+
+    t3dLog(ctx, T3D_LOG_INFO, "%s found in %.2fms\n", *leaked ? "leak" : "no leaks", GetTime() - start_time);
+
+    t3dFree(ctx, grid.cells);
+    t3dFree(ctx, starts);
+    t3dFree(ctx, locations);
+
+    return ctx->error;
+}
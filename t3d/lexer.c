@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define LEX_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+#include "t3d_private.h"
+
+/* The whole document is split up into tokens in a single pass before the
+ * parser gets to it. Input is classified 64 bytes at a time into bitmasks,
+ * so the only bytes that get looked at individually are the ones where
+ * something actually happens, i.e. the edges of words, '=', quotes,
+ * brackets and line endings. Control characters are treated as whitespace. */
+
+#define BLOCK_SIZE  64
+
+/* most tokens a single block can produce (a line, a word and an empty value per byte) */
+#define MAX_BLOCK_TOKENS    (BLOCK_SIZE * 3 + 4)
+
+#define NONE    UINT32_MAX
+
+typedef struct Masks {
+    uint64_t separator; /* whitespace, control characters and '=' */
+    uint64_t events;    /* line endings, '=', '"', '(' and ')' */
+} Masks;
+
+static inline unsigned int CountTrailingZeros(uint64_t v) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return (unsigned int) index;
+#else
+    return (unsigned int) __builtin_ctzll(v);
+#endif
+}
+
+#if defined(LEX_SSE2)
+
+static void ClassifyBlock(const char *data, Masks *masks) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    const __m128i equals = _mm_set1_epi8('=');
+    const __m128i quote = _mm_set1_epi8('"'), open = _mm_set1_epi8('('), close = _mm_set1_epi8(')');
+
+    masks->separator = 0;
+    masks->events = 0;
+    for(unsigned int i = 0; i < BLOCK_SIZE; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) &data[i]);
+
+        /* anything up to and including a space counts as whitespace */
+        __m128i e = _mm_cmpeq_epi8(v, equals);
+        __m128i s = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, space), space), e);
+        e = _mm_or_si128(e, _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        e = _mm_or_si128(e, _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                         _mm_or_si128(_mm_cmpeq_epi8(v, open), _mm_cmpeq_epi8(v, close))));
+
+        masks->separator |= (uint64_t) (uint16_t) _mm_movemask_epi8(s) << i;
+        masks->events    |= (uint64_t) (uint16_t) _mm_movemask_epi8(e) << i;
+    }
+}
+
+#else
+
+static void ClassifyBlock(const char *data, Masks *masks) {
+    masks->separator = 0;
+    masks->events = 0;
+    for(unsigned int i = 0; i < BLOCK_SIZE; ++i) {
+        uint64_t bit = (uint64_t) 1 << i;
+        unsigned char c = (unsigned char) data[i];
+        if(c <= ' ' || c == '=') {
+            masks->separator |= bit;
+        }
+        if(c == '\n' || c == '\r' || c == '=' || c == '"' || c == '(' || c == ')') {
+            masks->events |= bit;
+        }
+    }
+}
+
+#endif
+
+static inline void PushToken(T3DLexer *lex, uint32_t type, uint32_t offset, uint32_t length) {
+    T3DToken *token = &lex->tokens[lex->num_tokens++];
+    token->offset = offset;
+    token->length = length;
+    token->line   = lex->line;
+    token->type   = type;
+}
+
+static inline void StartToken(T3DLexer *lex, uint32_t i) {
+    if(lex->line_token == NONE) {
+        lex->line_token = lex->num_tokens;
+        PushToken(lex, T3D_TOKEN_LINE, lex->line_start, 0);
+    }
+
+    lex->start = i;
+}
+
+static inline void EndToken(T3DLexer *lex, uint32_t i) {
+    if(lex->start == NONE) {
+        return;
+    }
+
+    uint32_t type;
+    if(lex->expect_value) {
+        type = T3D_TOKEN_VALUE;
+        lex->expect_value = false;
+    } else {
+        char c = lex->buf[lex->start];
+        type = ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.') ? T3D_TOKEN_NUMBER : T3D_TOKEN_WORD;
+    }
+
+    PushToken(lex, type, lex->start, i - lex->start);
+    lex->last_end = i;
+    lex->start = NONE;
+}
+
+/* whatever came before on this line is a key */
+static inline void EndKey(T3DLexer *lex, uint32_t i) {
+    if(lex->expect_value) {
+        /* key had no value, the '=' is a stray */
+        PushToken(lex, T3D_TOKEN_VALUE, i, 0);
+        lex->expect_value = false;
+        return;
+    }
+
+    if(lex->line_token == NONE || lex->line_token == lex->num_tokens - 1) {
+        return;
+    }
+
+    T3DToken *token = &lex->tokens[lex->num_tokens - 1];
+    if(token->type == T3D_TOKEN_WORD || token->type == T3D_TOKEN_NUMBER) {
+        token->type = T3D_TOKEN_KEY;
+        lex->expect_value = true;
+    }
+}
+
+static inline void EndLine(T3DLexer *lex, uint32_t i) {
+    EndToken(lex, i);
+
+    if(lex->expect_value) {
+        PushToken(lex, T3D_TOKEN_VALUE, i, 0);
+        lex->expect_value = false;
+    }
+
+    if(lex->line_token != NONE) {
+        T3DToken *token = &lex->tokens[lex->line_token];
+        token->length = lex->last_end - token->offset;
+        lex->line_token = NONE;
+    }
+
+    lex->comment = false;
+    lex->quote = false;
+    lex->depth = 0;
+}
+
+static T3DToken *ReserveTokens(T3DContext *ctx, size_t num) {
+    if(num <= ctx->max_tokens) {
+        return ctx->tokens;
+    }
+
+    size_t max_tokens = (ctx->max_tokens == 0) ? 4096 : ctx->max_tokens;
+    while(max_tokens < num) max_tokens *= 2;
+
+    T3DToken *tokens = t3dReallocTag(ctx, ctx->tokens, sizeof(T3DToken) * max_tokens, T3D_MEMORY_TOKENS);
+    if(tokens == NULL) {
+        return NULL;
+    }
+
+    ctx->tokens = tokens;
+    ctx->max_tokens = (unsigned int) max_tokens;
+    return tokens;
+}
+
+static inline void LexBlock(T3DLexer *lex, const Masks *masks, uint32_t pos) {
+    const char *buf = lex->buf;
+
+    uint64_t word = ~masks->separator;
+    uint64_t prev = (word << 1) | lex->carry;
+    lex->carry = word >> 63;
+
+    uint64_t starts = word & ~prev;
+    uint64_t ends   = ~word & prev;
+
+    uint64_t events = starts | ends | masks->events;
+    while(events != 0) {
+        unsigned int b = CountTrailingZeros(events);
+        events &= events - 1;
+
+        uint64_t bit = (uint64_t) 1 << b;
+        uint32_t i = pos + b;
+        char c = buf[i];
+
+        bool eol = (c == '\n' || c == '\r');
+        if(lex->comment) {
+            if(!eol) {
+                continue;
+            }
+        } else if(lex->quote || lex->depth > 0) {
+            if(!eol) {
+                if(lex->quote) {
+                    lex->quote = (c != '"');
+                } else if(c == '(') {
+                    lex->depth++;
+                } else if(c == ')') {
+                    lex->depth--;
+                }
+                continue;
+            }
+        } else {
+            if(starts & bit) {
+                if(c == ';' && lex->line_token == NONE) {
+                    lex->comment = true;
+                    continue;
+                }
+
+                StartToken(lex, i);
+            }
+
+            if(c == '"') {
+                lex->quote = true;
+                continue;
+            } else if(c == '(') {
+                lex->depth = 1;
+                continue;
+            }
+
+            if(ends & bit) {
+                EndToken(lex, i);
+            }
+
+            if(c == '=') {
+                EndKey(lex, i);
+            }
+        }
+
+        if(eol) {
+            EndLine(lex, i);
+
+            /* CRLF only counts once, for the LF */
+            if(c == '\n' || buf[i + 1] != '\n') {
+                lex->line++;
+            }
+            lex->line_start = i + 1;
+        }
+    }
+}
+
+void t3dBeginLexer(T3DContext *ctx, T3DLexer *lex) {
+    memset(lex, 0, sizeof(T3DLexer));
+    lex->tokens = ctx->tokens;
+    lex->line = 1;
+    lex->line_token = NONE;
+    lex->start = NONE;
+
+    ctx->num_tokens = 0;
+}
+
+/* runs over every whole block we've got, bar the last byte which is kept back so
+ * we can always peek one ahead; buf may have moved since the last call */
+static bool LexBlocks(T3DContext *ctx, T3DLexer *state, const char *buf, size_t available) {
+    if(available > UINT32_MAX - BLOCK_SIZE) {
+        t3dSetError(ctx, T3D_ERROR_LIMIT, "error: documents larger than 4GB aren't supported!\n");
+        return false;
+    }
+
+    /* work on a copy, so none of this has to be reloaded after every token is written */
+    T3DLexer lex = *state;
+    lex.buf = buf;
+
+    Masks masks;
+    for(; lex.pos + BLOCK_SIZE < available; lex.pos += BLOCK_SIZE) {
+        if(lex.num_tokens + MAX_BLOCK_TOKENS > ctx->max_tokens &&
+           (lex.tokens = ReserveTokens(ctx, lex.num_tokens + MAX_BLOCK_TOKENS)) == NULL) {
+            return false;
+        }
+
+        ClassifyBlock(&buf[lex.pos], &masks);
+        LexBlock(&lex, &masks, lex.pos);
+    }
+
+    *state = lex;
+    ctx->num_tokens = lex.num_tokens;
+
+    return true;
+}
+
+bool t3dFeedLexer(T3DContext *ctx, T3DLexer *lex, const char *buf, size_t available) {
+    /* most lines have a handful of tokens on them */
+    if(ctx->max_tokens < (available / 8) + MAX_BLOCK_TOKENS &&
+       (lex->tokens = ReserveTokens(ctx, (available / 8) + MAX_BLOCK_TOKENS)) == NULL) {
+        return false;
+    }
+
+    return LexBlocks(ctx, lex, buf, available);
+}
+
+/* buf must be NUL-terminated at buf[length] */
+bool t3dEndLexer(T3DContext *ctx, T3DLexer *lex, const char *buf, size_t length) {
+    if(!LexBlocks(ctx, lex, buf, length + 1)) {
+        return false;
+    }
+
+    if(lex->num_tokens + MAX_BLOCK_TOKENS > ctx->max_tokens &&
+       (lex->tokens = ReserveTokens(ctx, lex->num_tokens + MAX_BLOCK_TOKENS)) == NULL) {
+        return false;
+    }
+
+    /* pad out whatever's left, spaces won't produce anything beyond closing the last word */
+    char tail[BLOCK_SIZE];
+    memset(tail, ' ', sizeof(tail));
+    memcpy(tail, &buf[lex->pos], length - lex->pos);
+
+    Masks masks;
+    ClassifyBlock(tail, &masks);
+    lex->buf = buf;
+    LexBlock(lex, &masks, lex->pos);
+
+    EndLine(lex, (uint32_t) length);
+
+    ctx->num_tokens = lex->num_tokens;
+
+    return true;
+}
+
+/* tokenises the whole buffer in one go, offsets are relative to buf */
+bool t3dLexBuffer(T3DContext *ctx, const char *buf, size_t length) {
+    T3DLexer lex;
+    t3dBeginLexer(ctx, &lex);
+    return t3dFeedLexer(ctx, &lex, buf, length) && t3dEndLexer(ctx, &lex, buf, length);
+}
+
+/* works out where a token sits for the sake of diagnostics */
+void t3dGetTokenPosition(const T3DContext *ctx, unsigned int index, unsigned int *line, unsigned int *column) {
+    *line = 0;
+    *column = 0;
+
+    if(index >= ctx->num_tokens) {
+        if(ctx->num_tokens == 0) {
+            return;
+        }
+        index = ctx->num_tokens - 1;
+    }
+
+    const T3DToken *token = &ctx->tokens[index];
+    *line = token->line;
+
+    for(unsigned int i = index + 1; i-- > 0;) {
+        if(ctx->tokens[i].type == T3D_TOKEN_LINE) {
+            *column = token->offset - ctx->tokens[i].offset + 1;
+            break;
+        }
+    }
+}
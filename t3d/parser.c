@@ -0,0 +1,708 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "t3d_private.h"
+
+/* yeah, yeah... I know... shut-up. */
+#define CurToken()      (&ctx->tokens[ctx->cur_token])
+#define ParseBlock()    while(ctx->cur_token < ctx->num_tokens && ctx->error == T3D_ERROR_NONE)
+
+/* everything below works on the tokens from the lexer; on entry to the body of
+ * a chunk we're always sat on a line token, and handling it moves us to the next */
+
+static void SkipLine(T3DContext *ctx) {
+    while(++ctx->cur_token < ctx->num_tokens && CurToken()->type != T3D_TOKEN_LINE) {}
+}
+
+/* returns the nth token along on the current line, or NULL if it's not that long */
+static const T3DToken *PeekToken(T3DContext *ctx, unsigned int n) {
+    for(unsigned int i = 1; i <= n; ++i) {
+        if(ctx->cur_token + i >= ctx->num_tokens || ctx->tokens[ctx->cur_token + i].type == T3D_TOKEN_LINE) {
+            return NULL;
+        }
+    }
+
+    return &ctx->tokens[ctx->cur_token + n];
+}
+
+static bool IsToken(const T3DContext *ctx, const T3DToken *token, const char *string) {
+    size_t length = strlen(string);
+    return (token != NULL && token->length == length &&
+            pl_strncasecmp(&ctx->base[token->offset], string, length) == 0);
+}
+
+static bool HasPrefix(const T3DContext *ctx, const T3DToken *token, const char *string) {
+    size_t length = strlen(string);
+    return (token != NULL && token->length >= length &&
+            pl_strncasecmp(&ctx->base[token->offset], string, length) == 0);
+}
+
+static void ParseString(T3DContext *ctx, const T3DToken *token, char *out, size_t size) {
+    size_t length = (token->length < size - 1) ? token->length : size - 1;
+    memcpy(out, &ctx->base[token->offset], length);
+    out[length] = '\0';
+}
+
+static int ParseInteger(T3DContext *ctx, const T3DToken *token) {
+    char n[16];
+    ParseString(ctx, token, n, sizeof(n));
+    return atoi(n);
+}
+
+/* line and column for diagnostics */
+#define ParsePosition(a)    t3dGetTokenPosition(ctx, ctx->cur_token, &(a).line, &(a).column)
+typedef struct Position {
+    unsigned int line;
+    unsigned int column;
+} Position;
+
+static bool ChunkStart(T3DContext *ctx) {
+    if(IsToken(ctx, PeekToken(ctx, 1), "Begin")) {
+        ctx->cur_token += 2;
+        return true;
+    }
+
+    return false;
+}
+
+static bool ChunkEnd(T3DContext *ctx, const char *chunk) {
+    if(IsToken(ctx, PeekToken(ctx, 1), "End")) {
+        if(!HasPrefix(ctx, PeekToken(ctx, 2), chunk)) {
+            Position position;
+            ParsePosition(position);
+            t3dSetError(ctx, T3D_ERROR_SYNTAX, "error: missing end segment for %s (line %u, column %u)!\n",
+                        chunk, position.line, position.column);
+            return true;
+        }
+
+        SkipLine(ctx);
+
+        return true;
+    }
+
+    return false;
+}
+
+/*******************************/
+
+static void ReadMap(T3DContext *ctx);
+static void ReadBrush(T3DContext *ctx);
+static void ReadPolyList(T3DContext *ctx);
+static void ReadPolygon(T3DContext *ctx);
+static void ReadActor(T3DContext *ctx);
+
+/* returns the value if the current line is the given field, e.g. "Vertex -1,+2,-3" */
+static const T3DToken *ReadField(T3DContext *ctx, const char *prop) {
+    if(!IsToken(ctx, PeekToken(ctx, 1), prop)) {
+        return NULL;
+    }
+
+    return PeekToken(ctx, 2);
+}
+
+static bool ReadVectorField(T3DContext *ctx, const char *prop, PLVector3 *vector) {
+    const T3DToken *value = ReadField(ctx, prop);
+    if(value == NULL) {
+        return false;
+    }
+
+    t3dParseVector(&ctx->base[value->offset], value->length, vector);
+    SkipLine(ctx);
+
+    return true;
+}
+
+/* fetches the next key/value pair from the current line, value is NULL if there wasn't one */
+static bool ReadProperty(T3DContext *ctx, const T3DToken **key, const T3DToken **value) {
+    if(ctx->cur_token >= ctx->num_tokens || CurToken()->type == T3D_TOKEN_LINE) {
+        return false;
+    }
+
+    *key = CurToken();
+    *value = NULL;
+    ctx->cur_token++;
+
+    if((*key)->type == T3D_TOKEN_KEY && ctx->cur_token < ctx->num_tokens && CurToken()->type == T3D_TOKEN_VALUE) {
+        *value = CurToken();
+        ctx->cur_token++;
+    }
+
+    return true;
+}
+
+#define ReadPropertyString(a, b)    _ReadPropertyString(ctx, key, value, (a), (b), sizeof(b))
+static bool _ReadPropertyString(T3DContext *ctx, const T3DToken *key, const T3DToken *value,
+                                const char *parm, char *out, size_t size) {
+    if(value != NULL && IsToken(ctx, key, parm)) {
+#ifdef DEBUG_PARSER
+        t3dLog(ctx, T3D_LOG_DEBUG, "prop=%s\n", parm);
+#endif
+
+        ParseString(ctx, value, out, size);
+        return true;
+    }
+
+    return false;
+}
+
+#define ReadPropertyInteger(a, b)   _ReadPropertyInteger(ctx, key, value, (a), (b))
+static bool _ReadPropertyInteger(T3DContext *ctx, const T3DToken *key, const T3DToken *value,
+                                 const char *parm, int *out) {
+    if(value != NULL && IsToken(ctx, key, parm)) {
+        *out = ParseInteger(ctx, value);
+        return true;
+    }
+
+    return false;
+}
+
+static void SkipProperty(T3DContext *ctx, const T3DToken *key) {
+    ctx->num_unknown++;
+    t3dLog(ctx, T3D_LOG_DEBUG, "unknown property \"%.*s\", ignoring!\n", (int) key->length, &ctx->base[key->offset]);
+}
+
+/* records a key/value pair against the actor without decoding it; in a chunk
+ * header the value is the single token, otherwise it's the rest of the line */
+static T3DProperty *ReadActorProperty(T3DContext *ctx, T3DActor *actor, const T3DToken *key, const T3DToken *value,
+                                      const T3DToken *line) {
+    T3DProperty *property = t3dAddProperty(ctx, actor);
+    if(property == NULL) {
+        return NULL;
+    }
+
+    property->key.offset = key->offset;
+    property->key.length = key->length;
+
+    if(value == NULL) {
+        property->value.offset = key->offset + key->length;
+        property->value.length = 0;
+    } else if(line != NULL) {
+        property->value.offset = value->offset;
+        property->value.length = (line->offset + line->length) - value->offset;
+    } else {
+        property->value.offset = value->offset;
+        property->value.length = value->length;
+    }
+
+    return property;
+}
+
+static void ReadChunk(T3DContext *ctx) {
+    if(ctx->cur_chunk + 1 >= MAX_CHUNK_DEPTH) {
+        t3dSetError(ctx, T3D_ERROR_LIMIT, "error: chunks are nested too deeply (%d), aborting!\n", MAX_CHUNK_DEPTH);
+        return;
+    }
+
+    /* checked for cancelling here, which is often enough without costing much */
+    if(ctx->cur_token < ctx->num_tokens) {
+        ctx->progress.bytes_parsed = CurToken()->offset;
+    }
+    if(!t3dReportProgress(ctx)) {
+        return;
+    }
+
+    ctx->cur_chunk++;
+
+    /* names are matched by prefix, so ActorList is read as an actor */
+    const T3DToken *name = (ctx->cur_token < ctx->num_tokens && CurToken()->type != T3D_TOKEN_LINE) ? CurToken() : NULL;
+    if (HasPrefix(ctx, name, "Map")) {
+        ctx->chunks[ctx->cur_chunk].context = CTX_MAP;
+        ctx->cur_token++;
+        ReadMap(ctx);
+    } else if (HasPrefix(ctx, name, "Brush")) {
+        ctx->cur_token++;
+        ReadBrush(ctx);
+    } else if (HasPrefix(ctx, name, "Actor")) {
+        ctx->cur_token++;
+        ReadActor(ctx);
+    } else if (HasPrefix(ctx, name, "PolyList")) {
+        ctx->cur_token++;
+        ReadPolyList(ctx);
+    } else if (HasPrefix(ctx, name, "Polygon")) {
+        ctx->cur_token++;
+        ReadPolygon(ctx);
+    } else if (HasPrefix(ctx, name, "ActorList")) {
+        ctx->chunks[ctx->cur_chunk].context = CTX_ACTORLIST;
+        SkipLine(ctx);
+    } else {
+        Position position;
+        ParsePosition(position);
+        t3dSetError(ctx, T3D_ERROR_SYNTAX, "unhandled chunk \"%.*s\" (line %u, column %u)!\n",
+                    (name != NULL) ? (int) name->length : 0, (name != NULL) ? &ctx->base[name->offset] : "",
+                    position.line, position.column);
+    }
+
+    ctx->cur_chunk--;
+}
+
+#define print_heading(a)    t3dLog(ctx, T3D_LOG_DEBUG, "%*sparsing " a "\n", ctx->cur_chunk, "");
+
+static void ReadPolygon(T3DContext *ctx) {
+    print_heading("Polygon");
+
+    T3DBrush *brush = CurBrush();
+    if(brush->poly_list == NULL || brush->num_poly >= ctx->poly_limit) {
+        Position position;
+        ParsePosition(position);
+        t3dSetError(ctx, T3D_ERROR_SYNTAX, "error: invalid number of polygons for brush (%d / %d) on line %u, aborting!\n",
+                    brush->num_poly + 1, ctx->poly_limit, position.line);
+        return;
+    }
+
+    if(brush->num_poly >= brush->max_poly) {
+        unsigned int max_poly = (brush->max_poly * 2 < ctx->poly_limit) ? brush->max_poly * 2 : ctx->poly_limit;
+        T3DPolygon *poly_list = t3dReallocTag(ctx, brush->poly_list, max_poly * sizeof(T3DPolygon), T3D_MEMORY_POLYGONS);
+        if(poly_list == NULL) {
+            return;
+        }
+        memset(&poly_list[brush->max_poly], 0, (max_poly - brush->max_poly) * sizeof(T3DPolygon));
+        brush->poly_list = poly_list;
+        brush->max_poly = max_poly;
+    }
+
+    T3DPolygon *poly = &brush->poly_list[brush->num_poly];
+
+    const T3DToken *key, *value;
+    while(ReadProperty(ctx, &key, &value)) {
+        if(ReadPropertyString("Item", poly->item)) {
+            continue;
+        }
+
+        if(ReadPropertyString("Texture", poly->texture)) {
+            continue;
+        }
+
+        if(ReadPropertyString("Group", poly->group)) {
+            continue;
+        }
+
+        /* T3D spec suggests to ignore 'link' property, so we shall */
+
+        SkipProperty(ctx, key);
+    }
+
+    if(plIsEmptyString(poly->texture)) {
+        strncpy(poly->texture, "none", sizeof(poly->texture));
+    }
+
+    ParseBlock() {
+        if(ChunkEnd(ctx, "Polygon")) {
+            break;
+        }
+
+        if(ChunkStart(ctx)) {
+            ReadChunk(ctx);
+            brush = CurBrush();
+            poly = &brush->poly_list[brush->num_poly];
+            continue;
+        }
+
+        if(ReadVectorField(ctx, "Origin", &poly->origin)) {
+            continue;
+        }
+
+        if(ReadVectorField(ctx, "TextureU", &poly->u)) {
+            continue;
+        }
+
+        if(ReadVectorField(ctx, "TextureV", &poly->v)) {
+            continue;
+        }
+
+        if((value = ReadField(ctx, "Vertex")) != NULL) {
+            if(poly->num_vertices >= T3D_MAX_POLYGON_VERTICES) {
+                Position position;
+                ParsePosition(position);
+                t3dSetError(ctx, T3D_ERROR_LIMIT, "error: too many vertices for polygon (%d) on line %u, aborting!\n",
+                            T3D_MAX_POLYGON_VERTICES, position.line);
+                break;
+            }
+
+            t3dParseVector(&ctx->base[value->offset], value->length, &poly->vertices[poly->num_vertices++]);
+        }
+
+        SkipLine(ctx);
+    }
+
+    /* they're near enough always the same across the brush, so the first will do */
+    if(brush->group == 0 && poly->group[0] != '\0') {
+        brush->group = t3dInternGroup(ctx, poly->group);
+    }
+
+    brush->num_poly++;
+}
+
+static void ReadPolyList(T3DContext *ctx) {
+    print_heading("PolyList");
+
+    T3DBrush *brush = CurBrush();
+
+    const T3DToken *key, *value;
+    while(ReadProperty(ctx, &key, &value)) {
+        if(ReadPropertyInteger("Num", (int *) &brush->max_poly)) {
+            continue;
+        }
+
+        SkipProperty(ctx, key);
+    }
+
+    /* if we weren't told how many to expect, start small and grow as we go */
+    if(brush->max_poly == 0) {
+        ctx->poly_limit = MAX_BRUSH_FACES;
+        brush->max_poly = 16;
+    } else {
+        ctx->poly_limit = brush->max_poly;
+    }
+
+    if((brush->poly_list = t3dCallocTag(ctx, brush->max_poly, sizeof(T3DPolygon), T3D_MEMORY_POLYGONS)) == NULL) {
+        t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to allocate %d polygons, aborting!\n", brush->max_poly);
+        return;
+    }
+
+    ParseBlock() {
+        if(ChunkEnd(ctx, "PolyList")) {
+            break;
+        }
+
+        if(ChunkStart(ctx)) {
+            ReadChunk(ctx);
+            brush = CurBrush();
+            continue;
+        }
+
+        SkipLine(ctx);
+    }
+
+    if(ctx->error != T3D_ERROR_NONE) {
+        return;
+    }
+
+    if(brush->num_poly < brush->max_poly) {
+        T3DPolygon *poly_list = t3dReallocTag(ctx, brush->poly_list, brush->num_poly * sizeof(T3DPolygon),
+                                              T3D_MEMORY_POLYGONS);
+        if(poly_list == NULL && brush->num_poly > 0) {
+            t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to shrink polylist down!\n");
+            return;
+        }
+        brush->poly_list = poly_list;
+        brush->max_poly = brush->num_poly;
+    }
+}
+
+static void ReadMapHeader(T3DContext *ctx) {
+    const T3DToken *key, *value;
+    while(ReadProperty(ctx, &key, &value)) {
+        if(ReadPropertyString("Name", ctx->map.name)) {
+            continue;
+        }
+
+        if(ReadPropertyInteger("Brushes", (int*) &ctx->map.num_brushes)) {
+            continue;
+        }
+
+        SkipProperty(ctx, key);
+    }
+}
+
+/* used to pull the header out when we're not parsing the map as a whole */
+void t3dReadMapHeader(T3DContext *ctx, const char *pos) {
+    memset(&ctx->map, 0, sizeof(ctx->map));
+
+    ctx->base = pos;
+    if(!t3dLexBuffer(ctx, pos, strcspn(pos, "\r\n"))) {
+        return;
+    }
+
+    ctx->cur_token = 1; /* past the line */
+    ReadMapHeader(ctx);
+}
+
+static void ReadMap(T3DContext *ctx) {
+    print_heading("Map");
+
+    /* header */
+    ReadMapHeader(ctx);
+
+    ParseBlock() {
+        if(ChunkEnd(ctx, "Map")) {
+            break;
+        }
+
+        if(ChunkStart(ctx)) {
+            ReadChunk(ctx);
+            continue;
+        }
+
+        SkipLine(ctx);
+    }
+}
+
+static void ReadActor(T3DContext *ctx) {
+    ctx->chunks[ctx->cur_chunk].context = CTX_ACTOR;
+
+    print_heading("Actor");
+
+    /* nested actors (i.e. ActorList) will move this along, so don't hold onto it */
+#define actor CurActor()
+
+    const T3DToken *key, *value;
+    while(ReadProperty(ctx, &key, &value)) {
+        const T3DProperty *property = ReadActorProperty(ctx, actor, key, value, NULL);
+        if(property == NULL || value == NULL) {
+            continue;
+        }
+
+        if(IsToken(ctx, key, "Class")) {
+            t3dDecodeString(ctx, property, actor->class_name, sizeof(actor->class_name));
+            actor->class_index = t3dGetActorDef(actor->class_name);
+#ifdef DEBUG_PARSER
+            t3dLog(ctx, T3D_LOG_DEBUG, "prop=Class\n");
+#endif
+        } else if(IsToken(ctx, key, "Name")) {
+            t3dDecodeString(ctx, property, actor->name, sizeof(actor->name));
+#ifdef DEBUG_PARSER
+            t3dLog(ctx, T3D_LOG_DEBUG, "prop=Name\n");
+#endif
+        }
+    }
+
+    ParseBlock() {
+        if(ChunkEnd(ctx, "Actor")) {
+            break;
+        }
+
+        if(ChunkStart(ctx)) {
+            ReadChunk(ctx);
+            continue;
+        }
+
+        if((key = PeekToken(ctx, 1)) != NULL) {
+            ReadActorProperty(ctx, actor, key, PeekToken(ctx, 2), CurToken());
+        }
+        SkipLine(ctx);
+    }
+
+#undef actor
+
+    if(ctx->error != T3D_ERROR_NONE) {
+        return;
+    }
+
+    ctx->num_actors++;
+    t3dGrowActors(ctx);
+}
+
+static void ReadBrush(T3DContext *ctx) {
+    ctx->chunks[ctx->cur_chunk].context = CTX_BRUSH;
+
+    print_heading("Brush");
+
+    /* fetched again after every nested chunk, as the brush list may have been grown */
+    T3DBrush *brush = CurBrush();
+
+    const T3DToken *key, *value;
+    while(ReadProperty(ctx, &key, &value)) {
+        if(ReadPropertyString("Name", brush->name)) {
+            continue;
+        }
+
+        SkipProperty(ctx, key);
+    }
+
+    if((ctx->cur_chunk > 0) && (ctx->chunks[ctx->cur_chunk - 1].context == CTX_ACTOR)) {
+        const T3DActor *actor = CurActor();
+        if (actor->class_index != NULL &&
+            (actor->class_index->id == ACT_Brush || actor->class_index->id == ACT_Mover)) {
+            t3dGetActorVector(ctx, actor, "Location", &brush->location);
+
+            char csg[32] = { '\0' };
+            t3dGetActorString(ctx, actor, "CsgOper", csg, sizeof(csg));
+            if (pl_strncasecmp(csg, "CSG_Subtract", 12) == 0) {
+                brush->csg = CSG_Subtract;
+            } else if (pl_strncasecmp(csg, "CSG_Active", 10) == 0) {
+                brush->csg = CSG_Active;
+            } else if (pl_strncasecmp(csg, "CSG_Add", 7) == 0) {
+                brush->csg = CSG_Add;
+            } else if (pl_strncasecmp(csg, "CSG_Deintersect", 15) == 0) {
+                brush->csg = CSG_Deintersect;
+            } else if (pl_strncasecmp(csg, "CSG_Intersect", 13) == 0) {
+                brush->csg = CSG_Intersect;
+            }
+        } else {
+            t3dLog(ctx, T3D_LOG_WARNING, "warning: previous chunk was an actor but not of a brush class!\n");
+        }
+    }
+
+    ParseBlock() {
+        if(ChunkEnd(ctx, "Brush")) {
+            break;
+        }
+
+        if(ChunkStart(ctx)) {
+            ReadChunk(ctx);
+            brush = CurBrush();
+            continue;
+        }
+
+        if(ReadVectorField(ctx, "Location", &brush->location)) {
+            continue;
+        }
+
+        if(ReadVectorField(ctx, "PrePivot", &brush->pre_pivot)) {
+            continue;
+        }
+
+        if(ReadVectorField(ctx, "PostPivot", &brush->post_pivot)) {
+            continue;
+        }
+
+        if(IsToken(ctx, PeekToken(ctx, 1), "Settings")) {
+            ctx->cur_token += 2;
+            while(ReadProperty(ctx, &key, &value)) {
+                if(ReadPropertyInteger("CSG", (int *) &brush->csg)) {
+                    continue;
+                }
+
+                if(ReadPropertyInteger("Flags", (int *) &brush->flags)) {
+                    continue;
+                }
+
+                if(ReadPropertyInteger("PolyFlags", (int *) &brush->poly_flags)) {
+                    continue;
+                }
+
+                if(ReadPropertyInteger("Color", (int *) &brush->colour)) {
+                    continue;
+                }
+
+                SkipProperty(ctx, key);
+            }
+            continue;
+        }
+
+        SkipLine(ctx);
+    }
+
+    if(ctx->error != T3D_ERROR_NONE) {
+        return;
+    }
+
+    ctx->num_brushes++;
+    t3dGrowBrushes(ctx);
+}
+
+/**************************************************/
+
+static T3DError ParseTokens(T3DContext *ctx) {
+    ctx->cur_chunk = -1;
+    ctx->cur_token = 0;
+
+    ParseBlock() {
+        if(ChunkStart(ctx)) {
+            ReadChunk(ctx);
+            continue;
+        }
+
+        SkipLine(ctx);
+    }
+
+    if(ctx->error == T3D_ERROR_NONE && ctx->cur_chunk != -1) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: failed to escape all blocks - parsing may have failed!\n");
+    }
+
+    ctx->progress.bytes_parsed = ctx->progress.total_bytes;
+    t3dReportProgress(ctx);
+
+    return ctx->error;
+}
+
+static bool BeginParsing(T3DContext *ctx, size_t length) {
+    ctx->progress.phase = T3D_PHASE_PARSING;
+    ctx->progress.bytes_read = length;
+    ctx->progress.bytes_parsed = 0;
+    ctx->progress.total_bytes = length;
+    return t3dReportProgress(ctx);
+}
+
+T3DError t3dParseBuffer(T3DContext *ctx, const char *buf, size_t length) {
+    if(buf == NULL || buf[length] != '\0') {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: buffer passed to t3dParseBuffer must be NUL-terminated!\n");
+        return ctx->error;
+    }
+
+    if(length > UINT32_MAX) {
+        t3dSetError(ctx, T3D_ERROR_LIMIT, "error: documents larger than 4GB aren't supported!\n");
+        return ctx->error;
+    }
+
+    ctx->base = &buf[0];
+
+    if(!BeginParsing(ctx, length) || !t3dLexBuffer(ctx, buf, length)) {
+        return ctx->error;
+    }
+
+    return ParseTokens(ctx);
+}
+
+static bool FeedLexer(T3DContext *ctx, const char *buf, size_t length, void *user) {
+    ctx->progress.bytes_read = length;
+    return t3dFeedLexer(ctx, (T3DLexer *) user, buf, length) && t3dReportProgress(ctx);
+}
+
+/* there'd be thousands of them otherwise, so each is only logged with verbose */
+static T3DError ReportUnknownProperties(T3DContext *ctx) {
+    if(ctx->error == T3D_ERROR_NONE && ctx->num_unknown > 0) {
+        t3dLog(ctx, T3D_LOG_INFO, "ignored %u unknown properties\n", ctx->num_unknown);
+    }
+
+    return ctx->error;
+}
+
+T3DError t3dParseFile(T3DContext *ctx, const char *path) {
+    t3dResetContext(ctx);
+
+    ctx->progress.phase = T3D_PHASE_READING;
+    if(!t3dReportProgress(ctx)) {
+        return ctx->error;
+    }
+
+    size_t length;
+    bool standard = t3dIsStandardStream(path);
+    T3DCompression compression = standard ? T3D_COMPRESSION_NONE : t3dDetectFileCompression(path);
+    if(compression == T3D_COMPRESSION_NONE && !standard) {
+        if((ctx->buffer = t3dLoadFile(ctx, path, &length)) == NULL) {
+            return ctx->error;
+        }
+
+        t3dLog(ctx, T3D_LOG_INFO, "parsing...\n");
+
+        t3dParseBuffer(ctx, ctx->buffer, length);
+        return ReportUnknownProperties(ctx);
+    }
+
+    /* lex as it arrives, so the bulk of the work overlaps with decompression, or with whatever's piping it in */
+    t3dLog(ctx, T3D_LOG_INFO, "streaming T3D from \"%s\"...\n", path);
+
+    T3DLexer lex;
+    t3dBeginLexer(ctx, &lex);
+    ctx->buffer = standard ? t3dLoadStandardInput(ctx, &length, FeedLexer, &lex) :
+                  t3dLoadCompressedFile(ctx, path, compression, &length, FeedLexer, &lex);
+    if(ctx->buffer == NULL) {
+        return ctx->error;
+    }
+
+    ctx->base = ctx->buffer;
+    if(!t3dEndLexer(ctx, &lex, ctx->buffer, length)) {
+        return ctx->error;
+    }
+
+    t3dLog(ctx, T3D_LOG_INFO, "parsing...\n");
+
+    if(!BeginParsing(ctx, length)) {
+        return ctx->error;
+    }
+
+    ParseTokens(ctx);
+    return ReportUnknownProperties(ctx);
+}
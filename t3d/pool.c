@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "t3d_private.h"
+
+/* Writes out a set of maps concurrently, such as the tiles or groups of a
+ * level. Each job works from its own shallow copy of the context, with its
+ * own error and a log and progress that go via the pool, so the only thing
+ * shared is the document. The calling thread does its share too. */
+
+#define MAX_POOL_THREADS    64
+
+typedef struct Pool {
+    T3DContext *ctx;
+    const T3DPoolOptions *options;
+
+    T3DPoolJob *jobs;
+    unsigned int num_jobs;
+    unsigned int next_job;
+
+    bool cancelled;
+    T3DError error;
+    unsigned int error_job;
+
+    T3DMutex mutex;     /* guards the above, the log, progress and the open/close callbacks */
+    T3DThread threads[MAX_POOL_THREADS];
+} Pool;
+
+static void PoolLog(T3DLogLevel level, const char *message, void *user) {
+    Pool *pool = (Pool *) user;
+    t3dLockMutex(&pool->mutex);
+    pool->ctx->options.log(level, message, pool->ctx->options.log_user);
+    t3dUnlockMutex(&pool->mutex);
+}
+
+/* each call is another brush written by one of the jobs, which all count towards the one total */
+static bool PoolProgress(const T3DProgress *progress, void *user) {
+    (void)(progress);
+    Pool *pool = (Pool *) user;
+    t3dLockMutex(&pool->mutex);
+    T3DContext *ctx = pool->ctx;
+    ctx->progress.brushes_written++;
+    if(!pool->cancelled && !ctx->options.progress(&ctx->progress, ctx->options.progress_user)) {
+        pool->cancelled = true;
+    }
+    bool cancelled = pool->cancelled;
+    t3dUnlockMutex(&pool->mutex);
+
+    return !cancelled;
+}
+
+static void WriteJob(Pool *pool, T3DContext *ctx, T3DPoolJob *job) {
+    const T3DPoolOptions *options = pool->options;
+
+    t3dLockMutex(&pool->mutex);
+    const T3DSink *sink = options->open(job, options->user);
+    t3dUnlockMutex(&pool->mutex);
+
+    if(sink == NULL || sink->write == NULL) {
+        t3dSetError(ctx, T3D_ERROR_IO, "error: failed to open %s!\n", job->name);
+        return;
+    }
+
+    T3DWriter writer;
+    t3dInitWriter(&writer, ctx, sink);
+    t3dWriteWorldspawn(&writer);
+
+    for(unsigned int i = 0; i < job->num_brushes && ctx->error == T3D_ERROR_NONE; ++i) {
+        t3dBeginBrush(&writer, job->brushes[i]);
+        t3dWriteBrush(&writer, &ctx->brushes[job->brushes[i]]);
+        t3dReportProgress(ctx);
+    }
+
+    t3dEndWorldspawn(&writer);
+
+    for(unsigned int i = 0; i < job->num_actors && ctx->error == T3D_ERROR_NONE; ++i) {
+        t3dWriteEntity(&writer, &ctx->actors[job->actors[i]]);
+    }
+
+    t3dEndMap(&writer);
+    t3dFlushWriter(&writer);
+
+    t3dLockMutex(&pool->mutex);
+    bool closed = options->close(job, sink, options->user);
+    t3dUnlockMutex(&pool->mutex);
+
+    if(!closed) {
+        t3dSetError(ctx, T3D_ERROR_IO, "error: failed to close %s!\n", job->name);
+    }
+}
+
+static void PoolThread(void *user) {
+    Pool *pool = (Pool *) user;
+    for(;;) {
+        T3DContext ctx;
+
+        t3dLockMutex(&pool->mutex);
+        unsigned int index = pool->next_job;
+        bool found = (index < pool->num_jobs && !pool->cancelled);
+        if(found) {
+            pool->next_job++;
+            ctx = *pool->ctx;
+        }
+        t3dUnlockMutex(&pool->mutex);
+
+        if(!found) {
+            break;
+        }
+
+        ctx.error = T3D_ERROR_NONE;
+        ctx.options.log = PoolLog;
+        ctx.options.log_user = pool;
+        if(ctx.options.progress != NULL) {
+            ctx.options.progress = PoolProgress;
+            ctx.options.progress_user = pool;
+        }
+        if(pool->options->ungrouped) {
+            ctx.options.groups = false;
+        }
+
+        WriteJob(pool, &ctx, &pool->jobs[index]);
+
+        t3dLockMutex(&pool->mutex);
+        if(ctx.error != T3D_ERROR_NONE && (pool->error == T3D_ERROR_NONE || index < pool->error_job)) {
+            pool->error = ctx.error;
+            pool->error_job = index;
+        }
+        t3dUnlockMutex(&pool->mutex);
+    }
+}
+
+void t3dRunPool(T3DContext *ctx, const T3DPoolOptions *options, T3DPoolJob *jobs, unsigned int num_jobs) {
+    Pool pool = {
+            .ctx      = ctx,
+            .options  = options,
+            .jobs     = jobs,
+            .num_jobs = num_jobs,
+    };
+
+    /* brushes may be in more than the one job, i.e. tiles with a margin */
+    ctx->progress.brushes_written = 0;
+    ctx->progress.total_brushes = 0;
+    for(unsigned int i = 0; i < num_jobs; ++i) {
+        ctx->progress.total_brushes += jobs[i].num_brushes;
+    }
+
+    unsigned int num_threads = (options->num_threads > 0) ? options->num_threads : t3dGetNumProcessors();
+    if(num_threads > num_jobs) num_threads = num_jobs;
+    if(num_threads > MAX_POOL_THREADS) num_threads = MAX_POOL_THREADS;
+
+    t3dLog(ctx, T3D_LOG_INFO, "writing %u %s on %u threads...\n", num_jobs, options->what, num_threads);
+
+    t3dInitMutex(&pool.mutex);
+
+    /* this thread does its share too */
+    unsigned int num_started = 1;
+    for(; num_started < num_threads; ++num_started) {
+        if(!t3dCreateThread(&pool.threads[num_started], PoolThread, &pool)) {
+            break;
+        }
+    }
+
+    PoolThread(&pool);
+
+    for(unsigned int i = 1; i < num_started; ++i) {
+        t3dJoinThread(&pool.threads[i]);
+    }
+
+    t3dDestroyMutex(&pool.mutex);
+
+    /* errors have already been logged, just need to pass on the first */
+    if(ctx->error == T3D_ERROR_NONE) {
+        ctx->error = pool.error;
+    }
+}
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "t3d_private.h"
+
+/* Properties are recorded as spans into the input rather than being
+ * copied out, and are only decoded when something actually asks. */
+
+/* an actor's properties are kept contiguous, so if anything else got in
+ * the way since (i.e. a nested actor) then they get shuffled up to the end */
+T3DProperty *t3dAddProperty(T3DContext *ctx, T3DActor *actor) {
+    if(actor->num_properties == 0) {
+        actor->first_property = ctx->num_properties;
+    }
+
+    bool relocate = (actor->first_property + actor->num_properties != ctx->num_properties);
+    unsigned int required = ctx->num_properties + 1 + (relocate ? actor->num_properties : 0);
+    if(required > ctx->max_properties) {
+        unsigned int max_properties = (ctx->max_properties == 0) ? 256 : ctx->max_properties;
+        while(max_properties < required) max_properties *= 2;
+
+        T3DProperty *properties = t3dReallocTag(ctx, ctx->properties, sizeof(T3DProperty) * max_properties, T3D_MEMORY_PROPERTIES);
+        if(properties == NULL) {
+            return NULL;
+        }
+
+        ctx->properties = properties;
+        ctx->max_properties = max_properties;
+    }
+
+    if(relocate) {
+        memcpy(&ctx->properties[ctx->num_properties], &ctx->properties[actor->first_property],
+               sizeof(T3DProperty) * actor->num_properties);
+        actor->first_property = ctx->num_properties;
+        ctx->num_properties += actor->num_properties;
+    }
+
+    actor->num_properties++;
+    return &ctx->properties[ctx->num_properties++];
+}
+
+const char *t3dGetSpan(const T3DContext *ctx, T3DSpan span) {
+    return &ctx->base[span.offset];
+}
+
+const T3DProperty *t3dGetActorProperties(const T3DContext *ctx, const T3DActor *actor, unsigned int *num_properties) {
+    *num_properties = actor->num_properties;
+    if(actor->num_properties == 0) {
+        return NULL;
+    }
+
+    return &ctx->properties[actor->first_property];
+}
+
+const T3DProperty *t3dFindActorProperty(const T3DContext *ctx, const T3DActor *actor, const char *key) {
+    size_t length = strlen(key);
+    for(unsigned int i = 0; i < actor->num_properties; ++i) {
+        const T3DProperty *property = &ctx->properties[actor->first_property + i];
+        if(property->key.length != length) {
+            continue;
+        }
+
+        if(pl_strncasecmp(t3dGetSpan(ctx, property->key), key, length) == 0) {
+            return property;
+        }
+    }
+
+    return NULL;
+}
+
+/**************************************************/
+
+bool t3dDecodeString(const T3DContext *ctx, const T3DProperty *property, char *out, size_t size) {
+    const char *value = t3dGetSpan(ctx, property->value);
+    size_t length = property->value.length;
+    if(length >= 2 && value[0] == '"' && value[length - 1] == '"') {
+        value++;
+        length -= 2;
+    }
+
+    bool status = true;
+    if(length >= size) {
+        length = size - 1;
+        status = false;
+    }
+
+    memcpy(out, value, length);
+    out[length] = '\0';
+
+    return status;
+}
+
+bool t3dDecodeInteger(const T3DContext *ctx, const T3DProperty *property, int *out) {
+    char n[32];
+    t3dDecodeString(ctx, property, n, sizeof(n));
+
+    char *end;
+    long l = strtol(n, &end, 10);
+    if(end == n) {
+        return false;
+    }
+
+    *out = (int) l;
+    return true;
+}
+
+bool t3dDecodeFloat(const T3DContext *ctx, const T3DProperty *property, float *out) {
+    char n[32];
+    t3dDecodeString(ctx, property, n, sizeof(n));
+
+    char *end;
+    float f = strtof(n, &end);
+    if(end == n) {
+        return false;
+    }
+
+    *out = f;
+    return true;
+}
+
+/* shared with the parser, which uses it for vertices and the like */
+bool t3dParseVector(const char *data, size_t length, PLVector3 *out) {
+    char v[128];
+    if(length >= sizeof(v)) {
+        length = sizeof(v) - 1;
+    }
+    memcpy(v, data, length);
+    v[length] = '\0';
+
+    float components[3] = { 0, 0, 0 };
+    unsigned int num_components = 0;
+
+    const char *pos = v;
+    if(*pos == '(') pos++;
+    while(*pos != '\0' && *pos != ')') {
+        while(*pos == ' ' || *pos == ',') pos++;
+
+        /* labelled, e.g. X=1.0 */
+        unsigned int index = num_components;
+        if(pos[0] != '\0' && pos[1] == '=') {
+            switch(pos[0]) {
+                case 'x': case 'X': index = 0; break;
+                case 'y': case 'Y': index = 1; break;
+                case 'z': case 'Z': index = 2; break;
+                default: return false;
+            }
+            pos += 2;
+        }
+
+        char *end;
+        float f = strtof(pos, &end);
+        if(end == pos || index >= 3) {
+            return false;
+        }
+
+        components[index] = f;
+        num_components = index + 1;
+        pos = end;
+    }
+
+    out->x = components[0];
+    out->y = components[1];
+    out->z = components[2];
+    return true;
+}
+
+bool t3dDecodeVector(const T3DContext *ctx, const T3DProperty *property, PLVector3 *out) {
+    const char *value = t3dGetSpan(ctx, property->value);
+    size_t length = property->value.length;
+    if(length >= 2 && value[0] == '"' && value[length - 1] == '"') {
+        value++;
+        length -= 2;
+    }
+
+    return t3dParseVector(value, length, out);
+}
+
+bool t3dGetActorString(const T3DContext *ctx, const T3DActor *actor, const char *key, char *out, size_t size) {
+    const T3DProperty *property = t3dFindActorProperty(ctx, actor, key);
+    if(property == NULL) {
+        return false;
+    }
+
+    return t3dDecodeString(ctx, property, out, size);
+}
+
+bool t3dGetActorInteger(const T3DContext *ctx, const T3DActor *actor, const char *key, int *out) {
+    const T3DProperty *property = t3dFindActorProperty(ctx, actor, key);
+    if(property == NULL) {
+        return false;
+    }
+
+    return t3dDecodeInteger(ctx, property, out);
+}
+
+bool t3dGetActorVector(const T3DContext *ctx, const T3DActor *actor, const char *key, PLVector3 *out) {
+    const T3DProperty *property = t3dFindActorProperty(ctx, actor, key);
+    if(property == NULL) {
+        return false;
+    }
+
+    return t3dDecodeVector(ctx, property, out);
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "t3d_private.h"
+
+/* Brushes and entities can be written out in the order of the Morton
+ * code of their centres, so that things near one another in the level
+ * are also near one another in the map, no matter what order they were
+ * saved in. Sorting is done with an LSD radix sort, which is stable, so
+ * ties keep whatever order came before. */
+
+#define RADIX_BITS      11
+#define RADIX_SIZE      (1 << RADIX_BITS)
+#define RADIX_MASK      (RADIX_SIZE - 1)
+#define RADIX_PASSES    ((64 + RADIX_BITS - 1) / RADIX_BITS)
+
+/* not worth the trouble of spinning up threads below this */
+#define PARALLEL_THRESHOLD  65536
+#define MAX_SORT_THREADS    16
+
+typedef struct SortJob {
+    const T3DSortItem *src;
+    T3DSortItem *dst;
+    size_t start, end;
+    unsigned int shift;
+
+    size_t counts[RADIX_SIZE];    /* then offsets, once they've been worked out */
+
+    T3DThread thread;
+} SortJob;
+
+static void CountDigits(void *user) {
+    SortJob *job = (SortJob *) user;
+    memset(job->counts, 0, sizeof(job->counts));
+    for(size_t i = job->start; i < job->end; ++i) {
+        job->counts[(job->src[i].key >> job->shift) & RADIX_MASK]++;
+    }
+}
+
+static void ScatterDigits(void *user) {
+    SortJob *job = (SortJob *) user;
+    for(size_t i = job->start; i < job->end; ++i) {
+        job->dst[job->counts[(job->src[i].key >> job->shift) & RADIX_MASK]++] = job->src[i];
+    }
+}
+
+/* runs the function over every job, the first on this thread */
+static void RunJobs(SortJob *jobs, unsigned int num_jobs, void (*function)(void *user)) {
+    unsigned int num_threads = 1;
+    for(; num_threads < num_jobs; ++num_threads) {
+        if(!t3dCreateThread(&jobs[num_threads].thread, function, &jobs[num_threads])) {
+            break;
+        }
+    }
+
+    function(&jobs[0]);
+    for(unsigned int i = num_threads; i < num_jobs; ++i) {
+        function(&jobs[i]);
+    }
+
+    for(unsigned int i = 1; i < num_threads; ++i) {
+        t3dJoinThread(&jobs[i].thread);
+    }
+}
+
+/* sorts by key, preserving the order of anything with the same key */
+bool t3dRadixSort(T3DContext *ctx, T3DSortItem *items, size_t num_items) {
+    if(num_items < 2) {
+        return true;
+    }
+
+    T3DSortItem *temp = t3dMallocTag(ctx, sizeof(T3DSortItem) * num_items, T3D_MEMORY_GEOMETRY);
+    if(temp == NULL) {
+        return false;
+    }
+
+    unsigned int num_jobs = 1;
+    if(num_items >= PARALLEL_THRESHOLD) {
+        num_jobs = t3dGetNumProcessors();
+        if(num_jobs > MAX_SORT_THREADS) num_jobs = MAX_SORT_THREADS;
+    }
+
+    SortJob *jobs = t3dCallocTag(ctx, num_jobs, sizeof(SortJob), T3D_MEMORY_GEOMETRY);
+    if(jobs == NULL) {
+        t3dFree(ctx, temp);
+        return false;
+    }
+
+    T3DSortItem *src = items, *dst = temp;
+    for(unsigned int pass = 0; pass < RADIX_PASSES; ++pass) {
+        for(unsigned int i = 0; i < num_jobs; ++i) {
+            jobs[i].src   = src;
+            jobs[i].dst   = dst;
+            jobs[i].start = (num_items * i) / num_jobs;
+            jobs[i].end   = (num_items * (i + 1)) / num_jobs;
+            jobs[i].shift = pass * RADIX_BITS;
+        }
+
+        RunJobs(jobs, num_jobs, CountDigits);
+
+        /* each job gets its own run within each bucket, in order, which keeps it stable */
+        size_t offset = 0;
+        bool skip = false;
+        for(unsigned int digit = 0; digit < RADIX_SIZE; ++digit) {
+            size_t total = 0;
+            for(unsigned int i = 0; i < num_jobs; ++i) {
+                size_t count = jobs[i].counts[digit];
+                jobs[i].counts[digit] = offset + total;
+                total += count;
+            }
+
+            /* everything has the same digit, so this pass wouldn't change anything */
+            if(total == num_items) {
+                skip = true;
+                break;
+            }
+            offset += total;
+        }
+
+        if(skip) {
+            continue;
+        }
+
+        RunJobs(jobs, num_jobs, ScatterDigits);
+
+        T3DSortItem *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if(src != items) {
+        memcpy(items, src, sizeof(T3DSortItem) * num_items);
+    }
+
+    t3dFree(ctx, jobs);
+    t3dFree(ctx, temp);
+
+    return true;
+}
+
+/**************************************************/
+
+/* spreads the bottom 21 bits out so there's two zeroes between each */
+static uint64_t SpreadBits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+}
+
+static uint64_t GetMortonCode(const double *point, const double *mins, const double *scale) {
+    uint64_t code = 0;
+    for(unsigned int i = 0; i < 3; ++i) {
+        double v = (point[i] - mins[i]) * scale[i];
+        uint64_t q = (v > 0.0) ? (uint64_t) v : 0;
+        if(q > 0x1fffff) q = 0x1fffff;
+        code |= SpreadBits(q) << i;
+    }
+    return code;
+}
+
+/* Fills in order with the indices sorted by the Morton code of each
+ * centre. Anything given the same code goes by the tie-breaker, if one
+ * is provided, and then the order it came in. */
+bool t3dSortSpatially(T3DContext *ctx, const double *centres, const uint64_t *ties, unsigned int num,
+                      uint32_t *order) {
+    T3DSortItem *items = t3dMallocTag(ctx, sizeof(T3DSortItem) * (num + 1), T3D_MEMORY_GEOMETRY);
+    if(items == NULL) {
+        return false;
+    }
+
+    double mins[3] = { 0, 0, 0 }, maxs[3] = { 0, 0, 0 };
+    for(unsigned int i = 0; i < num; ++i) {
+        for(unsigned int j = 0; j < 3; ++j) {
+            double v = centres[i * 3 + j];
+            if(i == 0 || v < mins[j]) mins[j] = v;
+            if(i == 0 || v > maxs[j]) maxs[j] = v;
+        }
+    }
+
+    double scale[3];
+    for(unsigned int i = 0; i < 3; ++i) {
+        scale[i] = (maxs[i] > mins[i]) ? (double) 0x1fffff / (maxs[i] - mins[i]) : 0.0;
+    }
+
+    /* least significant key goes first */
+    bool status = true;
+    if(ties != NULL) {
+        for(unsigned int i = 0; i < num; ++i) {
+            items[i].key = ties[i];
+            items[i].index = i;
+        }
+        status = t3dRadixSort(ctx, items, num);
+    } else {
+        for(unsigned int i = 0; i < num; ++i) {
+            items[i].index = i;
+        }
+    }
+
+    if(status) {
+        for(unsigned int i = 0; i < num; ++i) {
+            items[i].key = GetMortonCode(&centres[items[i].index * 3], mins, scale);
+        }
+        status = t3dRadixSort(ctx, items, num);
+    }
+
+    if(status) {
+        for(unsigned int i = 0; i < num; ++i) {
+            order[i] = items[i].index;
+        }
+    }
+
+    t3dFree(ctx, items);
+
+    return status;
+}
@@ -0,0 +1,746 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#   include <io.h>
+#   include <fcntl.h>
+#endif
+
+#if defined(T3D_USE_ZLIB)
+#   include <zlib.h>
+#endif
+#if defined(T3D_USE_ZSTD)
+#   include <zstd.h>
+#endif
+
+#include "t3d_private.h"
+
+#if defined(T3D_USE_ZLIB) || defined(T3D_USE_ZSTD)
+#   define USE_COMPRESSION
+#endif
+
+/* Compressed input is decompressed on a thread of its own, a chunk at a
+ * time, and handed over to whoever's reading it as each chunk fills up. The
+ * compressed file itself is never held in memory, only a window of it.
+ * Standard input goes through the same way, compressed or not, as it can't
+ * be sized up or seeked about in. */
+
+#define STREAM_INPUT_SIZE   (64 * 1024)
+#define STREAM_CHUNK_SIZE   (256 * 1024)
+#define STREAM_NUM_CHUNKS   4
+
+#define OUTPUT_BUFFER_SIZE  (64 * 1024)
+
+T3DCompression t3dGetCompression(const char *path) {
+    const char *extension = strrchr(path, '.');
+    if(extension == NULL) {
+        return T3D_COMPRESSION_NONE;
+    }
+
+    if(pl_strcasecmp(extension, ".gz") == 0) {
+        return T3D_COMPRESSION_GZIP;
+    } else if(pl_strcasecmp(extension, ".zst") == 0) {
+        return T3D_COMPRESSION_ZSTD;
+    }
+
+    return T3D_COMPRESSION_NONE;
+}
+
+bool t3dIsCompressionSupported(T3DCompression compression) {
+    switch(compression) {
+        case T3D_COMPRESSION_NONE: return true;
+#if defined(T3D_USE_ZLIB)
+        case T3D_COMPRESSION_GZIP: return true;
+#endif
+#if defined(T3D_USE_ZSTD)
+        case T3D_COMPRESSION_ZSTD: return true;
+#endif
+        default: return false;
+    }
+}
+
+static const char *GetCompressionName(T3DCompression compression) {
+    switch(compression) {
+        default: return "uncompressed";
+        case T3D_COMPRESSION_GZIP: return "gzip";
+        case T3D_COMPRESSION_ZSTD: return "zstd";
+    }
+}
+
+bool t3dIsStandardStream(const char *path) {
+    return path[0] == '-' && path[1] == '\0';
+}
+
+static T3DCompression DetectCompression(const unsigned char *magic, size_t length) {
+    if(length >= 2 && magic[0] == 0x1F && magic[1] == 0x8B) {
+        return T3D_COMPRESSION_GZIP;
+    } else if(length == 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD) {
+        return T3D_COMPRESSION_ZSTD;
+    }
+
+    return T3D_COMPRESSION_NONE;
+}
+
+/* goes by the contents rather than the name, so misnamed files still work */
+T3DCompression t3dDetectFileCompression(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        return T3D_COMPRESSION_NONE;
+    }
+
+    unsigned char magic[4] = { 0, 0, 0, 0 };
+    size_t length = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+
+    return DetectCompression(magic, length);
+}
+
+/**************************************************/
+/* Input */
+
+typedef struct Chunk {
+    char *data;
+    size_t length;
+} Chunk;
+
+typedef struct Stream {
+    FILE *fp;
+    T3DCompression compression;
+
+    /* already read to find out what it is, so goes ahead of the rest */
+    unsigned char magic[4];
+    size_t magic_length;
+
+    unsigned char *input;
+    bool finished;  /* reached the end of a frame/member */
+
+#if defined(T3D_USE_ZLIB)
+    z_stream zlib;
+#endif
+#if defined(T3D_USE_ZSTD)
+    ZSTD_DStream *zstd;
+    ZSTD_inBuffer zstd_input;
+#endif
+
+    /* everything below is shared between the threads */
+
+    T3DMutex mutex;
+    T3DCondition filled;
+    T3DCondition emptied;
+
+    Chunk chunks[STREAM_NUM_CHUNKS];
+    unsigned int head;      /* next to be consumed */
+    unsigned int num_full;
+
+    bool done;
+    bool cancelled;
+    char error[128];
+} Stream;
+
+/* returns false once there's nothing more to read, successfully or not */
+static bool ReadInput(Stream *stream, unsigned char *out, size_t size, size_t *length) {
+    *length = 0;
+    if(stream->magic_length > 0) {
+        memcpy(out, stream->magic, stream->magic_length);
+        *length = stream->magic_length;
+        stream->magic_length = 0;
+    }
+
+    /* a pipe hands over whatever it has, so keep going until there's a full chunk */
+    size_t read;
+    while(*length < size && (read = fread(&out[*length], 1, size - *length, stream->fp)) > 0) {
+        *length += read;
+    }
+    if(*length > 0) {
+        return true;
+    }
+
+    if(ferror(stream->fp)) {
+        snprintf(stream->error, sizeof(stream->error), "failed to read input");
+    } else if(!stream->finished) {
+        snprintf(stream->error, sizeof(stream->error), "unexpected end of compressed input");
+    }
+
+    return false;
+}
+
+/* fills out as far as it can, returns the number of bytes produced */
+static size_t Decompress(Stream *stream, char *out, size_t size, bool *eof) {
+    switch(stream->compression) {
+        default: break;
+
+        case T3D_COMPRESSION_NONE: {
+            size_t length;
+            if(!ReadInput(stream, (unsigned char *) out, size, &length)) {
+                *eof = true;
+            }
+            return length;
+        }
+
+#if defined(T3D_USE_ZLIB)
+        case T3D_COMPRESSION_GZIP: {
+            z_stream *zlib = &stream->zlib;
+            zlib->next_out = (Bytef *) out;
+            zlib->avail_out = (uInt) size;
+            while(zlib->avail_out > 0) {
+                if(zlib->avail_in == 0) {
+                    size_t length;
+                    if(!ReadInput(stream, stream->input, STREAM_INPUT_SIZE, &length)) {
+                        *eof = true;
+                        break;
+                    }
+                    zlib->next_in = stream->input;
+                    zlib->avail_in = (uInt) length;
+                }
+
+                int status = inflate(zlib, Z_NO_FLUSH);
+                if(status == Z_STREAM_END) {
+                    /* there may well be another member following this one */
+                    stream->finished = true;
+                    inflateReset(zlib);
+                } else if(status == Z_OK) {
+                    stream->finished = false;
+                } else if(status != Z_BUF_ERROR) {
+                    snprintf(stream->error, sizeof(stream->error), "%s",
+                             (zlib->msg != NULL) ? zlib->msg : "failed to inflate");
+                    *eof = true;
+                    break;
+                }
+            }
+            return size - zlib->avail_out;
+        }
+#endif
+
+#if defined(T3D_USE_ZSTD)
+        case T3D_COMPRESSION_ZSTD: {
+            ZSTD_outBuffer output = { out, size, 0 };
+            while(output.pos < output.size) {
+                if(stream->zstd_input.pos == stream->zstd_input.size) {
+                    size_t length;
+                    if(!ReadInput(stream, stream->input, STREAM_INPUT_SIZE, &length)) {
+                        *eof = true;
+                        break;
+                    }
+                    stream->zstd_input.src = stream->input;
+                    stream->zstd_input.size = length;
+                    stream->zstd_input.pos = 0;
+                }
+
+                size_t status = ZSTD_decompressStream(stream->zstd, &output, &stream->zstd_input);
+                if(ZSTD_isError(status)) {
+                    snprintf(stream->error, sizeof(stream->error), "%s", ZSTD_getErrorName(status));
+                    *eof = true;
+                    break;
+                }
+                stream->finished = (status == 0);
+            }
+            return output.pos;
+        }
+#endif
+    }
+
+    *eof = true;
+    return 0;
+}
+
+static void DecompressThread(void *user) {
+    Stream *stream = (Stream *) user;
+
+    bool eof = false;
+    while(!eof) {
+        t3dLockMutex(&stream->mutex);
+        while(stream->num_full == STREAM_NUM_CHUNKS && !stream->cancelled) {
+            t3dWaitCondition(&stream->emptied, &stream->mutex);
+        }
+        bool cancelled = stream->cancelled;
+        Chunk *chunk = &stream->chunks[(stream->head + stream->num_full) % STREAM_NUM_CHUNKS];
+        t3dUnlockMutex(&stream->mutex);
+
+        if(cancelled) {
+            break;
+        }
+
+        /* nobody else touches this chunk until it's been handed over */
+        chunk->length = Decompress(stream, chunk->data, STREAM_CHUNK_SIZE, &eof);
+
+        t3dLockMutex(&stream->mutex);
+        if(chunk->length > 0) {
+            stream->num_full++;
+        }
+        t3dSignalCondition(&stream->filled);
+        t3dUnlockMutex(&stream->mutex);
+    }
+
+    t3dLockMutex(&stream->mutex);
+    stream->done = true;
+    t3dSignalCondition(&stream->filled);
+    t3dUnlockMutex(&stream->mutex);
+}
+
+static bool InitStream(T3DContext *ctx, Stream *stream) {
+    if((stream->input = t3dMallocTag(ctx, STREAM_INPUT_SIZE, T3D_MEMORY_STREAM)) == NULL) {
+        return false;
+    }
+
+    for(unsigned int i = 0; i < STREAM_NUM_CHUNKS; ++i) {
+        if((stream->chunks[i].data = t3dMallocTag(ctx, STREAM_CHUNK_SIZE, T3D_MEMORY_STREAM)) == NULL) {
+            return false;
+        }
+    }
+
+    switch(stream->compression) {
+        default: break;
+        case T3D_COMPRESSION_NONE:
+            /* there's no end of a frame to wait on */
+            stream->finished = true;
+            return true;
+#if defined(T3D_USE_ZLIB)
+        case T3D_COMPRESSION_GZIP:
+            /* only accept gzip, not raw zlib */
+            if(inflateInit2(&stream->zlib, 15 + 16) != Z_OK) {
+                t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to initialise inflate!\n");
+                return false;
+            }
+            return true;
+#endif
+#if defined(T3D_USE_ZSTD)
+        case T3D_COMPRESSION_ZSTD:
+            if((stream->zstd = ZSTD_createDStream()) == NULL || ZSTD_isError(ZSTD_initDStream(stream->zstd))) {
+                t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to initialise zstd!\n");
+                return false;
+            }
+            return true;
+#endif
+    }
+
+    t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: %s input isn't supported by this build!\n",
+                GetCompressionName(stream->compression));
+    return false;
+}
+
+static void ShutdownStream(T3DContext *ctx, Stream *stream) {
+    switch(stream->compression) {
+        default: break;
+#if defined(T3D_USE_ZLIB)
+        case T3D_COMPRESSION_GZIP:
+            inflateEnd(&stream->zlib);
+            break;
+#endif
+#if defined(T3D_USE_ZSTD)
+        case T3D_COMPRESSION_ZSTD:
+            ZSTD_freeDStream(stream->zstd);
+            break;
+#endif
+    }
+
+    for(unsigned int i = 0; i < STREAM_NUM_CHUNKS; ++i) {
+        t3dFree(ctx, stream->chunks[i].data);
+    }
+    t3dFree(ctx, stream->input);
+}
+
+/* best guess at how big the output will be, so we can avoid reallocating as we go */
+static size_t GetDecompressedSize(Stream *stream) {
+    size_t size = 0;
+
+    long start = ftell(stream->fp);
+    if(start < 0 || fseek(stream->fp, 0, SEEK_END) != 0) {
+        return 0;
+    }
+    long end = ftell(stream->fp);
+
+    switch(stream->compression) {
+        default: break;
+        case T3D_COMPRESSION_GZIP: {
+            /* trailer has the size of the last member, modulo 4GB */
+            unsigned char trailer[4];
+            if(end >= 4 && fseek(stream->fp, -4, SEEK_END) == 0 && fread(trailer, 1, 4, stream->fp) == 4) {
+                size = (size_t) trailer[0] | ((size_t) trailer[1] << 8) |
+                       ((size_t) trailer[2] << 16) | ((size_t) trailer[3] << 24);
+            }
+            break;
+        }
+#if defined(T3D_USE_ZSTD)
+        case T3D_COMPRESSION_ZSTD: {
+            unsigned char header[ZSTD_FRAMEHEADERSIZE_MAX];
+            if(fseek(stream->fp, 0, SEEK_SET) == 0) {
+                size_t length = fread(header, 1, sizeof(header), stream->fp);
+                unsigned long long content = ZSTD_getFrameContentSize(header, length);
+                if(content != ZSTD_CONTENTSIZE_UNKNOWN && content != ZSTD_CONTENTSIZE_ERROR && content < UINT32_MAX) {
+                    size = (size_t) content;
+                }
+            }
+            break;
+        }
+#endif
+    }
+
+    /* going by typical ratios for text */
+    if(stream->compression == T3D_COMPRESSION_NONE && end > start) {
+        size = (size_t) (end - start) + stream->magic_length;
+    } else if(size == 0 && end > 0) {
+        size = (size_t) end * 8;
+    }
+
+    fseek(stream->fp, start, SEEK_SET);
+    return size;
+}
+
+static char *LoadStream(T3DContext *ctx, Stream *stream, const char *path, size_t *length,
+                        T3DStreamFunction function, void *user) {
+    if(!InitStream(ctx, stream)) {
+        ShutdownStream(ctx, stream);
+        return NULL;
+    }
+
+    /* always keep room for the terminator */
+    size_t max_length = GetDecompressedSize(stream) + 1;
+    char *buf = t3dMallocTag(ctx, max_length, T3D_MEMORY_INPUT);
+
+    t3dInitMutex(&stream->mutex);
+    t3dInitCondition(&stream->filled);
+    t3dInitCondition(&stream->emptied);
+
+    T3DThread thread;
+    bool started = (buf != NULL) && t3dCreateThread(&thread, DecompressThread, stream);
+    if(buf != NULL && !started) {
+        t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to start decompression thread!\n");
+    }
+
+    T3DDecoder decoder;
+    bool first = true;
+
+    *length = 0;
+    while(started) {
+        t3dLockMutex(&stream->mutex);
+        while(stream->num_full == 0 && !stream->done) {
+            t3dWaitCondition(&stream->filled, &stream->mutex);
+        }
+        if(stream->num_full == 0) {
+            t3dUnlockMutex(&stream->mutex);
+            break;
+        }
+        Chunk *chunk = &stream->chunks[stream->head];
+        t3dUnlockMutex(&stream->mutex);
+
+        /* can only tell what it's in once the first of it has arrived */
+        size_t bom_length = 0;
+        if(first) {
+            T3DEncoding encoding = t3dDetectEncoding(chunk->data, chunk->length, &bom_length);
+            t3dInitDecoder(&decoder, encoding);
+            if(encoding != T3D_ENCODING_UTF8) {
+                t3dLog(ctx, T3D_LOG_INFO, "converting from %s ... ", t3dGetEncodingName(encoding));
+
+                /* going by it being mostly ASCII, so half the size */
+                char *new_buf = t3dReallocTag(ctx, buf, max_length / 2 + 64, T3D_MEMORY_INPUT);
+                if(new_buf != NULL) {
+                    buf = new_buf;
+                    max_length = max_length / 2 + 64;
+                }
+            }
+            first = false;
+        }
+
+        bool status = t3dAppendText(ctx, &decoder, &chunk->data[bom_length], chunk->length - bom_length,
+                                    &buf, length, &max_length);
+        if(status && function != NULL) {
+            status = function(ctx, buf, *length, user);
+        }
+
+        t3dLockMutex(&stream->mutex);
+        stream->head = (stream->head + 1) % STREAM_NUM_CHUNKS;
+        stream->num_full--;
+        if(!status) {
+            stream->cancelled = true;
+        }
+        t3dSignalCondition(&stream->emptied);
+        t3dUnlockMutex(&stream->mutex);
+
+        if(!status) {
+            break;
+        }
+    }
+
+    if(started) {
+        t3dJoinThread(&thread);
+    }
+
+    t3dDestroyCondition(&stream->emptied);
+    t3dDestroyCondition(&stream->filled);
+    t3dDestroyMutex(&stream->mutex);
+
+    ShutdownStream(ctx, stream);
+
+    if(stream->error[0] != '\0') {
+        t3dSetError(ctx, T3D_ERROR_IO, "error: failed to %s \"%s\" (%s)!\n",
+                    (stream->compression == T3D_COMPRESSION_NONE) ? "read" : "decompress", path, stream->error);
+    }
+
+    if(ctx->error != T3D_ERROR_NONE) {
+        t3dFree(ctx, buf);
+        return NULL;
+    }
+
+    buf[*length] = '\0';
+    return buf;
+}
+
+char *t3dLoadCompressedFile(T3DContext *ctx, const char *path, T3DCompression compression, size_t *length,
+                            T3DStreamFunction function, void *user) {
+    Stream stream;
+    memset(&stream, 0, sizeof(Stream));
+    stream.compression = compression;
+
+    if((stream.fp = fopen(path, "rb")) == NULL) {
+        t3dSetError(ctx, T3D_ERROR_IO, "failed to read \"%s\", aborting!\n", path);
+        return NULL;
+    }
+
+    char *buf = LoadStream(ctx, &stream, path, length, function, user);
+    fclose(stream.fp);
+    return buf;
+}
+
+/* what's in it is found out from the first few bytes, as there's no going back to look again */
+char *t3dLoadStandardInput(T3DContext *ctx, size_t *length, T3DStreamFunction function, void *user) {
+    Stream stream;
+    memset(&stream, 0, sizeof(Stream));
+    stream.fp = stdin;
+
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+
+    stream.magic_length = fread(stream.magic, 1, sizeof(stream.magic), stdin);
+    stream.compression = DetectCompression(stream.magic, stream.magic_length);
+
+    return LoadStream(ctx, &stream, "-", length, function, user);
+}
+
+/**************************************************/
+/* Output */
+
+struct T3DOutput {
+    T3DContext *ctx;
+
+    FILE *fp;
+    T3DCompression compression;
+    T3DSink sink;
+    bool standard;  /* stdout, which isn't ours to close */
+
+    unsigned char *buffer;
+    bool failed;
+
+#if defined(T3D_USE_ZLIB)
+    z_stream zlib;
+#endif
+#if defined(T3D_USE_ZSTD)
+    ZSTD_CStream *zstd;
+#endif
+};
+
+#if defined(USE_COMPRESSION)
+static bool WriteOutputBuffer(T3DOutput *output, size_t length) {
+    if(length > 0 && fwrite(output->buffer, 1, length, output->fp) != length) {
+        output->failed = true;
+    }
+    return !output->failed;
+}
+#endif
+
+#if defined(T3D_USE_ZLIB)
+static bool Deflate(T3DOutput *output, int flush) {
+    z_stream *zlib = &output->zlib;
+    do {
+        zlib->next_out = output->buffer;
+        zlib->avail_out = OUTPUT_BUFFER_SIZE;
+        if(deflate(zlib, flush) == Z_STREAM_ERROR) {
+            output->failed = true;
+            return false;
+        }
+
+        if(!WriteOutputBuffer(output, OUTPUT_BUFFER_SIZE - zlib->avail_out)) {
+            return false;
+        }
+    } while(zlib->avail_out == 0);
+
+    return true;
+}
+#endif
+
+static size_t WriteCompressed(const void *data, size_t length, void *user) {
+    T3DOutput *output = (T3DOutput *) user;
+    if(output->failed) {
+        return 0;
+    }
+
+#if !defined(T3D_USE_ZLIB) && !defined(T3D_USE_ZSTD)
+    (void)(data);
+    (void)(length);
+#endif
+
+    switch(output->compression) {
+        default: break;
+#if defined(T3D_USE_ZLIB)
+        case T3D_COMPRESSION_GZIP:
+            output->zlib.next_in = (Bytef *) data;
+            output->zlib.avail_in = (uInt) length;
+            return Deflate(output, Z_NO_FLUSH) ? length : 0;
+#endif
+#if defined(T3D_USE_ZSTD)
+        case T3D_COMPRESSION_ZSTD: {
+            ZSTD_inBuffer input = { data, length, 0 };
+            while(input.pos < input.size) {
+                ZSTD_outBuffer out = { output->buffer, OUTPUT_BUFFER_SIZE, 0 };
+                if(ZSTD_isError(ZSTD_compressStream(output->zstd, &out, &input)) ||
+                   !WriteOutputBuffer(output, out.pos)) {
+                    output->failed = true;
+                    return 0;
+                }
+            }
+            return length;
+        }
+#endif
+    }
+
+    return 0;
+}
+
+/* passed along as soon as the writer lets go of it, so whatever's reading can get on with it */
+static size_t WriteStandardOutput(const void *data, size_t length, void *user) {
+    size_t written = fwrite(data, 1, length, (FILE *) user);
+    fflush((FILE *) user);
+    return written;
+}
+
+T3DOutput *t3dOpenOutput(T3DContext *ctx, const char *path) {
+    T3DCompression compression = t3dGetCompression(path);
+    if(!t3dIsCompressionSupported(compression)) {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: %s output isn't supported by this build!\n",
+                    GetCompressionName(compression));
+        return NULL;
+    }
+
+    T3DOutput *output = t3dCallocTag(ctx, 1, sizeof(T3DOutput), T3D_MEMORY_WRITER);
+    if(output == NULL) {
+        return NULL;
+    }
+
+    output->ctx = ctx;
+    output->compression = compression;
+
+    if(t3dIsStandardStream(path)) {
+        output->standard = true;
+        output->fp = stdout;
+        output->sink.write = WriteStandardOutput;
+        output->sink.user = output->fp;
+        return output;
+    }
+
+    if((output->fp = fopen(path, (compression == T3D_COMPRESSION_NONE) ? "w" : "wb")) == NULL) {
+        t3dSetError(ctx, T3D_ERROR_IO, "failed to open \"%s\"!\n", path);
+        t3dFree(ctx, output);
+        return NULL;
+    }
+
+    if(compression == T3D_COMPRESSION_NONE) {
+        output->sink.write = t3dWriteFile;
+        output->sink.user = output->fp;
+        return output;
+    }
+
+    if((output->buffer = t3dMallocTag(ctx, OUTPUT_BUFFER_SIZE, T3D_MEMORY_WRITER)) == NULL) {
+        fclose(output->fp);
+        t3dFree(ctx, output);
+        return NULL;
+    }
+
+    bool status = false;
+    switch(compression) {
+        default: break;
+#if defined(T3D_USE_ZLIB)
+        case T3D_COMPRESSION_GZIP:
+            status = (deflateInit2(&output->zlib, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                                   Z_DEFAULT_STRATEGY) == Z_OK);
+            break;
+#endif
+#if defined(T3D_USE_ZSTD)
+        case T3D_COMPRESSION_ZSTD:
+            status = ((output->zstd = ZSTD_createCStream()) != NULL &&
+                      !ZSTD_isError(ZSTD_initCStream(output->zstd, 3)));
+            if(!status) {
+                ZSTD_freeCStream(output->zstd);
+            }
+            break;
+#endif
+    }
+
+    if(!status) {
+        t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to initialise %s compression!\n",
+                    GetCompressionName(compression));
+        fclose(output->fp);
+        t3dFree(ctx, output->buffer);
+        t3dFree(ctx, output);
+        return NULL;
+    }
+
+    output->sink.write = WriteCompressed;
+    output->sink.user = output;
+    return output;
+}
+
+const T3DSink *t3dGetOutputSink(T3DOutput *output) {
+    return &output->sink;
+}
+
+T3DError t3dCloseOutput(T3DOutput *output) {
+    T3DContext *ctx = output->ctx;
+
+    switch(output->compression) {
+        default: break;
+#if defined(T3D_USE_ZLIB)
+        case T3D_COMPRESSION_GZIP:
+            if(!output->failed) {
+                output->zlib.next_in = NULL;
+                output->zlib.avail_in = 0;
+                Deflate(output, Z_FINISH);
+            }
+            deflateEnd(&output->zlib);
+            break;
+#endif
+#if defined(T3D_USE_ZSTD)
+        case T3D_COMPRESSION_ZSTD: {
+            size_t remaining = 1;
+            while(remaining > 0 && !output->failed) {
+                ZSTD_outBuffer out = { output->buffer, OUTPUT_BUFFER_SIZE, 0 };
+                remaining = ZSTD_endStream(output->zstd, &out);
+                if(ZSTD_isError(remaining)) {
+                    output->failed = true;
+                    break;
+                }
+                WriteOutputBuffer(output, out.pos);
+            }
+            ZSTD_freeCStream(output->zstd);
+            break;
+        }
+#endif
+    }
+
+    if(output->standard) {
+        if(fflush(output->fp) != 0 || ferror(output->fp)) {
+            output->failed = true;
+        }
+    } else if(fclose(output->fp) != 0) {
+        output->failed = true;
+    }
+
+    if(output->failed) {
+        t3dSetError(ctx, T3D_ERROR_IO, "error: failed to finish writing output!\n");
+    }
+
+    t3dFree(ctx, output->buffer);
+    t3dFree(ctx, output);
+
+    return ctx->error;
+}
@@ -0,0 +1,623 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <PL/platform_filesystem.h>
+
+#include "t3d_private.h"
+
+#define READ_CHUNK_SIZE (4 * 1024 * 1024)
+
+/**************************************************/
+
+static void *DefaultMalloc(size_t size, void *user) {
+    (void)(user);
+    return malloc(size);
+}
+
+static void *DefaultRealloc(void *ptr, size_t size, void *user) {
+    (void)(user);
+    return realloc(ptr, size);
+}
+
+static void DefaultFree(void *ptr, void *user) {
+    (void)(user);
+    free(ptr);
+}
+
+static void DefaultLog(T3DLogLevel level, const char *message, void *user) {
+    (void)(level);
+    (void)(user);
+    fputs(message, stderr);
+}
+
+/* every allocation is prefixed with one of these, so we know how much
+ * is being released and what it was for; kept at 16 bytes for alignment */
+typedef struct Allocation {
+    size_t size;
+    size_t tag;
+} Allocation;
+
+static void AddMemory(T3DContext *ctx, T3DMemoryTag tag, size_t size) {
+    T3DMemoryStats *stats[2] = { &ctx->memory[tag], &ctx->memory[T3D_MAX_MEMORY_TAGS] };
+    for(unsigned int i = 0; i < 2; ++i) {
+        stats[i]->live += size;
+        stats[i]->num_allocations++;
+        if(stats[i]->live > stats[i]->peak) {
+            stats[i]->peak = stats[i]->live;
+        }
+    }
+}
+
+static void RemoveMemory(T3DContext *ctx, T3DMemoryTag tag, size_t size) {
+    ctx->memory[tag].live -= size;
+    ctx->memory[T3D_MAX_MEMORY_TAGS].live -= size;
+}
+
+void *t3dMallocTag(T3DContext *ctx, size_t size, T3DMemoryTag tag) {
+    Allocation *header = NULL;
+    if(size <= SIZE_MAX - sizeof(Allocation)) {
+        header = ctx->options.allocator.malloc(sizeof(Allocation) + size, ctx->options.allocator.user);
+    }
+    if(header == NULL) {
+        t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to allocate %zu bytes!\n", size);
+        return NULL;
+    }
+
+    header->size = size;
+    header->tag = tag;
+    AddMemory(ctx, tag, size);
+
+    return header + 1;
+}
+
+void *t3dCallocTag(T3DContext *ctx, size_t num, size_t size, T3DMemoryTag tag) {
+    if(size != 0 && num > SIZE_MAX / size) {
+        t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to allocate %zu * %zu bytes!\n", num, size);
+        return NULL;
+    }
+
+    void *ptr = t3dMallocTag(ctx, num * size, tag);
+    if(ptr != NULL) {
+        memset(ptr, 0, num * size);
+    }
+    return ptr;
+}
+
+/* the allocation moves over to the new tag, if it differs */
+void *t3dReallocTag(T3DContext *ctx, void *ptr, size_t size, T3DMemoryTag tag) {
+    if(ptr == NULL) {
+        return t3dMallocTag(ctx, size, tag);
+    }
+
+    Allocation *header = (Allocation *) ptr - 1;
+    size_t old_size = header->size;
+    T3DMemoryTag old_tag = (T3DMemoryTag) header->tag;
+
+    Allocation *new_header = NULL;
+    if(size <= SIZE_MAX - sizeof(Allocation)) {
+        new_header = ctx->options.allocator.realloc(header, sizeof(Allocation) + size, ctx->options.allocator.user);
+    }
+    if(new_header == NULL) {
+        t3dSetError(ctx, T3D_ERROR_MEMORY, "error: failed to reallocate %zu bytes!\n", size);
+        return NULL;
+    }
+
+    RemoveMemory(ctx, old_tag, old_size);
+    new_header->size = size;
+    new_header->tag = tag;
+    AddMemory(ctx, tag, size);
+
+    return new_header + 1;
+}
+
+void *t3dMalloc(T3DContext *ctx, size_t size) {
+    return t3dMallocTag(ctx, size, T3D_MEMORY_OTHER);
+}
+
+void *t3dCalloc(T3DContext *ctx, size_t num, size_t size) {
+    return t3dCallocTag(ctx, num, size, T3D_MEMORY_OTHER);
+}
+
+void *t3dRealloc(T3DContext *ctx, void *ptr, size_t size) {
+    return t3dReallocTag(ctx, ptr, size, (ptr != NULL) ? (T3DMemoryTag) ((Allocation *) ptr - 1)->tag : T3D_MEMORY_OTHER);
+}
+
+void t3dFree(T3DContext *ctx, void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+
+    Allocation *header = (Allocation *) ptr - 1;
+    RemoveMemory(ctx, (T3DMemoryTag) header->tag, header->size);
+
+    ctx->options.allocator.free(header, ctx->options.allocator.user);
+}
+
+void t3dGetMemoryStats(const T3DContext *ctx, T3DMemoryTag tag, T3DMemoryStats *stats) {
+    if(tag > T3D_MAX_MEMORY_TAGS) {
+        memset(stats, 0, sizeof(T3DMemoryStats));
+        return;
+    }
+
+    *stats = ctx->memory[tag];
+}
+
+const char *t3dGetMemoryTagName(T3DMemoryTag tag) {
+    static const char *names[T3D_MAX_MEMORY_TAGS] = {
+            "context",
+            "input",
+            "tokens",
+            "brushes",
+            "polygons",
+            "actors",
+            "properties",
+            "writer",
+            "stream",
+            "incremental",
+            "geometry",
+            "index",
+            "groups",
+            "other",
+    };
+
+    if(tag >= T3D_MAX_MEMORY_TAGS) {
+        return "total";
+    }
+
+    return names[tag];
+}
+
+/**************************************************/
+
+void t3dLog(T3DContext *ctx, T3DLogLevel level, const char *format, ...) {
+    /* not even formatted unless asked for, as it's called for just about everything */
+    if(level == T3D_LOG_DEBUG && !ctx->options.verbose) {
+        return;
+    }
+
+    char message[1024];
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    ctx->options.log(level, message, ctx->options.log_user);
+}
+
+/* only the first error is retained, as that's typically the one that matters */
+void t3dSetError(T3DContext *ctx, T3DError error, const char *format, ...) {
+    char message[1024];
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    ctx->options.log(T3D_LOG_ERROR, message, ctx->options.log_user);
+
+    if(ctx->error == T3D_ERROR_NONE) {
+        ctx->error = error;
+    }
+}
+
+/* cancelling isn't logged as an error, as it's what was asked for */
+bool t3dReportProgress(T3DContext *ctx) {
+    if(ctx->error != T3D_ERROR_NONE) {
+        return false;
+    }
+
+    if(ctx->options.progress != NULL && !ctx->options.progress(&ctx->progress, ctx->options.progress_user)) {
+        ctx->error = T3D_ERROR_CANCELLED;
+        return false;
+    }
+
+    return true;
+}
+
+T3DError t3dGetError(const T3DContext *ctx) {
+    return ctx->error;
+}
+
+const char *t3dGetErrorString(T3DError error) {
+    static const char *strings[T3D_MAX_ERRORS] = {
+            "no error",
+            "out of memory",
+            "i/o failure",
+            "syntax error",
+            "limit exceeded",
+            "no brushes",
+            "invalid parameter",
+            "cancelled",
+    };
+
+    if(error >= T3D_MAX_ERRORS) {
+        return "unknown error";
+    }
+
+    return strings[error];
+}
+
+/**************************************************/
+
+T3DContext *t3dCreateContext(const T3DOptions *options) {
+    T3DOptions defaults;
+    if(options == NULL) {
+        memset(&defaults, 0, sizeof(T3DOptions));
+        options = &defaults;
+    }
+
+    T3DAllocator allocator = options->allocator;
+    if(allocator.malloc == NULL || allocator.realloc == NULL || allocator.free == NULL) {
+        allocator.malloc  = DefaultMalloc;
+        allocator.realloc = DefaultRealloc;
+        allocator.free    = DefaultFree;
+        allocator.user    = NULL;
+    }
+
+    T3DContext *ctx = allocator.malloc(sizeof(T3DContext), allocator.user);
+    if(ctx == NULL) {
+        return NULL;
+    }
+
+    memset(ctx, 0, sizeof(T3DContext));
+    AddMemory(ctx, T3D_MEMORY_CONTEXT, sizeof(T3DContext));
+    ctx->options = *options;
+    ctx->options.allocator = allocator;
+    if(ctx->options.log == NULL) {
+        ctx->options.log = DefaultLog;
+    }
+
+    if(ctx->options.format >= MAX_MAP_FORMATS) {
+        ctx->options.format = MAP_FORMAT_IDT2;
+    }
+
+    if(!t3dGrowBrushes(ctx) || !t3dGrowActors(ctx)) {
+        t3dDestroyContext(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+/* applies to the next document; the allocator can't be changed once the context exists */
+void t3dSetOptions(T3DContext *ctx, const T3DOptions *options) {
+    T3DAllocator allocator = ctx->options.allocator;
+    ctx->options = *options;
+    ctx->options.allocator = allocator;
+    if(ctx->options.log == NULL) {
+        ctx->options.log = DefaultLog;
+    }
+
+    if(ctx->options.format >= MAX_MAP_FORMATS) {
+        ctx->options.format = MAP_FORMAT_IDT2;
+    }
+}
+
+/* throws away the current document, but keeps hold of our allocations */
+void t3dResetContext(T3DContext *ctx) {
+    /* the slot after the last is the one that was being parsed, so may also hold data */
+    for(unsigned int i = 0; i <= ctx->num_brushes && i < ctx->max_brushes; ++i) {
+        t3dFree(ctx, ctx->brushes[i].poly_list);
+    }
+
+    unsigned int num_brushes = (ctx->num_brushes < ctx->max_brushes) ? ctx->num_brushes + 1 : ctx->max_brushes;
+    unsigned int num_actors = (ctx->num_actors < ctx->max_actors) ? ctx->num_actors + 1 : ctx->max_actors;
+    memset(ctx->brushes, 0, sizeof(T3DBrush) * num_brushes);
+    memset(ctx->actors, 0, sizeof(T3DActor) * num_actors);
+    ctx->num_brushes = 0;
+    ctx->num_actors = 0;
+    ctx->num_duplicates = 0;
+
+    t3dResetGroups(ctx);
+
+    memset(&ctx->map, 0, sizeof(ctx->map));
+    memset(ctx->chunks, 0, sizeof(ctx->chunks));
+    ctx->cur_chunk = -1;
+    ctx->num_tokens = 0;
+    ctx->cur_token = 0;
+    ctx->num_unknown = 0;
+
+    ctx->num_properties = 0;
+    ctx->base = NULL;
+
+    t3dFree(ctx, ctx->buffer);
+    ctx->buffer = NULL;
+
+    memset(&ctx->progress, 0, sizeof(T3DProgress));
+
+    ctx->error = T3D_ERROR_NONE;
+}
+
+void t3dDestroyContext(T3DContext *ctx) {
+    if(ctx == NULL) {
+        return;
+    }
+
+    if(ctx->brushes != NULL && ctx->actors != NULL) {
+        t3dResetContext(ctx);
+    }
+
+    t3dFree(ctx, ctx->brushes);
+    t3dFree(ctx, ctx->actors);
+    t3dFree(ctx, ctx->properties);
+    t3dFree(ctx, ctx->tokens);
+    t3dFree(ctx, ctx->groups);
+    t3dFree(ctx, ctx->group_table);
+
+    ctx->options.allocator.free(ctx, ctx->options.allocator.user);
+}
+
+/* keeps the invariant that there's always a zeroed slot past the end */
+bool t3dGrowBrushes(T3DContext *ctx) {
+    if(ctx->num_brushes + 1 < ctx->max_brushes) {
+        return true;
+    }
+
+    unsigned int max_brushes = (ctx->max_brushes == 0) ? 64 : ctx->max_brushes * 2;
+    T3DBrush *brushes = t3dReallocTag(ctx, ctx->brushes, sizeof(T3DBrush) * max_brushes, T3D_MEMORY_BRUSHES);
+    if(brushes == NULL) {
+        return false;
+    }
+
+    memset(&brushes[ctx->max_brushes], 0, sizeof(T3DBrush) * (max_brushes - ctx->max_brushes));
+    ctx->brushes = brushes;
+    ctx->max_brushes = max_brushes;
+    return true;
+}
+
+bool t3dGrowActors(T3DContext *ctx) {
+    if(ctx->num_actors + 1 < ctx->max_actors) {
+        return true;
+    }
+
+    unsigned int max_actors = (ctx->max_actors == 0) ? 64 : ctx->max_actors * 2;
+    T3DActor *actors = t3dReallocTag(ctx, ctx->actors, sizeof(T3DActor) * max_actors, T3D_MEMORY_ACTORS);
+    if(actors == NULL) {
+        return false;
+    }
+
+    memset(&actors[ctx->max_actors], 0, sizeof(T3DActor) * (max_actors - ctx->max_actors));
+    ctx->actors = actors;
+    ctx->max_actors = max_actors;
+    return true;
+}
+
+unsigned int t3dGetNumBrushes(const T3DContext *ctx) {
+    return ctx->num_brushes;
+}
+
+unsigned int t3dGetNumActors(const T3DContext *ctx) {
+    return ctx->num_actors;
+}
+
+unsigned int t3dGetNumDuplicates(const T3DContext *ctx) {
+    return ctx->num_duplicates;
+}
+
+const T3DBrush *t3dGetBrush(const T3DContext *ctx, unsigned int index) {
+    if(index >= ctx->num_brushes) {
+        return NULL;
+    }
+
+    return &ctx->brushes[index];
+}
+
+const T3DActor *t3dGetActor(const T3DContext *ctx, unsigned int index) {
+    if(index >= ctx->num_actors) {
+        return NULL;
+    }
+
+    return &ctx->actors[index];
+}
+
+/**************************************************/
+
+char *t3dLoadFile(T3DContext *ctx, const char *path, size_t *length) {
+    t3dLog(ctx, T3D_LOG_INFO, "attempting to read T3D at \"%s\" ... ", path);
+
+    if(t3dIsStandardStream(path)) {
+        char *buf = t3dLoadStandardInput(ctx, length, NULL, NULL);
+        if(buf != NULL) {
+            t3dLog(ctx, T3D_LOG_INFO, "success!\n");
+        }
+        return buf;
+    }
+
+    if(!plFileExists(path)) {
+        t3dSetError(ctx, T3D_ERROR_IO, "failed to find \"%s\", aborting!\n", path);
+        return NULL;
+    }
+
+    T3DCompression compression = t3dDetectFileCompression(path);
+    if(compression != T3D_COMPRESSION_NONE) {
+        char *buf = t3dLoadCompressedFile(ctx, path, compression, length, NULL, NULL);
+        if(buf != NULL) {
+            t3dLog(ctx, T3D_LOG_INFO, "success!\n");
+        }
+        return buf;
+    }
+
+    size_t bom_length;
+    T3DEncoding encoding = t3dDetectFileEncoding(path, &bom_length);
+    if(encoding != T3D_ENCODING_UTF8) {
+        char *buf = t3dLoadEncodedFile(ctx, path, encoding, length);
+        if(buf != NULL) {
+            t3dLog(ctx, T3D_LOG_INFO, "success!\n");
+        }
+        return buf;
+    }
+
+    PLFile *fp = plOpenFile(path, false);
+    if(fp == NULL) {
+        t3dSetError(ctx, T3D_ERROR_IO, "failed to read \"%s\", aborting!\n", path);
+        return NULL;
+    }
+
+    char *buf;
+    *length = plGetFileSize(fp);
+    if((buf = t3dMallocTag(ctx, *length + 1, T3D_MEMORY_INPUT)) == NULL) {
+        plCloseFile(fp);
+        return NULL;
+    }
+
+    /* skip over the BOM, if there is one */
+    char bom[3];
+    if(bom_length > 0 && plReadFile(fp, bom, 1, bom_length) == bom_length) {
+        *length -= bom_length;
+    }
+
+    /* read in pieces, so there's progress to report and a chance to cancel */
+    ctx->progress.total_bytes = *length;
+    size_t num_read = 0;
+    while(num_read < *length) {
+        size_t size = (*length - num_read < READ_CHUNK_SIZE) ? *length - num_read : READ_CHUNK_SIZE;
+        size_t result = plReadFile(fp, &buf[num_read], 1, size);
+        num_read += result;
+        if(result != size) {
+            t3dLog(ctx, T3D_LOG_WARNING, "Failed to read entirety of T3D, expect faults!\n");
+            break;
+        }
+
+        ctx->progress.bytes_read = num_read;
+        if(!t3dReportProgress(ctx)) {
+            plCloseFile(fp);
+            t3dFree(ctx, buf);
+            return NULL;
+        }
+    }
+    buf[*length] = '\0';
+    plCloseFile(fp);
+
+    t3dLog(ctx, T3D_LOG_INFO, "success!\n");
+
+    return buf;
+}
+
+size_t t3dWriteFile(const void *data, size_t length, void *user) {
+    return fwrite(data, 1, length, (FILE *) user);
+}
+
+/**************************************************/
+
+/* https://stackoverflow.com/questions/3018313/algorithm-to-convert-rgb-to-hsv-and-hsv-to-rgb-in-range-0-255-for-both */
+void t3dConvertHSV(unsigned char h, unsigned char s, unsigned char v,
+                   unsigned char *r, unsigned char *g, unsigned char *b) {
+    if(s == 0) {
+        if(v == 0) {
+            *r = 255;
+            *g = 255;
+            *b = 255;
+        } else {
+            *r = v;
+            *g = v;
+            *b = v;
+        }
+        return;
+    }
+
+    unsigned char region = (unsigned char) (h / 43);
+    unsigned char remainder = (unsigned char) ((h - (region * 43)) * 6);
+
+    unsigned char p = (unsigned char) ((v * (255 - s)) >> 8);
+    unsigned char q = (unsigned char) ((v * (255 - ((s * remainder) >> 8))) >> 8);
+    unsigned char t = (unsigned char) ((v * (255 - ((s * (255 - remainder)) >> 8))) >> 8);
+
+    switch(region) {
+        case 0:     *r = v; *g = t; *b = p; break;
+        case 1:     *r = q; *g = v; *b = p; break;
+        case 2:     *r = p; *g = v; *b = t; break;
+        case 3:     *r = p; *g = q; *b = v; break;
+        case 4:     *r = t; *g = p; *b = v; break;
+        default:    *r = v; *g = p; *b = q; break;
+    }
+}
+
+/* the reverse of the above, near enough */
+void t3dConvertRGB(unsigned char r, unsigned char g, unsigned char b,
+                   unsigned char *h, unsigned char *s, unsigned char *v) {
+    unsigned char max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+    unsigned char min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+
+    *v = max;
+    if(max == 0 || max == min) {
+        *h = 0;
+        *s = 0;
+        return;
+    }
+
+    int delta = max - min;
+    *s = (unsigned char) (255 * delta / max);
+
+    int hue;
+    if(max == r) {
+        hue = 0 + 43 * (g - b) / delta;
+    } else if(max == g) {
+        hue = 85 + 43 * (b - r) / delta;
+    } else {
+        hue = 171 + 43 * (r - g) / delta;
+    }
+    *h = (unsigned char) ((hue + 256) % 256);
+}
+
+/****************************
+ * Actors
+ ***************************/
+
+#define StandardEntityName(a)                   { (a), (a), (a), (a), (a) }
+#define EntityName(ID2, ID3, ID4, GSRC, SRC)    { (ID2), (ID3), (ID4), (GSRC), (SRC) }
+
+static const T3DActorDef actor_definitions[]={
+        {"Brush",           ACT_Brush},
+        {"Mover",           ACT_Mover},
+        {"AmbientSound",    ACT_AmbientSound},
+
+        { "PlayerStart",    ACT_PlayerStart,    StandardEntityName("info_player_start") },
+        { "Light",          ACT_Light,          StandardEntityName("light") },
+
+        { "PathNode",       ACT_PathNode,       EntityName(NULL, NULL, NULL, "info_node", "info_node") },
+
+        {"Spotlight",       ACT_Spotlight},
+        {"Sparks",          ACT_Sparks},
+        {"LevelSummary",    ACT_LevelSummary},
+        {"LevelInfo",       ACT_LevelInfo},
+
+        /* UT99 */
+        { "HealthVial",     ACT_HealthVial,     EntityName(NULL, NULL, NULL, "item_battery", NULL) },
+
+        {NULL}
+};
+
+const T3DActorDef *t3dGetActorDef(const char *name) {
+    for(unsigned int i = 0; i < plArrayElements(actor_definitions); ++i) {
+        if(actor_definitions[i].name == NULL) {
+            break;
+        }
+
+        if(pl_strncasecmp(name, actor_definitions[i].name, sizeof(name)) == 0) {
+            return &actor_definitions[i];
+        }
+    }
+
+    return &actor_definitions[ACT_Unknown];
+}
+
+const T3DActorDef *t3dGetActorDefForEntity(const char *classname, unsigned int format) {
+    if(format >= MAX_MAP_FORMATS) {
+        return NULL;
+    }
+
+    for(unsigned int i = 0; i < plArrayElements(actor_definitions); ++i) {
+        if(actor_definitions[i].name == NULL) {
+            break;
+        }
+
+        const char *target = actor_definitions[i].targets[format];
+        if(target != NULL && pl_strcasecmp(classname, target) == 0) {
+            return &actor_definitions[i];
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,552 @@
+/*
+ * libt3d
+ *
+ * Everything needed to parse a T3D document and write it back out as a MAP.
+ * All state lives in a T3DContext, so as many documents as you like can be
+ * converted at once, just so long as each context is only used by one thread
+ * at a time.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <PL/platform_math.h>
+
+#define T3D_VERSION "0.01"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum T3DError {
+    T3D_ERROR_NONE,
+
+    T3D_ERROR_MEMORY,       /* allocator returned NULL */
+    T3D_ERROR_IO,           /* failed to read input or the sink rejected output */
+    T3D_ERROR_SYNTAX,       /* malformed or unsupported document */
+    T3D_ERROR_LIMIT,        /* document exceeds one of our fixed limits */
+    T3D_ERROR_NO_BRUSHES,   /* nothing to write */
+    T3D_ERROR_PARAMETER,    /* invalid argument passed to the API */
+    T3D_ERROR_CANCELLED,    /* the progress function asked for it to stop */
+
+    T3D_MAX_ERRORS
+} T3DError;
+
+enum { /* do NOT change the ordering of these!!! */
+    MAP_FORMAT_IDT2,    /* Quake, Quake 2 */
+    MAP_FORMAT_IDT3,    /* Quake 3 */
+    MAP_FORMAT_IDT4,    /* Doom 3 */
+
+    MAP_FORMAT_GSRC,    /* Half-Life */
+    MAP_FORMAT_SRC,     /* Half-Life 2 */
+
+    MAX_MAP_FORMATS
+};
+
+typedef enum T3DLogLevel {
+    T3D_LOG_DEBUG,
+    T3D_LOG_INFO,
+    T3D_LOG_WARNING,
+    T3D_LOG_ERROR,
+} T3DLogLevel;
+
+/* all memory owned by a context goes through here */
+typedef struct T3DAllocator {
+    void *(*malloc)(size_t size, void *user);
+    void *(*realloc)(void *ptr, size_t size, void *user);
+    void (*free)(void *ptr, void *user);
+    void *user;
+} T3DAllocator;
+
+/* output is handed over in chunks, return the number of bytes consumed */
+typedef struct T3DSink {
+    size_t (*write)(const void *data, size_t length, void *user);
+    void *user;
+} T3DSink;
+
+typedef void (*T3DLogFunction)(T3DLogLevel level, const char *message, void *user);
+
+typedef enum T3DPhase {
+    T3D_PHASE_QUEUED,       /* only seen with t3dStartConversion, before it gets going */
+    T3D_PHASE_READING,
+    T3D_PHASE_PARSING,
+    T3D_PHASE_WRITING,
+    T3D_PHASE_DONE,         /* likewise */
+} T3DPhase;
+
+typedef struct T3DProgress {
+    T3DPhase phase;
+
+    uint64_t bytes_read;
+    uint64_t bytes_parsed;
+    uint64_t total_bytes;   /* 0 until it's known, which for streamed input is once it's all been read */
+
+    unsigned int brushes_written;
+    unsigned int total_brushes;
+} T3DProgress;
+
+/* called back at each chunk parsed and each brush written, so keep it cheap, return false to cancel */
+typedef bool (*T3DProgressFunction)(const T3DProgress *progress, void *user);
+
+typedef struct T3DOptions {
+    unsigned int format;    /* MAP_FORMAT_* */
+
+    bool actors;            /* retain original actor names for entities */
+    bool add;               /* only additive geometry */
+    bool sub;               /* only subtractive geometry */
+    bool properties;        /* pass all actor properties through as entity keys */
+    bool duplicates;        /* report brushes that duplicate another */
+    bool dedupe;            /* drop brushes that duplicate another */
+    bool sort;              /* write brushes and entities out in spatial (Morton) order */
+    bool groups;            /* keep brushes together by editor group, as func_group or visgroups */
+
+    T3DAllocator allocator; /* leave zeroed for malloc/realloc/free */
+
+    T3DLogFunction log;     /* leave NULL to print to stderr */
+    void *log_user;
+    bool verbose;           /* also log T3D_LOG_DEBUG, which is every chunk parsed, so there's a lot of it */
+
+    T3DProgressFunction progress;   /* optional, ignored by t3dConvertBatch */
+    void *progress_user;
+} T3DOptions;
+
+/****************************
+ * Document
+ ***************************/
+
+enum {
+    ACT_Brush,          /* */
+    ACT_Mover,          /* func_wall */
+
+    ACT_AmbientSound,   /* */
+
+    ACT_PlayerStart,    /* info_player_start */
+
+    ACT_Light,          /* light */
+    ACT_Spotlight,      /* light_spot */
+
+    ACT_Sparks,         /* env_spark */
+
+    ACT_LevelSummary,   /* worldspawn */
+    ACT_LevelInfo,      /* worldspawn */
+
+    ACT_PathNode,
+
+    /* UT99 */
+    ACT_HealthVial,     /* item_battery */
+
+    ACT_Unknown
+};
+
+typedef struct T3DActorDef {
+    const char *name;
+    unsigned int id;
+
+    const char *targets[MAX_MAP_FORMATS];
+} T3DActorDef;
+
+/* offset and length into the buffer the document was parsed from */
+typedef struct T3DSpan {
+    uint32_t offset;
+    uint32_t length;
+} T3DSpan;
+
+typedef struct T3DProperty {
+    T3DSpan key;
+    T3DSpan value;  /* undecoded, e.g. "(X=1.0,Z=2.0)" */
+} T3DProperty;
+
+typedef struct T3DActor {
+    char name[64];
+    char class_name[64];
+
+    const T3DActorDef *class_index;
+
+    /* everything else is only decoded on request, see t3dGetActorProperties */
+    unsigned int first_property;
+    unsigned int num_properties;
+} T3DActor;
+
+#define T3D_MAX_POLYGON_VERTICES    32
+
+typedef struct T3DPolygon { /* i 'ssa face >:I */
+    char item[64];
+    char texture[128];
+    char group[64];
+
+    /* T3D spec specifies that we're not guaranteed four vertices
+     * so, while I haven't seen a case of this, we will respect it */
+    PLVector3 vertices[T3D_MAX_POLYGON_VERTICES];
+    unsigned int num_vertices;
+
+    PLVector3 u;
+    PLVector3 v;
+
+    PLVector3 origin;
+} T3DPolygon;
+
+enum {
+    CSG_Active,
+    CSG_Add,
+    CSG_Subtract,
+    CSG_Intersect,
+    CSG_Deintersect,
+};
+
+typedef struct T3DBrush { /* i 'ssa primitive >:I */
+    char name[32];
+
+    T3DPolygon *poly_list;
+    unsigned int num_poly;
+    unsigned int max_poly;
+
+    PLVector3 location;
+    PLVector3 rotation;
+    PLVector3 pre_pivot;
+    PLVector3 post_pivot;
+
+    unsigned int csg;
+    unsigned int group;     /* see t3dGetGroupName, 0 if it isn't in one */
+    unsigned int flags;
+    unsigned int poly_flags;
+    unsigned int colour;
+} T3DBrush;
+
+/****************************
+ * Context
+ ***************************/
+
+typedef struct T3DContext T3DContext;
+
+T3DContext *t3dCreateContext(const T3DOptions *options);
+void t3dDestroyContext(T3DContext *ctx);
+void t3dResetContext(T3DContext *ctx);
+/* the allocator is left as it was */
+void t3dSetOptions(T3DContext *ctx, const T3DOptions *options);
+
+T3DError t3dGetError(const T3DContext *ctx);
+const char *t3dGetErrorString(T3DError error);
+
+void *t3dMalloc(T3DContext *ctx, size_t size);
+void *t3dCalloc(T3DContext *ctx, size_t num, size_t size);
+void *t3dRealloc(T3DContext *ctx, void *ptr, size_t size);
+void t3dFree(T3DContext *ctx, void *ptr);
+
+/* returns a NUL-terminated copy of the file, release with t3dFree */
+char *t3dLoadFile(T3DContext *ctx, const char *path, size_t *length);
+
+/* buf must be NUL-terminated at buf[length] and outlive the context's use of it */
+T3DError t3dParseBuffer(T3DContext *ctx, const char *buf, size_t length);
+T3DError t3dParseFile(T3DContext *ctx, const char *path);
+
+T3DError t3dWriteMap(T3DContext *ctx, const T3DSink *sink);
+
+/* flood fills the map from each player start, if it leaks then a point file
+ * tracing the shortest way out is written to the sink */
+T3DError t3dCheckLeaks(T3DContext *ctx, const T3DSink *sink, bool *leaked);
+
+unsigned int t3dGetNumBrushes(const T3DContext *ctx);
+unsigned int t3dGetNumActors(const T3DContext *ctx);
+/* only counted if duplicates or dedupe are enabled */
+unsigned int t3dGetNumDuplicates(const T3DContext *ctx);
+const T3DBrush *t3dGetBrush(const T3DContext *ctx, unsigned int index);
+const T3DActor *t3dGetActor(const T3DContext *ctx, unsigned int index);
+
+const T3DActorDef *t3dGetActorDef(const char *name);
+/* the other way around, returns NULL if nothing targets the entity in the given format */
+const T3DActorDef *t3dGetActorDefForEntity(const char *classname, unsigned int format);
+
+/****************************
+ * Properties
+ ***************************/
+
+/* the returned pointer is into the parsed buffer, so isn't NUL-terminated */
+const char *t3dGetSpan(const T3DContext *ctx, T3DSpan span);
+
+const T3DProperty *t3dGetActorProperties(const T3DContext *ctx, const T3DActor *actor, unsigned int *num_properties);
+const T3DProperty *t3dFindActorProperty(const T3DContext *ctx, const T3DActor *actor, const char *key);
+
+/* strips any surrounding quotes, returns false if it had to be truncated */
+bool t3dDecodeString(const T3DContext *ctx, const T3DProperty *property, char *out, size_t size);
+bool t3dDecodeInteger(const T3DContext *ctx, const T3DProperty *property, int *out);
+bool t3dDecodeFloat(const T3DContext *ctx, const T3DProperty *property, float *out);
+/* handles both "(X=1,Y=2,Z=3)", where missing components are zero, and "(1,2,3)" */
+bool t3dDecodeVector(const T3DContext *ctx, const T3DProperty *property, PLVector3 *out);
+
+/* shorthand for looking up and decoding in one go, out is left untouched if the property is missing */
+bool t3dGetActorString(const T3DContext *ctx, const T3DActor *actor, const char *key, char *out, size_t size);
+bool t3dGetActorInteger(const T3DContext *ctx, const T3DActor *actor, const char *key, int *out);
+bool t3dGetActorVector(const T3DContext *ctx, const T3DActor *actor, const char *key, PLVector3 *out);
+
+/* stock sink for writing out to a stdio stream, user is the FILE */
+size_t t3dWriteFile(const void *data, size_t length, void *user);
+
+/****************************
+ * Memory
+ ***************************/
+
+/* Everything the context allocates is accounted against one of these,
+ * so it's possible to see where the memory went after a conversion. */
+
+typedef enum T3DMemoryTag {
+    T3D_MEMORY_CONTEXT,
+    T3D_MEMORY_INPUT,       /* the document itself */
+    T3D_MEMORY_TOKENS,
+    T3D_MEMORY_BRUSHES,
+    T3D_MEMORY_POLYGONS,
+    T3D_MEMORY_ACTORS,
+    T3D_MEMORY_PROPERTIES,
+    T3D_MEMORY_WRITER,
+    T3D_MEMORY_STREAM,      /* decompression buffers */
+    T3D_MEMORY_INCREMENTAL,
+    T3D_MEMORY_GEOMETRY,    /* scratch space for checking over the brushes */
+    T3D_MEMORY_INDEX,
+    T3D_MEMORY_GROUPS,
+    T3D_MEMORY_OTHER,       /* anything via t3dMalloc and friends */
+
+    T3D_MAX_MEMORY_TAGS
+} T3DMemoryTag;
+
+typedef struct T3DMemoryStats {
+    size_t live;                /* bytes currently allocated */
+    size_t peak;                /* most that were allocated at any one time */
+    unsigned long num_allocations;
+} T3DMemoryStats;
+
+/* pass T3D_MAX_MEMORY_TAGS for the total across all tags */
+void t3dGetMemoryStats(const T3DContext *ctx, T3DMemoryTag tag, T3DMemoryStats *stats);
+const char *t3dGetMemoryTagName(T3DMemoryTag tag);
+
+/****************************
+ * Compression
+ ***************************/
+
+/* Compressed input is picked up by t3dParseFile and t3dLoadFile from the
+ * contents of the file, and is decompressed on a separate thread as it's
+ * being parsed. Output is compressed when the path asks for it. A path of
+ * "-" reads from stdin or writes to stdout instead, which needn't be
+ * seekable. */
+
+typedef enum T3DCompression {
+    T3D_COMPRESSION_NONE,
+    T3D_COMPRESSION_GZIP,   /* .gz */
+    T3D_COMPRESSION_ZSTD,   /* .zst */
+} T3DCompression;
+
+/* goes by the extension of the given path */
+T3DCompression t3dGetCompression(const char *path);
+bool t3dIsCompressionSupported(T3DCompression compression);
+
+typedef struct T3DOutput T3DOutput;
+
+T3DOutput *t3dOpenOutput(T3DContext *ctx, const char *path);
+/* valid until the output is closed */
+const T3DSink *t3dGetOutputSink(T3DOutput *output);
+/* finishes off any compression, returns an error if anything failed to be written */
+T3DError t3dCloseOutput(T3DOutput *output);
+
+/****************************
+ * Tiled Export
+ ***************************/
+
+/* Splits the world into a grid of tiles across the ground plane, writing
+ * each out as a map of its own with its own worldspawn, so they can be
+ * compiled separately. Brushes go to the tile holding the centre of their
+ * bounds, and to any others within the margin; entities go to the tile
+ * holding their origin. */
+
+typedef struct T3DTile {
+    unsigned int column;    /* along x, in map space */
+    unsigned int row;       /* along y */
+
+    double mins[3];         /* not including the margin */
+    double maxs[3];
+
+    unsigned int num_brushes;   /* tiles without any brushes aren't written */
+    unsigned int num_actors;
+} T3DTile;
+
+typedef struct T3DTileOptions {
+    unsigned int columns;
+    unsigned int rows;
+    double margin;              /* brushes this close to a tile are written into it too */
+    unsigned int num_threads;   /* leave as 0 for one per processor */
+
+    /* called from whichever thread writes the tile, but never more than one at a time */
+    const T3DSink *(*open)(const T3DTile *tile, void *user);
+    bool (*close)(const T3DTile *tile, const T3DSink *sink, void *user);
+    void *user;
+} T3DTileOptions;
+
+/* tiles must have room for columns * rows, and is filled in row by row */
+T3DError t3dWriteTiles(T3DContext *ctx, const T3DTileOptions *options, T3DTile *tiles);
+
+/****************************
+ * Groups
+ ***************************/
+
+/* Brushes belong to the group given on their polygons, which is how they
+ * were organised in the editor, and group 0 holds those that weren't in
+ * one. With the groups option they're kept together when written, either
+ * as func_group entities or tagged into visgroups, depending on the format.
+ * They can also be split up, writing each group out as a map of its own
+ * with its own worldspawn, along with the entities naming it as their first
+ * group; entities in no group, or one without brushes, go with group 0. */
+
+unsigned int t3dGetNumGroups(const T3DContext *ctx);
+/* returns NULL if there's no such group */
+const char *t3dGetGroupName(const T3DContext *ctx, unsigned int group);
+
+typedef struct T3DGroup {
+    unsigned int index;
+    const char *name;           /* empty for group 0 */
+
+    unsigned int num_brushes;   /* groups without any brushes aren't written */
+    unsigned int num_actors;
+} T3DGroup;
+
+typedef struct T3DGroupOptions {
+    unsigned int num_threads;   /* leave as 0 for one per processor */
+
+    /* called from whichever thread writes the group, but never more than one at a time */
+    const T3DSink *(*open)(const T3DGroup *group, void *user);
+    bool (*close)(const T3DGroup *group, const T3DSink *sink, void *user);
+    void *user;
+} T3DGroupOptions;
+
+/* groups must have room for t3dGetNumGroups */
+T3DError t3dWriteGroups(T3DContext *ctx, const T3DGroupOptions *options, T3DGroup *groups);
+
+/****************************
+ * Incremental Conversion
+ ***************************/
+
+/* Caches the output of each top-level block in the document against a
+ * hash of its contents, so that subsequent updates only need to parse
+ * the blocks that changed. */
+
+typedef struct T3DIncremental T3DIncremental;
+
+T3DIncremental *t3dCreateIncremental(T3DContext *ctx);
+void t3dDestroyIncremental(T3DIncremental *inc);
+
+/* buf must be writable and NUL-terminated at buf[length] */
+T3DError t3dUpdateIncremental(T3DIncremental *inc, char *buf, size_t length, const T3DSink *sink,
+                              unsigned int *num_changed, unsigned int *num_blocks);
+
+/****************************
+ * Index
+ ***************************/
+
+/* A table of contents for a document, giving the byte range of each
+ * top-level block along with what's in it, so that only the blocks that
+ * are wanted need to be read and parsed. It's kept in a sidecar file next
+ * to the document, i.e. foo.t3d.idx, and is built again whenever the
+ * document's size or modification time no longer match. Offsets are into
+ * the decompressed document. */
+
+typedef struct T3DIndexEntry {
+    uint64_t offset;
+    uint64_t length;
+
+    char class_name[64];
+    char name[64];
+
+    uint32_t num_brushes;
+    uint32_t num_polygons;
+
+    float mins[3];  /* bounds of its brushes, or just its location if it has none */
+    float maxs[3];
+} T3DIndexEntry;
+
+typedef struct T3DIndex {
+    uint64_t file_size;
+    int64_t file_time;
+
+    T3DIndexEntry *entries;
+    unsigned int num_entries;
+} T3DIndex;
+
+/* buf must be writable and NUL-terminated at buf[length] */
+T3DIndex *t3dBuildIndex(T3DContext *ctx, char *buf, size_t length);
+T3DError t3dWriteIndex(T3DContext *ctx, const T3DIndex *index, const T3DSink *sink);
+/* returns NULL if there isn't one, or if it's out of date */
+T3DIndex *t3dReadIndex(T3DContext *ctx, const char *index_path, const char *path);
+/* reads the sidecar for path, building and saving it first if needed */
+T3DIndex *t3dLoadIndex(T3DContext *ctx, const char *path, bool rebuild);
+void t3dDestroyIndex(T3DContext *ctx, T3DIndex *index);
+
+/* parses only the blocks flagged in selected, which has an entry for each in the index */
+T3DError t3dParseIndexed(T3DContext *ctx, const char *path, const T3DIndex *index, const bool *selected);
+
+/****************************
+ * Batch Conversion
+ ***************************/
+
+/* Converts a set of documents with reading, parsing and writing overlapped,
+ * so neither the disk nor the cores sit idle while the other is busy. The
+ * next few documents are read in ahead while a pool of workers parses
+ * them, and finished maps are written out behind, via io_uring where it's
+ * available. The log function may be called from any of the threads. */
+
+typedef struct T3DBatchJob {
+    const char *in_path;
+    const char *out_path;
+
+    /* filled in once it's done */
+    T3DError error;
+    unsigned int num_brushes;
+    unsigned int num_actors;
+} T3DBatchJob;
+
+typedef struct T3DBatchOptions {
+    unsigned int num_workers;   /* parsing threads, 0 for one per core */
+    unsigned int read_ahead;    /* documents read in ahead of being parsed, 0 for the default */
+    unsigned int write_behind;  /* maps waiting to be written out, 0 for the default */
+} T3DBatchOptions;
+
+/* every job is attempted, returns the first error in the order given */
+T3DError t3dConvertBatch(const T3DOptions *options, const T3DBatchOptions *batch_options, T3DBatchJob *jobs,
+                         unsigned int num_jobs);
+
+/****************************
+ * Import
+ ***************************/
+
+/* Goes the other way, reading a MAP (standard or Valve 220) and writing
+ * it out as a T3D. Brushes are turned back into polygons and added into a
+ * subtractive brush around the whole map; brush entities such as
+ * func_group are merged into the world. Point entities are mapped back
+ * through the actor definitions for the format set in the options. */
+T3DError t3dImportMap(T3DContext *ctx, const char *path, const T3DSink *sink);
+/* buf must be NUL-terminated at buf[length] */
+T3DError t3dImportMapBuffer(T3DContext *ctx, const char *buf, size_t length, const T3DSink *sink);
+
+/****************************
+ * Asynchronous Conversion
+ ***************************/
+
+/* Reads, parses and writes out a document on a thread of its own, so that
+ * interactive tools can carry on while a large map converts. Progress can
+ * be polled from any thread, or picked up via the progress function in the
+ * options, which is called back on the conversion's thread, as is the log.
+ * Cancelling takes effect at the next chunk or brush, after which all of
+ * the conversion's memory is released and any partial output removed. */
+
+typedef struct T3DConversion T3DConversion;
+
+/* the options and paths are copied, returns NULL if it couldn't be started */
+T3DConversion *t3dStartConversion(const T3DOptions *options, const char *in_path, const char *out_path);
+/* returns true once it's done, can be called from any thread */
+bool t3dGetConversionProgress(T3DConversion *conversion, T3DProgress *progress);
+void t3dCancelConversion(T3DConversion *conversion);
+/* waits for it to finish, if it hasn't already, and frees it */
+T3DError t3dFinishConversion(T3DConversion *conversion);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,387 @@
+/* internal to libt3d, don't include this from anywhere else! */
+
+#pragma once
+
+#include <stdarg.h>
+
+#if defined(_WIN32)
+#   include <windows.h>
+#else
+#   include <pthread.h>
+#endif
+
+#include <PL/platform.h>
+
+#include "t3d.h"
+
+/* debug flags, DEBUG_PARSER dumps every brush and property as well (with -verbose) */
+
+#define MAX_BRUSH_FACES     4096
+#define MAX_CHUNK_DEPTH     16
+
+enum {
+    T3D_TOKEN_LINE,     /* start of a line, spans the whole thing */
+    T3D_TOKEN_WORD,
+    T3D_TOKEN_NUMBER,   /* word starting with a digit or sign, e.g. a vertex */
+    T3D_TOKEN_KEY,      /* word followed by '=' */
+    T3D_TOKEN_VALUE,    /* whatever follows a key, may be empty */
+};
+
+typedef struct T3DToken {
+    uint32_t offset;    /* relative to ctx->base */
+    uint32_t length;
+    uint32_t line;
+    uint32_t type;
+} T3DToken;
+
+enum {
+    CTX_MAP,
+
+    CTX_ACTORLIST,
+    CTX_ACTOR,
+
+    CTX_BRUSH,
+
+    CTX_POLYLIST,
+    CTX_POLYGON,
+};
+
+typedef struct T3DGroupName {
+    char name[64];
+    uint32_t hash;
+} T3DGroupName;
+
+struct T3DContext {
+    T3DOptions options;
+
+    T3DError error;
+
+    struct {
+        char name[32];
+
+        unsigned int num_brushes;
+    } map;
+
+    T3DBrush *brushes;
+    unsigned int num_brushes;
+    unsigned int max_brushes;
+
+    T3DActor *actors;
+    unsigned int num_actors;
+    unsigned int max_actors;
+
+    unsigned int num_duplicates;    /* found by the last write */
+
+    /* interned from the polygons, the first is always the empty one */
+    T3DGroupName *groups;
+    unsigned int num_groups;
+    unsigned int max_groups;
+    uint32_t *group_table;  /* open addressed, 0 for an empty slot */
+    unsigned int group_table_size;
+
+    /* parsing data */
+
+    struct {
+        unsigned int context;
+    } chunks[MAX_CHUNK_DEPTH];
+    int cur_chunk;
+
+    T3DToken *tokens;
+    unsigned int num_tokens;
+    unsigned int max_tokens;
+    unsigned int cur_token;
+
+    unsigned int poly_limit;    /* most polygons the current polylist may hold */
+    unsigned int num_unknown;   /* properties the parser had no use for */
+
+    const char *base;   /* start of the buffer spans are relative to */
+
+    T3DProperty *properties;
+    unsigned int num_properties;
+    unsigned int max_properties;
+
+    char *buffer;   /* input loaded by t3dParseFile, if any */
+
+    T3DProgress progress;   /* as of the last chunk or brush */
+
+    T3DMemoryStats memory[T3D_MAX_MEMORY_TAGS + 1];    /* last is the total */
+};
+
+/* there's always at least one spare slot after the last brush/actor, which is the one being parsed */
+#define CurBrush()  (&ctx->brushes[ctx->num_brushes])
+#define CurActor()  (&ctx->actors[ctx->num_actors])
+
+/* t3d.c */
+
+void t3dLog(T3DContext *ctx, T3DLogLevel level, const char *format, ...);
+void t3dSetError(T3DContext *ctx, T3DError error, const char *format, ...);
+/* hands the progress over to the progress function, returns false if it's been cancelled */
+bool t3dReportProgress(T3DContext *ctx);
+
+void *t3dMallocTag(T3DContext *ctx, size_t size, T3DMemoryTag tag);
+void *t3dCallocTag(T3DContext *ctx, size_t num, size_t size, T3DMemoryTag tag);
+void *t3dReallocTag(T3DContext *ctx, void *ptr, size_t size, T3DMemoryTag tag);
+
+bool t3dGrowBrushes(T3DContext *ctx);
+bool t3dGrowActors(T3DContext *ctx);
+
+void t3dConvertHSV(unsigned char h, unsigned char s, unsigned char v,
+                   unsigned char *r, unsigned char *g, unsigned char *b);
+void t3dConvertRGB(unsigned char r, unsigned char g, unsigned char b,
+                   unsigned char *h, unsigned char *s, unsigned char *v);
+
+/* thread.c */
+
+#if defined(_WIN32)
+typedef CRITICAL_SECTION T3DMutex;
+typedef CONDITION_VARIABLE T3DCondition;
+#else
+typedef pthread_mutex_t T3DMutex;
+typedef pthread_cond_t T3DCondition;
+#endif
+
+/* must stay put until it's been joined */
+typedef struct T3DThread {
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    void (*function)(void *user);
+    void *user;
+} T3DThread;
+
+bool t3dCreateThread(T3DThread *thread, void (*function)(void *user), void *user);
+void t3dJoinThread(T3DThread *thread);
+
+void t3dInitMutex(T3DMutex *mutex);
+void t3dDestroyMutex(T3DMutex *mutex);
+void t3dLockMutex(T3DMutex *mutex);
+void t3dUnlockMutex(T3DMutex *mutex);
+
+void t3dInitCondition(T3DCondition *condition);
+void t3dDestroyCondition(T3DCondition *condition);
+void t3dWaitCondition(T3DCondition *condition, T3DMutex *mutex);
+void t3dSignalCondition(T3DCondition *condition);
+void t3dBroadcastCondition(T3DCondition *condition);
+
+unsigned int t3dGetNumProcessors(void);
+
+/* writer.c */
+
+typedef struct T3DFormat T3DFormat;
+
+typedef struct T3DWriter {
+    T3DContext *ctx;
+    const T3DSink *sink;
+    const T3DFormat *format;
+
+    unsigned int next_id;   /* for formats that number everything */
+    bool defer_ids;         /* leave a marker in place of each id, see t3dWriterWriteDeferred */
+
+    char buffer[16384];
+    size_t length;
+} T3DWriter;
+
+/* stand in for an id that's yet to be assigned, and a brush's group, whose number isn't known until then either */
+#define T3D_DEFERRED_ID     '\x1f'
+#define T3D_DEFERRED_GROUP  '\x1e'
+
+void t3dInitWriter(T3DWriter *writer, T3DContext *ctx, const T3DSink *sink);
+bool t3dFlushWriter(T3DWriter *writer);
+void t3dWriterPrintf(T3DWriter *writer, const char *format, ...);
+void t3dWriterWrite(T3DWriter *writer, const void *data, size_t length);
+/* writes out something produced with defer_ids, filling in the ids and group as it goes */
+void t3dWriterWriteDeferred(T3DWriter *writer, const char *data, size_t length, unsigned int group);
+void t3dWriteId(T3DWriter *writer, const char *indent);
+
+void t3dWriteWorldspawn(T3DWriter *writer);
+void t3dEndWorldspawn(T3DWriter *writer);
+void t3dEndMap(T3DWriter *writer);
+bool t3dIsBrushExported(const T3DContext *ctx, const T3DBrush *brush);
+bool t3dCheckBrush(T3DContext *ctx, const T3DBrush *brush, unsigned int index);
+void t3dBeginBrush(T3DWriter *writer, unsigned int index);
+void t3dWriteBrush(T3DWriter *writer, const T3DBrush *brush);
+bool t3dCheckEntity(T3DContext *ctx, const T3DActor *actor);
+void t3dWriteEntity(T3DWriter *writer, const T3DActor *actor);
+bool t3dGetExportCounts(T3DContext *ctx, unsigned int *num_brushes, unsigned int *num_actors);
+
+/* everything that needs to be known before writing anything */
+typedef struct T3DExport {
+    unsigned int num_brushes;
+    unsigned int num_actors;
+
+    uint32_t *duplicates;   /* NULL unless we're looking for duplicates */
+    uint32_t *brush_order;  /* NULL unless we're sorting */
+    uint32_t *actor_order;
+
+    uint32_t *group_starts; /* NULL unless grouping, where each group's brushes begin in the order */
+    unsigned int num_groups;
+} T3DExport;
+
+bool t3dBeginExport(T3DContext *ctx, T3DExport *info);
+void t3dEndExport(T3DContext *ctx, T3DExport *info);
+/* index of the nth brush/actor to be written */
+unsigned int t3dGetExportBrush(const T3DExport *info, unsigned int n);
+unsigned int t3dGetExportActor(const T3DExport *info, unsigned int n);
+
+/* pool.c */
+
+/* one of a set of maps written out at once, i.e. a tile or a group */
+typedef struct T3DPoolJob {
+    char name[96];  /* for any errors, i.e. tile 1 2 */
+    void *user;     /* whatever it's a job for, i.e. the T3DTile */
+
+    const uint32_t *brushes;
+    unsigned int num_brushes;
+    const uint32_t *actors;
+    unsigned int num_actors;
+} T3DPoolJob;
+
+typedef struct T3DPoolOptions {
+    const char *what;           /* for the log, i.e. "tiles" */
+    unsigned int num_threads;   /* 0 for one per core */
+    bool ungrouped;             /* leave out the groups of the brushes in each map */
+
+    /* only ever called one at a time */
+    const T3DSink *(*open)(T3DPoolJob *job, void *user);
+    bool (*close)(T3DPoolJob *job, const T3DSink *sink, void *user);
+    void *user;
+} T3DPoolOptions;
+
+/* the first error in the order the jobs were given is passed on */
+void t3dRunPool(T3DContext *ctx, const T3DPoolOptions *options, T3DPoolJob *jobs, unsigned int num_jobs);
+
+/* formats.c */
+
+struct T3DFormat {
+    void (*begin_map)(T3DWriter *writer);   /* up to and including the worldspawn's keys */
+    void (*begin_brush)(T3DWriter *writer, unsigned int index);
+    void (*write_brush)(T3DWriter *writer, const T3DBrush *brush);
+    void (*end_world)(T3DWriter *writer);
+    void (*begin_group)(T3DWriter *writer, unsigned int group);
+    void (*end_group)(T3DWriter *writer);
+    void (*begin_entity)(T3DWriter *writer);
+    void (*write_light)(T3DWriter *writer, unsigned char r, unsigned char g, unsigned char b);
+    void (*end_entity)(T3DWriter *writer);
+    void (*end_map)(T3DWriter *writer);
+
+    const char *indent; /* for keys within an entity */
+    bool uses_ids;
+    bool group_entities;    /* groups are entities of their own, rather than being tagged within the world */
+};
+
+const T3DFormat *t3dGetFormat(unsigned int format);
+
+/* geometry.c */
+
+void t3dGetMapPoint(const PLVector3 *point, const PLVector3 *offset, double *out);
+double t3dDotProduct(const double *a, const double *b);
+double t3dGetNormal(const double *p0, const double *p1, const double *p2, double *normal);
+void t3dGetFacePoints(const T3DBrush *brush, const T3DPolygon *face, double points[3][3]);
+bool t3dGetBrushBounds(const T3DBrush *brush, double *mins, double *maxs);
+void t3dGetBrushCentre(const T3DBrush *brush, double *centre);
+void t3dGetActorCentre(const T3DContext *ctx, const T3DActor *actor, double *centre);
+void t3dGetBaseTextureAxes(const double *normal, double *u, double *v);
+
+uint64_t t3dHashBrush(const T3DBrush *brush);
+uint32_t *t3dFindDuplicateBrushes(T3DContext *ctx, const uint64_t *hashes, unsigned int num_brushes);
+bool t3dCheckDuplicate(T3DContext *ctx, const uint32_t *duplicates, unsigned int index);
+
+/* groups.c */
+
+unsigned int t3dInternGroup(T3DContext *ctx, const char *name);
+unsigned int t3dFindGroup(const T3DContext *ctx, const char *name);
+void t3dResetGroups(T3DContext *ctx);
+bool t3dLayoutGroups(T3DContext *ctx, T3DExport *info, const uint32_t *groups);
+
+/* sort.c */
+
+typedef struct T3DSortItem {
+    uint64_t key;
+    uint32_t index;
+} T3DSortItem;
+
+bool t3dRadixSort(T3DContext *ctx, T3DSortItem *items, size_t num_items);
+bool t3dSortSpatially(T3DContext *ctx, const double *centres, const uint64_t *ties, unsigned int num,
+                      uint32_t *order);
+
+/* property.c */
+
+T3DProperty *t3dAddProperty(T3DContext *ctx, T3DActor *actor);
+bool t3dParseVector(const char *data, size_t length, PLVector3 *out);
+
+/* lexer.c */
+
+typedef struct T3DLexer {
+    T3DToken *tokens;
+    uint32_t num_tokens;
+
+    const char *buf;
+    uint32_t pos;           /* everything before here has been lexed */
+    uint64_t carry;         /* whether the last byte of the previous block was part of a word */
+
+    uint32_t line;
+    uint32_t line_start;
+    uint32_t line_token;    /* index of the current line's token, or UINT32_MAX */
+    uint32_t last_end;      /* end of the last token on this line */
+
+    uint32_t start;         /* start of the token we're in, or UINT32_MAX */
+    bool expect_value;      /* last token was a key */
+    bool comment;
+    bool quote;
+    unsigned int depth;     /* brackets */
+} T3DLexer;
+
+/* the input may be fed in as it arrives, so long as it's all kept in the one buffer */
+void t3dBeginLexer(T3DContext *ctx, T3DLexer *lex);
+bool t3dFeedLexer(T3DContext *ctx, T3DLexer *lex, const char *buf, size_t available);
+bool t3dEndLexer(T3DContext *ctx, T3DLexer *lex, const char *buf, size_t length);
+bool t3dLexBuffer(T3DContext *ctx, const char *buf, size_t length);
+void t3dGetTokenPosition(const T3DContext *ctx, unsigned int index, unsigned int *line, unsigned int *column);
+
+/* incremental.c */
+
+/* spans are relative to buf, header is left pointing after "Begin Map" if there is one */
+unsigned int t3dFindBlocks(T3DContext *ctx, const char *buf, T3DSpan **blocks, const char **header, T3DMemoryTag tag);
+
+/* encoding.c */
+
+typedef enum T3DEncoding {
+    T3D_ENCODING_UTF8,      /* or just ASCII, which is nearly always the case */
+    T3D_ENCODING_UTF16LE,
+    T3D_ENCODING_UTF16BE,
+} T3DEncoding;
+
+typedef struct T3DDecoder {
+    T3DEncoding encoding;
+    unsigned char pending[4];   /* character split across calls */
+    unsigned int num_pending;
+} T3DDecoder;
+
+/* goes by the BOM, if there is one, which is to be skipped over */
+T3DEncoding t3dDetectEncoding(const void *data, size_t length, size_t *bom_length);
+T3DEncoding t3dDetectFileEncoding(const char *path, size_t *bom_length);
+const char *t3dGetEncodingName(T3DEncoding encoding);
+
+void t3dInitDecoder(T3DDecoder *decoder, T3DEncoding encoding);
+size_t t3dDecodeText(T3DDecoder *decoder, const void *data, size_t length, char *out, size_t size, size_t *written);
+bool t3dAppendText(T3DContext *ctx, T3DDecoder *decoder, const void *data, size_t length, char **buf,
+                   size_t *buf_length, size_t *max_length);
+char *t3dLoadEncodedFile(T3DContext *ctx, const char *path, T3DEncoding encoding, size_t *length);
+
+/* stream.c */
+
+/* "-", for stdin or stdout */
+bool t3dIsStandardStream(const char *path);
+T3DCompression t3dDetectFileCompression(const char *path);
+
+/* called back on the calling thread each time more of the document has arrived */
+typedef bool (*T3DStreamFunction)(T3DContext *ctx, const char *buf, size_t length, void *user);
+char *t3dLoadCompressedFile(T3DContext *ctx, const char *path, T3DCompression compression, size_t *length,
+                            T3DStreamFunction function, void *user);
+char *t3dLoadStandardInput(T3DContext *ctx, size_t *length, T3DStreamFunction function, void *user);
+
+/* parser.c */
+
+void t3dReadMapHeader(T3DContext *ctx, const char *pos);
@@ -0,0 +1,78 @@
+#include "t3d_private.h"
+
+/* just enough threading to get by, without dragging in anything else */
+
+#if defined(_WIN32)
+
+static DWORD WINAPI ThreadEntry(LPVOID user) {
+    T3DThread *thread = (T3DThread *) user;
+    thread->function(thread->user);
+    return 0;
+}
+
+bool t3dCreateThread(T3DThread *thread, void (*function)(void *user), void *user) {
+    thread->function = function;
+    thread->user = user;
+    thread->handle = CreateThread(NULL, 0, ThreadEntry, thread, 0, NULL);
+    return (thread->handle != NULL);
+}
+
+void t3dJoinThread(T3DThread *thread) {
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+}
+
+void t3dInitMutex(T3DMutex *mutex) { InitializeCriticalSection(mutex); }
+void t3dDestroyMutex(T3DMutex *mutex) { DeleteCriticalSection(mutex); }
+void t3dLockMutex(T3DMutex *mutex) { EnterCriticalSection(mutex); }
+void t3dUnlockMutex(T3DMutex *mutex) { LeaveCriticalSection(mutex); }
+
+void t3dInitCondition(T3DCondition *condition) { InitializeConditionVariable(condition); }
+void t3dDestroyCondition(T3DCondition *condition) { (void)(condition); }
+void t3dWaitCondition(T3DCondition *condition, T3DMutex *mutex) { SleepConditionVariableCS(condition, mutex, INFINITE); }
+void t3dSignalCondition(T3DCondition *condition) { WakeConditionVariable(condition); }
+void t3dBroadcastCondition(T3DCondition *condition) { WakeAllConditionVariable(condition); }
+
+unsigned int t3dGetNumProcessors(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (unsigned int) info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+#include <unistd.h>
+
+static void *ThreadEntry(void *user) {
+    T3DThread *thread = (T3DThread *) user;
+    thread->function(thread->user);
+    return NULL;
+}
+
+bool t3dCreateThread(T3DThread *thread, void (*function)(void *user), void *user) {
+    thread->function = function;
+    thread->user = user;
+    return (pthread_create(&thread->handle, NULL, ThreadEntry, thread) == 0);
+}
+
+void t3dJoinThread(T3DThread *thread) {
+    pthread_join(thread->handle, NULL);
+}
+
+void t3dInitMutex(T3DMutex *mutex) { pthread_mutex_init(mutex, NULL); }
+void t3dDestroyMutex(T3DMutex *mutex) { pthread_mutex_destroy(mutex); }
+void t3dLockMutex(T3DMutex *mutex) { pthread_mutex_lock(mutex); }
+void t3dUnlockMutex(T3DMutex *mutex) { pthread_mutex_unlock(mutex); }
+
+void t3dInitCondition(T3DCondition *condition) { pthread_cond_init(condition, NULL); }
+void t3dDestroyCondition(T3DCondition *condition) { pthread_cond_destroy(condition); }
+void t3dWaitCondition(T3DCondition *condition, T3DMutex *mutex) { pthread_cond_wait(condition, mutex); }
+void t3dSignalCondition(T3DCondition *condition) { pthread_cond_signal(condition); }
+void t3dBroadcastCondition(T3DCondition *condition) { pthread_cond_broadcast(condition); }
+
+unsigned int t3dGetNumProcessors(void) {
+    long num = sysconf(_SC_NPROCESSORS_ONLN);
+    return (num > 0) ? (unsigned int) num : 1;
+}
+
+#endif
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "t3d_private.h"
+
+/* Large levels can be split up into a grid of tiles across the ground
+ * plane, each written out as a map of its own. A brush belongs to the tile
+ * holding the centre of its bounds and an entity to the tile holding its
+ * origin, so everything lands in exactly one tile, unless a margin is given,
+ * in which case brushes within that distance of a tile are written into it
+ * as well. Tiles are written out concurrently, through the pool. */
+
+typedef struct TileGrid {
+    double mins[3], maxs[3];
+    double size[2];
+    unsigned int columns, rows;
+} TileGrid;
+
+static unsigned int GetTileCoord(const TileGrid *grid, unsigned int axis, double v) {
+    unsigned int num = (axis == 0) ? grid->columns : grid->rows;
+    if(grid->size[axis] <= 0.0) {
+        return 0;
+    }
+
+    /* written so NaN ends up in the first tile too, rather than being cast */
+    double coord = floor((v - grid->mins[axis]) / grid->size[axis]);
+    if(!(coord >= 0.0)) {
+        return 0;
+    }
+    return (coord >= (double) num) ? (num - 1) : (unsigned int) coord;
+}
+
+/* the brush always goes in the tile holding its centre, and any others it's within the margin of */
+static void GetBrushTiles(const TileGrid *grid, const double *bounds, double margin,
+                          unsigned int *first, unsigned int *last) {
+    for(unsigned int i = 0; i < 2; ++i) {
+        if(margin > 0.0) {
+            first[i] = GetTileCoord(grid, i, bounds[i] - margin);
+            last[i]  = GetTileCoord(grid, i, bounds[i + 3] + margin);
+        } else {
+            first[i] = last[i] = GetTileCoord(grid, i, (bounds[i] + bounds[i + 3]) * 0.5);
+        }
+    }
+}
+
+typedef struct TileLayout {
+    double *bounds;     /* of each brush, mins are above maxs if it's not exported */
+    uint32_t *owners;   /* tile each actor belongs to, or UINT32_MAX */
+    uint32_t *starts;   /* where each tile's brushes and then actors begin */
+
+    /* indices for each tile, one after another */
+    uint32_t *brushes;
+    uint32_t *actors;
+
+    T3DPoolJob *jobs;
+    unsigned int num_jobs;
+} TileLayout;
+
+static void FreeLayout(T3DContext *ctx, TileLayout *layout) {
+    t3dFree(ctx, layout->bounds);
+    t3dFree(ctx, layout->owners);
+    t3dFree(ctx, layout->starts);
+    t3dFree(ctx, layout->brushes);
+    t3dFree(ctx, layout->actors);
+    t3dFree(ctx, layout->jobs);
+}
+
+/* works out which tiles everything goes into; everything's checked here,
+ * so any warnings only turn up the once */
+static bool LayoutTiles(T3DContext *ctx, const T3DExport *info, const T3DTileOptions *options, T3DTile *tiles,
+                        TileLayout *layout) {
+    unsigned int num_tiles = options->columns * options->rows;
+    if((layout->bounds = t3dCallocTag(ctx, info->num_brushes + 1, sizeof(double) * 6, T3D_MEMORY_GEOMETRY)) == NULL ||
+       (layout->owners = t3dMallocTag(ctx, sizeof(uint32_t) * (info->num_actors + 1), T3D_MEMORY_GEOMETRY)) == NULL ||
+       (layout->starts = t3dCallocTag(ctx, num_tiles * 2, sizeof(uint32_t), T3D_MEMORY_GEOMETRY)) == NULL ||
+       (layout->jobs = t3dCallocTag(ctx, num_tiles, sizeof(T3DPoolJob), T3D_MEMORY_GEOMETRY)) == NULL) {
+        return false;
+    }
+
+    double *bounds = layout->bounds;
+    TileGrid grid = { .columns = options->columns, .rows = options->rows };
+    bool valid = false;
+    for(unsigned int n = 0; n < info->num_brushes; ++n) {
+        unsigned int i = t3dGetExportBrush(info, n);
+        double *mins = &bounds[i * 6], *maxs = &bounds[i * 6 + 3];
+        if(!t3dCheckBrush(ctx, &ctx->brushes[i], i) || !t3dCheckDuplicate(ctx, info->duplicates, i) ||
+           !t3dGetBrushBounds(&ctx->brushes[i], mins, maxs)) {
+            mins[0] = 1.0;
+            maxs[0] = 0.0;
+            continue;
+        }
+
+        for(unsigned int j = 0; j < 3; ++j) {
+            if(!valid || mins[j] < grid.mins[j]) grid.mins[j] = mins[j];
+            if(!valid || maxs[j] > grid.maxs[j]) grid.maxs[j] = maxs[j];
+        }
+        valid = true;
+    }
+
+    /* nothing to write, nor anything to lay the grid out by */
+    if(!valid) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: no brushes to split into tiles!\n");
+        for(unsigned int i = 0; i < num_tiles; ++i) {
+            tiles[i].column = i % grid.columns;
+            tiles[i].row    = i / grid.columns;
+        }
+        return true;
+    }
+
+    grid.size[0] = (grid.maxs[0] - grid.mins[0]) / grid.columns;
+    grid.size[1] = (grid.maxs[1] - grid.mins[1]) / grid.rows;
+
+    for(unsigned int row = 0; row < grid.rows; ++row) {
+        for(unsigned int column = 0; column < grid.columns; ++column) {
+            T3DTile *tile = &tiles[row * grid.columns + column];
+            tile->column  = column;
+            tile->row     = row;
+            tile->mins[0] = grid.mins[0] + grid.size[0] * column;
+            tile->mins[1] = grid.mins[1] + grid.size[1] * row;
+            tile->mins[2] = grid.mins[2];
+            tile->maxs[0] = tile->mins[0] + grid.size[0];
+            tile->maxs[1] = tile->mins[1] + grid.size[1];
+            tile->maxs[2] = grid.maxs[2];
+        }
+    }
+
+    /* count up what goes where, then go over it all again to fill it in */
+
+    size_t num_brushes = 0, num_actors = 0;
+    for(unsigned int n = 0; n < info->num_brushes; ++n) {
+        unsigned int i = t3dGetExportBrush(info, n);
+        if(bounds[i * 6] > bounds[i * 6 + 3]) {
+            continue;
+        }
+
+        unsigned int first[2], last[2];
+        GetBrushTiles(&grid, &bounds[i * 6], options->margin, first, last);
+        for(unsigned int row = first[1]; row <= last[1]; ++row) {
+            for(unsigned int column = first[0]; column <= last[0]; ++column) {
+                tiles[row * grid.columns + column].num_brushes++;
+                num_brushes++;
+            }
+        }
+    }
+
+    for(unsigned int n = 0; n < info->num_actors; ++n) {
+        unsigned int i = t3dGetExportActor(info, n);
+        layout->owners[i] = UINT32_MAX;
+        if(!t3dCheckEntity(ctx, &ctx->actors[i])) {
+            continue;
+        }
+
+        double origin[3];
+        t3dGetActorCentre(ctx, &ctx->actors[i], origin);
+        layout->owners[i] = GetTileCoord(&grid, 1, origin[1]) * grid.columns + GetTileCoord(&grid, 0, origin[0]);
+        tiles[layout->owners[i]].num_actors++;
+        num_actors++;
+    }
+
+    if((layout->brushes = t3dMallocTag(ctx, sizeof(uint32_t) * (num_brushes + 1), T3D_MEMORY_GEOMETRY)) == NULL ||
+       (layout->actors = t3dMallocTag(ctx, sizeof(uint32_t) * (num_actors + 1), T3D_MEMORY_GEOMETRY)) == NULL) {
+        return false;
+    }
+
+    uint32_t *brush_starts = layout->starts, *actor_starts = &layout->starts[num_tiles];
+    for(unsigned int i = 1; i < num_tiles; ++i) {
+        brush_starts[i] = brush_starts[i - 1] + tiles[i - 1].num_brushes;
+        actor_starts[i] = actor_starts[i - 1] + tiles[i - 1].num_actors;
+    }
+
+    /* tiles without any brushes won't compile, so they're left out */
+    for(unsigned int i = 0; i < num_tiles; ++i) {
+        if(tiles[i].num_brushes == 0) {
+            continue;
+        }
+
+        T3DPoolJob *job = &layout->jobs[layout->num_jobs++];
+        snprintf(job->name, sizeof(job->name), "tile %u %u", tiles[i].column, tiles[i].row);
+        job->user        = &tiles[i];
+        job->brushes     = &layout->brushes[brush_starts[i]];
+        job->num_brushes = tiles[i].num_brushes;
+        job->actors      = &layout->actors[actor_starts[i]];
+        job->num_actors  = tiles[i].num_actors;
+    }
+
+    for(unsigned int n = 0; n < info->num_brushes; ++n) {
+        unsigned int i = t3dGetExportBrush(info, n);
+        if(bounds[i * 6] > bounds[i * 6 + 3]) {
+            continue;
+        }
+
+        unsigned int first[2], last[2];
+        GetBrushTiles(&grid, &bounds[i * 6], options->margin, first, last);
+        for(unsigned int row = first[1]; row <= last[1]; ++row) {
+            for(unsigned int column = first[0]; column <= last[0]; ++column) {
+                layout->brushes[brush_starts[row * grid.columns + column]++] = i;
+            }
+        }
+    }
+
+    for(unsigned int n = 0; n < info->num_actors; ++n) {
+        unsigned int i = t3dGetExportActor(info, n);
+        if(layout->owners[i] != UINT32_MAX) {
+            layout->actors[actor_starts[layout->owners[i]]++] = i;
+        }
+    }
+
+    return true;
+}
+
+static const T3DSink *OpenTile(T3DPoolJob *job, void *user) {
+    const T3DTileOptions *options = (const T3DTileOptions *) user;
+    return options->open((const T3DTile *) job->user, options->user);
+}
+
+static bool CloseTile(T3DPoolJob *job, const T3DSink *sink, void *user) {
+    const T3DTileOptions *options = (const T3DTileOptions *) user;
+    return options->close((const T3DTile *) job->user, sink, options->user);
+}
+
+T3DError t3dWriteTiles(T3DContext *ctx, const T3DTileOptions *options, T3DTile *tiles) {
+    if(options == NULL || tiles == NULL || options->open == NULL || options->close == NULL ||
+       options->columns == 0 || options->rows == 0 || !(options->margin >= 0.0)) {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: invalid options passed to t3dWriteTiles!\n");
+        return ctx->error;
+    }
+
+    memset(tiles, 0, sizeof(T3DTile) * options->columns * options->rows);
+
+    T3DExport info;
+    if(t3dBeginExport(ctx, &info)) {
+        TileLayout layout;
+        memset(&layout, 0, sizeof(TileLayout));
+        if(LayoutTiles(ctx, &info, options, tiles, &layout)) {
+            T3DPoolOptions pool_options = {
+                    .what        = "tiles",
+                    .num_threads = options->num_threads,
+                    .open        = OpenTile,
+                    .close       = CloseTile,
+                    .user        = (void *) options,
+            };
+            t3dRunPool(ctx, &pool_options, layout.jobs, layout.num_jobs);
+        }
+        FreeLayout(ctx, &layout);
+    }
+    t3dEndExport(ctx, &info);
+
+    return ctx->error;
+}
@@ -0,0 +1,500 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "t3d_private.h"
+
+/**************************************************/
+
+void t3dInitWriter(T3DWriter *writer, T3DContext *ctx, const T3DSink *sink) {
+    writer->ctx = ctx;
+    writer->sink = sink;
+    writer->format = t3dGetFormat(ctx->options.format);
+    writer->next_id = 1;
+    writer->defer_ids = false;
+    writer->length = 0;
+}
+
+bool t3dFlushWriter(T3DWriter *writer) {
+    if(writer->length == 0) {
+        return true;
+    }
+
+    size_t length = writer->length;
+    writer->length = 0;
+
+    if(writer->ctx->error != T3D_ERROR_NONE) {
+        return false;
+    }
+
+    if(writer->sink->write(writer->buffer, length, writer->sink->user) != length) {
+        t3dSetError(writer->ctx, T3D_ERROR_IO, "error: failed to write %zu bytes to sink!\n", length);
+        return false;
+    }
+
+    return true;
+}
+
+void t3dWriterWrite(T3DWriter *writer, const void *data, size_t length) {
+    if(writer->length + length > sizeof(writer->buffer)) {
+        if(!t3dFlushWriter(writer)) {
+            return;
+        }
+
+        /* too big to bother buffering */
+        if(length > sizeof(writer->buffer)) {
+            if(writer->sink->write(data, length, writer->sink->user) != length) {
+                t3dSetError(writer->ctx, T3D_ERROR_IO, "error: failed to write %zu bytes to sink!\n", length);
+            }
+            return;
+        }
+    }
+
+    memcpy(&writer->buffer[writer->length], data, length);
+    writer->length += length;
+}
+
+void t3dWriterPrintf(T3DWriter *writer, const char *format, ...) {
+    va_list args;
+    for(unsigned int i = 0; i < 2; ++i) {
+        size_t space = sizeof(writer->buffer) - writer->length;
+
+        va_start(args, format);
+        int length = vsnprintf(&writer->buffer[writer->length], space, format, args);
+        va_end(args);
+
+        if(length < 0) {
+            t3dSetError(writer->ctx, T3D_ERROR_IO, "error: failed to format output!\n");
+            return;
+        }
+
+        if((size_t) length < space) {
+            writer->length += (size_t) length;
+            return;
+        }
+
+        /* didn't fit, so flush and try again */
+        if(!t3dFlushWriter(writer)) {
+            return;
+        }
+    }
+
+    t3dSetError(writer->ctx, T3D_ERROR_LIMIT, "error: formatted output exceeds writer buffer!\n");
+}
+
+void t3dWriteId(T3DWriter *writer, const char *indent) {
+    if(writer->defer_ids) {
+        t3dWriterPrintf(writer, "%s\"id\" \"%c\"\n", indent, T3D_DEFERRED_ID);
+        return;
+    }
+
+    t3dWriterPrintf(writer, "%s\"id\" \"%u\"\n", indent, writer->next_id++);
+}
+
+void t3dWriterWriteDeferred(T3DWriter *writer, const char *data, size_t length, unsigned int group) {
+    if(!writer->format->uses_ids) {
+        t3dWriterWrite(writer, data, length);
+        return;
+    }
+
+    const char *end = data + length;
+    for(const char *marker = data; marker < end; ++marker) {
+        if(*marker != T3D_DEFERRED_ID && *marker != T3D_DEFERRED_GROUP) {
+            continue;
+        }
+
+        t3dWriterWrite(writer, data, marker - data);
+        t3dWriterPrintf(writer, "%u", (*marker == T3D_DEFERRED_ID) ? writer->next_id++ : group);
+        data = marker + 1;
+    }
+    t3dWriterWrite(writer, data, end - data);
+}
+
+/**************************************************/
+
+static const char *GetEntityForActor(T3DContext *ctx, const T3DActor *actor) {
+    if(ctx->options.actors || actor->class_index->id == ACT_Unknown) {
+        if(actor->class_name[0] == '\0' || actor->class_name[0] == ' ') {
+            t3dLog(ctx, T3D_LOG_WARNING, "warning: invalid actor name, possibly failed to parse?\n");
+            return "unknown";
+        }
+        return &actor->class_name[0];
+    }
+
+    const char *target = actor->class_index->targets[ctx->options.format];
+    if(target == NULL || target[0] == '\0') {
+        t3dLog(ctx, T3D_LOG_WARNING,
+               "warning: no entity target provided for actor \"%s\" in this mode, returning actor name instead!\n",
+               actor->class_index->name);
+        return &actor->class_name[0];
+    }
+
+    return target;
+}
+
+#define WriteField(a, b)    t3dWriterPrintf(writer, "%s\"%s\" \"%s\"\n", writer->format->indent, (a), (b))
+#define WriteVector(a, b)   t3dWriterPrintf(writer, "%s\"%s\" \"%d %d %d\"\n", writer->format->indent, (a), \
+                                            (int)(b).y, (int)(b).x, (int)(b).z)
+
+void t3dWriteWorldspawn(T3DWriter *writer) {
+    writer->format->begin_map(writer);
+}
+
+void t3dEndWorldspawn(T3DWriter *writer) {
+    writer->format->end_world(writer);
+}
+
+void t3dEndMap(T3DWriter *writer) {
+    writer->format->end_map(writer);
+}
+
+/* same as below, but without any of the noise */
+bool t3dIsBrushExported(const T3DContext *ctx, const T3DBrush *brush) {
+    if(ctx->options.add && brush->csg != CSG_Add) {
+        return false;
+    }
+
+    if(ctx->options.sub && brush->csg != CSG_Subtract) {
+        return false;
+    }
+
+    return (brush->num_poly >= 4);
+}
+
+/* returns false if the brush shouldn't be exported */
+bool t3dCheckBrush(T3DContext *ctx, const T3DBrush *brush, unsigned int index) {
+    if(ctx->options.add && brush->csg != CSG_Add) {
+        return false;
+    }
+
+    if(ctx->options.sub && brush->csg != CSG_Subtract) {
+        return false;
+    }
+
+#ifdef DEBUG_PARSER
+    t3dLog(ctx, T3D_LOG_DEBUG, "brush %d\n", index);
+    t3dLog(ctx, T3D_LOG_DEBUG, " name:     %s\n", brush->name);
+    t3dLog(ctx, T3D_LOG_DEBUG, " csg:      %d\n", brush->csg);
+    t3dLog(ctx, T3D_LOG_DEBUG, " location: %d %d %d\n",
+           (int) brush->location.x, (int) brush->location.y, (int) brush->location.z);
+#else
+    (void)(index);
+#endif
+
+    if(brush->num_poly < 4) {
+        t3dLog(ctx, T3D_LOG_WARNING, "warning: invalid number of polygons to produce brush (%d), skipping!\n",
+               brush->num_poly);
+        return false;
+    }
+
+    return true;
+}
+
+/* anything that precedes the brush and depends on its position in the document */
+void t3dBeginBrush(T3DWriter *writer, unsigned int index) {
+    writer->format->begin_brush(writer, index);
+}
+
+void t3dWriteBrush(T3DWriter *writer, const T3DBrush *brush) {
+    writer->format->write_brush(writer, brush);
+
+#ifdef DEBUG_PARSER
+    T3DContext *ctx = writer->ctx;
+    for(unsigned int j = 0; j < brush->num_poly; ++j) {
+        const T3DPolygon *cur_face = &brush->poly_list[j];
+        t3dLog(ctx, T3D_LOG_DEBUG, " poly %d\n", j);
+        t3dLog(ctx, T3D_LOG_DEBUG, "  texture: %s\n", cur_face->texture);
+        t3dLog(ctx, T3D_LOG_DEBUG, "  group:   %s\n", cur_face->group);
+        t3dLog(ctx, T3D_LOG_DEBUG, "  item:    %s\n", cur_face->item);
+        for(unsigned int k = 0; k < 4; ++k) {
+            t3dLog(ctx, T3D_LOG_DEBUG, "  vector %d (%d %d %d)\n", k,
+                   (int) cur_face->vertices[k].x, (int) cur_face->vertices[k].y, (int) cur_face->vertices[k].z);
+        }
+    }
+#endif
+}
+
+/* returns false if the actor doesn't produce an entity */
+bool t3dCheckEntity(T3DContext *ctx, const T3DActor *actor) {
+    (void)(ctx);
+    return (actor->class_index != NULL && actor->class_index->id != ACT_Brush);
+}
+
+/* these are already covered by the entity itself */
+static bool IsPassthroughProperty(const T3DContext *ctx, const T3DProperty *property) {
+    static const char *ignore[] = { "Class", "Name", "Location" };
+    for(unsigned int i = 0; i < plArrayElements(ignore); ++i) {
+        size_t length = strlen(ignore[i]);
+        if(property->key.length == length && pl_strncasecmp(t3dGetSpan(ctx, property->key), ignore[i], length) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void t3dWriteEntity(T3DWriter *writer, const T3DActor *actor) {
+    T3DContext *ctx = writer->ctx;
+
+    writer->format->begin_entity(writer);
+
+    PLVector3 location = { 0, 0, 0 };
+    t3dGetActorVector(ctx, actor, "Location", &location);
+
+    WriteField("classname", GetEntityForActor(ctx, actor));
+    WriteVector("origin", location);
+
+    if (pl_strncasecmp(actor->class_name, "light", 5) == 0) {
+        int hue = 0, saturation = 0, brightness = 0;
+        t3dGetActorInteger(ctx, actor, "LightHue", &hue);
+        t3dGetActorInteger(ctx, actor, "LightSaturation", &saturation);
+        t3dGetActorInteger(ctx, actor, "LightBrightness", &brightness);
+
+        unsigned char r, g, b;
+        t3dConvertHSV((unsigned char) hue,
+                      (unsigned char) saturation,
+                      (unsigned char) brightness,
+                      &r, &g, &b);
+        writer->format->write_light(writer, r, g, b);
+    }
+
+    if(ctx->options.properties) {
+        unsigned int num_properties;
+        const T3DProperty *properties = t3dGetActorProperties(ctx, actor, &num_properties);
+        for(unsigned int i = 0; i < num_properties; ++i) {
+            if(!IsPassthroughProperty(ctx, &properties[i])) {
+                continue;
+            }
+
+            char value[512];
+            t3dDecodeString(ctx, &properties[i], value, sizeof(value));
+
+            /* there's no way to escape these in a map */
+            for(char *c = value; *c != '\0'; ++c) {
+                if(*c == '"') *c = '\'';
+                else if(*c == T3D_DEFERRED_ID || *c == T3D_DEFERRED_GROUP) *c = ' ';
+            }
+
+            t3dWriterPrintf(writer, "%s\"%.*s\" \"%s\"\n", writer->format->indent,
+                            (int) properties[i].key.length, t3dGetSpan(ctx, properties[i].key), value);
+        }
+    }
+
+    writer->format->end_entity(writer);
+}
+
+/* returns NULL if we're not looking for duplicates */
+static uint32_t *FindDuplicates(T3DContext *ctx, unsigned int num_brushes) {
+    if(!ctx->options.duplicates && !ctx->options.dedupe) {
+        return NULL;
+    }
+
+    uint64_t *hashes = t3dMallocTag(ctx, sizeof(uint64_t) * (num_brushes + 1), T3D_MEMORY_BRUSHES);
+    if(hashes == NULL) {
+        return NULL;
+    }
+
+    for(unsigned int i = 0; i < num_brushes; ++i) {
+        hashes[i] = (ctx->brushes[i].num_poly >= 4) ? t3dHashBrush(&ctx->brushes[i]) : 0;
+    }
+
+    uint32_t *duplicates = t3dFindDuplicateBrushes(ctx, hashes, num_brushes);
+    t3dFree(ctx, hashes);
+
+    return duplicates;
+}
+
+/* returns NULL if we're sticking to the original order */
+static uint32_t *SortBrushes(T3DContext *ctx, unsigned int num_brushes) {
+    if(!ctx->options.sort) {
+        return NULL;
+    }
+
+    uint32_t *order = t3dMallocTag(ctx, sizeof(uint32_t) * (num_brushes + 1), T3D_MEMORY_GEOMETRY);
+    double *centres = t3dMallocTag(ctx, sizeof(double) * 3 * (num_brushes + 1), T3D_MEMORY_GEOMETRY);
+    uint64_t *hashes = t3dMallocTag(ctx, sizeof(uint64_t) * (num_brushes + 1), T3D_MEMORY_GEOMETRY);
+    if(order != NULL && centres != NULL && hashes != NULL) {
+        /* geometry breaks any ties, so the order doesn't depend on the editor's */
+        for(unsigned int i = 0; i < num_brushes; ++i) {
+            t3dGetBrushCentre(&ctx->brushes[i], &centres[i * 3]);
+            hashes[i] = t3dHashBrush(&ctx->brushes[i]);
+        }
+
+        if(!t3dSortSpatially(ctx, centres, hashes, num_brushes, order)) {
+            t3dFree(ctx, order);
+            order = NULL;
+        }
+    }
+
+    t3dFree(ctx, centres);
+    t3dFree(ctx, hashes);
+
+    return order;
+}
+
+static uint32_t *SortActors(T3DContext *ctx, unsigned int num_actors) {
+    if(!ctx->options.sort) {
+        return NULL;
+    }
+
+    uint32_t *order = t3dMallocTag(ctx, sizeof(uint32_t) * (num_actors + 1), T3D_MEMORY_GEOMETRY);
+    double *centres = t3dMallocTag(ctx, sizeof(double) * 3 * (num_actors + 1), T3D_MEMORY_GEOMETRY);
+    if(order != NULL && centres != NULL) {
+        for(unsigned int i = 0; i < num_actors; ++i) {
+            t3dGetActorCentre(ctx, &ctx->actors[i], &centres[i * 3]);
+        }
+
+        if(!t3dSortSpatially(ctx, centres, NULL, num_actors, order)) {
+            t3dFree(ctx, order);
+            order = NULL;
+        }
+    }
+
+    t3dFree(ctx, centres);
+
+    return order;
+}
+
+/* the last brush and actor in the document are never exported */
+bool t3dGetExportCounts(T3DContext *ctx, unsigned int *num_brushes, unsigned int *num_actors) {
+    *num_brushes = ctx->map.num_brushes;
+    if(*num_brushes == 0) {
+        if(ctx->num_brushes == 0) {
+            t3dSetError(ctx, T3D_ERROR_NO_BRUSHES, "error: no brushes from t3d!\n");
+            return false;
+        }
+        *num_brushes = ctx->num_brushes - 1;
+    }
+
+    /* header may claim more than we actually have */
+    if(*num_brushes > ctx->num_brushes) {
+        *num_brushes = ctx->num_brushes;
+    }
+
+    *num_actors = (ctx->num_actors > 0) ? (ctx->num_actors - 1) : 0;
+
+    return true;
+}
+
+/* works out everything that needs to be known before writing anything */
+bool t3dBeginExport(T3DContext *ctx, T3DExport *info) {
+    memset(info, 0, sizeof(T3DExport));
+    if(!t3dGetExportCounts(ctx, &info->num_brushes, &info->num_actors)) {
+        return false;
+    }
+
+    ctx->progress.phase = T3D_PHASE_WRITING;
+    ctx->progress.brushes_written = 0;
+    ctx->progress.total_brushes = info->num_brushes;
+    if(!t3dReportProgress(ctx)) {
+        return false;
+    }
+
+    info->duplicates  = FindDuplicates(ctx, info->num_brushes);
+    info->brush_order = SortBrushes(ctx, info->num_brushes);
+    info->actor_order = SortActors(ctx, info->num_actors);
+
+    if(ctx->options.groups && ctx->error == T3D_ERROR_NONE) {
+        t3dLayoutGroups(ctx, info, NULL);
+    }
+
+    return (ctx->error == T3D_ERROR_NONE);
+}
+
+void t3dEndExport(T3DContext *ctx, T3DExport *info) {
+    t3dFree(ctx, info->duplicates);
+    t3dFree(ctx, info->brush_order);
+    t3dFree(ctx, info->actor_order);
+    t3dFree(ctx, info->group_starts);
+    memset(info, 0, sizeof(T3DExport));
+}
+
+unsigned int t3dGetExportBrush(const T3DExport *info, unsigned int n) {
+    return (info->brush_order != NULL) ? info->brush_order[n] : n;
+}
+
+unsigned int t3dGetExportActor(const T3DExport *info, unsigned int n) {
+    return (info->actor_order != NULL) ? info->actor_order[n] : n;
+}
+
+static void WriteBrushes(T3DWriter *writer, const T3DExport *info, unsigned int first, unsigned int last) {
+    T3DContext *ctx = writer->ctx;
+    for(unsigned int n = first; n < last && ctx->error == T3D_ERROR_NONE; ++n) {
+        unsigned int i = t3dGetExportBrush(info, n);
+        if(!t3dCheckBrush(ctx, &ctx->brushes[i], i) || !t3dCheckDuplicate(ctx, info->duplicates, i)) {
+            continue;
+        }
+
+        t3dBeginBrush(writer, i);
+        t3dWriteBrush(writer, &ctx->brushes[i]);
+
+        ctx->progress.brushes_written++;
+        t3dReportProgress(ctx);
+    }
+}
+
+/* everything but group 0, which goes in the world */
+static void WriteGroups(T3DWriter *writer, const T3DExport *info) {
+    for(unsigned int i = 1; i < info->num_groups; ++i) {
+        if(info->group_starts[i] == info->group_starts[i + 1]) {
+            continue;
+        }
+
+        writer->format->begin_group(writer, i);
+        WriteBrushes(writer, info, info->group_starts[i], info->group_starts[i + 1]);
+        writer->format->end_group(writer);
+    }
+}
+
+T3DError t3dWriteMap(T3DContext *ctx, const T3DSink *sink) {
+    if(sink == NULL || sink->write == NULL) {
+        t3dSetError(ctx, T3D_ERROR_PARAMETER, "error: invalid sink passed to t3dWriteMap!\n");
+        return ctx->error;
+    }
+
+    T3DExport info;
+    if(!t3dBeginExport(ctx, &info)) {
+        t3dEndExport(ctx, &info);
+        return ctx->error;
+    }
+
+    T3DWriter writer;
+    t3dInitWriter(&writer, ctx, sink);
+
+    /* write out the world spawn */
+
+    t3dWriteWorldspawn(&writer);
+
+    t3dLog(ctx, T3D_LOG_INFO, "writing %d brushes...\n", info.num_brushes);
+    if(info.group_starts != NULL) {
+        t3dLog(ctx, T3D_LOG_INFO, "keeping them together in %u groups...\n", info.num_groups - 1);
+        WriteBrushes(&writer, &info, 0, info.group_starts[1]);
+        if(!writer.format->group_entities) {
+            WriteGroups(&writer, &info);
+        }
+    } else {
+        WriteBrushes(&writer, &info, 0, info.num_brushes);
+    }
+
+    t3dEndWorldspawn(&writer);
+
+    if(info.group_starts != NULL && writer.format->group_entities) {
+        WriteGroups(&writer, &info);
+    }
+
+    for (unsigned int n = 0; n < info.num_actors && ctx->error == T3D_ERROR_NONE; ++n) {
+        unsigned int i = t3dGetExportActor(&info, n);
+        if(!t3dCheckEntity(ctx, &ctx->actors[i])) {
+            continue;
+        }
+
+        t3dWriteEntity(&writer, &ctx->actors[i]);
+    }
+
+    t3dEndMap(&writer);
+    t3dFlushWriter(&writer);
+
+    t3dEndExport(ctx, &info);
+
+    return ctx->error;
+}
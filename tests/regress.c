@@ -0,0 +1,1782 @@
+/* Golden output and performance regression tests.
+ *
+ * Every T3D in the examples directory is converted, along with a few
+ * generated stress inputs, and the output is compared against the golden
+ * MAPs kept in tests/golden, ignoring line endings, trailing whitespace and
+ * the version stamp. Outputs that are too big to be worth keeping around
+ * are checked against a hash instead. Parse and write times, the best of a
+ * few runs, and the peak memory of each are compared against those stored
+ * in tests/baseline.txt; times are scaled by how long a fixed bit of work
+ * takes compared to when the baseline was taken, so it holds up on other
+ * machines. The examples are also put through the batch converter, which
+ * has to produce exactly the same as converting them one at a time, as
+ * does converting them in the background, which is also cancelled part way
+ * through a large input to check it stops and lets go of everything.
+ * Watch mode has to give the same as a full conversion too, in every
+ * format with the groups kept, both from scratch and once a block's been
+ * changed and the rest come out of its cache.
+ * Each MAP in tests/import is turned back into a T3D, which is likewise
+ * compared against the golden output. The MAPs in the references directory
+ * next to the examples came from much older versions, so they're compared
+ * by their brushes' planes after a round trip, rather than line by line.
+ * Beyond plain conversion there are cases for tiled and split group export,
+ * the leak check, extracting from an index, and the test example read in
+ * as UTF-16 and compressed, which has to give the same as it does as is.
+ *
+ * usage: t3d_regress <examples dir> <tests dir> [options]
+ *  --update               accept the current output and performance as the new baseline
+ *  --time-threshold x     how far over the baseline a time may go, e.g. 0.5 for 50%
+ *  --memory-threshold x   likewise for peak memory
+ *  --no-timing            don't check the times, for when the machine's busy
+ *  --filter name          only run the cases starting with name
+ *  --verbose              let the library's warnings through */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#if defined(_WIN32)
+#   include <windows.h>
+#else
+#   include <dirent.h>
+#endif
+
+#include "t3d/t3d.h"
+
+#define NUM_RUNS            3
+#define MAX_TEST_CASES      64
+#define MAX_PATH_LENGTH     1024
+
+const char *examples_dir;
+const char *tests_dir;
+
+bool option_update = false;
+bool option_timing = true;
+bool option_verbose = false;
+double option_time_threshold = 0.5;
+double option_memory_threshold = 0.05;
+const char *option_filter = NULL;
+
+/* timings under this are mostly noise, so they're let off */
+#define TIME_SLACK_MS       2.0
+
+double GetTime(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
+
+void QuietLog(T3DLogLevel level, const char *message, void *user) {
+    (void)(user);
+    if(option_verbose && level >= T3D_LOG_WARNING) {
+        fputs(message, stderr);
+    }
+}
+
+/**************************************************/
+/* Output */
+
+typedef struct Buffer {
+    char *data;
+    size_t length;
+    size_t max_length;
+} Buffer;
+
+size_t WriteBuffer(const void *data, size_t length, void *user) {
+    Buffer *buffer = (Buffer *) user;
+    if(buffer->length + length + 1 > buffer->max_length) {
+        size_t max_length = (buffer->max_length > 0) ? buffer->max_length : 65536;
+        while(buffer->length + length + 1 > max_length) {
+            max_length *= 2;
+        }
+
+        char *buf = realloc(buffer->data, max_length);
+        if(buf == NULL) {
+            return 0;
+        }
+        buffer->data = buf;
+        buffer->max_length = max_length;
+    }
+
+    memcpy(&buffer->data[buffer->length], data, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return length;
+}
+
+bool LoadBuffer(const char *path, Buffer *buffer) {
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        return false;
+    }
+
+    char chunk[65536];
+    size_t length;
+    bool status = true;
+    while(status && (length = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        status = (WriteBuffer(chunk, length, buffer) == length);
+    }
+
+    status = status && !ferror(fp);
+    fclose(fp);
+    return status;
+}
+
+bool SaveBuffer(const char *path, const Buffer *buffer) {
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL) {
+        fprintf(stderr, "error: failed to open \"%s\" for writing!\n", path);
+        return false;
+    }
+
+    bool status = (fwrite(buffer->data, 1, buffer->length, fp) == buffer->length);
+    status = (fclose(fp) == 0) && status;
+    if(!status) {
+        fprintf(stderr, "error: failed to write \"%s\"!\n", path);
+    }
+    return status;
+}
+
+/* gives back the next line with anything allowed to differ taken off it,
+ * i.e. line endings, trailing whitespace and the version stamp */
+bool NextLine(const char **pos, const char *end, const char **line, size_t *length, unsigned int *line_num) {
+    for(;;) {
+        if(*pos >= end) {
+            return false;
+        }
+
+        (*line_num)++;
+
+        const char *start = *pos;
+        const char *eol = memchr(start, '\n', end - start);
+        if(eol == NULL) {
+            eol = end;
+        }
+        *pos = (eol < end) ? eol + 1 : end;
+
+        size_t n = eol - start;
+        while(n > 0 && (start[n - 1] == '\r' || start[n - 1] == ' ' || start[n - 1] == '\t')) {
+            n--;
+        }
+
+        /* not all that likely to turn up in a map otherwise */
+        static const char stamp[] = "generated with t3d2map v";
+        bool stamped = false;
+        for(size_t i = 0; i + sizeof(stamp) - 1 <= n && !stamped; ++i) {
+            stamped = (memcmp(&start[i], stamp, sizeof(stamp) - 1) == 0);
+        }
+        if(stamped) {
+            continue;
+        }
+
+        *line = start;
+        *length = n;
+        return true;
+    }
+}
+
+uint64_t HashOutput(const Buffer *buffer) {
+    uint64_t hash = 14695981039346656037ull;
+    const char *pos = buffer->data, *end = buffer->data + buffer->length, *line;
+    size_t length;
+    unsigned int line_num = 0;
+    while(NextLine(&pos, end, &line, &length, &line_num)) {
+        for(size_t i = 0; i < length; ++i) {
+            hash = (hash ^ (unsigned char) line[i]) * 1099511628211ull;
+        }
+        hash = (hash ^ '\n') * 1099511628211ull;
+    }
+    return hash;
+}
+
+/* reports the first line that differs */
+bool CompareOutput(const char *name, const Buffer *expected, const Buffer *output) {
+    const char *a = expected->data, *a_end = expected->data + expected->length;
+    const char *b = output->data, *b_end = output->data + output->length;
+    unsigned int a_line_num = 0, b_line_num = 0;
+    for(;;) {
+        const char *a_line, *b_line;
+        size_t a_length, b_length;
+        bool a_more = NextLine(&a, a_end, &a_line, &a_length, &a_line_num);
+        bool b_more = NextLine(&b, b_end, &b_line, &b_length, &b_line_num);
+        if(!a_more && !b_more) {
+            return true;
+        }
+
+        if(a_more != b_more || a_length != b_length || memcmp(a_line, b_line, a_length) != 0) {
+            fprintf(stderr, "  %s differs from its golden output at line %u (line %u of the output)\n",
+                    name, a_line_num, b_line_num);
+            fprintf(stderr, "   expected: %.*s\n", a_more ? (int) a_length : 5, a_more ? a_line : "(end)");
+            fprintf(stderr, "   got:      %.*s\n", b_more ? (int) b_length : 5, b_more ? b_line : "(end)");
+            return false;
+        }
+    }
+}
+
+/**************************************************/
+/* Stress Inputs */
+
+/* The same box brush UnrealEd makes, one after another in a grid, with
+ * each row of them in a group of its own and lights dotted about. */
+
+typedef struct Generator {
+    Buffer buffer;
+    uint32_t seed;
+    unsigned int num_actors;
+} Generator;
+
+void Generate(Generator *generator, const char *format, ...) {
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if(length > 0) {
+        WriteBuffer(line, (size_t) length, &generator->buffer);
+    }
+}
+
+/* so it's the same every time */
+unsigned int GetRandom(Generator *generator, unsigned int range) {
+    generator->seed = generator->seed * 1664525u + 1013904223u;
+    return (generator->seed >> 8) % range;
+}
+
+void GenerateBox(Generator *generator, const double *location, const double *extents, const char *csg,
+                 const char *texture, const char *group) {
+    static const struct {
+        int corners[4][3];  /* signs of each vertex */
+        int u[3], v[3];
+    } faces[6] = {
+            { { { -1, -1,  1 }, {  1, -1,  1 }, {  1,  1,  1 }, { -1,  1,  1 } }, {  0,  1,  0 }, { -1,  0,  0 } },
+            { { { -1,  1, -1 }, {  1,  1, -1 }, {  1, -1, -1 }, { -1, -1, -1 } }, {  0, -1,  0 }, { -1,  0,  0 } },
+            { { { -1,  1, -1 }, { -1,  1,  1 }, {  1,  1,  1 }, {  1,  1, -1 } }, {  1,  0,  0 }, {  0,  0, -1 } },
+            { { {  1, -1, -1 }, {  1, -1,  1 }, { -1, -1,  1 }, { -1, -1, -1 } }, { -1,  0,  0 }, {  0,  0, -1 } },
+            { { {  1,  1, -1 }, {  1,  1,  1 }, {  1, -1,  1 }, {  1, -1, -1 } }, {  0, -1,  0 }, {  0,  0, -1 } },
+            { { { -1, -1, -1 }, { -1, -1,  1 }, { -1,  1,  1 }, { -1,  1, -1 } }, {  0,  1,  0 }, {  0,  0, -1 } },
+    };
+
+    unsigned int n = generator->num_actors++;
+    Generate(generator, "Begin Actor Class=Brush Name=Brush%u\n", n);
+    Generate(generator, "    CsgOper=%s\n", csg);
+    Generate(generator, "    Location=(X=%f,Y=%f,Z=%f)\n", location[0], location[1], location[2]);
+    Generate(generator, "    Begin Brush Name=Model%u\n", n);
+    Generate(generator, "       Begin PolyList\n");
+    for(unsigned int i = 0; i < 6; ++i) {
+        Generate(generator, "          Begin Polygon Item=OUTSIDE Texture=%s%s%s Link=%u\n",
+                 texture, (group != NULL) ? " Group=" : "", (group != NULL) ? group : "", i);
+
+        double vertices[4][3];
+        for(unsigned int j = 0; j < 4; ++j) {
+            for(unsigned int k = 0; k < 3; ++k) {
+                vertices[j][k] = faces[i].corners[j][k] * extents[k];
+            }
+        }
+
+        Generate(generator, "             Origin   %f,%f,%f\n", vertices[0][0], vertices[0][1], vertices[0][2]);
+        Generate(generator, "             TextureU %d,%d,%d\n", faces[i].u[0], faces[i].u[1], faces[i].u[2]);
+        Generate(generator, "             TextureV %d,%d,%d\n", faces[i].v[0], faces[i].v[1], faces[i].v[2]);
+        for(unsigned int j = 0; j < 4; ++j) {
+            Generate(generator, "             Vertex   %f,%f,%f\n", vertices[j][0], vertices[j][1], vertices[j][2]);
+        }
+        Generate(generator, "          End Polygon\n");
+    }
+    Generate(generator, "       End PolyList\n");
+    Generate(generator, "    End Brush\n");
+    Generate(generator, "    Brush=Model'MyLevel.Model%u'\n", n);
+    Generate(generator, "End Actor\n");
+}
+
+void GenerateActor(Generator *generator, const char *class_name, const double *location, const char *group) {
+    unsigned int n = generator->num_actors++;
+    Generate(generator, "Begin Actor Class=%s Name=%s%u\n", class_name, class_name, n);
+    Generate(generator, "    Location=(X=%f,Y=%f,Z=%f)\n", location[0], location[1], location[2]);
+    if(strcmp(class_name, "Light") == 0) {
+        Generate(generator, "    LightBrightness=%u\n", 64 + GetRandom(generator, 192));
+        Generate(generator, "    LightHue=%u\n", GetRandom(generator, 256));
+        Generate(generator, "    LightSaturation=%u\n", GetRandom(generator, 256));
+    }
+    if(group != NULL) {
+        Generate(generator, "    Group=\"%s\"\n", group);
+    }
+    Generate(generator, "End Actor\n");
+}
+
+bool GenerateGrid(Buffer *buffer, unsigned int columns, unsigned int rows, unsigned int layers) {
+    static const char *textures[] = { "rClfFlr9x", "Wall_A", "Crate3", "Trim02", "Floor_Tile" };
+
+    Generator generator;
+    memset(&generator, 0, sizeof(Generator));
+    generator.seed = columns * 73856093u ^ rows * 19349663u ^ layers * 83492791u;
+
+    Generate(&generator, "Begin Map\n");
+    Generate(&generator, "Begin Actor Class=LevelInfo Name=LevelInfo0\n    Title=\"Stress\"\nEnd Actor\n");
+
+    /* the room everything sits in */
+    double spacing = 512.0;
+    double size[3] = { columns * spacing * 0.5 + 256.0, rows * spacing * 0.5 + 256.0, layers * spacing * 0.5 + 256.0 };
+    double centre[3] = { size[0] - 256.0, size[1] - 256.0, size[2] - 256.0 };
+    GenerateBox(&generator, centre, size, "CSG_Subtract", "Wall_A", NULL);
+
+    double start[3] = { spacing * 0.5, spacing * 0.5, 64.0 };
+    GenerateActor(&generator, "PlayerStart", start, NULL);
+
+    for(unsigned int layer = 0; layer < layers; ++layer) {
+        for(unsigned int row = 0; row < rows; ++row) {
+            char group[32];
+            snprintf(group, sizeof(group), "Row%u", row % 8);
+            for(unsigned int column = 0; column < columns; ++column) {
+                double location[3] = { column * spacing, row * spacing, layer * spacing };
+                double extents[3] = {
+                        16.0 + GetRandom(&generator, 8) * 16.0,
+                        16.0 + GetRandom(&generator, 8) * 16.0,
+                        8.0 + GetRandom(&generator, 4) * 8.0,
+                };
+                const char *texture = textures[GetRandom(&generator, sizeof(textures) / sizeof(*textures))];
+                GenerateBox(&generator, location, extents, "CSG_Add", texture, (column % 4 != 3) ? group : NULL);
+
+                if(GetRandom(&generator, 4) == 0) {
+                    double light[3] = { location[0] + 128.0, location[1] + 128.0, location[2] + 192.0 };
+                    GenerateActor(&generator, "Light", light, (GetRandom(&generator, 2) == 0) ? group : NULL);
+                }
+            }
+        }
+    }
+
+    Generate(&generator, "End Map\n");
+
+    *buffer = generator.buffer;
+    return (buffer->data != NULL);
+}
+
+/**************************************************/
+/* Test Cases */
+
+typedef enum TestKind {
+    TEST_CONVERT,
+    TEST_IMPORT,        /* input's a MAP to be turned back into a T3D */
+    TEST_REFERENCE,     /* input's a MAP from an older version, see RunReference */
+} TestKind;
+
+typedef struct TestCase TestCase;
+struct TestCase {
+    char name[64];
+    char path[MAX_PATH_LENGTH];     /* empty if the input's generated */
+    const Buffer *input;
+    T3DOptions options;
+    bool hashed;                    /* output's too big to keep, so only its hash is */
+    bool scratch;                   /* input was written out for the test, so is removed after */
+    TestKind kind;
+    const char *golden;             /* case whose golden output it has to match, if not its own */
+
+    /* in place of parsing the input, or writing it out as a map */
+    T3DError (*parse)(const TestCase *test_case, T3DContext *ctx);
+    T3DError (*write)(const TestCase *test_case, T3DContext *ctx, const T3DSink *sink);
+
+    /* filled in once it's run */
+    char outcome[64];               /* "map", "fnv:<hash>" or "error:<what>" */
+    double parse_ms;
+    double write_ms;
+    size_t peak_memory;
+    Buffer output;
+};
+
+TestCase test_cases[MAX_TEST_CASES];
+unsigned int num_test_cases = 0;
+
+TestCase *AddTestCase(const char *name, unsigned int format) {
+    if(num_test_cases == MAX_TEST_CASES) {
+        fprintf(stderr, "error: too many test cases!\n");
+        return NULL;
+    }
+
+    TestCase *test_case = &test_cases[num_test_cases++];
+    memset(test_case, 0, sizeof(TestCase));
+    snprintf(test_case->name, sizeof(test_case->name), "%s", name);
+    test_case->options.format = format;
+    test_case->options.log = QuietLog;
+    return test_case;
+}
+
+/* i.e. "chop shop.t3d" -> chop_shop */
+bool GetExampleName(const char *file_name, const char *extension, char *name, size_t size) {
+    snprintf(name, size, "%s", file_name);
+
+    char *ext = strrchr(name, '.');
+    if(ext == NULL || ext == name || pl_strcasecmp(ext, extension) != 0) {
+        return false;
+    }
+    *ext = '\0';
+
+    for(char *c = name; *c != '\0'; ++c) {
+        if(*c == ' ') *c = '_';
+    }
+    return true;
+}
+
+int CompareTestCases(const void *a, const void *b) {
+    return strcmp(((const TestCase *) a)->name, ((const TestCase *) b)->name);
+}
+
+/* imports are named after the MAP with "import." in front, i.e. import.stray_brace, references likewise */
+bool AddExample(const char *dir, const char *file_name, TestKind kind) {
+    static const char *prefixes[] = {
+            [TEST_CONVERT]   = "",
+            [TEST_IMPORT]    = "import.",
+            [TEST_REFERENCE] = "reference.",
+    };
+
+    char name[48];
+    if(!GetExampleName(file_name, (kind == TEST_CONVERT) ? ".t3d" : ".map", name, sizeof(name))) {
+        return true;
+    }
+
+    char case_name[64];
+    snprintf(case_name, sizeof(case_name), "%s%s", prefixes[kind], name);
+    TestCase *test_case = AddTestCase(case_name, MAP_FORMAT_IDT2);
+    if(test_case == NULL) {
+        return false;
+    }
+
+    snprintf(test_case->path, sizeof(test_case->path), "%s/%s", dir, file_name);
+    test_case->kind = kind;
+    return true;
+}
+
+bool FindExamples(const char *dir, TestKind kind) {
+    unsigned int first = num_test_cases;
+#if defined(_WIN32)
+    char pattern[MAX_PATH_LENGTH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if(find == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "error: failed to open \"%s\"!\n", dir);
+        return false;
+    }
+
+    bool status = true;
+    do {
+        if(!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            status = AddExample(dir, data.cFileName, kind);
+        }
+    } while(status && FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR *handle = opendir(dir);
+    if(handle == NULL) {
+        fprintf(stderr, "error: failed to open \"%s\"!\n", dir);
+        return false;
+    }
+
+    bool status = true;
+    struct dirent *entry;
+    while(status && (entry = readdir(handle)) != NULL) {
+        status = AddExample(dir, entry->d_name, kind);
+    }
+    closedir(handle);
+#endif
+
+    /* directory order isn't to be relied upon */
+    qsort(&test_cases[first], num_test_cases - first, sizeof(TestCase), CompareTestCases);
+    return status;
+}
+
+const TestCase *FindTestCase(const char *name) {
+    for(unsigned int i = 0; i < num_test_cases; ++i) {
+        if(strcmp(test_cases[i].name, name) == 0) {
+            return &test_cases[i];
+        }
+    }
+    return NULL;
+}
+
+/**************************************************/
+/* Other Outputs */
+
+#define MAX_PIECES  64
+
+/* tiles and groups are written in whatever order they finish, so each goes
+ * into a buffer of its own, and they're put together in order after */
+typedef struct Pieces {
+    Buffer buffers[MAX_PIECES];
+    T3DSink sinks[MAX_PIECES];
+    unsigned int columns;
+} Pieces;
+
+const T3DSink *OpenPiece(Pieces *pieces, unsigned int index) {
+    if(index >= MAX_PIECES) {
+        return NULL;
+    }
+
+    pieces->sinks[index] = (T3DSink) { WriteBuffer, &pieces->buffers[index] };
+    return &pieces->sinks[index];
+}
+
+/* each is headed with what it holds, then freed */
+void WritePiece(const T3DSink *sink, Buffer *buffer, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if(length > 0) {
+        sink->write(line, (size_t) length, sink->user);
+    }
+    if(buffer->length > 0) {
+        sink->write(buffer->data, buffer->length, sink->user);
+    }
+
+    free(buffer->data);
+    memset(buffer, 0, sizeof(Buffer));
+}
+
+const T3DSink *OpenTile(const T3DTile *tile, void *user) {
+    Pieces *pieces = (Pieces *) user;
+    return OpenPiece(pieces, tile->row * pieces->columns + tile->column);
+}
+
+bool CloseTile(const T3DTile *tile, const T3DSink *sink, void *user) {
+    (void)(tile);
+    (void)(sink);
+    (void)(user);
+    return true;
+}
+
+T3DError WriteTiles(const TestCase *test_case, T3DContext *ctx, const T3DSink *sink) {
+    (void)(test_case);
+
+    static Pieces pieces;
+    memset(&pieces, 0, sizeof(Pieces));
+    pieces.columns = 2;
+
+    T3DTile tiles[4];
+    T3DTileOptions options = {
+            .columns = 2,
+            .rows    = 2,
+            .margin  = 64.0,
+            .open    = OpenTile,
+            .close   = CloseTile,
+            .user    = &pieces,
+    };
+    T3DError error = t3dWriteTiles(ctx, &options, tiles);
+
+    for(unsigned int i = 0; i < options.columns * options.rows; ++i) {
+        WritePiece(sink, &pieces.buffers[i], "// tile %u %u, %u brushes, %u actors\n",
+                   tiles[i].column, tiles[i].row, tiles[i].num_brushes, tiles[i].num_actors);
+    }
+
+    return error;
+}
+
+const T3DSink *OpenGroup(const T3DGroup *group, void *user) {
+    return OpenPiece((Pieces *) user, group->index);
+}
+
+bool CloseGroup(const T3DGroup *group, const T3DSink *sink, void *user) {
+    (void)(group);
+    (void)(sink);
+    (void)(user);
+    return true;
+}
+
+T3DError WriteGroups(const TestCase *test_case, T3DContext *ctx, const T3DSink *sink) {
+    (void)(test_case);
+
+    static Pieces pieces;
+    memset(&pieces, 0, sizeof(Pieces));
+
+    unsigned int num_groups = t3dGetNumGroups(ctx);
+    if(num_groups > MAX_PIECES) {
+        fprintf(stderr, "  %u groups is more than there's room for\n", num_groups);
+        return T3D_ERROR_MEMORY;
+    }
+
+    T3DGroup groups[MAX_PIECES];
+    T3DGroupOptions options = {
+            .open  = OpenGroup,
+            .close = CloseGroup,
+            .user  = &pieces,
+    };
+    T3DError error = t3dWriteGroups(ctx, &options, groups);
+
+    for(unsigned int i = 0; i < num_groups; ++i) {
+        WritePiece(sink, &pieces.buffers[i], "// group %u \"%s\", %u brushes, %u actors\n",
+                   groups[i].index, groups[i].name, groups[i].num_brushes, groups[i].num_actors);
+    }
+
+    return error;
+}
+
+/* the point file, if there is one, followed by whether it leaked */
+T3DError WriteLeaks(const TestCase *test_case, T3DContext *ctx, const T3DSink *sink) {
+    (void)(test_case);
+
+    bool leaked;
+    T3DError error = t3dCheckLeaks(ctx, sink, &leaked);
+
+    const char *result = leaked ? "// leaked\n" : "// sealed\n";
+    sink->write(result, strlen(result), sink->user);
+    return error;
+}
+
+/* written out compressed, going by the extension of the input, then read back in */
+T3DError WriteCompressed(const TestCase *test_case, T3DContext *ctx, const T3DSink *sink) {
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "regress_%s.map%s", test_case->name, strrchr(test_case->path, '.'));
+
+    T3DOutput *output = t3dOpenOutput(ctx, path);
+    if(output == NULL) {
+        return t3dGetError(ctx);
+    }
+
+    T3DError error = t3dWriteMap(ctx, t3dGetOutputSink(output));
+    T3DError close_error = t3dCloseOutput(output);
+    if(error == T3D_ERROR_NONE) {
+        error = close_error;
+    }
+
+    size_t length;
+    char *buf = (error == T3D_ERROR_NONE) ? t3dLoadFile(ctx, path, &length) : NULL;
+    if(buf != NULL) {
+        sink->write(buf, length, sink->user);
+        t3dFree(ctx, buf);
+    } else if(error == T3D_ERROR_NONE) {
+        error = t3dGetError(ctx);
+    }
+
+    remove(path);
+    return error;
+}
+
+/* Indexes a copy of the input, so the sidecar isn't left lying about in the
+ * examples, checks the index reads back the same, then parses just what's in
+ * the western half of the map, as -extract region= would. */
+T3DError ParseExtract(const TestCase *test_case, T3DContext *ctx) {
+    const char *path = "regress_extract.t3d";
+    const char *index_path = "regress_extract.t3d.idx";
+
+    Buffer input = { NULL, 0, 0 };
+    bool status = LoadBuffer(test_case->path, &input) && SaveBuffer(path, &input);
+    free(input.data);
+    if(!status) {
+        return T3D_ERROR_IO;
+    }
+
+    T3DIndex *index = t3dLoadIndex(ctx, path, true);
+    T3DIndex *read = (index != NULL) ? t3dReadIndex(ctx, index_path, path) : NULL;
+    T3DError error = t3dGetError(ctx);
+    if(index != NULL && read == NULL && error == T3D_ERROR_NONE) {
+        fprintf(stderr, "  %s index couldn't be read back\n", test_case->name);
+        error = T3D_ERROR_IO;
+    } else if(read != NULL && (read->num_entries != index->num_entries ||
+                               memcmp(read->entries, index->entries, sizeof(T3DIndexEntry) * index->num_entries) != 0)) {
+        fprintf(stderr, "  %s index doesn't read back the same as it was built\n", test_case->name);
+        error = T3D_ERROR_IO;
+    }
+
+    bool *selected = (error == T3D_ERROR_NONE) ? calloc(read->num_entries + 1, sizeof(bool)) : NULL;
+    if(selected != NULL) {
+        float mins = read->entries[0].mins[0], maxs = read->entries[0].maxs[0];
+        for(unsigned int i = 1; i < read->num_entries; ++i) {
+            if(read->entries[i].mins[0] < mins) mins = read->entries[i].mins[0];
+            if(read->entries[i].maxs[0] > maxs) maxs = read->entries[i].maxs[0];
+        }
+
+        for(unsigned int i = 0; i < read->num_entries; ++i) {
+            selected[i] = (read->entries[i].mins[0] <= (mins + maxs) * 0.5f);
+        }
+
+        error = t3dParseIndexed(ctx, path, read, selected);
+        free(selected);
+    } else if(error == T3D_ERROR_NONE) {
+        error = T3D_ERROR_MEMORY;
+    }
+
+    t3dDestroyIndex(ctx, read);
+    t3dDestroyIndex(ctx, index);
+    remove(path);
+    remove(index_path);
+    return error;
+}
+
+/* ASCII widened out to UTF-16, with a BOM in front, as UnrealEd sometimes saves them */
+bool SaveUTF16(const char *path, const Buffer *input, bool big_endian) {
+    Buffer encoded = { NULL, 0, 0 };
+    WriteBuffer(big_endian ? "\xFE\xFF" : "\xFF\xFE", 2, &encoded);
+    for(size_t i = 0; i < input->length; ++i) {
+        char unit[2] = { big_endian ? '\0' : input->data[i], big_endian ? input->data[i] : '\0' };
+        WriteBuffer(unit, 2, &encoded);
+    }
+
+    bool status = (encoded.length == (input->length + 1) * 2) && SaveBuffer(path, &encoded);
+    free(encoded.data);
+    return status;
+}
+
+/* compressed going by the extension, the same as the library's output */
+bool SaveCompressed(const char *path, const Buffer *input) {
+    T3DOptions options = { .log = QuietLog };
+    T3DContext *ctx = t3dCreateContext(&options);
+    T3DOutput *output = (ctx != NULL) ? t3dOpenOutput(ctx, path) : NULL;
+
+    bool status = (output != NULL);
+    if(status) {
+        const T3DSink *sink = t3dGetOutputSink(output);
+        status = (sink->write(input->data, input->length, sink->user) == input->length);
+        status = (t3dCloseOutput(output) == T3D_ERROR_NONE) && status;
+    }
+
+    t3dDestroyContext(ctx);
+    if(!status) {
+        fprintf(stderr, "error: failed to write \"%s\"!\n", path);
+    }
+    return status;
+}
+
+/* the test example read in as UTF-16 and compressed, where it's supported, which has to give the same
+ * as it does as is, and deck16 extracted from its index and checked for leaks */
+bool AddExampleVariants(void) {
+    const TestCase *test = FindTestCase("test");
+    const TestCase *deck16 = FindTestCase("deck16");
+    if(test == NULL || deck16 == NULL) {
+        fprintf(stderr, "error: the test and deck16 examples are needed!\n");
+        return false;
+    }
+
+    Buffer input = { NULL, 0, 0 };
+    if(!LoadBuffer(test->path, &input)) {
+        fprintf(stderr, "error: failed to load \"%s\"!\n", test->path);
+        return false;
+    }
+
+    static const struct {
+        const char *name;
+        T3DCompression compression;
+        bool big_endian;
+    } variants[] = {
+            { "utf16le", T3D_COMPRESSION_NONE, false },
+            { "utf16be", T3D_COMPRESSION_NONE, true },
+            { "gz",      T3D_COMPRESSION_GZIP, false },
+            { "zst",     T3D_COMPRESSION_ZSTD, false },
+    };
+
+    bool status = true;
+    for(unsigned int i = 0; i < sizeof(variants) / sizeof(*variants) && status; ++i) {
+        if(variants[i].compression != T3D_COMPRESSION_NONE && !t3dIsCompressionSupported(variants[i].compression)) {
+            printf("%s isn't supported by this build, so test.%s is left out\n", variants[i].name, variants[i].name);
+            continue;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "test.%s", variants[i].name);
+        TestCase *test_case = AddTestCase(name, MAP_FORMAT_IDT2);
+        if(test_case == NULL) {
+            status = false;
+            break;
+        }
+
+        test_case->golden  = "test";
+        test_case->scratch = true;
+        if(variants[i].compression == T3D_COMPRESSION_NONE) {
+            snprintf(test_case->path, sizeof(test_case->path), "regress_test.%s.t3d", variants[i].name);
+            status = SaveUTF16(test_case->path, &input, variants[i].big_endian);
+        } else {
+            snprintf(test_case->path, sizeof(test_case->path), "regress_test.t3d.%s", variants[i].name);
+            test_case->write = WriteCompressed;
+            status = SaveCompressed(test_case->path, &input);
+        }
+    }
+    free(input.data);
+
+    TestCase *test_case;
+    if(!status || (test_case = AddTestCase("deck16.extract", MAP_FORMAT_IDT2)) == NULL) {
+        return false;
+    }
+    snprintf(test_case->path, sizeof(test_case->path), "%s", deck16->path);
+    test_case->parse = ParseExtract;
+
+    if((test_case = AddTestCase("deck16.leak", MAP_FORMAT_IDT2)) == NULL) {
+        return false;
+    }
+    snprintf(test_case->path, sizeof(test_case->path), "%s", deck16->path);
+    test_case->write = WriteLeaks;
+
+    return true;
+}
+
+Buffer stress_small, stress_large;
+
+bool AddStressCases(void) {
+    if(!GenerateGrid(&stress_small, 6, 6, 2) || !GenerateGrid(&stress_large, 40, 40, 4)) {
+        fprintf(stderr, "error: failed to generate stress inputs!\n");
+        return false;
+    }
+
+    /* every format, with the groups kept */
+    static const char *formats[MAX_MAP_FORMATS] = {
+            [MAP_FORMAT_IDT2] = "idt2",
+            [MAP_FORMAT_IDT3] = "idt3",
+            [MAP_FORMAT_IDT4] = "idt4",
+            [MAP_FORMAT_GSRC] = "gsrc",
+            [MAP_FORMAT_SRC]  = "src",
+    };
+    for(unsigned int i = 0; i < MAX_MAP_FORMATS; ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "stress_small.%s", formats[i]);
+        TestCase *test_case = AddTestCase(name, i);
+        if(test_case == NULL) {
+            return false;
+        }
+        test_case->input = &stress_small;
+        test_case->options.groups = true;
+    }
+
+    TestCase *test_case;
+    if((test_case = AddTestCase("stress_large", MAP_FORMAT_IDT2)) == NULL) {
+        return false;
+    }
+    test_case->input  = &stress_large;
+    test_case->hashed = true;
+
+    if((test_case = AddTestCase("stress_large.sorted", MAP_FORMAT_IDT2)) == NULL) {
+        return false;
+    }
+    test_case->input  = &stress_large;
+    test_case->hashed = true;
+    test_case->options.sort   = true;
+    test_case->options.dedupe = true;
+
+    /* and split up, either way */
+    if((test_case = AddTestCase("stress_small.tiles", MAP_FORMAT_IDT2)) == NULL) {
+        return false;
+    }
+    test_case->input = &stress_small;
+    test_case->write = WriteTiles;
+
+    if((test_case = AddTestCase("stress_small.splitgroups", MAP_FORMAT_IDT2)) == NULL) {
+        return false;
+    }
+    test_case->input = &stress_small;
+    test_case->write = WriteGroups;
+
+    return true;
+}
+
+/**************************************************/
+/* Running */
+
+void GetErrorOutcome(T3DError error, char *outcome, size_t size) {
+    snprintf(outcome, size, "error:%s", t3dGetErrorString(error));
+    for(char *c = outcome; *c != '\0'; ++c) {
+        if(*c == ' ' || *c == '/') *c = '-';
+    }
+}
+
+/* runs it a few times, keeping the best times and the output of the first */
+bool RunTestCase(TestCase *test_case) {
+    uint64_t first_hash = 0;
+    for(unsigned int run = 0; run < NUM_RUNS; ++run) {
+        T3DContext *ctx = t3dCreateContext(&test_case->options);
+        if(ctx == NULL) {
+            fprintf(stderr, "error: failed to create context for %s!\n", test_case->name);
+            return false;
+        }
+
+        Buffer output = { NULL, 0, 0 };
+        T3DSink sink = { WriteBuffer, &output };
+
+        double start = GetTime();
+        T3DError error;
+        if(test_case->kind == TEST_IMPORT) {
+            error = t3dImportMap(ctx, test_case->path, &sink);
+        } else if(test_case->parse != NULL) {
+            error = test_case->parse(test_case, ctx);
+        } else if(test_case->input != NULL) {
+            error = t3dParseBuffer(ctx, test_case->input->data, test_case->input->length);
+        } else {
+            error = t3dParseFile(ctx, test_case->path);
+        }
+        double parsed = GetTime();
+        if(error == T3D_ERROR_NONE && test_case->kind != TEST_IMPORT) {
+            error = (test_case->write != NULL) ? test_case->write(test_case, ctx, &sink) : t3dWriteMap(ctx, &sink);
+        }
+        double written = GetTime();
+
+        T3DMemoryStats stats;
+        t3dGetMemoryStats(ctx, T3D_MAX_MEMORY_TAGS, &stats);
+        t3dDestroyContext(ctx);
+
+        char outcome[64];
+        uint64_t hash = HashOutput(&output);
+        if(error != T3D_ERROR_NONE) {
+            GetErrorOutcome(error, outcome, sizeof(outcome));
+        } else if(test_case->hashed) {
+            snprintf(outcome, sizeof(outcome), "fnv:%016llx", (unsigned long long) hash);
+        } else {
+            snprintf(outcome, sizeof(outcome), "map");
+        }
+
+        if(run == 0) {
+            snprintf(test_case->outcome, sizeof(test_case->outcome), "%s", outcome);
+            test_case->parse_ms    = parsed - start;
+            test_case->write_ms    = written - parsed;
+            test_case->peak_memory = stats.peak;
+            test_case->output      = output;
+            first_hash = hash;
+            continue;
+        }
+
+        free(output.data);
+
+        /* anything running in parallel mustn't change the result */
+        if(strcmp(outcome, test_case->outcome) != 0 || hash != first_hash) {
+            fprintf(stderr, "  %s gave a different result on run %u (%s, expected %s)\n",
+                    test_case->name, run + 1, outcome, test_case->outcome);
+            snprintf(test_case->outcome, sizeof(test_case->outcome), "unstable");
+            return false;
+        }
+
+        if(parsed - start < test_case->parse_ms) test_case->parse_ms = parsed - start;
+        if(written - parsed < test_case->write_ms) test_case->write_ms = written - parsed;
+    }
+
+    return true;
+}
+
+/* converts all the examples at once, which has to give the same as doing them one by one */
+bool RunBatch(TestCase *batch_case, unsigned int num_examples) {
+    T3DBatchJob jobs[MAX_TEST_CASES];
+    char out_paths[MAX_TEST_CASES][MAX_PATH_LENGTH];
+    memset(jobs, 0, sizeof(jobs));
+    for(unsigned int i = 0; i < num_examples; ++i) {
+        snprintf(out_paths[i], sizeof(out_paths[i]), "regress_%.63s.map", test_cases[i].name);
+        remove(out_paths[i]);
+        jobs[i].in_path  = test_cases[i].path;
+        jobs[i].out_path = out_paths[i];
+    }
+
+    T3DBatchOptions batch_options = { .num_workers = 0 };
+    double start = GetTime();
+    t3dConvertBatch(&batch_case->options, &batch_options, jobs, num_examples);
+    batch_case->parse_ms = GetTime() - start;
+
+    bool status = true;
+    for(unsigned int i = 0; i < num_examples; ++i) {
+        const TestCase *test_case = &test_cases[i];
+
+        char outcome[64];
+        Buffer output = { NULL, 0, 0 };
+        if(jobs[i].error != T3D_ERROR_NONE) {
+            GetErrorOutcome(jobs[i].error, outcome, sizeof(outcome));
+        } else if(!LoadBuffer(out_paths[i], &output)) {
+            snprintf(outcome, sizeof(outcome), "missing");
+        } else {
+            snprintf(outcome, sizeof(outcome), "map");
+        }
+
+        if(strcmp(outcome, test_case->outcome) != 0) {
+            fprintf(stderr, "  batch gave %s for %s, expected %s\n", outcome, test_case->name, test_case->outcome);
+            status = false;
+        } else if(output.length != test_case->output.length ||
+                  (output.length > 0 && memcmp(output.data, test_case->output.data, output.length) != 0)) {
+            fprintf(stderr, "  batch output for %s doesn't match converting it on its own\n", test_case->name);
+            status = false;
+        }
+
+        free(output.data);
+        remove(out_paths[i]);
+    }
+
+    snprintf(batch_case->outcome, sizeof(batch_case->outcome), status ? "same" : "differs");
+    return status;
+}
+
+/**************************************************/
+/* References */
+
+/* The MAPs in the references directory came out of much older versions,
+ * which picked other points to define each face by and wrote the texture
+ * alignment differently, so rather than comparing them line by line each
+ * is imported and converted again, and every brush has to come back with
+ * the same planes. The subtractive brush the import wraps around it all is
+ * left out by only taking the additive ones. */
+
+#define MAX_PLANES  4096
+
+typedef struct Plane {
+    double normal[3];
+    double distance;
+    unsigned int brush;
+} Plane;
+
+/* every face in the map, with a new brush starting after anything that isn't one */
+unsigned int ReadPlanes(const Buffer *map, Plane *planes, unsigned int *num_brushes) {
+    unsigned int num_planes = 0, line_num = 0;
+    bool in_brush = false;
+    *num_brushes = 0;
+
+    const char *pos = map->data, *end = map->data + map->length, *line;
+    size_t length;
+    while(NextLine(&pos, end, &line, &length, &line_num) && num_planes < MAX_PLANES) {
+        char text[512];
+        snprintf(text, sizeof(text), "%.*s", (int) length, line);
+
+        double p[3][3];
+        if(sscanf(text, " ( %lf %lf %lf ) ( %lf %lf %lf ) ( %lf %lf %lf )",
+                  &p[0][0], &p[0][1], &p[0][2], &p[1][0], &p[1][1], &p[1][2], &p[2][0], &p[2][1], &p[2][2]) != 9) {
+            in_brush = false;
+            continue;
+        }
+
+        if(!in_brush) {
+            (*num_brushes)++;
+            in_brush = true;
+        }
+
+        double a[3], b[3];
+        for(unsigned int i = 0; i < 3; ++i) {
+            a[i] = p[1][i] - p[0][i];
+            b[i] = p[2][i] - p[0][i];
+        }
+
+        Plane *plane = &planes[num_planes++];
+        plane->normal[0] = a[1] * b[2] - a[2] * b[1];
+        plane->normal[1] = a[2] * b[0] - a[0] * b[2];
+        plane->normal[2] = a[0] * b[1] - a[1] * b[0];
+        double magnitude = sqrt(plane->normal[0] * plane->normal[0] + plane->normal[1] * plane->normal[1] +
+                                plane->normal[2] * plane->normal[2]);
+        for(unsigned int i = 0; i < 3 && magnitude > 0.0; ++i) {
+            plane->normal[i] /= magnitude;
+        }
+        plane->distance = plane->normal[0] * p[0][0] + plane->normal[1] * p[0][1] + plane->normal[2] * p[0][2];
+        plane->brush = *num_brushes - 1;
+    }
+
+    return num_planes;
+}
+
+/* the points are only whole units, so there's a little give */
+bool IsSamePlane(const Plane *a, const Plane *b) {
+    double dot = a->normal[0] * b->normal[0] + a->normal[1] * b->normal[1] + a->normal[2] * b->normal[2];
+    return dot > 0.9999 && fabs(a->distance - b->distance) < 0.5;
+}
+
+/* every face of the brush has to be in the other, and there has to be as many */
+bool IsSameBrush(const Plane *a, unsigned int num_a, const Plane *b, unsigned int num_b) {
+    if(num_a != num_b) {
+        return false;
+    }
+
+    for(unsigned int i = 0; i < num_a; ++i) {
+        unsigned int j = 0;
+        while(j < num_b && !IsSamePlane(&a[i], &b[j])) j++;
+        if(j == num_b) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ComparePlanes(const char *name, const Buffer *reference, const Buffer *output) {
+    static Plane expected[MAX_PLANES], planes[MAX_PLANES];
+    unsigned int num_expected_brushes, num_brushes;
+    unsigned int num_expected = ReadPlanes(reference, expected, &num_expected_brushes);
+    unsigned int num_planes = ReadPlanes(output, planes, &num_brushes);
+    if(num_expected_brushes != num_brushes) {
+        fprintf(stderr, "  %s came back with %u brushes, expected %u\n", name, num_brushes, num_expected_brushes);
+        return false;
+    }
+
+    /* brushes come back in the same order, so they can be gone through together */
+    unsigned int a = 0, b = 0;
+    for(unsigned int brush = 0; brush < num_brushes; ++brush) {
+        unsigned int num_a = 0, num_b = 0;
+        while(a + num_a < num_expected && expected[a + num_a].brush == brush) num_a++;
+        while(b + num_b < num_planes && planes[b + num_b].brush == brush) num_b++;
+
+        if(!IsSameBrush(&expected[a], num_a, &planes[b], num_b)) {
+            fprintf(stderr, "  %s brush %u doesn't have the same planes as the reference\n", name, brush);
+            return false;
+        }
+
+        a += num_a;
+        b += num_b;
+    }
+
+    return true;
+}
+
+bool RunReference(TestCase *test_case) {
+    Buffer reference = { NULL, 0, 0 }, imported = { NULL, 0, 0 }, output = { NULL, 0, 0 };
+    if(!LoadBuffer(test_case->path, &reference)) {
+        fprintf(stderr, "error: failed to load \"%s\"!\n", test_case->path);
+        return false;
+    }
+
+    double start = GetTime();
+    T3DContext *ctx = t3dCreateContext(&test_case->options);
+    T3DSink sink = { WriteBuffer, &imported };
+    T3DError error = (ctx != NULL) ? t3dImportMap(ctx, test_case->path, &sink) : T3D_ERROR_MEMORY;
+    t3dDestroyContext(ctx);
+    double parsed = GetTime();
+
+    T3DOptions options = test_case->options;
+    options.add = true;
+    if(error == T3D_ERROR_NONE) {
+        ctx = t3dCreateContext(&options);
+        sink = (T3DSink) { WriteBuffer, &output };
+        error = (ctx != NULL && imported.data != NULL) ? t3dParseBuffer(ctx, imported.data, imported.length)
+                                                       : T3D_ERROR_MEMORY;
+        if(error == T3D_ERROR_NONE) {
+            error = t3dWriteMap(ctx, &sink);
+        }
+        t3dDestroyContext(ctx);
+    }
+    double written = GetTime();
+
+    bool status = true;
+    if(error != T3D_ERROR_NONE) {
+        GetErrorOutcome(error, test_case->outcome, sizeof(test_case->outcome));
+    } else {
+        status = ComparePlanes(test_case->name, &reference, &output);
+        snprintf(test_case->outcome, sizeof(test_case->outcome), status ? "same" : "differs");
+    }
+    test_case->parse_ms = parsed - start;
+    test_case->write_ms = written - parsed;
+
+    free(reference.data);
+    free(imported.data);
+    free(output.data);
+    return status;
+}
+
+/**************************************************/
+/* Asynchronous */
+
+void Pause(void) {
+#if defined(_WIN32)
+    Sleep(1);
+#else
+    struct timespec ts = { 0, 1000000 };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/* keeps count of what's outstanding and what's been reported for a conversion */
+typedef struct Tracker {
+    T3DConversion *conversion;
+    long num_allocations;
+
+    T3DPhase last_phase;
+    bool in_order;              /* phases never went backwards, nor counts past their totals */
+    unsigned int cancel_at;     /* brushes written before the progress function cancels it, 0 not to */
+} Tracker;
+
+void *TrackMalloc(size_t size, void *user) {
+    void *ptr = malloc(size);
+    if(ptr != NULL) ((Tracker *) user)->num_allocations++;
+    return ptr;
+}
+
+void *TrackRealloc(void *ptr, size_t size, void *user) {
+    void *new_ptr = realloc(ptr, size);
+    if(ptr == NULL && new_ptr != NULL) ((Tracker *) user)->num_allocations++;
+    return new_ptr;
+}
+
+void TrackFree(void *ptr, void *user) {
+    if(ptr != NULL) ((Tracker *) user)->num_allocations--;
+    free(ptr);
+}
+
+bool TrackProgress(const T3DProgress *progress, void *user) {
+    Tracker *tracker = (Tracker *) user;
+    if(progress->phase < tracker->last_phase || progress->brushes_written > progress->total_brushes ||
+       (progress->total_bytes > 0 && progress->bytes_parsed > progress->total_bytes)) {
+        tracker->in_order = false;
+    }
+    tracker->last_phase = progress->phase;
+
+    return tracker->cancel_at == 0 || progress->brushes_written < tracker->cancel_at;
+}
+
+bool StartTracked(Tracker *tracker, const T3DOptions *options, const char *in_path, const char *out_path,
+                  unsigned int cancel_at) {
+    memset(tracker, 0, sizeof(Tracker));
+    tracker->in_order = true;
+    tracker->cancel_at = cancel_at;
+
+    T3DOptions tracked = *options;
+    tracked.allocator = (T3DAllocator) { TrackMalloc, TrackRealloc, TrackFree, tracker };
+    tracked.progress = TrackProgress;
+    tracked.progress_user = tracker;
+
+    remove(out_path);
+    if((tracker->conversion = t3dStartConversion(&tracked, in_path, out_path)) == NULL) {
+        fprintf(stderr, "  failed to start converting \"%s\"\n", in_path);
+        return false;
+    }
+
+    return true;
+}
+
+/* polls it until it's done, as an editor would, by which point all that's left is the conversion itself */
+T3DError FinishTracked(Tracker *tracker, const char *what, bool *status) {
+    T3DProgress progress;
+    while(!t3dGetConversionProgress(tracker->conversion, &progress)) {
+        Pause();
+    }
+
+    if(tracker->num_allocations != 1) {
+        fprintf(stderr, "  %s still had %ld allocations once done\n", what, tracker->num_allocations - 1);
+        *status = false;
+    }
+
+    T3DError error = t3dFinishConversion(tracker->conversion);
+    if(tracker->num_allocations != 0) {
+        fprintf(stderr, "  %s leaked %ld allocations\n", what, tracker->num_allocations);
+        *status = false;
+    }
+    if(!tracker->in_order || tracker->last_phase != T3D_PHASE_DONE) {
+        fprintf(stderr, "  %s reported its progress out of order\n", what);
+        *status = false;
+    }
+
+    return error;
+}
+
+bool CheckCancelled(T3DError error, const char *what, const char *out_path) {
+    if(error != T3D_ERROR_CANCELLED) {
+        fprintf(stderr, "  %s gave \"%s\" rather than being cancelled\n", what, t3dGetErrorString(error));
+        return false;
+    }
+
+    FILE *fp = fopen(out_path, "rb");
+    if(fp != NULL) {
+        fprintf(stderr, "  %s left its output behind after being cancelled\n", what);
+        fclose(fp);
+        return false;
+    }
+
+    return true;
+}
+
+/* the examples converted in the background all at once have to give the same as before,
+ * and cancelling from either side has to stop it and let go of everything */
+bool RunAsync(TestCase *async_case, unsigned int num_examples) {
+    static Tracker trackers[MAX_TEST_CASES];
+    char out_paths[MAX_TEST_CASES][MAX_PATH_LENGTH];
+
+    bool status = true;
+    double start = GetTime();
+    for(unsigned int i = 0; i < num_examples; ++i) {
+        snprintf(out_paths[i], sizeof(out_paths[i]), "regress_async_%.63s.map", test_cases[i].name);
+        status = StartTracked(&trackers[i], &async_case->options, test_cases[i].path, out_paths[i], 0) && status;
+    }
+
+    for(unsigned int i = 0; i < num_examples; ++i) {
+        const TestCase *test_case = &test_cases[i];
+        if(trackers[i].conversion == NULL) {
+            continue;
+        }
+
+        char outcome[64];
+        Buffer output = { NULL, 0, 0 };
+        T3DError error = FinishTracked(&trackers[i], test_case->name, &status);
+        if(error != T3D_ERROR_NONE) {
+            GetErrorOutcome(error, outcome, sizeof(outcome));
+        } else if(!LoadBuffer(out_paths[i], &output)) {
+            snprintf(outcome, sizeof(outcome), "missing");
+        } else {
+            snprintf(outcome, sizeof(outcome), "map");
+        }
+
+        if(strcmp(outcome, test_case->outcome) != 0) {
+            fprintf(stderr, "  async gave %s for %s, expected %s\n", outcome, test_case->name, test_case->outcome);
+            status = false;
+        } else if(output.length != test_case->output.length ||
+                  (output.length > 0 && memcmp(output.data, test_case->output.data, output.length) != 0)) {
+            fprintf(stderr, "  async output for %s doesn't match converting it on its own\n", test_case->name);
+            status = false;
+        }
+
+        free(output.data);
+        remove(out_paths[i]);
+    }
+    async_case->parse_ms = GetTime() - start;
+
+    /* big enough that there's plenty of time to cancel it */
+    const char *in_path = "regress_stress_large.t3d";
+    const char *out_path = "regress_async_stress_large.map";
+    if(!SaveBuffer(in_path, &stress_large)) {
+        return false;
+    }
+
+    Tracker tracker;
+    if(StartTracked(&tracker, &async_case->options, in_path, out_path, 1000)) {
+        T3DError error = FinishTracked(&tracker, "cancelling while writing", &status);
+        status = CheckCancelled(error, "cancelling while writing", out_path) && status;
+    } else {
+        status = false;
+    }
+
+    if(StartTracked(&tracker, &async_case->options, in_path, out_path, 0)) {
+        T3DProgress progress;
+        while(!t3dGetConversionProgress(tracker.conversion, &progress) &&
+              (progress.phase != T3D_PHASE_PARSING || progress.bytes_parsed == 0)) {
+            Pause();
+        }
+        t3dCancelConversion(tracker.conversion);
+        T3DError error = FinishTracked(&tracker, "cancelling while parsing", &status);
+        status = CheckCancelled(error, "cancelling while parsing", out_path) && status;
+    } else {
+        status = false;
+    }
+
+    remove(in_path);
+
+    snprintf(async_case->outcome, sizeof(async_case->outcome), status ? "same" : "differs");
+    return status;
+}
+
+/**************************************************/
+/* Watching */
+
+T3DError ConvertFull(const T3DOptions *options, const Buffer *input, Buffer *output) {
+    T3DContext *ctx = t3dCreateContext(options);
+    if(ctx == NULL) {
+        return T3D_ERROR_MEMORY;
+    }
+
+    T3DSink sink = { WriteBuffer, output };
+    T3DError error = t3dParseBuffer(ctx, input->data, input->length);
+    if(error == T3D_ERROR_NONE) {
+        error = t3dWriteMap(ctx, &sink);
+    }
+
+    t3dDestroyContext(ctx);
+    return error;
+}
+
+/* updates it with the input, which has to give exactly the same as converting it in full */
+bool CheckWatch(T3DIncremental *inc, const T3DOptions *options, Buffer *input, const char *what,
+                unsigned int expected_changed) {
+    Buffer expected = { NULL, 0, 0 }, output = { NULL, 0, 0 };
+    T3DError expected_error = ConvertFull(options, input, &expected);
+
+    T3DSink sink = { WriteBuffer, &output };
+    unsigned int num_changed = 0, num_blocks = 0;
+    T3DError error = t3dUpdateIncremental(inc, input->data, input->length, &sink, &num_changed, &num_blocks);
+
+    bool status = true;
+    if(error != expected_error) {
+        fprintf(stderr, "  watching %s gave \"%s\", expected \"%s\"\n",
+                what, t3dGetErrorString(error), t3dGetErrorString(expected_error));
+        status = false;
+    } else if(output.length != expected.length ||
+              (output.length > 0 && memcmp(output.data, expected.data, output.length) != 0)) {
+        fprintf(stderr, "  watching %s doesn't match converting it in full\n", what);
+        status = false;
+    } else if(error == T3D_ERROR_NONE && expected_changed > 0 && num_changed != expected_changed) {
+        fprintf(stderr, "  watching %s converted %u blocks again, expected %u\n", what, num_changed, expected_changed);
+        status = false;
+    }
+
+    free(expected.data);
+    free(output.data);
+    return status;
+}
+
+/* every example and the small stress input in each format, then again with one of the
+ * stress input's brushes moved into another group, which renumbers them */
+bool RunWatch(TestCase *watch_case, unsigned int num_examples) {
+    static const char *formats[MAX_MAP_FORMATS] = {
+            [MAP_FORMAT_IDT2] = "idt2",
+            [MAP_FORMAT_IDT3] = "idt3",
+            [MAP_FORMAT_IDT4] = "idt4",
+            [MAP_FORMAT_GSRC] = "gsrc",
+            [MAP_FORMAT_SRC]  = "src",
+    };
+
+    Buffer inputs[MAX_TEST_CASES + 1];
+    memset(inputs, 0, sizeof(inputs));
+    bool status = true;
+    for(unsigned int i = 0; i < num_examples; ++i) {
+        if(!LoadBuffer(test_cases[i].path, &inputs[i])) {
+            fprintf(stderr, "  failed to load \"%s\"\n", test_cases[i].path);
+            status = false;
+        }
+    }
+
+    /* kept apart from the original, as it's changed */
+    Buffer *stress = &inputs[num_examples];
+    WriteBuffer(stress_small.data, stress_small.length, stress);
+
+    double start = GetTime();
+    for(unsigned int format = 0; format < MAX_MAP_FORMATS && status; ++format) {
+        T3DOptions options = watch_case->options;
+        options.format = format;
+        options.groups = true;
+
+        for(unsigned int i = 0; i <= num_examples; ++i) {
+            T3DContext *ctx = t3dCreateContext(&options);
+            T3DIncremental *inc = (ctx != NULL) ? t3dCreateIncremental(ctx) : NULL;
+            if(inc == NULL) {
+                fprintf(stderr, "error: failed to create incremental context!\n");
+                t3dDestroyContext(ctx);
+                status = false;
+                break;
+            }
+
+            char what[128];
+            snprintf(what, sizeof(what), "%s as %s", (i < num_examples) ? test_cases[i].name : "stress_small",
+                     formats[format]);
+            status = CheckWatch(inc, &options, &inputs[i], what, 0) && status;
+
+            if(i == num_examples) {
+                char *group = strstr(stress->data, "Group=Row1 ");
+                if(group != NULL) {
+                    memcpy(group, "Group=Row7 ", 11);
+                    snprintf(what, sizeof(what), "stress_small as %s once changed", formats[format]);
+                    status = CheckWatch(inc, &options, stress, what, 1) && status;
+                    memcpy(group, "Group=Row1 ", 11);
+                } else {
+                    fprintf(stderr, "  stress_small has no groups to change\n");
+                    status = false;
+                }
+            }
+
+            t3dDestroyIncremental(inc);
+            t3dDestroyContext(ctx);
+        }
+    }
+    watch_case->parse_ms = GetTime() - start;
+
+    for(unsigned int i = 0; i <= num_examples; ++i) {
+        free(inputs[i].data);
+    }
+
+    snprintf(watch_case->outcome, sizeof(watch_case->outcome), status ? "same" : "differs");
+    return status;
+}
+
+/* how long a fixed bit of work takes, which has nothing to do with the library */
+double Calibrate(void) {
+    size_t size = 1024 * 1024;
+    uint32_t *data = malloc(size * sizeof(uint32_t));
+    if(data == NULL) {
+        return 0.0;
+    }
+
+    double best = 0.0;
+    for(unsigned int run = 0; run < 5; ++run) {
+        double start = GetTime();
+        uint32_t seed = 1;
+        for(size_t i = 0; i < size; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            data[i] = seed;
+        }
+
+        volatile uint64_t hash = 14695981039346656037ull;
+        for(unsigned int pass = 0; pass < 4; ++pass) {
+            for(size_t i = 0; i < size; ++i) {
+                hash = (hash ^ data[(i * 7919) & (size - 1)]) * 1099511628211ull;
+            }
+        }
+
+        double time = GetTime() - start;
+        if(run == 0 || time < best) {
+            best = time;
+        }
+    }
+
+    free(data);
+    return best;
+}
+
+/**************************************************/
+/* Baseline */
+
+typedef struct Baseline {
+    char name[64];
+    char outcome[64];
+    double parse_ms;
+    double write_ms;
+    size_t peak_memory;
+} Baseline;
+
+Baseline baselines[MAX_TEST_CASES];
+unsigned int num_baselines = 0;
+double baseline_calibration = 0.0;
+
+bool LoadBaseline(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL) {
+        return false;
+    }
+
+    char line[512];
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        Baseline *baseline = &baselines[num_baselines];
+        if(sscanf(line, "calibration %lf", &baseline_calibration) == 1) {
+            continue;
+        }
+
+        if(num_baselines < MAX_TEST_CASES &&
+           sscanf(line, "case %63s %63s %lf %lf %zu", baseline->name, baseline->outcome,
+                  &baseline->parse_ms, &baseline->write_ms, &baseline->peak_memory) == 5) {
+            num_baselines++;
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+const Baseline *FindBaseline(const char *name) {
+    for(unsigned int i = 0; i < num_baselines; ++i) {
+        if(strcmp(baselines[i].name, name) == 0) {
+            return &baselines[i];
+        }
+    }
+    return NULL;
+}
+
+bool SaveBaseline(const char *path, double calibration) {
+    FILE *fp = fopen(path, "w");
+    if(fp == NULL) {
+        fprintf(stderr, "error: failed to open \"%s\" for writing!\n", path);
+        return false;
+    }
+
+    fprintf(fp, "// generated by t3d_regress, run it with --update to accept any changes\n");
+    fprintf(fp, "// time taken by the calibration loop, which the times below are scaled by\n");
+    fprintf(fp, "calibration %.3f\n", calibration);
+    fprintf(fp, "// name outcome parse_ms write_ms peak_bytes\n");
+    for(unsigned int i = 0; i < num_test_cases; ++i) {
+        const TestCase *test_case = &test_cases[i];
+        fprintf(fp, "case %s %s %.3f %.3f %zu\n", test_case->name, test_case->outcome,
+                test_case->parse_ms, test_case->write_ms, test_case->peak_memory);
+    }
+
+    if(fclose(fp) != 0) {
+        fprintf(stderr, "error: failed to write \"%s\"!\n", path);
+        return false;
+    }
+
+    fprintf(stderr, "wrote baseline to \"%s\"\n", path);
+    return true;
+}
+
+bool CheckTime(const char *name, const char *what, double time, double baseline, double scale) {
+    double limit = baseline * scale * (1.0 + option_time_threshold) + TIME_SLACK_MS;
+    if(!option_timing || time <= limit) {
+        return true;
+    }
+
+    fprintf(stderr, "  %s %s took %.2fms, over the limit of %.2fms (baseline %.2fms)\n",
+            name, what, time, limit, baseline * scale);
+    return false;
+}
+
+void GetGoldenPath(const TestCase *test_case, char *path, size_t size) {
+    snprintf(path, size, "%s/golden/%s.%s", tests_dir, (test_case->golden != NULL) ? test_case->golden : test_case->name,
+             (test_case->kind == TEST_IMPORT) ? "t3d" : "map");
+}
+
+bool CheckTestCase(const TestCase *test_case, double scale) {
+    const Baseline *baseline = FindBaseline(test_case->name);
+    if(baseline == NULL) {
+        fprintf(stderr, "  %s isn't in the baseline, run with --update to add it\n", test_case->name);
+        return false;
+    }
+
+    bool status = true;
+    if(strcmp(test_case->outcome, baseline->outcome) != 0) {
+        fprintf(stderr, "  %s gave %s, expected %s\n", test_case->name, test_case->outcome, baseline->outcome);
+        status = false;
+    } else if(strcmp(test_case->outcome, "map") == 0) {
+        char path[MAX_PATH_LENGTH];
+        GetGoldenPath(test_case, path, sizeof(path));
+
+        Buffer expected = { NULL, 0, 0 };
+        if(!LoadBuffer(path, &expected)) {
+            fprintf(stderr, "  %s has no golden output at \"%s\", run with --update to add it\n",
+                    test_case->name, path);
+            status = false;
+        } else {
+            status = CompareOutput(test_case->name, &expected, &test_case->output);
+        }
+        free(expected.data);
+    }
+
+    status = CheckTime(test_case->name, "parse", test_case->parse_ms, baseline->parse_ms, scale) && status;
+    status = CheckTime(test_case->name, "write", test_case->write_ms, baseline->write_ms, scale) && status;
+
+    double memory_limit = (double) baseline->peak_memory * (1.0 + option_memory_threshold);
+    if(baseline->peak_memory > 0 && (double) test_case->peak_memory > memory_limit) {
+        fprintf(stderr, "  %s peaked at %zu bytes, over the limit of %.0f (baseline %zu)\n",
+                test_case->name, test_case->peak_memory, memory_limit, baseline->peak_memory);
+        status = false;
+    }
+
+    return status;
+}
+
+bool UpdateGolden(const TestCase *test_case) {
+    if(strcmp(test_case->outcome, "map") != 0 || test_case->golden != NULL) {
+        return true;
+    }
+
+    char path[MAX_PATH_LENGTH];
+    GetGoldenPath(test_case, path, sizeof(path));
+    return SaveBuffer(path, &test_case->output);
+}
+
+/**************************************************/
+
+bool ParseArguments(int argc, char **argv) {
+    if(argc < 3) {
+        return false;
+    }
+
+    examples_dir = argv[1];
+    tests_dir = argv[2];
+    for(int i = 3; i < argc; ++i) {
+        const char *parm = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if(strcmp(argv[i], "--update") == 0) {
+            option_update = true;
+        } else if(strcmp(argv[i], "--no-timing") == 0) {
+            option_timing = false;
+        } else if(strcmp(argv[i], "--verbose") == 0) {
+            option_verbose = true;
+        } else if(strcmp(argv[i], "--time-threshold") == 0 && parm != NULL) {
+            option_time_threshold = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--memory-threshold") == 0 && parm != NULL) {
+            option_memory_threshold = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--filter") == 0 && parm != NULL) {
+            option_filter = argv[++i];
+        } else {
+            fprintf(stderr, "unknown or invalid argument, \"%s\"!\n", argv[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if(!ParseArguments(argc, argv)) {
+        printf("usage: t3d_regress <examples dir> <tests dir> [--update] [--no-timing] [--verbose]\n"
+               "                   [--time-threshold x] [--memory-threshold x] [--filter name]\n");
+        return EXIT_FAILURE;
+    }
+
+    if(!FindExamples(examples_dir, TEST_CONVERT)) {
+        return EXIT_FAILURE;
+    }
+
+    /* the batch run needs the examples to be first */
+    unsigned int num_examples = num_test_cases;
+    TestCase *batch_case = AddTestCase("batch", MAP_FORMAT_IDT2);
+    TestCase *async_case = AddTestCase("async", MAP_FORMAT_IDT2);
+    TestCase *watch_case = AddTestCase("watch", MAP_FORMAT_IDT2);
+    if(batch_case == NULL || async_case == NULL || watch_case == NULL || !AddStressCases() || !AddExampleVariants()) {
+        return EXIT_FAILURE;
+    }
+
+    char import_dir[MAX_PATH_LENGTH];
+    snprintf(import_dir, sizeof(import_dir), "%s/import", tests_dir);
+    if(!FindExamples(import_dir, TEST_IMPORT)) {
+        return EXIT_FAILURE;
+    }
+
+    char reference_dir[MAX_PATH_LENGTH];
+    snprintf(reference_dir, sizeof(reference_dir), "%s/../references", examples_dir);
+    if(!FindExamples(reference_dir, TEST_REFERENCE)) {
+        return EXIT_FAILURE;
+    }
+
+    char baseline_path[MAX_PATH_LENGTH];
+    snprintf(baseline_path, sizeof(baseline_path), "%s/baseline.txt", tests_dir);
+    if(!LoadBaseline(baseline_path) && !option_update) {
+        fprintf(stderr, "error: failed to load \"%s\", run with --update to create it!\n", baseline_path);
+        return EXIT_FAILURE;
+    }
+
+    double calibration = Calibrate();
+    double scale = (baseline_calibration > 0.0 && calibration > 0.0) ? calibration / baseline_calibration : 1.0;
+    printf("calibration %.2fms, scaling baseline times by %.2f\n\n", calibration, scale);
+
+    /* everything has to run for an update, so the baseline's complete */
+    if(option_update && option_filter != NULL) {
+        fprintf(stderr, "error: --filter can't be used with --update!\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-24s %-24s %10s %10s %12s\n", "case", "outcome", "parse ms", "write ms", "peak KB");
+
+    unsigned int num_failed = 0, num_run = 0;
+    for(unsigned int i = 0; i < num_test_cases; ++i) {
+        TestCase *test_case = &test_cases[i];
+        if(option_filter != NULL && strncmp(test_case->name, option_filter, strlen(option_filter)) != 0) {
+            continue;
+        }
+
+        /* the examples have to have been run for these to be compared against them */
+        if((test_case == batch_case || test_case == async_case || test_case == watch_case) && option_filter != NULL) {
+            continue;
+        }
+
+        bool status;
+        if(test_case == batch_case) {
+            status = RunBatch(test_case, num_examples);
+        } else if(test_case == async_case) {
+            status = RunAsync(test_case, num_examples);
+        } else if(test_case == watch_case) {
+            status = RunWatch(test_case, num_examples);
+        } else if(test_case->kind == TEST_REFERENCE) {
+            status = RunReference(test_case);
+        } else {
+            status = RunTestCase(test_case);
+        }
+        printf("%-24s %-24s %10.2f %10.2f %12zu\n", test_case->name, test_case->outcome,
+               test_case->parse_ms, test_case->write_ms, test_case->peak_memory / 1024);
+        fflush(stdout);
+
+        if(option_update) {
+            status = status && UpdateGolden(test_case);
+        } else if(status) {
+            status = CheckTestCase(test_case, scale);
+        }
+
+        num_run++;
+        if(!status) {
+            printf("%-24s FAILED\n", test_case->name);
+            num_failed++;
+        }
+    }
+
+    if(option_update && num_failed == 0) {
+        num_failed = SaveBaseline(baseline_path, calibration) ? 0 : 1;
+    }
+
+    for(unsigned int i = 0; i < num_test_cases; ++i) {
+        free(test_cases[i].output.data);
+        if(test_cases[i].scratch) {
+            remove(test_cases[i].path);
+        }
+    }
+    free(stress_small.data);
+    free(stress_large.data);
+
+    printf("\n%u of %u cases passed\n", num_run - num_failed, num_run);
+    return (num_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}